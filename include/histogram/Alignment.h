@@ -0,0 +1,95 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+ * \class Alignment
+ * \brief Find the shift and scale that align a spectrum with a reference, for gain drift tracking.
+ * \details The shift is found from the maximum of the FFT cross-correlation of the two spectra,
+ * refined with a parabola. The scale is found the same way after both spectra are resampled on
+ * a logarithmic x axis, where a scale becomes a shift. When both are requested, the scale is
+ * found first and the shift is then found between the spectrum and the scaled reference.
+ *
+ * The result describes the spectrum as spectrum(x) ~ reference((x - shift)/scale).
+ * Aligning lists or sets of histograms runs on a thread pool, one pair per task.
+ * The histograms must not be filled while they are aligned.
+ */
+class Alignment {
+public:
+
+    //! The alignment of a spectrum with its reference.
+    struct Result {
+        double shift;           //!< Shift in x axis units.
+        double scale;           //!< Scale, 1 if not searched.
+        double correlation;     //!< Correlation coefficient at the best shift, between -1 and 1.
+    };
+
+    //! Parameters of the alignment.
+    struct Options {
+        bool find_scale;        //!< Also search for a scale.
+        double max_shift;       //!< Largest shift to consider, in x axis units. 0 for no limit.
+        double max_scale;       //!< Largest scale (or 1/scale) to consider.
+        double min_x;           //!< Lower end of the logarithmic axis. 0 to use the first bin above zero.
+        size_t log_bins;        //!< Number of bins of the logarithmic axis, at least 2. 0 to use the bin count of the spectrum.
+
+        Options()
+            : find_scale( false )
+            , max_shift( 0 )
+            , max_scale( 1.5 )
+            , min_x( 0 )
+            , log_bins( 0 ){}
+    };
+
+    //! Align a spectrum with a reference.
+    /*! Throws if the binning of the two are different.
+     */
+    static Result Align(Histogram1Dp hist,                      /*!< The spectrum. */
+                        Histogram1Dp reference,                 /*!< The reference spectrum. */
+                        const Options &options = Options()      /*!< Alignment parameters. */);
+
+    //! Align each spectrum of a list with the reference at the same position in another list.
+    /*! Throws if the lists are of different length.
+     */
+    static std::vector<Result> Align(const Histograms::list1d_t &hists,        /*!< The spectra. */
+                                     const Histograms::list1d_t &references,   /*!< The reference spectra. */
+                                     const Options &options = Options(),       /*!< Alignment parameters. */
+                                     ThreadPool &pool = ThreadPool::Default()  /*!< The pool to run on. */);
+
+    //! Align all 1D spectra of a set with the spectra of the same name in a reference set.
+    /*! Spectra missing from the reference set are skipped.
+     */
+    static std::map<std::string, Result> Align(Histograms &hists,                         /*!< The spectra. */
+                                               Histograms &references,                    /*!< The reference spectra. */
+                                               const Options &options = Options(),        /*!< Alignment parameters. */
+                                               ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+};
+
+#endif // ALIGNMENT_H
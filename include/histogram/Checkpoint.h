@@ -0,0 +1,128 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+ * \class Checkpoint
+ * \brief Binary checkpoints of a set of histograms, together with an input offset, for restart after a crash.
+ * \details A checkpoint file is a header followed by records. Each record holds the input offset given
+ * by the caller and the contents of the histograms, split in blocks of bins. A full record holds all
+ * blocks. An incremental record only holds the blocks whose contents changed since the previous
+ * record, found by comparing a hash of each block, and is appended to the file. Every
+ * full_interval'th checkpoint rewrites the file with a single full record, written to a temporary
+ * file and renamed into place, so the file does not grow without bounds.
+ *
+ * Each record ends with a checksum. Restore() replays the records in order and stops at the first
+ * incomplete or corrupt record, so a crash while writing loses at most the last checkpoint interval.
+ * The bins are copied first, and then hashed and encoded in parallel over histograms. Prompt-minus-random
+ * matrices (SubtractedHistogram2D) are stored with their ratio, and their bins as the bits of the doubles.
+ *
+ * ThreadSafeHistograms::WriteCheckpoint() flushes all adapters before writing the set, and only holds
+ * the histogram mutexes while the bins are copied.
+ */
+class Checkpoint {
+public:
+
+    //! Options for writing checkpoints.
+    struct Options {
+        //! Append records with only the changed blocks. If false, every checkpoint rewrites the file.
+        bool incremental;
+
+        //! Rewrite the file with a full record every this many checkpoints.
+        size_t full_interval;
+
+        //! Number of bins in a block.
+        size_t block_size;
+
+        Options() : incremental( true ), full_interval( 16 ), block_size( 4096 ){}
+    };
+
+    //! Set up checkpoints to a file. Nothing is written until the first call to Write().
+    explicit Checkpoint(const std::string &path,                /*!< The checkpoint file. */
+                        const Options &options = Options()      /*!< How to write. */);
+
+    //! Runs the step of a checkpoint that reads the histograms, e.g. while holding their mutexes.
+    typedef std::function<void(const std::function<void()> &)> guard_t;
+
+    //! Write a checkpoint of a set.
+    /*! The histograms are only read while copying their bins, which is run through the guard if one
+     *  is given, so that the histograms are not filled while they are copied. The copies are hashed,
+     *  encoded and written after the guard returns. Throws if the file cannot be written.
+     */
+    void Write(Histograms &set,                             /*!< The histograms to persist. */
+               uint64_t offset,                             /*!< Input offset to resume from. */
+               ThreadPool &pool = ThreadPool::Default(),    /*!< The pool to run on. */
+               const guard_t &guard = guard_t()             /*!< Runs the copy of the bins. */);
+
+    //! Get the number of checkpoints written.
+    [[nodiscard]] size_t GetCount() const { return count; }
+
+    //! Get the number of bytes written by the last checkpoint.
+    [[nodiscard]] size_t GetLastSize() const { return last_size; }
+
+    //! Restore a set from a checkpoint file.
+    /*! Histograms that are not in the set are created, existing histograms are overwritten and must
+     *  have the same binning. Throws if the file exists but is not a checkpoint file or if the binning
+     *  differs.
+     *
+     *  \return The input offset of the last complete record, or 0 if the file does not exist.
+     */
+    static uint64_t Restore(const std::string &path,    /*!< The checkpoint file. */
+                            Histograms &set             /*!< The set to restore into. */);
+
+private:
+    //! The checkpoint file.
+    const std::string path;
+
+    //! How to write.
+    const Options options;
+
+    //! The number of checkpoints written.
+    size_t count;
+
+    //! Bytes written by the last checkpoint.
+    size_t last_size;
+
+    //! What the file holds for a histogram.
+    struct state_t {
+        //! Hash of each block.
+        std::vector<uint64_t> blocks;
+
+        //! The entry count.
+        uint64_t entries = 0;
+    };
+
+    //! What the file holds for each histogram.
+    std::map<std::string, state_t> states;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,181 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef COINCIDENCE_H
+#define COINCIDENCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*!
+ * \class Coincidence
+ * \brief Builds time coincidences from timestamp sorted hit streams, e.g. one stream per detector.
+ * \details The streams are merged in time order (k-way merge with a heap) on the reader thread of a
+ * Pipeline. The merged hits are kept in a ring buffer that covers the look-back and look-ahead of the
+ * time windows, and cut into batches of triggers together with the hits around them. Worker threads
+ * then find, for each trigger, the other hits in the prompt window and in the random window and pass
+ * them as a group to a handler, typically filling a matrix through a ThreadSafeHistogram adapter.
+ *
+ * The windows are half open, [low, high), relative to the trigger timestamp. The bins of the regular
+ * histograms are unsigned counters, so random coincidences cannot be subtracted while filling them.
+ * Either fill the prompt and random groups into separate matrices, as in the example below, and
+ * subtract random times Options::GetRandomScale() from prompt when analysing the written matrices, or
+ * fill a single SubtractedHistogram2D through ThreadSafeHistograms::CreateSubtracted2D() with the
+ * scale as its ratio.
+ *
+ * Example:
+ * \code
+ * Coincidence::Options options;
+ * options.triggers = {0};
+ * Coincidence::Build(sources, [&](){
+ *     return [prompt = histograms.Create2D("prompt", ...), random = histograms.Create2D("random", ...)]
+ *         (const Coincidence::group_t &group) mutable {
+ *             for ( auto &hit : group.prompt ) prompt.Fill(group.trigger.energy, hit.energy);
+ *             for ( auto &hit : group.random ) random.Fill(group.trigger.energy, hit.energy);
+ *         };
+ * }, options);
+ * \endcode
+ */
+class Coincidence {
+public:
+
+    //! A detector hit.
+    struct hit_t {
+        int64_t timestamp;  //!< Timestamp of the hit.
+        uint32_t detector;  //!< Detector (or channel) number.
+        double energy;      //!< Energy, or any other value to histogram.
+    };
+
+    //! A source of hits in time order. Sets the next hit and returns true, or returns false at the end.
+    typedef std::function<bool(hit_t &hit)> source_t;
+
+    //! A trigger and its coincident hits.
+    struct group_t {
+        hit_t trigger;              //!< The trigger hit.
+        std::vector<hit_t> prompt;  //!< Hits in the prompt window.
+        std::vector<hit_t> random;  //!< Hits in the random window.
+    };
+
+    //! Coincidence windows and how to run.
+    struct Options {
+        //! Prompt window relative to the trigger, [prompt_low, prompt_high).
+        int64_t prompt_low, prompt_high;
+
+        //! Random window relative to the trigger, [random_low, random_high). Empty to disable.
+        int64_t random_low, random_high;
+
+        //! Detectors whose hits are triggers. Empty for all hits.
+        std::vector<uint32_t> triggers;
+
+        //! Also pair hits from the same detector as the trigger.
+        bool same_detector;
+
+        //! Number of triggers in each batch.
+        size_t batch_size;
+
+        //! Number of batches in flight.
+        size_t batches;
+
+        //! Number of worker threads.
+        unsigned threads;
+
+        Options()
+            : prompt_low( -50 ), prompt_high( 50 ), random_low( 200 ), random_high( 400 ), triggers()
+            , same_detector( false ), batch_size( 4096 ), batches( 16 ), threads( 2 ){}
+
+        //! Weight of random relative to prompt coincidences for the subtraction.
+        [[nodiscard]] double GetRandomScale() const
+        {
+            return ( random_high > random_low ) ? double(prompt_high - prompt_low)/double(random_high - random_low) : 0.;
+        }
+    };
+
+    //! Counts from a run.
+    struct Stats {
+        size_t hits = 0;        //!< Hits read from the sources.
+        size_t triggers = 0;    //!< Trigger hits.
+        size_t groups = 0;      //!< Groups passed to the handlers.
+        size_t prompt = 0;      //!< Hits in prompt windows.
+        size_t random = 0;      //!< Hits in random windows.
+    };
+
+    //! Build coincidences from sources, calling a handler for each group with at least one coincident hit.
+    /*! The factory is called once on each worker thread and must return a callable taking a
+     *  const group_t&. The callable only has to be movable, so it can own ThreadSafeHistogram
+     *  adapters, and is destroyed (flushing them) on the worker thread when the sources are exhausted.
+     *  The factory is never called concurrently.
+     *  Throws if a source is not in time order.
+     *
+     *  \return Counts from the run.
+     */
+    template<typename Factory>
+    static Stats Build(std::vector<source_t> sources,           /*!< The hit streams. */
+                       Factory factory,                         /*!< Creates the handler of each worker. */
+                       const Options &options = Options()       /*!< Windows and how to run. */)
+    {
+        return Run(std::move(sources), [factory]() -> std::unique_ptr<handler_base> {
+            using H = decltype(factory());
+            return std::make_unique<handler_impl<H>>(factory());
+        }, options);
+    }
+
+    //! Build coincidences from streams held in memory.
+    template<typename Factory>
+    static Stats Build(const std::vector<std::vector<hit_t>> &streams,  /*!< The hit streams. */
+                       Factory factory,                                 /*!< Creates the handler of each worker. */
+                       const Options &options = Options()               /*!< Windows and how to run. */)
+    {
+        std::vector<source_t> sources;
+        for ( auto &stream : streams ){
+            sources.emplace_back([&stream, i = size_t(0)](hit_t &hit) mutable {
+                if ( i == stream.size() )
+                    return false;
+                hit = stream[i++];
+                return true;
+            });
+        }
+        return Build(std::move(sources), std::move(factory), options);
+    }
+
+private:
+    //! Type erased handler owned by one worker thread.
+    struct handler_base {
+        virtual ~handler_base() = default;
+        virtual void handle(const group_t &group) = 0;
+    };
+
+    template<typename H>
+    struct handler_impl : public handler_base {
+        H handler;
+        explicit handler_impl(H &&_handler) : handler( std::move(_handler) ){}
+        void handle(const group_t &group) override { handler(group); }
+    };
+
+    //! Run the pipeline.
+    static Stats Run(std::vector<source_t> sources,
+                     const std::function<std::unique_ptr<handler_base>()> &factory,
+                     const Options &options);
+};
+
+#endif // COINCIDENCE_H
@@ -0,0 +1,91 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef COMPARISON_H
+#define COMPARISON_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <string>
+#include <vector>
+
+/*!
+ * \class Comparison
+ * \brief Data quality comparison of 1D spectra against reference spectra.
+ * \details Computes for each pair of spectra the chi² per degree of freedom between the
+ * spectra normalised to the same area, the Kolmogorov-Smirnov distance and the shift of the
+ * highest peak. Only the regular bins are used. Comparison of a whole set of histograms runs
+ * on a thread pool, one spectrum per task, and returns a ranked list of the outliers.
+ *
+ * The live histograms must not be filled while they are compared.
+ */
+class Comparison {
+public:
+
+    //! The comparison metrics for a single spectrum.
+    struct Metrics {
+        std::string name;           //!< Name of the spectrum.
+        size_t live_counts;         //!< Sum of the regular bins of the live spectrum.
+        size_t reference_counts;    //!< Sum of the regular bins of the reference spectrum.
+        double chi2;                //!< Chi² per degree of freedom between the area normalised spectra.
+        size_t ndf;                 //!< Degrees of freedom, non-empty bins minus one.
+        double ks;                  //!< Kolmogorov-Smirnov distance, the largest difference of the normalised cumulative spectra.
+        double shift;               //!< Position of the highest peak of the live spectrum minus that of the reference, in x axis units.
+        double score;               //!< The largest of the metrics relative to its threshold. Above 1 for outliers.
+    };
+
+    //! Thresholds for flagging a spectrum as an outlier.
+    struct Options {
+        double chi2_threshold;  //!< Limit for the chi² per degree of freedom.
+        double ks_threshold;    //!< Limit for the Kolmogorov-Smirnov distance.
+        double shift_threshold; //!< Limit for the absolute peak shift in x axis units, 0 to not use the shift.
+        size_t min_counts;      //!< Spectra with fewer counts (live or reference) are skipped.
+        size_t max_reported;    //!< Maximum number of outliers to report, 0 for no limit.
+
+        Options()
+            : chi2_threshold( 3.0 )
+            , ks_threshold( 0.05 )
+            , shift_threshold( 0 )
+            , min_counts( 100 )
+            , max_reported( 20 ){}
+    };
+
+    //! Compare a single spectrum with its reference.
+    /*! Throws if the binning of the two are different.
+     *  \return the metrics.
+     */
+    static Metrics Compare(Histogram1Dp live,          /*!< The spectrum to check. */
+                           Histogram1Dp reference,     /*!< The reference spectrum. */
+                           const Options &options = Options() /*!< Thresholds used for the score. */);
+
+    //! Compare all 1D spectra of a set with the spectra of the same name in a reference set.
+    /*! Spectra missing from the reference set or with too few counts are skipped.
+     *  \return the outliers, highest score first.
+     */
+    static std::vector<Metrics> Compare(Histograms& live,       /*!< The spectra to check. */
+                                        Histograms& reference,  /*!< The reference spectra. */
+                                        const Options &options = Options(), /*!< Outlier thresholds. */
+                                        ThreadPool &pool = ThreadPool::Default() /*!< The pool to run on. */);
+
+};
+
+#endif // COMPARISON_H
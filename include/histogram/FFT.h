@@ -0,0 +1,62 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+/*!
+ * \class FFT
+ * \brief Dependency free fast Fourier transform and the operations built on it.
+ * \details Iterative radix-2 transform with a precomputed table of twiddle factors.
+ * Real sequences are zero padded to a power of two large enough that the
+ * circular correlation or convolution does not wrap around.
+ */
+class FFT {
+public:
+
+    //! Smallest power of two not less than n.
+    static size_t GoodSize(size_t n);
+
+    //! Transform data in place.
+    /*! The size must be a power of two, throws otherwise. The inverse transform is scaled by 1/N.
+     */
+    static void Transform(std::vector<std::complex<double>> &data, /*!< The data to transform. */
+                          bool inverse = false                     /*!< Do the inverse transform. */);
+
+    //! Cross-correlation of two real sequences.
+    /*! \return c[k + b.size() - 1] = sum_i a[i + k] b[i] for the lags k in [-(b.size()-1), a.size()-1].
+     */
+    static std::vector<double> Correlate(const std::vector<double> &a, /*!< The first sequence. */
+                                         const std::vector<double> &b  /*!< The second sequence. */);
+
+    //! Linear convolution of two real sequences.
+    /*! \return c[k] = sum_i a[i] b[k - i] for k in [0, a.size() + b.size() - 1).
+     */
+    static std::vector<double> Convolve(const std::vector<double> &a, /*!< The first sequence. */
+                                        const std::vector<double> &b  /*!< The second sequence. */);
+
+};
+
+#endif // FFT_H
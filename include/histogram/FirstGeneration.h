@@ -0,0 +1,100 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FIRSTGENERATION_H
+#define FIRSTGENERATION_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * \class FirstGeneration
+ * \brief Extraction of first generation gamma spectra from an unfolded Ex-Egamma matrix.
+ * \details Iterative subtraction method: the first generation spectrum of row i is
+ * fg_i = u_i - sum_{j<i} w_ij (N_i/N_j) u_j, where u_j are the unfolded rows, N_j = S_j/M_j
+ * the number of cascades through row j from the row area S_j and the multiplicity
+ * M_j = Ex_j/<Egamma>_j, and w_ij the probability of decay from row i to row j. The weights
+ * start out uniform and are replaced by the normalised first generation spectrum at
+ * Egamma = Ex_i - Ex_j after each iteration, until they no longer change.
+ *
+ * With the weights of the previous iteration the rows are independent, so each iteration
+ * runs in parallel over rows on a thread pool, with the row combinations as vectorisable
+ * axpy loops on dense matrices that are allocated once.
+ *
+ * The matrix has Egamma on the x axis and Ex on the y axis, in the same energy units.
+ */
+class FirstGeneration {
+public:
+
+    //! Parameters of the extraction.
+    struct Options {
+        size_t max_iterations;  //!< Largest number of weight iterations.
+        double tolerance;       //!< Stop when no weight changes by more than this.
+
+        Options()
+            : max_iterations( 50 )
+            , tolerance( 1e-4 ){}
+    };
+
+    //! Result of an extraction.
+    struct Result {
+        Histogram2Dp fg;                //!< The first generation matrix.
+        size_t iterations;              //!< Number of iterations done.
+        double change;                  //!< Largest weight change in the last iteration.
+        std::vector<double> values;     //!< The first generation matrix before rounding, regular bins, row major.
+    };
+
+    //! Result of an ensemble of extractions.
+    struct EnsembleResult {
+        Histogram2Dp mean;                  //!< Mean of the members.
+        Histogram2Dp std;                   //!< Standard deviation of the members.
+        std::vector<double> mean_values;    //!< Mean before rounding, regular bins, row major.
+        std::vector<double> std_values;     //!< Standard deviation before rounding, regular bins, row major.
+    };
+
+    //! Extract the first generation matrix.
+    /*! The result is created in the set with the same axes as the unfolded matrix, rounded and
+     *  with negative values set to zero.
+     */
+    static Result Extract(Histograms &set,                          /*!< The set to create the result in. */
+                          Histogram2Dp unfolded,                    /*!< The unfolded matrix. */
+                          const std::string &name,                  /*!< Name of the first generation matrix. */
+                          const Options &options = Options(),       /*!< Extraction parameters. */
+                          ThreadPool &pool = ThreadPool::Default()  /*!< The pool to run on. */);
+
+    //! Extract the first generation matrix from an ensemble of Poisson fluctuated copies of the unfolded matrix.
+    /*! Members run in parallel on the pool. Creates `name`_mean and `name`_std in the set.
+     */
+    static EnsembleResult Ensemble(Histograms &set,                          /*!< The set to create the results in. */
+                                   Histogram2Dp unfolded,                    /*!< The unfolded matrix. */
+                                   const std::string &name,                  /*!< Prefix of the result names. */
+                                   size_t members,                           /*!< Number of ensemble members. */
+                                   uint64_t seed = 1,                        /*!< Seed of the fluctuations, member k uses seed + k. */
+                                   const Options &options = Options(),       /*!< Extraction parameters. */
+                                   ThreadPool &pool = ThreadPool::Default()  /*!< The pool to run on. */);
+
+};
+
+#endif // FIRSTGENERATION_H
@@ -0,0 +1,319 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef FROZEN_H
+#define FROZEN_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*!
+ * \class FrozenBins
+ * \brief Compressed, read-only array of bin contents.
+ * \details The bins are stored in blocks of block_size bins. Each block uses the narrowest counter
+ * (8, 16, 32 or 64 bits) that holds its largest bin, and blocks where all bins are zero take no
+ * space beyond their header. A bin is found directly from its block header, so random access is
+ * constant time.
+ */
+class FrozenBins {
+public:
+    //! The type of the bin contents.
+    typedef size_t data_t;
+
+    //! Number of bins in a block.
+    static constexpr size_t block_size = 64;
+
+    //! Append bins. Must be followed by Seal() before the bins are read.
+    void Append(const data_t *values,   /*!< The bin contents. */
+                size_t n                /*!< The number of bins. */);
+
+    //! Encode the last, partial block.
+    void Seal();
+
+    //! Get a bin.
+    [[nodiscard]] data_t Get(size_t i /*!< The bin index. */) const
+    {
+        const uint8_t width = widths[i/block_size];
+        if ( width == 0 )
+            return 0;
+        const uint8_t *p = bytes.data() + offsets[i/block_size] + ( i % block_size )*width;
+        return Read(p, width);
+    }
+
+    //! Decode a range of bins.
+    void Decode(size_t first,   /*!< The first bin. */
+                size_t n,       /*!< The number of bins. */
+                data_t *out     /*!< Where to write the n bin contents. */) const;
+
+    //! Get the number of bins.
+    [[nodiscard]] size_t GetSize() const { return size; }
+
+    //! Get the number of bytes used.
+    [[nodiscard]] size_t GetMemoryUsage() const
+    { return sizeof(*this) + widths.capacity() + offsets.capacity()*sizeof(size_t) + bytes.capacity(); }
+
+private:
+    //! Read a counter of the given width.
+    static data_t Read(const uint8_t *p, uint8_t width);
+
+    //! Encode the pending block.
+    void Encode();
+
+    //! The number of bins.
+    size_t size = 0;
+
+    //! Counter width in bytes of each block, 0 for blocks with only zeros.
+    std::vector<uint8_t> widths;
+
+    //! Byte offset of each block.
+    std::vector<size_t> offsets;
+
+    //! The encoded counters.
+    std::vector<uint8_t> bytes;
+
+    //! Bins not yet encoded.
+    std::array<data_t, block_size> pending = {};
+
+    //! The number of bins not yet encoded.
+    size_t pending_size = 0;
+};
+
+/*!
+ * \class FrozenHistogram1D
+ * \brief An immutable, compressed copy of a 1D histogram.
+ */
+class FrozenHistogram1D : public Named {
+public:
+    //! The type used to count in each bin.
+    typedef FrozenBins::data_t data_t;
+
+    //! Freeze a histogram.
+    explicit FrozenHistogram1D(Histogram1Dp hist /*!< The histogram to freeze. */);
+
+    //! Get the contents of a bin.
+    /*! \return The bin content.
+     */
+    [[nodiscard]] data_t GetBinContent(Axis::index_t bin /*!< The bin to look at. */) const
+    { return ( bin < xaxis.GetBinCountAll() ) ? bins.Get(bin) : 0; }
+
+    //! Get the x axis of the histogram.
+    [[nodiscard]] const Axis &GetAxisX() const { return xaxis; }
+
+    //! Get the number of entries in the histogram.
+    [[nodiscard]] size_t GetEntries() const { return entries; }
+
+    //! Get the number of bytes used.
+    [[nodiscard]] size_t GetMemoryUsage() const { return sizeof(*this) + bins.GetMemoryUsage(); }
+
+    //! Add the contents to a mutable histogram, weighted by scale. Throws if the binning is different.
+    void AddTo(Histogram1Dp hist, data_t scale = 1) const;
+
+private:
+    //! The x axis of the histogram.
+    const Axis xaxis;
+
+    //! The number of entries in the histogram.
+    const size_t entries;
+
+    //! The bin contents, including the overflow bins.
+    FrozenBins bins;
+};
+
+/*!
+ * \class FrozenHistogram2D
+ * \brief An immutable, compressed copy of a 2D histogram.
+ */
+class FrozenHistogram2D : public Named {
+public:
+    //! The type used to count in each bin.
+    typedef FrozenBins::data_t data_t;
+
+    //! Freeze a histogram.
+    explicit FrozenHistogram2D(Histogram2Dp hist /*!< The histogram to freeze. */);
+
+    //! Get the contents of a bin.
+    /*! \return The bin content.
+     */
+    [[nodiscard]] data_t GetBinContent(Axis::index_t xbin /*!< The x bin to look at. */,
+                                       Axis::index_t ybin /*!< The y bin to look at. */) const
+    {
+        return ( xbin < xaxis.GetBinCountAll() && ybin < yaxis.GetBinCountAll() )
+            ? bins.Get(ybin*xaxis.GetBinCountAll() + xbin) : 0;
+    }
+
+    //! Get the x axis of the histogram.
+    [[nodiscard]] const Axis &GetAxisX() const { return xaxis; }
+
+    //! Get the y axis of the histogram.
+    [[nodiscard]] const Axis &GetAxisY() const { return yaxis; }
+
+    //! Get the number of entries in the histogram.
+    [[nodiscard]] size_t GetEntries() const { return entries; }
+
+    //! Get the number of bytes used.
+    [[nodiscard]] size_t GetMemoryUsage() const { return sizeof(*this) + bins.GetMemoryUsage(); }
+
+    //! Add the contents to a mutable histogram, weighted by scale. Throws if the binning is different.
+    void AddTo(Histogram2Dp hist, data_t scale = 1) const;
+
+    //! Project onto the x axis, summing y bins first to last (default all regular bins).
+    /*! \return The projection, created in the set with entries equal to the projected counts.
+     */
+    Histogram1Dp ProjectX(Histograms &set,              /*!< The set to create the projection in. */
+                          const std::string &name,      /*!< Name of the projection. */
+                          Axis::index_t first = 1,      /*!< The first y bin to include. */
+                          Axis::index_t last = 0        /*!< The last y bin to include, 0 for the last regular bin. */) const;
+
+    //! Project onto the y axis, summing x bins first to last (default all regular bins).
+    /*! \return The projection, created in the set with entries equal to the projected counts.
+     */
+    Histogram1Dp ProjectY(Histograms &set,              /*!< The set to create the projection in. */
+                          const std::string &name,      /*!< Name of the projection. */
+                          Axis::index_t first = 1,      /*!< The first x bin to include. */
+                          Axis::index_t last = 0        /*!< The last x bin to include, 0 for the last regular bin. */) const;
+
+private:
+    //! The x axis of the histogram.
+    const Axis xaxis;
+
+    //! The y axis of the histogram.
+    const Axis yaxis;
+
+    //! The number of entries in the histogram.
+    const size_t entries;
+
+    //! The bin contents row by row, including the overflow bins.
+    FrozenBins bins;
+};
+
+/*!
+ * \class FrozenHistogram3D
+ * \brief An immutable, compressed copy of a 3D histogram.
+ */
+class FrozenHistogram3D : public Named {
+public:
+    //! The type used to count in each bin.
+    typedef FrozenBins::data_t data_t;
+
+    //! Freeze a histogram.
+    explicit FrozenHistogram3D(Histogram3Dp hist /*!< The histogram to freeze. */);
+
+    //! Get the contents of a bin.
+    /*! \return The bin content.
+     */
+    [[nodiscard]] data_t GetBinContent(Axis::index_t xbin /*!< The x bin to look at. */,
+                                       Axis::index_t ybin /*!< The y bin to look at. */,
+                                       Axis::index_t zbin /*!< The z bin to look at. */) const
+    {
+        return ( xbin < xaxis.GetBinCountAll() && ybin < yaxis.GetBinCountAll() && zbin < zaxis.GetBinCountAll() )
+            ? bins.Get(( zbin*yaxis.GetBinCountAll() + ybin )*xaxis.GetBinCountAll() + xbin) : 0;
+    }
+
+    //! Get the x axis of the histogram.
+    [[nodiscard]] const Axis &GetAxisX() const { return xaxis; }
+
+    //! Get the y axis of the histogram.
+    [[nodiscard]] const Axis &GetAxisY() const { return yaxis; }
+
+    //! Get the z axis of the histogram.
+    [[nodiscard]] const Axis &GetAxisZ() const { return zaxis; }
+
+    //! Get the number of entries in the histogram.
+    [[nodiscard]] size_t GetEntries() const { return entries; }
+
+    //! Get the number of bytes used.
+    [[nodiscard]] size_t GetMemoryUsage() const { return sizeof(*this) + bins.GetMemoryUsage(); }
+
+    //! Add the contents to a mutable histogram, weighted by scale. Throws if the binning is different.
+    void AddTo(Histogram3Dp hist, data_t scale = 1) const;
+
+    //! Project onto one axis, summing the regular bins of the other two.
+    /*! \return The projection, created in the set with entries equal to the projected counts.
+     */
+    Histogram1Dp Project(Histograms &set,           /*!< The set to create the projection in. */
+                         const std::string &name,   /*!< Name of the projection. */
+                         int axis                   /*!< The axis to project onto, 0, 1 or 2 for x, y or z. */) const;
+
+private:
+    //! The x axis of the histogram.
+    const Axis xaxis;
+
+    //! The y axis of the histogram.
+    const Axis yaxis;
+
+    //! The z axis of the histogram.
+    const Axis zaxis;
+
+    //! The number of entries in the histogram.
+    const size_t entries;
+
+    //! The bin contents row by row and slice by slice, including the overflow bins.
+    FrozenBins bins;
+};
+
+/*!
+ * \class FrozenHistograms
+ * \brief An immutable, compressed copy of a set of histograms, e.g. of a completed run.
+ */
+class FrozenHistograms {
+public:
+    //! Freeze all histograms of a set, in parallel over histograms.
+    explicit FrozenHistograms(Histograms &set,                          /*!< The set to freeze. */
+                              ThreadPool &pool = ThreadPool::Default()  /*!< The pool to run on. */);
+
+    //! Find a frozen 1D histogram.
+    /*! \return the histogram, or nullptr if not found.
+     */
+    [[nodiscard]] const FrozenHistogram1D *Find1D(const std::string &name) const;
+
+    //! Find a frozen 2D histogram.
+    /*! \return the histogram, or nullptr if not found.
+     */
+    [[nodiscard]] const FrozenHistogram2D *Find2D(const std::string &name) const;
+
+    //! Find a frozen 3D histogram.
+    /*! \return the histogram, or nullptr if not found.
+     */
+    [[nodiscard]] const FrozenHistogram3D *Find3D(const std::string &name) const;
+
+    //! Add the frozen histograms to the histograms with the same name in a mutable set.
+    /*! Histograms that are not in the set are skipped, like in Histograms::Merge.
+     */
+    void AddTo(Histograms &set,                             /*!< The set to add to. */
+               ThreadPool &pool = ThreadPool::Default()     /*!< The pool to run on. */) const;
+
+    //! Get the number of bytes used by all histograms.
+    [[nodiscard]] size_t GetMemoryUsage() const;
+
+private:
+    std::map<std::string, std::unique_ptr<FrozenHistogram1D>> map1d;
+    std::map<std::string, std::unique_ptr<FrozenHistogram2D>> map2d;
+    std::map<std::string, std::unique_ptr<FrozenHistogram3D>> map3d;
+};
+
+#endif // FROZEN_H
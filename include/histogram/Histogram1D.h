@@ -29,10 +29,10 @@
 #define HISTOGRAM1D_H_
 
 #include <histogram/Histograms.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
 
-//#define H1D_USE_BUFFER 1
-
 // ########################################################################
 
 //! A one-dimensional histogram.
@@ -41,7 +41,7 @@ public:
   //! The type used to count in each bin.
   typedef size_t data_t;
 
-  //! Typedef if buffer is used.
+  //! A buffered fill.
     struct buf_t {
         Axis::bin_t x;
         data_t w;
@@ -59,7 +59,8 @@ public:
                Axis::bin_t left,          /*!< The lower edge of the lowest bin.  */
                Axis::bin_t right,         /*!< The upper edge of the highest bin. */
                const std::string& xtitle, /*!< The title of the x axis. */
-               const std::string& path="" /*!< Path if in directories within root file */);
+               const std::string& path="", /*!< Path if in directories within root file */
+               const FillPolicy& policy=FillPolicy() /*!< How the histogram is filled. */);
 
   //! Deallocate memory.
   ~Histogram1D();
@@ -76,11 +77,14 @@ public:
   void Fill(Axis::bin_t x,  /*!< The x axis value. */
             data_t weight=1 /*!< How much to add to the corresponding bin content. */)
   {
-#ifdef H1D_USE_BUFFER
-    buffer.push_back(buf_t(x, weight)); if( buffer.size()>=buffer_max ) FlushBuffer();
-#else
-    FillDirect(x, weight);
-#endif /* H1D_USE_BUFFER */
+    if( policy.buffer_size == 0 ) {
+      FillDirect(buf_t(x, weight));
+    } else {
+      buffer.emplace_back(x, weight);
+      buffered.store(true, std::memory_order_relaxed);
+      if( buffer.size()>=policy.buffer_size )
+        FlushBuffer();
+    }
   }
 
   //! Get the contents of a bin.
@@ -88,6 +92,15 @@ public:
    */
   data_t GetBinContent(Axis::index_t bin /*!< The bin to look at. */);
 
+  //! Set the contents of a bin.
+  void SetBinContent(Axis::index_t bin /*!< The bin to set. */,
+                     data_t c          /*!< The bin content.  */);
+
+  //! Get the contents of all bins.
+  /*! \return Pointer to GetAxisX().GetBinCountAll() bin contents, with the underflow bin first and the overflow bin last.
+   */
+  const data_t *GetData();
+
   //! Get the x axis of the histogram.
   /*! \return The histogram's x axis.
    */
@@ -98,11 +111,18 @@ public:
   /*! \return The histogram's entry count.
    */
   [[nodiscard]] int GetEntries() const
-  { return entries; }
+  { return entries + buffer.size(); }
 
   //! Clear all bins of the histogram.
   void Reset();
 
+  //! Get the fill policy of the histogram.
+  [[nodiscard]] const FillPolicy& GetFillPolicy() const
+  { return policy; }
+
+  //! Change the fill policy of the histogram. Buffered fills are applied first.
+  void SetFillPolicy(const FillPolicy& policy /*!< The new policy. */);
+
   //! Directly increment the histogram. Inlined for optimal performance.
   inline void FillDirect(const buf_t &element)
   {
@@ -110,15 +130,26 @@ public:
       data[xaxis.FindBin( element.x )] += element.w;
   }
 
-private:
-  //! Increment a histogram bin directly, bypassing the buffer.
-  void FillDirect(Axis::bin_t x,  /*!< The x axis value. */
-                  data_t weight=1 /*!< How much to add to the corresponding bin content. */);
+  //! Add to the contents of a bin without changing the entry count.
+  /*! Bins are numbered as in GetBinContent, with 0 as the underflow bin.
+   */
+  inline void AddBinContent(Axis::index_t bin, /*!< The bin to increment. */
+                            data_t weight      /*!< How much to add to the bin content. */)
+  {
+      data[bin] += weight;
+  }
 
-#ifdef H1D_USE_BUFFER
-  //! Flush the data buffer.
+  //! Add to the entry count of the histogram.
+  inline void AddEntries(size_t n /*!< The number of entries to add. */)
+  {
+      entries += n;
+  }
+
+private:
+  //! Apply the buffered fills.
+  /*! Readers may call this from several threads at once (e.g. through GetBinContent), only the first applies the buffer.
+   */
   void FlushBuffer();
-#endif /* H1D_USE_BUFFER */
 
   //! The x axis of the histogram;
   const Axis xaxis;
@@ -129,10 +160,17 @@ private:
   //! The bin contents, including the overflow bins.
   data_t *data;
 
-#ifdef H1D_USE_BUFFER
+  //! How the histogram is filled.
+  FillPolicy policy;
+
+  //! Fills not yet applied.
   buffer_t buffer;
-  static const unsigned int buffer_max = 1024;
-#endif /* H1D_USE_BUFFER */
+
+  //! True while the buffer may hold fills, so that readers of a flushed histogram skip the lock.
+  std::atomic<bool> buffered;
+
+  //! Serialises flushes by concurrent readers.
+  std::mutex flush_mutex;
 };
 
 #endif /* HISTOGRAM1D_H_ */
\ No newline at end of file
@@ -30,17 +30,17 @@
 #define HISTOGRAM2D_H_
 
 #include <histogram/Histograms.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
 
-#define USE_ROWS 1
-//#define H2D_USE_BUFFER 1
-
 //! A two-dimensional histogram.
 class Histogram2D : public Named {
 public:
   //! The type used to count in each bin.
   typedef size_t data_t;
 
+  //! A buffered fill.
   struct buf_t {
       Axis::bin_t x, y;
       data_t w;
@@ -62,7 +62,8 @@ public:
                Axis::bin_t yleft,         /*!< The lower edge of the lowest bin on the y axis. */
                Axis::bin_t yright,        /*!< The upper edge of the highest bin on the y axis. */
                const std::string& ytitle, /*!< The title of the y axis. */
-               const std::string& path="" /*!< Path if in directories within root file */);
+               const std::string& path="", /*!< Path if in directories within root file */
+               const FillPolicy& policy=FillPolicy() /*!< How the histogram is filled. */);
 
   //! Deallocate memory.
   ~Histogram2D();
@@ -80,11 +81,14 @@ public:
             Axis::bin_t y,  /*!< The y axis value. */
             data_t weight=1 /*!< How much to add to the corresponding bin content. */)
   {
-#ifdef H2D_USE_BUFFER
-    buffer.push_back(buf_t(x, y, weight)); if( buffer.size()>=buffer_max ) FlushBuffer();
-#else
-    FillDirect(x, y, weight);
-#endif /* H2D_USE_BUFFER */
+    if( policy.buffer_size == 0 ) {
+      FillDirect(buf_t(x, y, weight));
+    } else {
+      buffer.emplace_back(x, y, weight);
+      buffered.store(true, std::memory_order_relaxed);
+      if( buffer.size()>=policy.buffer_size )
+        FlushBuffer();
+    }
   }
 
   //! Get the contents of a bin.
@@ -93,6 +97,17 @@ public:
   data_t GetBinContent(Axis::index_t xbin /*!< The x bin to look at. */,
                        Axis::index_t ybin /*!< The y bin to look at. */);
 
+  //! Get the contents of all bins of a row.
+  /*! \return Pointer to GetAxisX().GetBinCountAll() bin contents of the row, with the underflow bin first,
+   *  or nullptr if the row does not exist.
+   */
+  const data_t *GetRow(Axis::index_t ybin /*!< The y bin of the row. */);
+
+  //! Get the contents of all bins of a row for writing.
+  /*! Like GetRow(), but the contents may be changed through the pointer. The entry count is not changed.
+   */
+  data_t *GetWritableRow(Axis::index_t ybin /*!< The y bin of the row. */);
+
   //! Set the contents of a bin.
   void SetBinContent(Axis::index_t xbin /*!< The x bin to look at.   */,
                      Axis::index_t ybin /*!< The y bin to look at.   */,
@@ -114,34 +129,41 @@ public:
   /*! \return The histogram's entry count.
    */
   [[nodiscard]] int GetEntries() const
-  { return entries; }
+  { return entries + buffer.size(); }
 
   //! Clear all bins of the histogram.
   void Reset();
 
+  //! Get the fill policy of the histogram.
+  [[nodiscard]] const FillPolicy& GetFillPolicy() const
+  { return policy; }
+
+  //! Change the fill policy of the histogram. Buffered fills are applied first.
+  void SetFillPolicy(const FillPolicy& policy /*!< The new policy. */);
+
   //! Directly increment the histogram. Inlined for optimal performance.
   inline void FillDirect(const buf_t &element)
   {
       Axis::index_t xbin = xaxis.FindBin( element.x );
       Axis::index_t ybin = yaxis.FindBin( element.y );
-#ifndef USE_ROWS
-      data[xaxis.GetBinCountAll()*ybin + xbin] += element.w;
-#else
-      rows[ybin][xbin] += element.w;
-#endif
+      if( policy.layout == FillPolicy::rows )
+        rows[ybin][xbin] += element.w;
+      else
+        data[xaxis.GetBinCountAll()*ybin + xbin] += element.w;
       entries += 1;
   }
 
-private:
-  //! Increment a histogram bin directly, bypassing the buffer.
-  void FillDirect(Axis::bin_t x,  /*!< The x axis value. */
-                  Axis::bin_t y,  /*!< The y axis value. */
-                  data_t weight=1 /*!< How much to add to the corresponding bin content. */);
+  //! Add to the entry count of the histogram.
+  inline void AddEntries(size_t n /*!< The number of entries to add. */)
+  {
+      entries += n;
+  }
 
-#ifdef H2D_USE_BUFFER
-  //! Flush the data buffer.
+private:
+  //! Apply the buffered fills.
+  /*! Readers may call this from several threads at once (e.g. through GetBinContent), only the first applies the buffer.
+   */
   void FlushBuffer();
-#endif /* H2D_USE_BUFFER */
 
   //! The x axis of the histogram;
   const Axis xaxis;
@@ -152,17 +174,23 @@ private:
   //! The number of entries in the histogram.
   size_t entries;
 
-#ifndef USE_ROWS
-  //! The bin contents, including the overflow bins.
+  //! The bin contents, row by row, including the overflow bins.
   data_t *data;
-#else
+
+  //! Pointers to the start of each row in data.
   data_t **rows;
-#endif
 
-#ifdef H2D_USE_BUFFER
+  //! How the histogram is filled.
+  FillPolicy policy;
+
+  //! Fills not yet applied.
   buffer_t buffer;
-  static const unsigned int buffer_max = 4096;
-#endif /* H2D_USE_BUFFER */
+
+  //! True while the buffer may hold fills, so that readers of a flushed histogram skip the lock.
+  std::atomic<bool> buffered;
+
+  //! Serialises flushes by concurrent readers.
+  std::mutex flush_mutex;
 };
 
 #endif /* HISTOGRAM2D_H_ */
\ No newline at end of file
@@ -27,18 +27,17 @@
 #define HISTOGRAM3D_H_
 
 #include <histogram/Histograms.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
 
-#define USE_ROWS 1
-//#define H3D_USE_BUFFER 1
-
-
 //! A two-dimensional histogram.
 class Histogram3D : public Named {
 public:
     //! The type used to count in each bin.
     typedef size_t data_t;
 
+    //! A buffered fill.
     struct buf_t {
         Axis::bin_t x, y, z;
         data_t w;
@@ -66,7 +65,8 @@ public:
                 Axis::bin_t zleft,         /*!< The lower edge of the lowest bin on the y axis. */
                 Axis::bin_t zright,        /*!< The upper edge of the highest bin on the y axis. */
                 const std::string& ztitle, /*!< The title of the y axis. */
-                const std::string& path="" /*!< Path if in directories within root file */);
+                const std::string& path="", /*!< Path if in directories within root file */
+                const FillPolicy& policy=FillPolicy() /*!< How the histogram is filled. */);
 
     //! Deallocate memory.
     ~Histogram3D();
@@ -85,11 +85,14 @@ public:
               Axis::bin_t z,  /*!< The z axis value. */
               data_t weight=1 /*!< How much to add to the corresponding bin content. */)
     {
-#ifdef H3D_USE_BUFFER
-        buffer.push_back(buf_t(x, y, z, weight)); if( buffer.size()>=buffer_max ) FlushBuffer();
-#else
-        FillDirect(x, y, z, weight);
-#endif /* H3D_USE_BUFFER */
+        if( policy.buffer_size == 0 ) {
+            FillDirect(buf_t(x, y, z, weight));
+        } else {
+            buffer.emplace_back(x, y, z, weight);
+            buffered.store(true, std::memory_order_relaxed);
+            if( buffer.size()>=policy.buffer_size )
+                FlushBuffer();
+        }
     }
 
     //! Get the contents of a bin.
@@ -99,6 +102,19 @@ public:
                          Axis::index_t ybin /*!< The y bin to look at. */,
                          Axis::index_t zbin /*!< The z bin to look at. */);
 
+    //! Get the contents of all bins of a row.
+    /*! \return Pointer to GetAxisX().GetBinCountAll() bin contents of the row, with the underflow bin first,
+     *  or nullptr if the row does not exist.
+     */
+    const data_t *GetRow(Axis::index_t ybin /*!< The y bin of the row. */,
+                         Axis::index_t zbin /*!< The z bin of the row. */);
+
+    //! Get the contents of all bins of a row for writing.
+    /*! Like GetRow(), but the contents may be changed through the pointer. The entry count is not changed.
+     */
+    data_t *GetWritableRow(Axis::index_t ybin /*!< The y bin of the row. */,
+                           Axis::index_t zbin /*!< The z bin of the row. */);
+
     //! Set the contents of a bin.
     void SetBinContent(Axis::index_t xbin /*!< The x bin to look at.   */,
                        Axis::index_t ybin /*!< The y bin to look at.   */,
@@ -127,37 +143,42 @@ public:
     /*! \return The histogram's entry count.
      */
     [[nodiscard]] int GetEntries() const
-    { return entries; }
+    { return entries + buffer.size(); }
 
     //! Clear all bins of the histogram.
     void Reset();
 
+    //! Get the fill policy of the histogram.
+    [[nodiscard]] const FillPolicy& GetFillPolicy() const
+    { return policy; }
+
+    //! Change the fill policy of the histogram. Buffered fills are applied first.
+    void SetFillPolicy(const FillPolicy& policy /*!< The new policy. */);
+
     //! Directly increment the histogram. Inlined for optimal performance.
     inline void FillDirect(const buf_t &element)
     {
         Axis::index_t xbin = xaxis.FindBin( element.x );
         Axis::index_t ybin = yaxis.FindBin( element.y );
         Axis::index_t zbin = zaxis.FindBin( element.z );
-#ifndef USE_ROWS
-        data[xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zbin +
-         xaxis.GetBinCountAll()*ybin + xbin] += element.w;
-#else
-        rows[zbin][ybin][xbin] += element.w;
+        if( policy.layout == FillPolicy::rows )
+            rows[zbin][ybin][xbin] += element.w;
+        else
+            data[xaxis.GetBinCountAll()*( yaxis.GetBinCountAll()*zbin + ybin ) + xbin] += element.w;
         entries += 1;
-#endif // USE_ROWS
+    }
+
+    //! Add to the entry count of the histogram.
+    inline void AddEntries(size_t n /*!< The number of entries to add. */)
+    {
+        entries += n;
     }
 
 private:
-    //! Increment a histogram bin directly, bypassing the buffer.
-    void FillDirect(Axis::bin_t x,  /*!< The x axis value. */
-                    Axis::bin_t y,  /*!< The y axis value. */
-                    Axis::bin_t z,  /*!< The z axis value. */
-                    data_t weight=1 /*!< How much to add to the corresponding bin content. */);
-
-#ifdef H3D_USE_BUFFER
-    //! Flush the data buffer.
+    //! Apply the buffered fills.
+    /*! Readers may call this from several threads at once (e.g. through GetBinContent), only the first applies the buffer.
+     */
     void FlushBuffer();
-#endif /* H2D_USE_BUFFER */
 
     //! The x axis of the histogram;
     const Axis xaxis;
@@ -171,17 +192,23 @@ private:
     //! The number of entries in the histogram.
     size_t entries;
 
-#ifndef USE_ROWS
-    //! The bin contents, including the overflow bins.
+    //! The bin contents, row by row and plane by plane, including the overflow bins.
     data_t *data;
-#else
+
+    //! Pointers to the start of each row in data, indexed by z and then y.
     data_t ***rows;
-#endif
 
-#ifdef H3D_USE_BUFFER
+    //! How the histogram is filled.
+    FillPolicy policy;
+
+    //! Fills not yet applied.
     buffer_t buffer;
-    static const unsigned int buffer_max = 4096;
-#endif /* H3D_USE_BUFFER */
+
+    //! True while the buffer may hold fills, so that readers of a flushed histogram skip the lock.
+    std::atomic<bool> buffered;
+
+    //! Serialises flushes by concurrent readers.
+    std::mutex flush_mutex;
 };
 
 #endif /* HISTOGRAM3D_H_ */
@@ -16,10 +16,12 @@
 class Histogram1D;
 class Histogram2D;
 class Histogram3D;
+class SubtractedHistogram2D;
 
 typedef Histogram1D* Histogram1Dp;
 typedef Histogram2D* Histogram2Dp;
 typedef Histogram3D* Histogram3Dp;
+typedef SubtractedHistogram2D* SubtractedHistogram2Dp;
 
 /*!
  * \class MamaWriter
@@ -43,6 +45,12 @@ public:
   static int Write(std::ostream& out, /*!< The output stream to write to. */
                    Histogram2Dp h      /*!< The histogram to write. */);
 
+  //! Write a single prompt-minus-random matrix in MAMA format.
+  /*! \return 0 if okay, <0 if error
+   */
+  static int Write(std::ostream& out,         /*!< The output stream to write to. */
+                   SubtractedHistogram2Dp h   /*!< The matrix to write. */);
+
     //! Write a single 3D histogram in MAMA format.
     /*! Throws because not implemented.
      */
@@ -0,0 +1,99 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef PEAKFIT_H
+#define PEAKFIT_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <vector>
+
+/*!
+ * \class PeakFit
+ * \brief Levenberg-Marquardt fits of Gaussian peaks on a linear background.
+ * \details A region of a 1D spectrum is fitted with
+ * f(x) = offset + slope (x - x_0) + sum_k area_k w/(sigma_k sqrt(2 pi)) exp(-(x - centroid_k)²/(2 sigma_k²)),
+ * where w is the bin width and x_0 the middle of the region, so that the areas are in counts.
+ * The fit minimises chi² with the bin contents as variance (at least 1), using analytic derivatives.
+ * The model and Jacobian are evaluated as loops over the bins of the region, one array per
+ * parameter, so that the compiler can vectorise them.
+ *
+ * Fitting a batch of regions runs on a thread pool, one fit per task. Regions are read straight
+ * from the histogram storage, so the histograms must not be filled while they are fitted.
+ */
+class PeakFit {
+public:
+
+    //! A region to fit.
+    struct Region {
+        Histogram1Dp hist;              //!< The spectrum.
+        double low;                     //!< Lower end of the region, in x axis units.
+        double high;                    //!< Upper end of the region, in x axis units.
+        std::vector<double> centroids;  //!< Starting centroid of each peak.
+    };
+
+    //! A fitted peak.
+    struct Peak {
+        double area, area_error;            //!< Area in counts.
+        double centroid, centroid_error;    //!< Centroid in x axis units.
+        double sigma, sigma_error;          //!< Standard deviation in x axis units.
+    };
+
+    //! Result of a fit.
+    struct Result {
+        std::vector<Peak> peaks;            //!< The peaks, in the order of the starting centroids.
+        double offset, offset_error;        //!< Background at the middle of the region.
+        double slope, slope_error;          //!< Background slope per x axis unit.
+        double chi2;                        //!< chi² of the fit.
+        size_t ndf;                         //!< Degrees of freedom.
+        size_t iterations;                  //!< Number of iterations.
+        bool converged;                     //!< True if the fit converged.
+    };
+
+    //! Parameters of the fits.
+    struct Options {
+        size_t max_iterations;  //!< Largest number of iterations.
+        double tolerance;       //!< The fit has converged when chi² improves by less than this fraction.
+        double sigma;           //!< Starting standard deviation of the peaks in x axis units, 0 for two bin widths.
+
+        Options()
+            : max_iterations( 200 )
+            , tolerance( 1e-7 )
+            , sigma( 0 ){}
+    };
+
+    //! Fit a single region.
+    /*! Throws if the region has fewer bins than free parameters.
+     */
+    static Result Fit(const Region &region,                 /*!< The region to fit. */
+                      const Options &options = Options()    /*!< Fit parameters. */);
+
+    //! Fit a batch of regions in parallel.
+    /*! \return the results in the order of the regions.
+     */
+    static std::vector<Result> Fit(const std::vector<Region> &regions,          /*!< The regions to fit. */
+                                   const Options &options = Options(),          /*!< Fit parameters. */
+                                   ThreadPool &pool = ThreadPool::Default()     /*!< The pool to run on. */);
+
+};
+
+#endif // PEAKFIT_H
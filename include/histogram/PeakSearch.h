@@ -0,0 +1,100 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef PEAKSEARCH_H
+#define PEAKSEARCH_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+ * \class PeakSearch
+ * \brief Automatic search for peaks in 1D spectra.
+ * \details The spectrum is convolved with the negative second derivative of a Gaussian, which
+ * removes linear background and gives a positive response at peaks. Local maxima of the response
+ * that are significant compared to its statistical uncertainty are accepted as peaks. Centroid and
+ * area of each peak are then computed from the spectrum in a window around the peak, with a linear
+ * background estimated from the window edges.
+ *
+ * Searching a list or a set of histograms runs on a thread pool, one spectrum per task.
+ * The histograms must not be filled while they are searched.
+ */
+class PeakSearch {
+public:
+
+    //! A peak found in a spectrum.
+    struct Peak {
+        double centroid;        //!< Background subtracted centroid, in x axis units.
+        double sigma;           //!< Estimated standard deviation of the peak, in x axis units.
+        double area;            //!< Background subtracted counts in the peak window.
+        double background;      //!< Background counts under the peak window.
+        double significance;    //!< Response of the filter divided by its uncertainty.
+    };
+
+    //! Parameters of the search.
+    struct Options {
+        double sigma;           //!< Expected standard deviation of the peaks, in bins.
+        double threshold;       //!< Minimum significance of a peak.
+        size_t max_peaks;       //!< Keep only this many peaks with the largest area, 0 for all.
+
+        Options()
+            : sigma( 2.0 )
+            , threshold( 5.0 )
+            , max_peaks( 0 ){}
+    };
+
+    //! Search for peaks in a single spectrum.
+    /*! \return the peaks sorted by centroid.
+     */
+    static std::vector<Peak> Search(Histogram1Dp hist,                    /*!< The spectrum to search. */
+                                    const Options &options = Options()    /*!< Search parameters. */);
+
+    //! Search for peaks in a list of spectra.
+    /*! \return the peaks of each spectrum, in the same order as the list.
+     */
+    static std::vector<std::vector<Peak>> Search(const Histograms::list1d_t &hists,          /*!< The spectra to search. */
+                                                 const Options &options = Options(),         /*!< Search parameters. */
+                                                 ThreadPool &pool = ThreadPool::Default()    /*!< The pool to run on. */);
+
+    //! Search for peaks in all 1D spectra of a set.
+    /*! \return the peaks of each spectrum, by histogram name.
+     */
+    static std::map<std::string, std::vector<Peak>> Search(Histograms &hists,                         /*!< The spectra to search. */
+                                                           const Options &options = Options(),        /*!< Search parameters. */
+                                                           ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+    //! Convolve a spectrum with the negative second derivative of a Gaussian.
+    /*! The spectrum is extended with its edge values. The loops run over the kernel
+     *  outermost so that they vectorise.
+     *  \return the filter response and its variance for each bin in response and variance.
+     */
+    static void Filter(const std::vector<double> &spectrum,   /*!< The bin contents. */
+                       double sigma,                          /*!< Width of the Gaussian, in bins. */
+                       std::vector<double> &response,         /*!< Filter response. */
+                       std::vector<double> &variance          /*!< Variance of the response. */);
+
+};
+
+#endif // PEAKSEARCH_H
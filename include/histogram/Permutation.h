@@ -0,0 +1,74 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef PERMUTATION_H
+#define PERMUTATION_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <array>
+#include <string>
+
+/*!
+ * \class Permutation
+ * \brief Reordering of the axes of 2D and 3D histograms.
+ * \details The result is a new histogram where the axes are swapped or permuted, so that access along
+ * what was a slow axis becomes sequential. All bins are copied, including the overflow bins, and the
+ * entry count is kept.
+ *
+ * The copy is done in cubic (3D) or square (2D) tiles that fit in the L1 cache, so that both the reads
+ * and the writes of a tile touch a small number of cache lines, and the tiles are distributed over
+ * the thread pool.
+ */
+class Permutation {
+public:
+
+    //! Side of the tiles used for 2D histograms.
+    static constexpr size_t block2d = 64;
+
+    //! Side of the tiles used for 3D histograms.
+    static constexpr size_t block3d = 16;
+
+    //! Transpose a matrix, with the result created in the set.
+    /*! \return A matrix with the x axis of `hist` as its y axis and the y axis of `hist` as its x axis.
+     */
+    static Histogram2Dp Transpose(Histograms &set,                           /*!< The set to create the result in. */
+                                  Histogram2Dp hist,                         /*!< The matrix to transpose. */
+                                  const std::string &name,                   /*!< Name of the result. */
+                                  ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+    //! Permute the axes of a cube, with the result created in the set.
+    /*! Axis k of the result is axis order[k] of `hist`, where 0, 1 and 2 are x, y and z. For instance
+     *  {2, 0, 1} gives a cube with z as its x axis, x as its y axis and y as its z axis.
+     *  Throws if `order` is not a permutation of {0, 1, 2}.
+     *
+     *  \return The permuted cube.
+     */
+    static Histogram3Dp Permute(Histograms &set,                             /*!< The set to create the result in. */
+                                Histogram3Dp hist,                           /*!< The cube to permute. */
+                                const std::string &name,                     /*!< Name of the result. */
+                                const std::array<int, 3> &order,             /*!< Source axis of each axis of the result. */
+                                ThreadPool &pool = ThreadPool::Default()     /*!< The pool to run on. */);
+
+};
+
+#endif // PERMUTATION_H
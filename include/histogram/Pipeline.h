@@ -0,0 +1,440 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/*!
+ * A small reader -> transform -> fill execution engine.
+ *
+ * A pipeline owns a fixed pool of batches. The reader stage takes an empty batch,
+ * fills it with events and passes it on. Each following stage runs on one or more
+ * threads, takes batches from the previous stage, processes them and passes them on.
+ * After the last stage the batch is handed back to the reader to be refilled, so
+ * no memory is allocated while running and the number of batches in flight bounds
+ * the memory use. When a stage is slower than the one before it, the queue in front
+ * of it fills up and the upstream stage waits (backpressure).
+ *
+ * Stages are created per worker thread through a factory, so each worker can own
+ * its own state, for example a ThreadSafeHistogram adapter or a private Histograms
+ * replica. The state is destroyed (and thereby flushed) on the worker thread when
+ * the pipeline has drained.
+ *
+ * Example:
+ * \code
+ * Pipeline<std::vector<Event>> pipeline(16);
+ * pipeline.SetReader([&](std::vector<Event> &batch){ return ReadEvents(file, batch); })
+ *         .AddStage([](std::vector<Event> &batch){ Calibrate(batch); }, 4)
+ *         .AddStageFactory([&](){
+ *              return [adapter = histograms.Create1D("e", "e", 4096, 0, 4096, "E")]
+ *                  (std::vector<Event> &batch) mutable { for (auto &e : batch) adapter.Fill(e.energy); };
+ *          }, 2);
+ * pipeline.Run();
+ * \endcode
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace PipelineDetails {
+    //! Size of a cache line, used to keep the producer and consumer indices apart.
+    constexpr size_t cache_line = 64;
+
+    //! Number of times a waiting push or pop yields before it blocks.
+    constexpr unsigned spin_count = 64;
+}
+
+/*!
+ * Bounded multi-producer multi-consumer lock-free queue.
+ * Each slot carries a sequence number telling whether it is ready to be written
+ * or read in the current lap, so producers and consumers only contend on their
+ * own index (D. Vyukov's bounded MPMC queue). The capacity is rounded up to a
+ * power of two. A push or pop that has to wait spins for a short while and then
+ * blocks on a condition variable, so idle threads do not keep a core busy.
+ */
+template<typename T>
+class BoundedQueue
+{
+private:
+    struct slot_t {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask;
+    std::unique_ptr<slot_t[]> slots;
+
+    alignas(PipelineDetails::cache_line) std::atomic<size_t> head;
+    alignas(PipelineDetails::cache_line) std::atomic<size_t> tail;
+    alignas(PipelineDetails::cache_line) std::atomic<bool> closed;
+
+    //! Number of threads blocked (or about to block) in push or pop.
+    alignas(PipelineDetails::cache_line) std::atomic<unsigned> waiters;
+    std::mutex wait_mutex;
+    std::condition_variable wait_condition;
+
+    //! Wake blocked threads after the queue changed.
+    void notify()
+    {
+        // Pairs with the increment of waiters, so either the waiter sees the change or we see the waiter.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ( waiters.load(std::memory_order_relaxed) > 0 ){
+            std::lock_guard lock(wait_mutex);
+            wait_condition.notify_all();
+        }
+    }
+
+    //! Wait until ready() returns true, first spinning and then blocking.
+    template<typename F>
+    void wait(F ready)
+    {
+        for ( unsigned i = 0 ; i < PipelineDetails::spin_count ; ++i ){
+            if ( ready() )
+                return;
+            std::this_thread::yield();
+        }
+        waiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+            std::unique_lock lock(wait_mutex);
+            wait_condition.wait(lock, ready);
+        }
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    static size_t round_up(size_t capacity)
+    {
+        size_t size = 2;
+        while ( size < capacity )
+            size <<= 1;
+        return size;
+    }
+
+    //! Add an element if there is room, without waking waiting threads.
+    bool enqueue(const T &value)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            slot_t &slot = slots[pos & mask];
+            const size_t seq = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if ( diff == 0 ){
+                if ( tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ){
+                    slot.value = value;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if ( diff < 0 ){
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //! Remove an element if there is one, without waking waiting threads.
+    bool dequeue(T &value)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            slot_t &slot = slots[pos & mask];
+            const size_t seq = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if ( diff == 0 ){
+                if ( head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) ){
+                    value = slot.value;
+                    slot.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if ( diff < 0 ){
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+public:
+    explicit BoundedQueue(size_t capacity)
+        : mask( round_up(capacity) - 1 )
+        , slots( new slot_t[mask + 1] )
+        , head( 0 )
+        , tail( 0 )
+        , closed( false )
+        , waiters( 0 )
+    {
+        for ( size_t i = 0 ; i <= mask ; ++i )
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    //! Try to add an element. Returns false if the queue is full.
+    bool try_push(const T &value)
+    {
+        if ( !enqueue(value) )
+            return false;
+        notify();
+        return true;
+    }
+
+    //! Try to remove an element. Returns false if the queue is empty.
+    bool try_pop(T &value)
+    {
+        if ( !dequeue(value) )
+            return false;
+        notify();
+        return true;
+    }
+
+    //! Add an element, waiting while the queue is full.
+    void push(const T &value)
+    {
+        wait([&](){ return enqueue(value); });
+        notify();
+    }
+
+    //! Remove an element, waiting while the queue is empty.
+    /*! \return false if the queue is empty and has been closed.
+     */
+    bool pop(T &value)
+    {
+        bool popped = false;
+        wait([&](){
+            popped = dequeue(value);
+            return popped || closed.load(std::memory_order_acquire);
+        });
+        if ( !popped )
+            popped = dequeue(value);
+        if ( popped )
+            notify();
+        return popped;
+    }
+
+    //! Mark that no more elements will be pushed.
+    void close()
+    {
+        closed.store(true, std::memory_order_release);
+        notify();
+    }
+
+    //! Check if the queue has been closed.
+    [[nodiscard]] bool is_closed() const { return closed.load(std::memory_order_acquire); }
+
+    //! Get the capacity of the queue.
+    [[nodiscard]] size_t capacity() const { return mask + 1; }
+};
+
+/*!
+ * Pipeline of a reader stage followed by any number of parallel stages.
+ * Batch must be default constructible. Batches are reused, so the reader should
+ * clear or overwrite the batch it is given.
+ */
+template<typename Batch>
+class Pipeline
+{
+public:
+    //! Reader stage. Fills the batch and returns false when there is no more input.
+    /*! A batch is passed on even if false is returned, so the last, partial batch
+     *  can be returned together with the end of input. Empty batches are recycled.
+     */
+    typedef std::function<bool(Batch &)> reader_t;
+
+private:
+    //! Type erased stage object owned by one worker thread.
+    struct stage_base {
+        virtual ~stage_base() = default;
+        virtual void process(Batch &batch) = 0;
+    };
+
+    //! Holds any callable taking a Batch&. Only needs to be movable.
+    template<typename S>
+    struct stage_impl : public stage_base {
+        S stage;
+        explicit stage_impl(S &&_stage) : stage( std::move(_stage) ){}
+        void process(Batch &batch) override { stage(batch); }
+    };
+
+    //! Creates the stage object of one worker thread.
+    typedef std::function<std::unique_ptr<stage_base>()> factory_t;
+
+    //! Check if a batch is empty, for batch types having empty(). Used to skip empty batches.
+    template<typename B>
+    static auto batch_empty(const B &batch, int) -> decltype(batch.empty()) { return batch.empty(); }
+
+    template<typename B>
+    static bool batch_empty(const B &, long) { return false; }
+
+    struct stage_info_t {
+        factory_t factory;
+        unsigned threads;
+    };
+
+    const size_t batches;
+    reader_t reader;
+    std::vector<stage_info_t> stages;
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    void set_error(std::exception_ptr e)
+    {
+        std::lock_guard lock(error_mutex);
+        if ( !error )
+            error = e;
+    }
+
+public:
+    //! Create a pipeline.
+    explicit Pipeline(size_t _batches = 16 /*!< Number of batches in flight. */)
+        : batches( std::max<size_t>(_batches, 1) ){}
+
+    //! Set the reader stage. It always runs on a single thread.
+    Pipeline &SetReader(reader_t _reader)
+    {
+        reader = std::move(_reader);
+        return *this;
+    }
+
+    //! Add a stage where every worker thread gets its own stage object.
+    /*! The factory is called once on each worker thread and must return a callable
+     *  taking a Batch&. The callable only has to be movable, so it can own a
+     *  ThreadSafeHistogram adapter. It is destroyed on the worker thread when the
+     *  pipeline has drained.
+     */
+    template<typename Factory>
+    Pipeline &AddStageFactory(Factory factory, unsigned threads = 1)
+    {
+        stages.push_back({[factory]() -> std::unique_ptr<stage_base> {
+            using S = decltype(factory());
+            return std::make_unique<stage_impl<S>>(factory());
+        }, std::max(threads, 1u)});
+        return *this;
+    }
+
+    //! Add a stage where all worker threads call the same callable concurrently.
+    template<typename Stage>
+    Pipeline &AddStage(Stage stage, unsigned threads = 1)
+    {
+        auto shared = std::make_shared<Stage>(std::move(stage));
+        return AddStageFactory([shared](){ return [shared](Batch &batch){ (*shared)(batch); }; }, threads);
+    }
+
+    //! Run the pipeline until the reader runs out of input and all batches are processed.
+    /*! Rethrows the first exception thrown by any stage after the pipeline has stopped.
+     */
+    void Run()
+    {
+        if ( !reader )
+            throw std::runtime_error("Pipeline has no reader");
+
+        std::vector<Batch> storage(batches);
+        BoundedQueue<Batch *> free(batches);
+        for ( auto &batch : storage )
+            free.push(&batch);
+
+        // queues[i] feeds stage i
+        std::vector<std::unique_ptr<BoundedQueue<Batch *>>> queues;
+        for ( size_t i = 0 ; i < stages.size() ; ++i )
+            queues.emplace_back(new BoundedQueue<Batch *>(batches));
+
+        std::atomic<bool> abort( false );
+        std::vector<std::unique_ptr<std::atomic<unsigned>>> running;
+        std::vector<std::thread> threads;
+
+        for ( size_t s = 0 ; s < stages.size() ; ++s ){
+            running.emplace_back(new std::atomic<unsigned>(stages[s].threads));
+            BoundedQueue<Batch *> &in = *queues[s];
+            BoundedQueue<Batch *> &out = ( s + 1 < stages.size() ) ? *queues[s + 1] : free;
+            const bool last = ( s + 1 == stages.size() );
+            std::atomic<unsigned> &active = *running[s];
+            for ( unsigned t = 0 ; t < stages[s].threads ; ++t ){
+                threads.emplace_back([this, s, &in, &out, last, &active, &abort](){
+                    std::unique_ptr<stage_base> stage;
+                    try {
+                        stage = stages[s].factory();
+                    } catch ( ... ){
+                        set_error(std::current_exception());
+                        abort.store(true);
+                    }
+
+                    // After an error, batches are still passed on (unprocessed) so
+                    // that no stage blocks waiting for a batch that never arrives.
+                    Batch *batch = nullptr;
+                    while ( in.pop(batch) ){
+                        if ( stage && !abort.load(std::memory_order_relaxed) ){
+                            try {
+                                stage->process(*batch);
+                            } catch ( ... ){
+                                set_error(std::current_exception());
+                                abort.store(true);
+                            }
+                        }
+                        out.push(batch);
+                    }
+
+                    // Destroy the stage state (flushing adapters) before signalling the end.
+                    try {
+                        stage.reset();
+                    } catch ( ... ){
+                        set_error(std::current_exception());
+                    }
+                    if ( active.fetch_sub(1) == 1 && !last )
+                        out.close();
+                });
+            }
+        }
+
+        // The reader runs on the calling thread.
+        try {
+            bool more = true;
+            while ( more && !abort.load(std::memory_order_relaxed) ){
+                Batch *batch = nullptr;
+                free.pop(batch);
+                more = reader(*batch);
+                if ( stages.empty() || batch_empty(*batch, 0) )
+                    free.push(batch);
+                else
+                    queues[0]->push(batch);
+            }
+        } catch ( ... ){
+            set_error(std::current_exception());
+            abort.store(true);
+        }
+        if ( !queues.empty() )
+            queues[0]->close();
+
+        for ( auto &thread : threads )
+            thread.join();
+
+        if ( error )
+            std::rethrow_exception(error);
+    }
+};
+
+#endif // PIPELINE_H
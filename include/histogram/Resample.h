@@ -0,0 +1,137 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*!
+ * \class Resample
+ * \brief Redistribution of the counts of a 2D histogram onto new axes under a coordinate transform.
+ * \details Each source bin is mapped to the quadrilateral spanned by its transformed corners, and its
+ * counts are shared between the target bins in proportion to the area of overlap, found by clipping
+ * the quadrilateral with each target bin. This is exact for affine transforms. For other monotone
+ * transforms each source bin can be subdivided to follow the curvature. Counts mapped outside the
+ * regular target bins are dropped.
+ *
+ * The overlaps are computed once into a Stencil, in parallel over blocks of source rows, and stored
+ * by target bin so that applying it runs in parallel over blocks of target rows without conflicts.
+ * A stencil can be reused for any number of matrices with the same binning.
+ */
+class Resample {
+public:
+
+    //! A coordinate transform, (x, y) -> (x', y').
+    typedef std::function<std::pair<double, double>(double x, double y)> map_t;
+
+    //! Affine transform, x' = a11 x + a12 y + b1, y' = a21 x + a22 y + b2.
+    struct Affine {
+        double a11, a12, a21, a22, b1, b2;
+
+        std::pair<double, double> operator()(double x, double y) const
+        { return {a11*x + a12*y + b1, a21*x + a22*y + b2}; }
+
+        //! Rotation by angle (radians, counterclockwise) around (x0, y0).
+        static Affine Rotation(double angle, double x0 = 0, double y0 = 0);
+    };
+
+    //! Precomputed overlaps between source and target bins.
+    class Stencil {
+    public:
+        //! Compute the overlaps of the regular bins of the source axes with the regular bins of the target axes.
+        Stencil(const Axis &source_x,                       /*!< x axis of the source matrices. */
+                const Axis &source_y,                       /*!< y axis of the source matrices. */
+                const Axis &target_x,                       /*!< x axis of the target matrices. */
+                const Axis &target_y,                       /*!< y axis of the target matrices. */
+                const map_t &map,                           /*!< The transform. */
+                size_t subdivisions = 1,                    /*!< Split each source bin in this many parts along each axis. */
+                ThreadPool &pool = ThreadPool::Default()    /*!< The pool to run on. */);
+
+        //! Redistribute a matrix.
+        /*! Source and target hold the regular bins, row major. Throws if the source has the wrong size.
+         */
+        void Apply(const std::vector<double> &source,           /*!< The source matrix. */
+                   std::vector<double> &target,                 /*!< The target matrix. */
+                   ThreadPool &pool = ThreadPool::Default()     /*!< The pool to run on. */) const;
+
+        //! Get the source x axis.
+        [[nodiscard]] const Axis &GetSourceX() const { return source_x; }
+
+        //! Get the source y axis.
+        [[nodiscard]] const Axis &GetSourceY() const { return source_y; }
+
+        //! Get the target x axis.
+        [[nodiscard]] const Axis &GetTargetX() const { return target_x; }
+
+        //! Get the target y axis.
+        [[nodiscard]] const Axis &GetTargetY() const { return target_y; }
+
+        //! Get the number of (source, target) overlaps.
+        [[nodiscard]] size_t GetSize() const { return fraction.size(); }
+
+    private:
+        size_t source_columns;
+        size_t source_rows;
+        const Axis source_x;
+        const Axis source_y;
+        const Axis target_x;
+        const Axis target_y;
+
+        //! Overlaps of target bin t are at [start[t], start[t+1]).
+        std::vector<size_t> start;
+
+        //! Source bin of each overlap.
+        std::vector<size_t> source;
+
+        //! Fraction of the source bin's counts that goes to the target bin.
+        std::vector<double> fraction;
+    };
+
+    //! Transform a matrix onto new axes, with the result created in the set.
+    static Histogram2Dp Transform(Histograms &set,                           /*!< The set to create the result in. */
+                                  Histogram2Dp hist,                         /*!< The matrix to transform. */
+                                  const std::string &name,                   /*!< Name of the result. */
+                                  const Axis &target_x,                      /*!< x axis of the result. */
+                                  const Axis &target_y,                      /*!< y axis of the result. */
+                                  const map_t &map,                          /*!< The transform. */
+                                  size_t subdivisions = 1,                   /*!< Split each source bin in this many parts along each axis. */
+                                  ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+    //! Transform a matrix with a precomputed stencil, with the result created in the set.
+    /*! The contents of the result are rounded. Throws if the axes of the matrix do not have the binning
+     *  of the source axes of the stencil.
+     */
+    static Histogram2Dp Transform(Histograms &set,                           /*!< The set to create the result in. */
+                                  Histogram2Dp hist,                         /*!< The matrix to transform. */
+                                  const std::string &name,                   /*!< Name of the result. */
+                                  const Stencil &stencil,                    /*!< The precomputed overlaps. */
+                                  ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+};
+
+#endif // RESAMPLE_H
@@ -0,0 +1,92 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*!
+ * \class Resolution
+ * \brief Folding of spectra and matrices with a Gaussian detector resolution.
+ * \details The counts of each bin are spread over the neighbouring bins with the integral of a
+ * Gaussian over each bin, so counts are conserved except for what falls outside the regular bins.
+ * A constant width is folded as an FFT convolution. A width that depends on x is folded with a
+ * banded sum over four standard deviations around each bin.
+ *
+ * Matrices are folded along the x axis, in parallel over rows, and lists of spectra in parallel
+ * over histograms. The folded histograms are created in the given set with the contents rounded.
+ */
+class Resolution {
+public:
+
+    //! Standard deviation of the resolution as a function of x, both in x axis units.
+    typedef std::function<double(double)> sigma_t;
+
+    //! The resolution, either a constant standard deviation or a function of x.
+    struct Kernel {
+        double sigma;           //!< Constant standard deviation, used if sigma_of_x is empty.
+        sigma_t sigma_of_x;     //!< Standard deviation as a function of x.
+
+        //! Constant resolution.
+        Kernel(double _sigma) : sigma( _sigma ), sigma_of_x(){}
+
+        //! Resolution depending on x, from any callable taking and returning a double.
+        template<typename F, typename = std::enable_if_t<std::is_invocable_r_v<double, F, double>>>
+        Kernel(F _sigma_of_x) : sigma( 0 ), sigma_of_x( std::move(_sigma_of_x) ){}
+    };
+
+    //! Fold the regular bins of a spectrum in place.
+    static void Fold(std::vector<double> &spectrum,   /*!< Contents of the regular bins. */
+                     const Axis &axis,                /*!< The axis of the spectrum. */
+                     const Kernel &kernel             /*!< The resolution. */);
+
+    //! Fold a spectrum into a new histogram.
+    static Histogram1Dp Fold(Histograms &set,             /*!< The set to create the result in. */
+                             Histogram1Dp hist,           /*!< The spectrum. */
+                             const std::string &name,     /*!< Name of the folded spectrum. */
+                             const Kernel &kernel         /*!< The resolution. */);
+
+    //! Fold each row of a matrix along the x axis into a new histogram.
+    static Histogram2Dp Fold(Histograms &set,                           /*!< The set to create the result in. */
+                             Histogram2Dp hist,                         /*!< The matrix. */
+                             const std::string &name,                   /*!< Name of the folded matrix. */
+                             const Kernel &kernel,                      /*!< The resolution. */
+                             ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+    //! Fold a list of spectra into new histograms named after them with the suffix appended.
+    /*! \return the folded spectra, in the order of the list.
+     */
+    static Histograms::list1d_t Fold(Histograms &set,                           /*!< The set to create the results in. */
+                                     const Histograms::list1d_t &hists,         /*!< The spectra. */
+                                     const std::string &suffix,                 /*!< Suffix of the folded names. */
+                                     const Kernel &kernel,                      /*!< The resolution. */
+                                     ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+};
+
+#endif // RESOLUTION_H
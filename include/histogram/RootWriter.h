@@ -10,6 +10,8 @@
 #ifndef RootWriter_H_
 #define RootWriter_H_ 1
 
+#include <histogram/Histograms.h>
+
 #include <string>
 #include <memory>
 
@@ -17,21 +19,12 @@ class TH1;
 class TH2;
 class TH3;
 class TFile;
+class TDirectory;
 
 typedef TH1* TH1p;
 typedef TH2* TH2p;
 typedef TH3* TH3p;
 
-class Named;
-class Histogram1D;
-class Histogram2D;
-class Histogram3D;
-
-typedef Histogram1D* Histogram1Dp;
-typedef Histogram2D* Histogram2Dp;
-typedef Histogram3D* Histogram3Dp;
-
-class Histograms;
 
 #define ROOT1D_YTITLE 1 // 0=No title on y-axis, 1=Counts/binwidth on y-axis.
 
@@ -48,9 +41,12 @@ class RootWriter {
 
 private:
 
-    //! Modify the root file to be in the correct directory before creating the histogram.
-    static void Navigate( Named *named, /*!< Named object where we will find the directory. */
-                          TFile *file   /*!< ROOT file we are writing to.                   */);
+    //! Write the histograms of a directory and its subdirectories.
+    /*! Each subdirectory is created once in the ROOT file before its histograms are written.
+     *  \return the number of histograms written.
+     */
+    static size_t WriteDirectory( const Histograms::Directory& dir, /*!< The directory of the histogram set. */
+                                  TDirectory *target                /*!< The ROOT directory to write into.   */);
 
 public:
   //! Write many histograms at once.
@@ -62,6 +58,17 @@ public:
                      const char *title = "",          /*!< Title of the ROOT file.  */
                      const char *options = "RECREATE" /*!< ROOT file options.       */);
 
+  //! Write the histograms of a subtree of the set.
+  /*! The histograms in the directory given by path and its subdirectories are written,
+   *  keeping their full paths. The output file will be overwritten if it exists.
+   *  Throws std::runtime_error if the directory does not exist.
+   */
+  static void WriteSubtree( Histograms& histograms,          /*!< The histogram list.       */
+                            const std::string& path,         /*!< Path of the subtree.      */
+                            const char *filename,            /*!< The output filename.      */
+                            const char *title = "",          /*!< Title of the ROOT file.   */
+                            const char *options = "RECREATE" /*!< ROOT file options.        */);
+
   //! Create a ROOT histogram from a Histogram1D.
   /*! \return the ROOT 1D histogram.
    */
@@ -72,6 +79,11 @@ public:
    */
   static TH2p CreateTH2(Histogram2Dp m /*!< The Histogram2D to be cpoied. */);
 
+  //! Create a ROOT histogram from a prompt-minus-random matrix.
+  /*! \return the ROOT 2D histogram, with double bins since the contents may be negative or fractional.
+   */
+  static TH2p CreateTH2(SubtractedHistogram2Dp m /*!< The matrix to be copied. */);
+
   //! Create a ROOT histogram from a Histogram2D.
   /*! \return the ROOT 2D histogram.
    */
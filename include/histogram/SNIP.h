@@ -0,0 +1,98 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SNIP_H
+#define SNIP_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <string>
+#include <vector>
+
+/*!
+ * \class SNIP
+ * \brief Background estimation with the Statistics-sensitive Non-linear Iterative Peak-clipping algorithm.
+ * \details For each clipping window p each bin is replaced by the smaller of itself and the mean of the
+ * bins p away, which clips away peaks narrower than the window. The clipping is done on the
+ * log-log-square root transformed spectrum by default, to make it work over several orders of magnitude.
+ * In 2D each bin is clipped against the means along x, along y and of the four diagonal neighbours.
+ *
+ * Each clipping pass reads one buffer and writes another, so the passes are plain min loops that
+ * the compiler vectorises, and 2D passes run in parallel over rows. Only regular bins are used;
+ * the background is written rounded into a new histogram.
+ */
+class SNIP {
+public:
+
+    //! Parameters of the clipping.
+    struct Options {
+        size_t iterations;          //!< Largest clipping window, in bins. Should be about the width of the peaks.
+        bool decreasing_window;     //!< Go from the largest window to the smallest, as in TSpectrum.
+        bool lls;                   //!< Clip the log-log-square root transformed spectrum.
+
+        Options()
+            : iterations( 24 )
+            , decreasing_window( true )
+            , lls( true ){}
+    };
+
+    //! Estimate the background of a spectrum in place.
+    static void Background(std::vector<double> &spectrum,       /*!< The spectrum, replaced by its background. */
+                           const Options &options = Options()   /*!< Clipping parameters. */);
+
+    //! Estimate the background of a matrix in place.
+    /*! With rows_only, each row is clipped as a spectrum, otherwise the 2D clipping is used.
+     */
+    static void Background(std::vector<double> &matrix,                 /*!< The matrix, row major, replaced by its background. */
+                           size_t columns,                              /*!< Number of columns. */
+                           size_t rows,                                 /*!< Number of rows. */
+                           bool rows_only,                              /*!< Clip each row on its own. */
+                           const Options &options = Options(),          /*!< Clipping parameters. */
+                           ThreadPool &pool = ThreadPool::Default()     /*!< The pool to run on. */);
+
+    //! Estimate the background of a 1D histogram into a new histogram in the set.
+    static Histogram1Dp Background(Histograms &set,                     /*!< The set to create the background in. */
+                                   Histogram1Dp hist,                   /*!< The spectrum. */
+                                   const std::string &name,             /*!< Name of the background histogram. */
+                                   const Options &options = Options()   /*!< Clipping parameters. */);
+
+    //! Estimate the background of a 2D histogram into a new histogram in the set.
+    static Histogram2Dp Background(Histograms &set,                         /*!< The set to create the background in. */
+                                   Histogram2Dp hist,                       /*!< The matrix. */
+                                   const std::string &name,                 /*!< Name of the background histogram. */
+                                   bool rows_only = false,                  /*!< Clip each row (x axis) on its own. */
+                                   const Options &options = Options(),      /*!< Clipping parameters. */
+                                   ThreadPool &pool = ThreadPool::Default() /*!< The pool to run on. */);
+
+    //! Estimate the background of a list of 1D histograms in parallel.
+    /*! The backgrounds are named after the histograms with the suffix appended.
+     *  \return the backgrounds, in the order of the list.
+     */
+    static Histograms::list1d_t Background(Histograms &set,                         /*!< The set to create the backgrounds in. */
+                                           const Histograms::list1d_t &hists,       /*!< The spectra. */
+                                           const std::string &suffix = "_bg",       /*!< Suffix of the background names. */
+                                           const Options &options = Options(),      /*!< Clipping parameters. */
+                                           ThreadPool &pool = ThreadPool::Default() /*!< The pool to run on. */);
+
+};
+
+#endif // SNIP_H
@@ -0,0 +1,349 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef STATICHISTOGRAM_H
+#define STATICHISTOGRAM_H
+
+/*!
+ * Histograms with the binning fixed at compile time.
+ *
+ * For small spectra filled in hot loops (detector IDs, short time spectra) the
+ * axis is a constant expression and the bins are stored inline in a std::array,
+ * so a fill is a couple of compares, a division by a constant and an increment.
+ * Bin edges are integers, since C++17 does not allow floating point template
+ * parameters. The binning follows Axis exactly, including the underflow and
+ * overflow bins, so the contents can be added to a Histogram1D/Histogram2D and
+ * written through a Histograms set with AddTo.
+ *
+ * Since the storage is inline, the histograms are meant for small shapes. Large
+ * ones should be allocated on the heap and not on the stack.
+ *
+ * Example:
+ * \code
+ * StaticHistogram1D<64, 0, 64, uint32_t> ids("ids", "Detector IDs", "ID");
+ * for ( auto &hit : hits ) ids.Fill(hit.id);
+ * ids.AddTo(histograms);
+ * RootWriter::Write(histograms, "out.root");
+ * \endcode
+ */
+
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+//! An axis with the binning fixed at compile time.
+/*! Has the same bin numbering as Axis. */
+template<Axis::index_t N, long Left, long Right>
+struct StaticAxis {
+    static_assert(N > 0, "A StaticAxis needs at least one bin");
+    static_assert(Left < Right, "The left edge of a StaticAxis must be below the right edge");
+
+    static constexpr Axis::index_t channels = N;                             /*!< The number of regular bins.         */
+    static constexpr Axis::index_t channels_all = N + 2;                     /*!< The number of bins incl. overflow.  */
+    static constexpr Axis::bin_t left = Left;                                /*!< The lower edge of the lowest bin.   */
+    static constexpr Axis::bin_t right = Right;                              /*!< The upper edge of the highest bin.  */
+    static constexpr Axis::bin_t binwidth = Axis::bin_t(Right - Left) / N;   /*!< The width of a regular bin.         */
+
+    //! Find a bin number.
+    /*! \return The number of the bin, the same as Axis::FindBin.
+     */
+    static constexpr Axis::index_t FindBin(Axis::bin_t x)
+    {
+        if ( x < left )
+            return 0;
+        else if ( x < right )
+            return 1 + Axis::index_t(( x - left ) / binwidth);
+        else
+            return channels_all - 1;
+    }
+
+    //! Check if a runtime axis has the same binning.
+    static bool Matches(const Axis &axis)
+    {
+        return axis.GetBinCount() == channels && axis.GetLeft() == left && axis.GetRight() == right;
+    }
+};
+
+namespace StaticHistogramDetails {
+
+    //! Convert a bin content to the count type of the dynamic histograms.
+    template<typename T>
+    size_t ToCount(T value, size_t scale)
+    {
+        if constexpr ( std::is_floating_point_v<T> )
+            return size_t(std::llround(value*T(scale)));
+        else
+            return size_t(value)*scale;
+    }
+}
+
+/*!
+ * \class StaticHistogram1D
+ * \brief A one-dimensional histogram with compile time binning and inline storage.
+ */
+template<Axis::index_t N, long Left, long Right, typename T = size_t>
+class StaticHistogram1D : public Named {
+public:
+    //! The axis type.
+    typedef StaticAxis<N, Left, Right> axis_t;
+
+    //! The type used to count in each bin.
+    typedef T data_t;
+
+    //! Construct an empty histogram.
+    StaticHistogram1D( const std::string& name,   /*!< The name of the histogram.               */
+                       const std::string& title,  /*!< The title of the histogram.              */
+                       const std::string& xtitle, /*!< The title of the x axis.                 */
+                       const std::string& path="" /*!< Path if in directories within root file. */)
+        : Named( name, title, path )
+        , xtitle( xtitle )
+        , entries( 0 )
+        , data{}
+    {}
+
+    //! Increment a histogram bin.
+    void Fill(Axis::bin_t x,  /*!< The x axis value. */
+              data_t weight=1 /*!< How much to add to the corresponding bin content. */)
+    {
+        entries += 1;
+        data[axis_t::FindBin(x)] += weight;
+    }
+
+    //! Get the contents of a bin.
+    /*! \return The bin content, 0 if the bin is out of range.
+     */
+    [[nodiscard]] data_t GetBinContent(Axis::index_t bin /*!< The bin to look at. */) const
+    { return ( bin < axis_t::channels_all ) ? data[bin] : 0; }
+
+    //! Add to the contents of a bin without changing the entry count.
+    void AddBinContent(Axis::index_t bin, /*!< The bin to increment. */
+                       data_t weight      /*!< How much to add to the bin content. */)
+    { data[bin] += weight; }
+
+    //! Get the contents of all bins, with the underflow bin first and the overflow bin last.
+    [[nodiscard]] const data_t *GetData() const
+    { return data.data(); }
+
+    //! Get the x axis as a runtime axis.
+    [[nodiscard]] Axis GetAxisX() const
+    { return Axis(GetName(), N, Left, Right, xtitle); }
+
+    //! Get the number of entries in the histogram.
+    [[nodiscard]] size_t GetEntries() const
+    { return entries; }
+
+    //! Add to the entry count of the histogram.
+    void AddEntries(size_t n /*!< The number of entries to add. */)
+    { entries += n; }
+
+    //! Clear all bins of the histogram.
+    void Reset()
+    {
+        data.fill(0);
+        entries = 0;
+    }
+
+    //! Add the counts of another histogram with the same binning, weighted by scale.
+    void Add(const StaticHistogram1D &other, data_t scale = 1)
+    {
+        for ( Axis::index_t i = 0 ; i < axis_t::channels_all ; ++i )
+            data[i] += scale*other.data[i];
+        entries += size_t(scale)*other.entries;
+    }
+
+    //! Add the contents to a dynamic histogram, weighted by scale.
+    /*! Floating point contents are rounded to the nearest count.
+     *  Throws if the binning is different.
+     */
+    void AddTo(Histogram1Dp hist, size_t scale = 1) const
+    {
+        if ( !axis_t::Matches(hist->GetAxisX()) )
+            throw std::runtime_error("Histograms '" + hist->GetName() + "' and '" + GetName() + "' does not have the same dimentions.");
+        for ( Axis::index_t i = 0 ; i < axis_t::channels_all ; ++i ){
+            if ( data[i] != 0 )
+                hist->AddBinContent(i, StaticHistogramDetails::ToCount(data[i], scale));
+        }
+        hist->AddEntries(scale*entries);
+    }
+
+    //! Add the contents to the histogram with the same name in a set, creating it if needed.
+    /*! This is how the histogram is merged and written with the rest of the set.
+     *  \return the histogram in the set.
+     */
+    Histogram1Dp AddTo(Histograms &set,   /*!< The set to add to.                  */
+                       size_t scale = 1   /*!< Weight of the contents when added. */) const
+    {
+        Histogram1Dp hist = set.Find1D(GetName());
+        if ( hist == nullptr )
+            hist = set.Create1D(GetName(), GetTitle(), N, Left, Right, xtitle, GetPath());
+        AddTo(hist, scale);
+        return hist;
+    }
+
+private:
+    //! The title of the x axis.
+    std::string xtitle;
+
+    //! The number of entries in the histogram.
+    size_t entries;
+
+    //! The bin contents, including the overflow bins.
+    std::array<data_t, axis_t::channels_all> data;
+};
+
+/*!
+ * \class StaticHistogram2D
+ * \brief A two-dimensional histogram with compile time binning and inline storage.
+ */
+template<Axis::index_t NX, long XLeft, long XRight,
+         Axis::index_t NY, long YLeft, long YRight, typename T = size_t>
+class StaticHistogram2D : public Named {
+public:
+    //! The x axis type.
+    typedef StaticAxis<NX, XLeft, XRight> xaxis_t;
+
+    //! The y axis type.
+    typedef StaticAxis<NY, YLeft, YRight> yaxis_t;
+
+    //! The type used to count in each bin.
+    typedef T data_t;
+
+    //! Construct an empty histogram.
+    StaticHistogram2D( const std::string& name,   /*!< The name of the histogram.               */
+                       const std::string& title,  /*!< The title of the histogram.              */
+                       const std::string& xtitle, /*!< The title of the x axis.                 */
+                       const std::string& ytitle, /*!< The title of the y axis.                 */
+                       const std::string& path="" /*!< Path if in directories within root file. */)
+        : Named( name, title, path )
+        , xtitle( xtitle )
+        , ytitle( ytitle )
+        , entries( 0 )
+        , data{}
+    {}
+
+    //! Increment a histogram bin.
+    void Fill(Axis::bin_t x,  /*!< The x axis value. */
+              Axis::bin_t y,  /*!< The y axis value. */
+              data_t weight=1 /*!< How much to add to the corresponding bin content. */)
+    {
+        entries += 1;
+        data[yaxis_t::FindBin(y)*xaxis_t::channels_all + xaxis_t::FindBin(x)] += weight;
+    }
+
+    //! Get the contents of a bin.
+    /*! \return The bin content, 0 if the bin is out of range.
+     */
+    [[nodiscard]] data_t GetBinContent(Axis::index_t xbin, /*!< The x bin to look at. */
+                                       Axis::index_t ybin  /*!< The y bin to look at. */) const
+    {
+        if ( xbin >= xaxis_t::channels_all || ybin >= yaxis_t::channels_all )
+            return 0;
+        return data[ybin*xaxis_t::channels_all + xbin];
+    }
+
+    //! Get a row of bins, with the underflow bin first and the overflow bin last.
+    [[nodiscard]] const data_t *GetRow(Axis::index_t ybin /*!< The y bin of the row. */) const
+    { return data.data() + ybin*xaxis_t::channels_all; }
+
+    //! Get the x axis as a runtime axis.
+    [[nodiscard]] Axis GetAxisX() const
+    { return Axis(GetName(), NX, XLeft, XRight, xtitle); }
+
+    //! Get the y axis as a runtime axis.
+    [[nodiscard]] Axis GetAxisY() const
+    { return Axis(GetName(), NY, YLeft, YRight, ytitle); }
+
+    //! Get the number of entries in the histogram.
+    [[nodiscard]] size_t GetEntries() const
+    { return entries; }
+
+    //! Add to the entry count of the histogram.
+    void AddEntries(size_t n /*!< The number of entries to add. */)
+    { entries += n; }
+
+    //! Clear all bins of the histogram.
+    void Reset()
+    {
+        data.fill(0);
+        entries = 0;
+    }
+
+    //! Add the counts of another histogram with the same binning, weighted by scale.
+    void Add(const StaticHistogram2D &other, data_t scale = 1)
+    {
+        for ( size_t i = 0 ; i < data.size() ; ++i )
+            data[i] += scale*other.data[i];
+        entries += size_t(scale)*other.entries;
+    }
+
+    //! Add the contents to a dynamic histogram, weighted by scale.
+    /*! Floating point contents are rounded to the nearest count.
+     *  Throws if the binning is different.
+     */
+    void AddTo(Histogram2Dp hist, size_t scale = 1) const
+    {
+        if ( !xaxis_t::Matches(hist->GetAxisX()) || !yaxis_t::Matches(hist->GetAxisY()) )
+            throw std::runtime_error("Histograms '" + hist->GetName() + "' and '" + GetName() + "' does not have the same dimentions.");
+        for ( Axis::index_t y = 0 ; y < yaxis_t::channels_all ; ++y ){
+            const data_t *row = GetRow(y);
+            const Histogram2D::data_t *current = hist->GetRow(y);
+            for ( Axis::index_t x = 0 ; x < xaxis_t::channels_all ; ++x ){
+                if ( row[x] != 0 )
+                    hist->SetBinContent(x, y, current[x] + StaticHistogramDetails::ToCount(row[x], scale));
+            }
+        }
+        hist->AddEntries(scale*entries);
+    }
+
+    //! Add the contents to the histogram with the same name in a set, creating it if needed.
+    /*! \return the histogram in the set.
+     */
+    Histogram2Dp AddTo(Histograms &set,   /*!< The set to add to.                  */
+                       size_t scale = 1   /*!< Weight of the contents when added. */) const
+    {
+        Histogram2Dp hist = set.Find2D(GetName());
+        if ( hist == nullptr )
+            hist = set.Create2D(GetName(), GetTitle(), NX, XLeft, XRight, xtitle, NY, YLeft, YRight, ytitle, GetPath());
+        AddTo(hist, scale);
+        return hist;
+    }
+
+private:
+    //! The title of the x axis.
+    std::string xtitle;
+
+    //! The title of the y axis.
+    std::string ytitle;
+
+    //! The number of entries in the histogram.
+    size_t entries;
+
+    //! The bin contents, row by row, including the overflow bins.
+    std::array<data_t, xaxis_t::channels_all*yaxis_t::channels_all> data;
+};
+
+#endif // STATICHISTOGRAM_H
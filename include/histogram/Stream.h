@@ -0,0 +1,225 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*!
+ * Streaming of histogram updates to other local processes over a Unix domain socket.
+ *
+ * A StreamPublisher listens on a socket path. Clients connect with StreamClient and
+ * subscribe to histograms by name. On each call to StreamPublisher::Publish() the
+ * publisher sends every client one update message with a sequence number, holding only
+ * the bins of its subscribed histograms that changed since the previous update. The
+ * first update of a histogram to a client is a keyframe with its definition and all
+ * non-zero bins. A StreamClient applies the updates to its own Histograms set, so the
+ * client has a copy of the subscribed histograms that is current as of the last update.
+ *
+ * Wire format, all values in host byte order:
+ * <ul>
+ * <li>Each message is a header of u32 magic, u8 type and u32 payload size, followed by the payload.</li>
+ * <li>Subscribe (client to publisher): u32 count, then count names as u32 size and bytes.
+ *     A count of 0 subscribes to all histograms. A new subscription replaces the previous.</li>
+ * <li>Update (publisher to client): u64 sequence, u32 count, then count histogram entries.
+ *     An entry is u8 flags (1 = keyframe), u8 dimensions and the name. A keyframe
+ *     continues with the title, the path and for each axis u64 bins, f64 left, f64 right
+ *     and the title. All entries continue with the u64 entry count, a varint number of
+ *     changed bins and for each changed bin the varint distance from the previous changed
+ *     bin and the zigzag varint change of the content. Bins are numbered row-major
+ *     including the overflow bins.</li>
+ * <li>Prompt-minus-random matrices (SubtractedHistogram2D) have 0x80 added to the dimensions,
+ *     their keyframes end with the f64 ratio, and the change of a bin is the change of the
+ *     bits of its double content.</li>
+ * </ul>
+ * Finding the changed bins is a linear scan of the subscribed histograms, but the size of
+ * the updates scales with the number of changed bins. A client that does not read its
+ * socket is not allowed to hold more than max_pending bytes; updates to it are then
+ * skipped and it gets keyframes once it has caught up, which it can tell from the gap in
+ * the sequence numbers.
+ */
+
+//! Streams changes of the histograms in a set to subscribed clients.
+class StreamPublisher {
+public:
+
+    //! Options for the publisher.
+    struct Options {
+        //! Maximum bytes queued for a client before updates to it are skipped.
+        size_t max_pending;
+
+        //! Maximum number of clients waiting to be accepted.
+        int backlog;
+
+        Options() : max_pending( size_t(64) << 20 ), backlog( 16 ){}
+    };
+
+    //! Start listening on a socket path. An existing file at the path is removed.
+    /*! Throws std::runtime_error if the socket cannot be created. */
+    StreamPublisher(Histograms &set,                    /*!< The histograms to publish. */
+                    const std::string &path,            /*!< Path of the Unix domain socket. */
+                    const Options &options = Options()  /*!< How to publish. */);
+
+    //! Close all connections and remove the socket file.
+    ~StreamPublisher();
+
+    StreamPublisher(const StreamPublisher &) = delete;
+    StreamPublisher &operator=(const StreamPublisher &) = delete;
+
+    //! Runs the step of an update that reads the histograms, e.g. while holding their mutexes.
+    typedef std::function<void(const std::function<void()> &)> guard_t;
+
+    //! Accept new clients, read their subscriptions and send each client an update.
+    /*! Call on each update interval. The histograms are only read while copying their bins,
+     *  which is run through the guard if one is given, so that the histograms are not filled
+     *  while they are copied (see ThreadSafeHistograms::Publish). The changes are found and
+     *  sent after the guard returns. Never blocks on a client.
+     */
+    void Publish(ThreadPool &pool = ThreadPool::Default(), /*!< The pool to copy and find changes on. */
+                 const guard_t &guard = guard_t()         /*!< Runs the copy of the bins. */);
+
+    //! Get the number of connected clients.
+    [[nodiscard]] size_t GetClientCount() const { return clients.size(); }
+
+    //! Get the sequence number of the last update.
+    [[nodiscard]] uint64_t GetSequence() const { return sequence; }
+
+    //! Get the number of bytes queued for all clients by the last update.
+    [[nodiscard]] size_t GetLastSize() const { return last_size; }
+
+private:
+    //! Key of a histogram: dimensions and name.
+    typedef std::pair<int, std::string> key_t;
+
+    //! A connected client.
+    struct client_t {
+        int fd = -1;                    /*!< The connection.                            */
+        bool all = false;               /*!< Subscribed to all histograms.              */
+        std::set<std::string> names;    /*!< Subscribed names, if not all.              */
+        std::set<key_t> synced;         /*!< Histograms the client has a copy of.       */
+        std::string in;                 /*!< Received bytes not yet parsed.             */
+        std::string out;                /*!< Bytes not yet sent.                        */
+    };
+
+    //! What synced clients have of a histogram.
+    struct snapshot_t {
+        std::vector<size_t> bins;       /*!< The bins as of the last update.            */
+        uint64_t entries = 0;           /*!< The entry count as of the last update.     */
+    };
+
+    //! Accept waiting clients.
+    void Accept();
+
+    //! Read and parse the messages from a client. Returns false if the connection is closed.
+    bool Receive(client_t &client);
+
+    //! Send queued bytes to a client. Returns false if the connection is broken.
+    static bool Send(client_t &client);
+
+    //! The histograms to publish.
+    Histograms &set;
+
+    //! Path of the socket.
+    const std::string path;
+
+    //! How to publish.
+    const Options options;
+
+    //! The listening socket.
+    int listener;
+
+    //! The connected clients.
+    std::vector<std::unique_ptr<client_t>> clients;
+
+    //! What synced clients have of each subscribed histogram.
+    std::map<key_t, snapshot_t> snapshots;
+
+    //! Sequence number of the last update.
+    uint64_t sequence;
+
+    //! Bytes queued by the last update.
+    size_t last_size;
+};
+
+//! Receives updates from a StreamPublisher and reconstructs the histograms.
+class StreamClient {
+public:
+    //! Connect to a publisher. Throws std::runtime_error if the connection fails.
+    explicit StreamClient(const std::string &path /*!< Path of the publisher's socket. */);
+
+    //! Close the connection.
+    ~StreamClient();
+
+    StreamClient(const StreamClient &) = delete;
+    StreamClient &operator=(const StreamClient &) = delete;
+
+    //! Subscribe to histograms by name, replacing the previous subscription.
+    /*! An empty list subscribes to all histograms. Names that do not exist yet are
+     *  sent once the histogram is created. Throws std::runtime_error if sending fails.
+     */
+    void Subscribe(const std::vector<std::string> &names = {} /*!< Names of the histograms. */);
+
+    //! Wait for updates and apply them.
+    /*! Waits at most timeout milliseconds for data, then applies all complete updates.
+     *  Throws std::runtime_error if an update cannot be applied, for instance if updates
+     *  were missed without keyframes.
+     *  \return The number of updates applied.
+     */
+    size_t Poll(int timeout = 0 /*!< Milliseconds to wait, negative to wait for an update. */);
+
+    //! Get the reconstructed histograms.
+    [[nodiscard]] Histograms &GetHistograms() { return set; }
+
+    //! Get the sequence number of the last update applied.
+    [[nodiscard]] uint64_t GetSequence() const { return sequence; }
+
+    //! Check if the publisher is still connected.
+    [[nodiscard]] bool IsConnected() const { return fd >= 0; }
+
+private:
+    //! Apply an update message.
+    void Apply(const char *payload, size_t size);
+
+    //! The connection.
+    int fd;
+
+    //! Received bytes not yet applied.
+    std::string in;
+
+    //! The reconstructed histograms.
+    Histograms set;
+
+    //! Sequence number of the last update applied.
+    uint64_t sequence;
+};
+
+#endif // STREAM_H
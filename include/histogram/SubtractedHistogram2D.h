@@ -0,0 +1,176 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef SUBTRACTEDHISTOGRAM2D_H
+#define SUBTRACTEDHISTOGRAM2D_H
+
+#include <histogram/Histograms.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+//! A two-dimensional histogram where random coincidences are subtracted while filling.
+/*! Each fill is tagged with the time window it came from. Prompt fills add their weight to the
+ *  bin, random fills subtract their weight times the ratio of the prompt to the random window
+ *  width, so the histogram holds prompt minus random when the run ends, in a single matrix of
+ *  doubles instead of two matrices of counters.
+ *
+ *  The buffered form of a fill is the bin number and the tag packed in 32 bits plus a 32 bit
+ *  weight, so the thread safe adapters (ThreadSafeSubtracted2D) buffer 8 bytes per fill.
+ *
+ *  Create the matrices with Histograms::CreateSubtracted2D, so that they are written, reset and
+ *  merged with the rest of the set.
+ */
+class SubtractedHistogram2D : public Named {
+public:
+  //! The type used to accumulate in each bin.
+  typedef double data_t;
+
+  //! The time window of a fill.
+  enum window_t : uint8_t {
+    prompt = 0, //!< Added with its weight.
+    random = 1  //!< Subtracted with its weight times the ratio.
+  };
+
+  //! A fill with the bin already found: (bin << 1) | window, and the weight.
+  struct buf_t {
+      uint32_t key;
+      uint32_t w;
+      buf_t(uint32_t k, uint32_t ww) : key(k), w(ww) { }
+
+      //! Empty element, for the write-combining cache of the adapters.
+      template<typename V>
+      buf_t(std::initializer_list<V>, uint32_t ww) : key(0), w(ww) { }
+  };
+  typedef std::vector<buf_t> buffer_t;
+
+  //! Construct a 2D histogram. Throws if it has more than 2^31 bins including the overflow bins.
+  SubtractedHistogram2D( const std::string& name,   /*!< The name of the new histogram. */
+                         const std::string& title,  /*!< The title of the new histogram. */
+                         Axis::index_t xchannels,   /*!< The number of regular bins on the x axis. */
+                         Axis::bin_t xleft,         /*!< The lower edge of the lowest bin on the x axis. */
+                         Axis::bin_t xright,        /*!< The upper edge of the highest bin on the x axis. */
+                         const std::string& xtitle, /*!< The title of the x axis. */
+                         Axis::index_t ychannels,   /*!< The number of regular bins on the y axis. */
+                         Axis::bin_t yleft,         /*!< The lower edge of the lowest bin on the y axis. */
+                         Axis::bin_t yright,        /*!< The upper edge of the highest bin on the y axis. */
+                         const std::string& ytitle, /*!< The title of the y axis. */
+                         double ratio,              /*!< Prompt over random window width. */
+                         const std::string& path="" /*!< Path if in directories within root file */);
+
+  //! Find the key of a fill.
+  [[nodiscard]] uint32_t FindKey(Axis::bin_t x,   /*!< The x axis value. */
+                                 Axis::bin_t y,   /*!< The y axis value. */
+                                 window_t window  /*!< The time window. */) const
+  { return uint32_t(( yaxis.FindBin(y)*xaxis.GetBinCountAll() + xaxis.FindBin(x) ) << 1) | window; }
+
+  //! Fill a histogram bin.
+  void Fill(Axis::bin_t x,         /*!< The x axis value. */
+            Axis::bin_t y,         /*!< The y axis value. */
+            window_t window,       /*!< The time window. */
+            Axis::index_t weight=1 /*!< The weight of the fill. */)
+  {
+    Add(FindKey(x, y, window), data_t(weight));
+  }
+
+  //! Directly add a fill with its key already found. Inlined for optimal performance.
+  inline void FillDirect(const buf_t &element)
+  {
+    Add(element.key, element.w);
+  }
+
+  //! Get the contents of a bin.
+  /*! \return The bin content.
+   */
+  [[nodiscard]] data_t GetBinContent(Axis::index_t xbin /*!< The x bin to look at. */,
+                                     Axis::index_t ybin /*!< The y bin to look at. */) const
+  {
+    return ( xbin < xaxis.GetBinCountAll() && ybin < yaxis.GetBinCountAll() )
+        ? data[ybin*xaxis.GetBinCountAll() + xbin] : 0;
+  }
+
+  //! Set the contents of a bin. Bins outside the histogram are ignored.
+  void SetBinContent(Axis::index_t xbin /*!< The x bin to set. */,
+                     Axis::index_t ybin /*!< The y bin to set. */,
+                     data_t c           /*!< The bin content. */)
+  {
+    if ( xbin < xaxis.GetBinCountAll() && ybin < yaxis.GetBinCountAll() )
+      data[ybin*xaxis.GetBinCountAll() + xbin] = c;
+  }
+
+  //! Get the contents of all bins, row by row with the overflow bins.
+  [[nodiscard]] const data_t *GetData() const
+  { return data.data(); }
+
+  //! Get the x axis of the histogram.
+  [[nodiscard]] const Axis& GetAxisX() const
+  { return xaxis; }
+
+  //! Get the y axis of the histogram.
+  [[nodiscard]] const Axis& GetAxisY() const
+  { return yaxis; }
+
+  //! Get the ratio of the prompt to the random window width.
+  [[nodiscard]] double GetRatio() const
+  { return ratio; }
+
+  //! Get the number of entries, prompt and random, in the histogram.
+  [[nodiscard]] int GetEntries() const
+  { return int(entries); }
+
+  //! Add to the entry count of the histogram.
+  inline void AddEntries(size_t n /*!< The number of entries to add. */)
+  { entries += n; }
+
+  //! Add another matrix, scaled.
+  /*! Throws if the binning of the two are different. */
+  void Add(const SubtractedHistogram2Dp &other, /*!< The matrix to add. */
+           data_t scale = 1.0                   /*!< The factor to multiply the other matrix with. */);
+
+  //! Clear all bins of the histogram.
+  void Reset();
+
+private:
+  //! Add a weighted fill to the bin of a key.
+  inline void Add(uint32_t key, data_t w)
+  {
+    data[key >> 1] += ( key & 1 ) ? -ratio*w : w;
+    entries += 1;
+  }
+
+  //! The x axis of the histogram.
+  const Axis xaxis;
+
+  //! The y axis of the histogram.
+  const Axis yaxis;
+
+  //! Weight of random fills relative to prompt fills.
+  const double ratio;
+
+  //! The number of entries in the histogram.
+  size_t entries;
+
+  //! The bin contents, including the overflow bins.
+  std::vector<data_t> data;
+};
+
+#endif // SUBTRACTEDHISTOGRAM2D_H
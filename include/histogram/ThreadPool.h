@@ -0,0 +1,119 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Work stealing thread pool used by all parallel operations of the library.
+ *
+ * Each worker has its own task queue. Tasks submitted from a worker go to the
+ * back of its own queue and are taken LIFO by the owner, while idle workers steal
+ * from the front of the other queues. Tasks submitted from outside are spread
+ * round-robin over the workers.
+ *
+ * Library functions that run in parallel take a ThreadPool& that defaults to
+ * ThreadPool::Default(). An application that already runs its own threads can
+ * limit the library by creating a pool of the size it wants (optionally pinned to
+ * a set of CPUs) and either passing it explicitly or installing it with
+ * ThreadPool::SetDefault().
+ */
+class ThreadPool
+{
+public:
+    //! A unit of work.
+    typedef std::function<void()> task_t;
+
+    //! Body of a parallel loop, called with a half open range [first, last).
+    typedef std::function<void(size_t first, size_t last)> range_body_t;
+
+    //! Start a pool.
+    explicit ThreadPool(unsigned threads = 0,              /*!< Number of workers, 0 means one per hardware thread. */
+                        const std::vector<int> &cpus = {}  /*!< CPUs to pin workers to (round-robin), empty for no pinning. */);
+
+    //! Finish all pending tasks and stop the workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    //! Schedule a task. The task must not throw.
+    void Submit(task_t task);
+
+    //! Run body over [begin, end) split into chunks of at least grain elements.
+    /*! The calling thread takes part in the work, so this may be called from
+     *  within a task running on the pool. Returns when all chunks are done and
+     *  rethrows the first exception thrown by the body.
+     */
+    void ParallelFor(size_t begin, size_t end, const range_body_t &body, size_t grain = 1);
+
+    //! Get the number of worker threads.
+    [[nodiscard]] unsigned GetThreadCount() const
+    { return unsigned(workers.size()); }
+
+    //! Get the pool used by the library when no pool is given.
+    /*! Unless a pool has been installed with SetDefault, a pool is created on first
+     *  use with the number of threads given by the environment variable
+     *  HISTOGRAM_THREADS, or one per hardware thread.
+     */
+    static ThreadPool &Default();
+
+    //! Install the pool to be returned by Default(). Pass nullptr to restore the built in pool.
+    /*! The pool must outlive its use as the default pool.
+     */
+    static void SetDefault(ThreadPool *pool);
+
+private:
+    struct worker_t {
+        std::mutex mutex;
+        std::deque<task_t> tasks;
+        std::thread thread;
+    };
+
+    //! Take a task from the back of the worker's own queue.
+    bool pop(size_t index, task_t &task);
+
+    //! Take a task from the front of another worker's queue.
+    bool steal(size_t index, task_t &task);
+
+    //! Main loop of a worker.
+    void run(size_t index);
+
+    std::vector<std::unique_ptr<worker_t>> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending;
+    std::atomic<size_t> next_worker;
+    bool stop;
+};
+
+#endif // THREADPOOL_H
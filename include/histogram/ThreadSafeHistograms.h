@@ -30,6 +30,10 @@
 #include <histogram/Histogram1D.h>
 #include <histogram/Histogram2D.h>
 #include <histogram/Histogram3D.h>
+#include <histogram/SubtractedHistogram2D.h>
+#include <histogram/Checkpoint.h>
+#include <histogram/Stream.h>
+#include <histogram/Trace.h>
 
 /*!
  * Thread safe histograms are histograms where the underlying memory for the histogram are stored thread safely.
@@ -37,109 +41,652 @@
  * the min flush size the adapter class will try to lock a mutex, if failed it will continue filling the buffer
  * until the size is larger than the max flush size. Once this has been reached the adapter will wait until the
  * mutex is released and then flush its buffer.
+ * Optionally an adapter combines repeated fills into the same bin in a small direct-mapped cache before they
+ * reach the buffer (see ThreadSafeHistogram::SetCacheSize).
+ * Optionally an overload policy can be set, where fills are sampled with a prescale while the buffer is above a
+ * high watermark and the mutex is busy (see ThreadSafeHistogramDetails::overload_policy_t).
+ * The set can be checkpointed to a file together with an input offset and restored after a restart
+ * (see ThreadSafeHistograms::WriteCheckpoint).
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <string>
 #include <map>
+#include <thread>
 #include <vector>
 #include <mutex>
 #include <exception>
 #include <stdexcept>
 
 namespace ThreadSafeHistogramDetails {
+
+    /*!
+     * Opt-in policy for overload. When the buffer of an adapter has grown past the high
+     * watermark and the histogram mutex is still busy, the adapter starts sampling: each
+     * fill is kept with probability 1/prescale and counts as prescale entries with its weight
+     * multiplied by prescale, so both the spectra and the entry counts stay unbiased while the
+     * buffer grows prescale times slower. Sampling stops as soon as the adapter manages to flush.
+     * A sampling adapter does not block at the max buffer size. Instead the prescale is doubled
+     * each time the buffer grows by another eighth of the max buffer size, so the buffer only
+     * grows with the logarithm of the number of fills while the mutex stays busy.
+     */
+    struct overload_policy_t
+    {
+        //! Buffer size from which fills are sampled while the mutex is busy. 0 disables sampling.
+        size_t high_watermark = 0;
+
+        //! While sampling, one in prescale fills is kept with its weight multiplied by prescale.
+        size_t prescale = 8;
+    };
+
+    //! Fills affected by the overload policy.
+    struct overload_stats_t
+    {
+        //! Fills kept while sampling (counted as prescale entries, with weight multiplied by the prescale).
+        size_t sampled = 0;
+
+        //! Fills dropped while sampling.
+        size_t shed = 0;
+
+        //! The largest prescale applied while sampling, or 0 if the fills were never sampled.
+        size_t prescale = 0;
+    };
+
+    /*!
+     * Who is touching the buffer of an adapter. The filling thread holds the adapter for the duration of
+     * each fill, and a checkpoint claims it the same way to flush it. So the adapter of an idle thread
+     * can be flushed without waiting for that thread, and a busy adapter is flushed between two fills.
+     */
+    struct adapter_control
+    {
+        //! True while a fill or a checkpoint holds the adapter.
+        std::atomic<bool> busy;
+
+        //! Set by a checkpoint to ask the filling thread to flush on its next fill.
+        std::atomic<bool> flush_requested;
+
+        adapter_control() : busy( false ), flush_requested( false ) {}
+
+        //! Take over the control of an adapter that is being moved. Both are held until released.
+        explicit adapter_control(adapter_control &other) : busy( true ), flush_requested( false )
+        {
+            other.enter();
+        }
+
+        //! Hold the adapter, waiting while a checkpoint flushes it.
+        inline void enter()
+        {
+            bool expected = false;
+            if ( !busy.compare_exchange_weak(expected, true, std::memory_order_acquire, std::memory_order_relaxed) )
+                wait();
+        }
+
+        //! Slow path of enter().
+        void wait()
+        {
+            while ( !try_enter() )
+                std::this_thread::yield();
+        }
+
+        //! Hold the adapter if nobody else does.
+        /*! \return true if the adapter is now held.
+         */
+        bool try_enter()
+        {
+            bool expected = false;
+            return busy.compare_exchange_strong(expected, true, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        //! Release the adapter.
+        inline void leave()
+        {
+            busy.store(false, std::memory_order_release);
+        }
+    };
+
+    //! Holds an adapter for the duration of a fill. Does nothing for adapters outside a set.
+    class hold_t
+    {
+    private:
+        adapter_control *control;
+
+    public:
+        explicit hold_t(adapter_control *_control) : control( _control )
+        {
+            if ( control )
+                control->enter();
+        }
+
+        ~hold_t()
+        {
+            if ( control )
+                control->leave();
+        }
+
+        hold_t(const hold_t &) = delete;
+        hold_t &operator=(const hold_t &) = delete;
+    };
+
+    /*!
+     * The live adapters of a set, so that their buffers can be flushed for a checkpoint.
+     * Adapters register themselves on construction and deregister on destruction.
+     */
+    struct adapter_registry
+    {
+        //! A registered adapter.
+        struct entry_t {
+            adapter_control *control;       /*!< Who holds the adapter. */
+            std::function<void()> flush;    /*!< Flushes the adapter, only called while holding it. */
+        };
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::map<const void *, entry_t> adapters;
+
+        void add(const void *adapter, adapter_control *control, std::function<void()> flush)
+        {
+            std::lock_guard lock(mutex);
+            adapters[adapter] = {control, std::move(flush)};
+        }
+
+        void remove(const void *adapter)
+        {
+            std::lock_guard lock(mutex);
+            adapters.erase(adapter);
+            condition.notify_all();
+        }
+
+        //! Replace a moved adapter, keeping a pending flush request.
+        void move(const void *from, const void *to, adapter_control *control, std::function<void()> flush)
+        {
+            std::lock_guard lock(mutex);
+            auto it = adapters.find(from);
+            if ( it != adapters.end() ){
+                control->flush_requested = it->second.control->flush_requested.load();
+                adapters.erase(it);
+            }
+            adapters[to] = {control, std::move(flush)};
+        }
+
+        //! Called by the filling thread when it has flushed after a request.
+        void acknowledge(adapter_control &control)
+        {
+            std::lock_guard lock(mutex);
+            control.flush_requested = false;
+            condition.notify_all();
+        }
+
+        //! Flush all live adapters.
+        /*!
+         * Adapters that are not being filled are held and flushed directly. The others are asked to
+         * flush on their next fill. Those that have not done so within a millisecond, e.g. because
+         * their thread went idle, are held and flushed directly once their fill is done. Never waits
+         * for a thread to fill again.
+         */
+        void flush_all()
+        {
+            std::unique_lock lock(mutex);
+            for ( auto &adapter : adapters ){
+                if ( !flush_held(adapter.second) )
+                    adapter.second.control->flush_requested = true;
+            }
+            while ( !condition.wait_for(lock, std::chrono::milliseconds(1), [this](){ return flushed(); }) ){
+                for ( auto &adapter : adapters ){
+                    if ( adapter.second.control->flush_requested )
+                        flush_held(adapter.second);
+                }
+            }
+        }
+
+    private:
+        //! Flush an adapter if it can be held. Must hold the mutex.
+        /*! \return true if the adapter was flushed.
+         */
+        static bool flush_held(entry_t &entry)
+        {
+            if ( !entry.control->try_enter() )
+                return false;
+            entry.flush();
+            entry.control->flush_requested = false;
+            entry.control->leave();
+            return true;
+        }
+
+        //! Check if all requested flushes are done. Must hold the mutex.
+        [[nodiscard]] bool flushed() const
+        {
+            return std::none_of(adapters.begin(), adapters.end(), [](const auto &adapter){
+                return adapter.second.control->flush_requested.load();
+            });
+        }
+    };
+
     template<typename H>
     struct protected_object
     {
         std::mutex mutex;
         H object;
-        protected_object(H _object) : mutex(), object(_object) {}
+        overload_stats_t stats;
+        protected_object(H _object) : mutex(), object(_object), stats() {}
     };
 }
 
 template<typename T>
 class ThreadSafeHistogram
 {
+public:
+    typedef ThreadSafeHistogramDetails::overload_policy_t overload_policy_t;
+    typedef ThreadSafeHistogramDetails::overload_stats_t overload_stats_t;
+
 private:
+    //! Who is touching the buffer, for checkpoints in other threads.
+    ThreadSafeHistogramDetails::adapter_control control;
+
     std::mutex &mutex;
     T *histogram;
 
     const size_t min_buffer;
     const size_t max_buffer;
+
+    //! Overload policy of this adapter.
+    overload_policy_t policy;
+
+    //! Shared statistics of the histogram, updated when flushing. May be null.
+    overload_stats_t *shared_stats;
+
+    //! Statistics of this adapter, and the part of it not yet added to the shared statistics.
+    overload_stats_t stats, unreported;
+
+    //! True while fills are being sampled.
+    bool overloaded;
+
+    //! The current prescale while sampling. Starts at the prescale of the policy.
+    size_t prescale;
+
+    //! Number of buffered entries at which the prescale is doubled next while sampling.
+    size_t escalation;
+
+    //! State of the xorshift generator used for sampling.
+    uint64_t random_state;
+
+    //! Marks an empty slot in the write-combining cache.
+    static constexpr Axis::index_t empty_slot = std::numeric_limits<Axis::index_t>::max();
+
+    //! Bin of each slot in the write-combining cache. Empty if the cache is disabled.
+    std::vector<Axis::index_t> cache_bins;
+
+    //! The combined fill of each slot in the write-combining cache.
+    typename T::buffer_t cache_elements;
+
+    //! Number of fills combined into each slot in the cache.
+    std::vector<size_t> cache_fills;
+
+    //! Entries combined into evicted cache slots, not yet added to the histogram.
+    size_t combined_entries;
+
+    //! Number of occupied slots in the write-combining cache.
+    size_t cached;
+
+    //! Fills taken since the last flush, whether buffered or combined in the cache.
+    size_t held;
+
+    //! Number of fills, combined or not, from which the adapter tries to flush even with few distinct entries.
+    size_t max_held;
+
+    //! Registry of the set the adapter belongs to. May be null.
+    ThreadSafeHistogramDetails::adapter_registry *registry;
+
 protected:
     typename T::buffer_t buffer;
 
 private:
-    void flush()
+    //! Add the buffer and cache to the histogram. Must hold the mutex.
+    /*! \return The number of buffered entries that were added.
+     */
+    size_t flush()
     {
+        evict_all();
+        const size_t flushed = buffer.size();
+        HISTOGRAM_TRACE(flush_begin, histogram->GetName(), flushed);
         for ( auto &element : buffer ){
             histogram->FillDirect(element);
         }
         buffer.clear();
+        histogram->AddEntries(combined_entries);
+        combined_entries = 0;
+        held = 0;
+        if ( shared_stats ){
+            shared_stats->sampled += unreported.sampled;
+            shared_stats->shed += unreported.shed;
+            shared_stats->prescale = std::max(shared_stats->prescale, unreported.prescale);
+        }
+        unreported = overload_stats_t();
+        overloaded = false;
+        HISTOGRAM_TRACE(flush_end, histogram->GetName(), histogram->GetEntries());
+        return flushed;
     }
 
-    void try_flush()
+    bool try_flush()
     {
         if ( mutex.try_lock() ){
-            flush();
+            HISTOGRAM_TRACE(lock_acquire, histogram->GetName(), buffer.size());
+            [[maybe_unused]] const size_t flushed = flush();
             mutex.unlock();
+            HISTOGRAM_TRACE(lock_release, histogram->GetName(), flushed);
+            return true;
+        }
+        return false;
+    }
+
+    //! Flush, waiting for the mutex.
+    void locked_flush()
+    {
+        HISTOGRAM_TRACE(lock_wait, histogram->GetName(), buffer.size());
+        [[maybe_unused]] size_t flushed;
+        {
+            std::lock_guard lock(mutex);
+            HISTOGRAM_TRACE(lock_acquire, histogram->GetName(), buffer.size());
+            flushed = flush();
+        }
+        HISTOGRAM_TRACE(lock_release, histogram->GetName(), flushed);
+    }
+
+    //! Move a cache slot to the buffer.
+    inline void evict(const size_t &slot)
+    {
+        buffer.push_back(cache_elements[slot]);
+        combined_entries += cache_fills[slot] - 1;
+        cache_bins[slot] = empty_slot;
+        --cached;
+    }
+
+    //! Move all cache slots to the buffer.
+    void evict_all()
+    {
+        for ( size_t slot = 0 ; slot < cache_bins.size() ; ++slot ){
+            if ( cache_bins[slot] != empty_slot )
+                evict(slot);
+        }
+    }
+
+    //! Slow path of sample(), only taken while overloaded.
+    bool sample_overloaded(Axis::index_t &weight)
+    {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        if ( random_state % prescale != 0 ){
+            ++stats.shed;
+            ++unreported.shed;
+            return false;
         }
+        ++stats.sampled;
+        ++unreported.sampled;
+        combined_entries += prescale - 1;
+        weight *= prescale;
+        return true;
+    }
+
+    //! Start sampling with the prescale of the policy.
+    void start_sampling()
+    {
+        overloaded = true;
+        prescale = policy.prescale;
+        escalation = max_buffer;
+        stats.prescale = std::max(stats.prescale, prescale);
+        unreported.prescale = std::max(unreported.prescale, prescale);
+    }
+
+    //! Called instead of blocking when the max buffer size is reached while sampling.
+    void escalate_sampling()
+    {
+        if ( try_flush() || buffer.size() + cached < escalation || prescale >= max_prescale )
+            return;
+        prescale *= 2;
+        escalation += std::max(max_buffer / 8, size_t(1));
+        stats.prescale = std::max(stats.prescale, prescale);
+        unreported.prescale = std::max(unreported.prescale, prescale);
     }
 
+    //! The prescale is not doubled beyond this, so that the weights cannot overflow.
+    static constexpr size_t max_prescale = size_t(1) << 24;
+
 protected:
+    //! Hold the adapter for a fill. Must be taken before anything else on each fill.
+    [[nodiscard]] inline ThreadSafeHistogramDetails::hold_t enter()
+    {
+        return ThreadSafeHistogramDetails::hold_t( registry ? &control : nullptr );
+    }
+
+    //! Flush when enough distinct entries are buffered, or when a checkpoint asked for it.
+    /*!
+     * The buffer sizes count distinct entries, that is buffered fills and occupied cache slots, so fills
+     * combined in the cache do not make the adapter lock more often. The combined fills are instead
+     * bounded by the max held fills (see SetCacheSize), from which the adapter tries to flush.
+     */
     inline void check_buffer()
     {
-        if ( buffer.size() < min_buffer )
+        const size_t pending = buffer.size() + cached;
+        if ( control.flush_requested.load(std::memory_order_relaxed) ){
+            locked_flush();
+            registry->acknowledge(control);
+        } else if ( pending < min_buffer && held < max_held )
             return;
-        else if ( buffer.size() < max_buffer )
-            try_flush();
+        else if ( pending < max_buffer ){
+            if ( !try_flush() && !overloaded && policy.high_watermark > 0 && pending >= policy.high_watermark &&
+                 policy.prescale > 1 )
+                start_sampling();
+        } else if ( overloaded )
+            escalate_sampling();
         else
-            force_flush();
+            locked_flush();
+    }
+
+    //! Apply the overload policy to a fill.
+    /*! \return false if the fill is to be dropped. The weight is scaled if the fill is kept while sampling.
+     */
+    inline bool sample(Axis::index_t &weight)
+    {
+        return !overloaded || sample_overloaded(weight);
+    }
+
+    //! Add a fill to the adapter.
+    /*!
+     * With the write-combining cache enabled, the fill is added to the weight of the cache slot of
+     * its bin if that slot already holds the same bin and the weight does not overflow. Otherwise
+     * the slot is evicted to the buffer and replaced by the fill. A flush empties the cache.
+     * \param element The fill.
+     * \param find_bin Callable returning the global bin of the fill given the histogram.
+     */
+    template<typename F>
+    inline void push(const typename T::buf_t &element, F find_bin)
+    {
+        ++held;
+        if ( cache_bins.empty() ){
+            buffer.push_back(element);
+            check_buffer();
+            return;
+        }
+        typedef decltype(element.w) weight_t;
+        const Axis::index_t bin = find_bin(*histogram);
+        const size_t slot = bin & ( cache_bins.size() - 1 );
+        if ( cache_bins[slot] == bin && cache_elements[slot].w <= std::numeric_limits<weight_t>::max() - element.w ){
+            cache_elements[slot].w += element.w;
+            ++cache_fills[slot];
+        } else {
+            if ( cache_bins[slot] != empty_slot )
+                evict(slot);
+            cache_bins[slot] = bin;
+            cache_elements[slot] = element;
+            cache_fills[slot] = 1;
+            ++cached;
+        }
+        check_buffer();
+    }
+
+    //! Apply a fill that cannot be buffered directly to the histogram, waiting for the mutex.
+    template<typename F>
+    void fill_locked(F fill)
+    {
+        HISTOGRAM_TRACE(lock_wait, histogram->GetName(), buffer.size());
+        std::lock_guard lock(mutex);
+        fill(*histogram);
     }
 
 public:
     ThreadSafeHistogram(std::mutex &_mutex, T *_histogram,
-                        const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384)
-        : mutex( _mutex )
+                        const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384,
+                        const overload_policy_t &_policy = overload_policy_t(),
+                        overload_stats_t *_shared_stats = nullptr,
+                        ThreadSafeHistogramDetails::adapter_registry *_registry = nullptr)
+        : control()
+        , mutex( _mutex )
         , histogram( _histogram )
         , min_buffer( _min_buffer )
         , max_buffer( _max_buffer )
+        , policy( _policy )
+        , shared_stats( _shared_stats )
+        , stats()
+        , unreported()
+        , overloaded( false )
+        , prescale( 1 )
+        , escalation( 0 )
+        , random_state( reinterpret_cast<uintptr_t>(this) | 1 )
+        , cache_bins()
+        , cache_elements()
+        , cache_fills()
+        , combined_entries( 0 )
+        , cached( 0 )
+        , held( 0 )
+        , max_held( std::numeric_limits<size_t>::max() )
+        , registry( _registry )
     {
         buffer.reserve( max_buffer );
+        if ( registry )
+            registry->add(this, &control, [this](){ locked_flush(); });
     }
 
     ThreadSafeHistogram(ThreadSafeHistogram &&other)
-        : mutex( other.mutex )
+        : control( other.control )
+        , mutex( other.mutex )
         , histogram( other.histogram )
         , min_buffer( other.min_buffer )
         , max_buffer( other.max_buffer )
+        , policy( other.policy )
+        , shared_stats( other.shared_stats )
+        , stats( other.stats )
+        , unreported( other.unreported )
+        , overloaded( other.overloaded )
+        , prescale( other.prescale )
+        , escalation( other.escalation )
+        , random_state( other.random_state )
+        , cache_bins( std::move(other.cache_bins) )
+        , cache_elements( std::move(other.cache_elements) )
+        , cache_fills( std::move(other.cache_fills) )
+        , combined_entries( other.combined_entries )
+        , cached( other.cached )
+        , held( other.held )
+        , max_held( other.max_held )
+        , registry( other.registry )
         , buffer( std::move(other.buffer) )
     {
+        other.unreported = overload_stats_t();
+        other.cache_bins.clear();
+        other.combined_entries = 0;
+        other.cached = 0;
+        other.held = 0;
+        if ( registry ){
+            registry->move(&other, this, &control, [this](){ locked_flush(); });
+            other.registry = nullptr;
+        }
+        other.control.leave();
+        control.leave();
     }
 
     ~ThreadSafeHistogram()
     {
-        force_flush();
+        {
+            const auto hold = enter();
+            locked_flush();
+        }
+        if ( registry )
+            registry->remove(this);
     }
 
     void force_flush()
     {
-        std::lock_guard lock(mutex);
-        flush();
+        const auto hold = enter();
+        locked_flush();
+    }
+
+    //! Set the number of slots in the write-combining cache.
+    /*!
+     * The cache is disabled by default. The size is rounded up to a power of two. Fills into the same
+     * bin as a cached fill are combined with it instead of being added to the buffer, so peaked spectra
+     * take fewer buffer entries, fewer histogram updates per flush and fewer flushes. Set to 0 to disable.
+     * Cached fills are moved to the buffer on eviction and on every flush.
+     */
+    void SetCacheSize(const size_t &size,            /*!< The number of slots. */
+                      const size_t &_max_held = 0    /*!< Fills from which the adapter tries to flush, 0 for 16 times the max buffer size. */)
+    {
+        const auto hold = enter();
+        evict_all();
+        size_t slots = ( size > 0 ) ? 1 : 0;
+        while ( slots < size )
+            slots <<= 1;
+        buffer.reserve( max_buffer + slots );
+        cache_bins.assign(slots, empty_slot);
+        cache_elements.assign(slots, typename T::buf_t({0., 0., 0.}, 0));
+        cache_fills.assign(slots, 0);
+        if ( slots == 0 )
+            max_held = std::numeric_limits<size_t>::max();
+        else
+            max_held = ( _max_held > 0 ) ? _max_held : 16 * max_buffer;
     }
 
+    //! Get the number of slots in the write-combining cache.
+    [[nodiscard]] size_t GetCacheSize() const { return cache_bins.size(); }
+
+    //! Set the overload policy of this adapter.
+    void SetOverloadPolicy(const overload_policy_t &_policy){ policy = _policy; }
+
+    //! Get the overload policy of this adapter.
+    [[nodiscard]] const overload_policy_t &GetOverloadPolicy() const { return policy; }
+
+    //! Check if the adapter is currently sampling fills.
+    [[nodiscard]] bool IsOverloaded() const { return overloaded; }
+
+    //! Get the current prescale, one in which fills is kept. 1 while not sampling.
+    [[nodiscard]] size_t GetPrescale() const { return overloaded ? prescale : 1; }
+
+    //! Get the number of fills sampled and shed by this adapter.
+    [[nodiscard]] const overload_stats_t &GetOverloadStats() const { return stats; }
+
 };
 
 class ThreadSafeHistogram1D : public ThreadSafeHistogram<Histogram1D>
 {
 public:
     ThreadSafeHistogram1D(std::mutex &_mutex, Histogram1D *_histogram,
-                          const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384)
-        : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer ){}
+                          const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384,
+                          const overload_policy_t &_policy = overload_policy_t(),
+                          overload_stats_t *_shared_stats = nullptr,
+                          ThreadSafeHistogramDetails::adapter_registry *_registry = nullptr)
+        : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer, _policy, _shared_stats, _registry ){}
 
     void Fill(const Axis::bin_t &x, const Axis::index_t &n = 1)
     {
-        buffer.push_back({x, n});
-        check_buffer();
+        const auto hold = enter();
+        Axis::index_t w = n;
+        if ( !sample(w) )
+            return;
+        push({x, w}, [&x](const Histogram1D &h){ return h.GetAxisX().FindBin(x); });
     }
 };
 
@@ -148,13 +695,21 @@ class ThreadSafeHistogram2D : public ThreadSafeHistogram<Histogram2D>
 public:
 
     ThreadSafeHistogram2D(std::mutex &_mutex, Histogram2D *_histogram,
-                          const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384)
-            : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer ){}
+                          const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384,
+                          const overload_policy_t &_policy = overload_policy_t(),
+                          overload_stats_t *_shared_stats = nullptr,
+                          ThreadSafeHistogramDetails::adapter_registry *_registry = nullptr)
+        : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer, _policy, _shared_stats, _registry ){}
 
     void Fill(const Axis::bin_t &x, const Axis::bin_t &y, const Axis::index_t &n = 1)
     {
-        buffer.push_back({x, y, n});
-        check_buffer();
+        const auto hold = enter();
+        Axis::index_t w = n;
+        if ( !sample(w) )
+            return;
+        push({x, y, w}, [&x, &y](const Histogram2D &h){
+            return h.GetAxisX().GetBinCountAll()*h.GetAxisY().FindBin(y) + h.GetAxisX().FindBin(x);
+        });
     }
 
 };
@@ -163,14 +718,191 @@ class ThreadSafeHistogram3D : public ThreadSafeHistogram<Histogram3D>
 {
 public:
     ThreadSafeHistogram3D(std::mutex &_mutex, Histogram3D *_histogram,
-                          const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384)
-            : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer ){}
+                          const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384,
+                          const overload_policy_t &_policy = overload_policy_t(),
+                          overload_stats_t *_shared_stats = nullptr,
+                          ThreadSafeHistogramDetails::adapter_registry *_registry = nullptr)
+        : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer, _policy, _shared_stats, _registry ){}
 
     void Fill(const Axis::bin_t &x, const Axis::bin_t &y,  const Axis::bin_t &z, const Axis::index_t &n = 1)
     {
-        buffer.push_back({x, y, z, n});
-        check_buffer();
+        const auto hold = enter();
+        Axis::index_t w = n;
+        if ( !sample(w) )
+            return;
+        push({x, y, z, w}, [&x, &y, &z](const Histogram3D &h){
+            return h.GetAxisX().GetBinCountAll()*(h.GetAxisY().GetBinCountAll()*h.GetAxisZ().FindBin(z) +
+                                                  h.GetAxisY().FindBin(y)) + h.GetAxisX().FindBin(x);
+        });
+    }
+};
+
+/*!
+ * Adapter for prompt-minus-random matrices. The bin is found when filling, so each buffered fill
+ * is only the packed bin and window tag plus the weight (8 bytes). With the write-combining cache
+ * enabled, fills of the same bin and window are combined. Weights that do not fit in 32 bits are
+ * added directly under the mutex.
+ */
+class ThreadSafeSubtracted2D : public ThreadSafeHistogram<SubtractedHistogram2D>
+{
+public:
+    typedef SubtractedHistogram2D::window_t window_t;
+
+    ThreadSafeSubtracted2D(std::mutex &_mutex, SubtractedHistogram2D *_histogram,
+                           const size_t &_min_buffer = 1024, const size_t &_max_buffer = 16384,
+                           const overload_policy_t &_policy = overload_policy_t(),
+                           overload_stats_t *_shared_stats = nullptr,
+                           ThreadSafeHistogramDetails::adapter_registry *_registry = nullptr)
+        : ThreadSafeHistogram( _mutex, _histogram, _min_buffer, _max_buffer, _policy, _shared_stats, _registry )
+        , xaxis( _histogram->GetAxisX() )
+        , yaxis( _histogram->GetAxisY() ){}
+
+    void Fill(const Axis::bin_t &x, const Axis::bin_t &y, const window_t &window, const Axis::index_t &n = 1)
+    {
+        const auto hold = enter();
+        Axis::index_t w = n;
+        if ( !sample(w) )
+            return;
+        const uint32_t key = uint32_t(( yaxis.FindBin(y)*xaxis.GetBinCountAll() + xaxis.FindBin(x) ) << 1) | window;
+        if ( w > std::numeric_limits<uint32_t>::max() ){
+            // The weight does not fit in a buffered fill.
+            fill_locked([&](SubtractedHistogram2D &h){ h.Fill(x, y, window, w); });
+            return;
+        }
+        push({key, uint32_t(w)}, [key](const SubtractedHistogram2D &){ return Axis::index_t(key); });
     }
+
+private:
+    //! Copies of the histogram axes, to avoid the indirection when finding the bin.
+    const Axis xaxis, yaxis;
+};
+
+/*!
+ * Adapter for small and medium 1D histograms (up to ~16k bins) that counts in a private tally of
+ * 16 bit counters instead of buffering entries. The tally stays in L1/L2 cache, so filling runs at
+ * close to single threaded speed. The tally is added to the shared histogram under the mutex when a
+ * counter is about to saturate, on force_flush() and on destruction.
+ */
+class ThreadSafeTally1D
+{
+public:
+    //! The type of the private counters.
+    typedef uint16_t count_t;
+
+private:
+    //! Who is touching the tally, for checkpoints in other threads.
+    ThreadSafeHistogramDetails::adapter_control control;
+
+    std::mutex &mutex;
+    Histogram1D *histogram;
+
+    //! Copy of the histogram axis, to avoid the indirection when finding the bin.
+    Axis xaxis;
+
+    //! Private counters, including the overflow bins.
+    std::vector<count_t> tally;
+
+    //! Entries in the tally.
+    size_t entries;
+
+    //! Registry of the set the adapter belongs to. May be null.
+    ThreadSafeHistogramDetails::adapter_registry *registry;
+
+    //! Add the tally, and an extra weight to one bin, to the histogram and clear it.
+    void flush(const Axis::index_t &bin, const Histogram1D::data_t &weight)
+    {
+        HISTOGRAM_TRACE(lock_wait, histogram->GetName(), entries);
+        {
+            std::lock_guard lock(mutex);
+            HISTOGRAM_TRACE(lock_acquire, histogram->GetName(), entries);
+            HISTOGRAM_TRACE(flush_begin, histogram->GetName(), entries);
+            for ( size_t i = 0 ; i < tally.size() ; ++i ){
+                if ( tally[i] > 0 )
+                    histogram->AddBinContent(i, tally[i]);
+            }
+            histogram->AddBinContent(bin, weight);
+            histogram->AddEntries(entries);
+            HISTOGRAM_TRACE(flush_end, histogram->GetName(), histogram->GetEntries());
+        }
+        HISTOGRAM_TRACE(lock_release, histogram->GetName(), entries);
+        std::fill(tally.begin(), tally.end(), 0);
+        entries = 0;
+    }
+
+    //! Hold the tally for a fill.
+    [[nodiscard]] inline ThreadSafeHistogramDetails::hold_t enter()
+    {
+        return ThreadSafeHistogramDetails::hold_t( registry ? &control : nullptr );
+    }
+
+public:
+    ThreadSafeTally1D(std::mutex &_mutex, Histogram1D *_histogram,
+                      ThreadSafeHistogramDetails::adapter_registry *_registry = nullptr)
+        : control()
+        , mutex( _mutex )
+        , histogram( _histogram )
+        , xaxis( _histogram->GetAxisX() )
+        , tally( _histogram->GetAxisX().GetBinCountAll(), 0 )
+        , entries( 0 )
+        , registry( _registry )
+    {
+        if ( registry )
+            registry->add(this, &control, [this](){ flush(0, 0); });
+    }
+
+    ThreadSafeTally1D(ThreadSafeTally1D &&other)
+        : control( other.control )
+        , mutex( other.mutex )
+        , histogram( other.histogram )
+        , xaxis( other.xaxis )
+        , tally( std::move(other.tally) )
+        , entries( other.entries )
+        , registry( other.registry )
+    {
+        other.tally.assign(tally.size(), 0);
+        other.entries = 0;
+        if ( registry ){
+            registry->move(&other, this, &control, [this](){ flush(0, 0); });
+            other.registry = nullptr;
+        }
+        other.control.leave();
+        control.leave();
+    }
+
+    ~ThreadSafeTally1D()
+    {
+        {
+            const auto hold = enter();
+            flush(0, 0);
+        }
+        if ( registry )
+            registry->remove(this);
+    }
+
+    void Fill(const Axis::bin_t &x, const Axis::index_t &n = 1)
+    {
+        const auto hold = enter();
+        if ( control.flush_requested.load(std::memory_order_relaxed) ){
+            flush(0, 0);
+            registry->acknowledge(control);
+        }
+        const Axis::index_t bin = xaxis.FindBin(x);
+        count_t &count = tally[bin];
+        if ( n <= Axis::index_t(std::numeric_limits<count_t>::max() - count) ){
+            count += count_t(n);
+            ++entries;
+        } else {
+            ++entries;
+            flush(bin, n);
+        }
+    }
+
+    void force_flush()
+    {
+        const auto hold = enter();
+        flush(0, 0);
+    }
+
 };
 
 class ThreadSafeHistograms
@@ -181,6 +913,8 @@ private:
     const size_t min_buffer;
     const size_t max_buffer;
 
+    ThreadSafeHistogramDetails::overload_policy_t overload_policy;
+
     typedef ThreadSafeHistogramDetails::protected_object<Histogram1Dp>* p1d;
     typedef ThreadSafeHistogramDetails::protected_object<Histogram2Dp>* p2d;
     typedef ThreadSafeHistogramDetails::protected_object<Histogram3Dp>* p3d;
@@ -189,6 +923,12 @@ private:
     std::map<std::string, p2d> map2d;
     std::map<std::string, p3d> map3d;
 
+    typedef ThreadSafeHistogramDetails::protected_object<SubtractedHistogram2Dp>* p2s;
+
+    std::map<std::string, p2s> map2s;
+
+    //! The live adapters of the set.
+    ThreadSafeHistogramDetails::adapter_registry registry;
 
     template<typename T>
     static typename T::value_type::second_type Get(T map, const std::string &name)
@@ -204,25 +944,40 @@ private:
     ThreadSafeHistogram1D Get1D(const std::string &name)
     {
         auto p = Get(map1d, name);
-        return {p->mutex, p->object, min_buffer, max_buffer};
+        return {p->mutex, p->object, min_buffer, max_buffer, overload_policy, &p->stats, &registry};
     }
 
     ThreadSafeHistogram2D Get2D(const std::string &name)
     {
         auto p = Get(map2d, name);
-        return {p->mutex, p->object, min_buffer, max_buffer};
+        return {p->mutex, p->object, min_buffer, max_buffer, overload_policy, &p->stats, &registry};
     }
 
     ThreadSafeHistogram3D Get3D(const std::string &name)
     {
         auto p = Get(map3d, name);
-        return {p->mutex, p->object, min_buffer, max_buffer};
+        return {p->mutex, p->object, min_buffer, max_buffer, overload_policy, &p->stats, &registry};
+    }
+
+    //! Lock the mutexes of all histograms, always in the same order.
+    std::vector<std::unique_lock<std::mutex>> LockAll()
+    {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for ( auto &hist : map1d )
+            locks.emplace_back(hist.second->mutex);
+        for ( auto &hist : map2d )
+            locks.emplace_back(hist.second->mutex);
+        for ( auto &hist : map3d )
+            locks.emplace_back(hist.second->mutex);
+        for ( auto &hist : map2s )
+            locks.emplace_back(hist.second->mutex);
+        return locks;
     }
 
 public:
 
     ThreadSafeHistograms(const size_t &min_buf = 1024, const size_t &max_buf = 16384)
-        : min_buffer( min_buf ), max_buffer( max_buf ){}
+        : min_buffer( min_buf ), max_buffer( max_buf ), overload_policy(){}
 
     ~ThreadSafeHistograms()
     {
@@ -235,6 +990,9 @@ public:
         for ( auto &hist : map3d ){
             delete hist.second;
         }
+        for ( auto &hist : map2s ){
+            delete hist.second;
+        }
     }
 
     ThreadSafeHistogram1D Create1D( const std::string& name,  /*!< The name of the new histogram. */
@@ -242,15 +1000,16 @@ public:
                                     Axis::index_t channels,   /*!< The number of regular bins. */
                                     Axis::bin_t left,         /*!< The lower edge of the lowest bin.  */
                                     Axis::bin_t right,        /*!< The upper edge of the highest bin. */
-                                    const std::string& xtitle /*!< The title of the x axis. */)
+                                    const std::string& xtitle, /*!< The title of the x axis. */
+                                    const std::string& path="" /*!< Path if in directories within root file */)
     {
         try {
             return Get1D(name);
         } catch ( std::out_of_range &e ){
             // The histogram doesn't exist, we will create it now.
-            p1d hist = new ThreadSafeHistogramDetails::protected_object<Histogram1Dp>(histograms.Create1D(name, title, channels, left, right, xtitle));
+            p1d hist = new ThreadSafeHistogramDetails::protected_object<Histogram1Dp>(histograms.Create1D(name, title, channels, left, right, xtitle, path));
             map1d[name] = hist;
-            return {hist->mutex, hist->object};
+            return {hist->mutex, hist->object, min_buffer, max_buffer, overload_policy, &hist->stats, &registry};
         }
     }
 
@@ -264,7 +1023,8 @@ public:
                                     Axis::index_t ychannels,   /*!< The number of regular bins on the y axis. */
                                     Axis::bin_t yleft,         /*!< The lower edge of the lowest bin on the y axis. */
                                     Axis::bin_t yright,        /*!< The upper edge of the highest bin on the y axis. */
-                                    const std::string& ytitle  /*!< The title of the y axis. */)
+                                    const std::string& ytitle, /*!< The title of the y axis. */
+                                    const std::string& path="" /*!< Path if in directories within root file */)
     {
         try {
             return Get2D(name);
@@ -274,9 +1034,9 @@ public:
                     new ThreadSafeHistogramDetails::protected_object<Histogram2Dp>(
                             histograms.Create2D(name, title,
                                                        xchannels, xleft, xright, xtitle,
-                                                       ychannels, yleft, yright, ytitle));
+                                                       ychannels, yleft, yright, ytitle, path));
             map2d[name] = hist;
-            return {hist->mutex, hist->object};
+            return {hist->mutex, hist->object, min_buffer, max_buffer, overload_policy, &hist->stats, &registry};
         }
     }
 
@@ -293,7 +1053,8 @@ public:
                                     Axis::index_t zchannels,   /*!< The number of regular bins on the z axis. */
                                     Axis::bin_t zleft,         /*!< The lower edge of the lowest bin on the z axis. */
                                     Axis::bin_t zright,        /*!< The upper edge of the highest bin on the z axis. */
-                                    const std::string& ztitle  /*!< The title of the z axis. */)
+                                    const std::string& ztitle, /*!< The title of the z axis. */
+                                    const std::string& path="" /*!< Path if in directories within root file */)
     {
         try {
             return Get3D(name);
@@ -303,14 +1064,166 @@ public:
                     histograms.Create3D(name, title,
                                         xchannels, xleft, xright, xtitle,
                                         ychannels, yleft, yright, ytitle,
-                                        zchannels, zleft, zright, ztitle));
+                                        zchannels, zleft, zright, ztitle, path));
             map3d[name] = hist;
-            return {hist->mutex, hist->object};
+            return {hist->mutex, hist->object, min_buffer, max_buffer, overload_policy, &hist->stats, &registry};
+        }
+    }
+
+    //! Get an adapter for a prompt-minus-random matrix, creating the matrix if needed.
+    /*! The ratio is the prompt over the random window width (see Coincidence::Options::GetRandomScale()).
+     */
+    ThreadSafeSubtracted2D CreateSubtracted2D( const std::string& name,   /*!< The name of the new histogram. */
+                                               const std::string& title,  /*!< The title of the new histogram. */
+                                               Axis::index_t xchannels,   /*!< The number of regular bins on the x axis. */
+                                               Axis::bin_t xleft,         /*!< The lower edge of the lowest bin on the x axis. */
+                                               Axis::bin_t xright,        /*!< The upper edge of the highest bin on the x axis. */
+                                               const std::string& xtitle, /*!< The title of the x axis. */
+                                               Axis::index_t ychannels,   /*!< The number of regular bins on the y axis. */
+                                               Axis::bin_t yleft,         /*!< The lower edge of the lowest bin on the y axis. */
+                                               Axis::bin_t yright,        /*!< The upper edge of the highest bin on the y axis. */
+                                               const std::string& ytitle, /*!< The title of the y axis. */
+                                               double ratio,              /*!< Prompt over random window width. */
+                                               const std::string& path="" /*!< Path if in directories within root file */)
+    {
+        auto p = map2s.find(name);
+        p2s hist;
+        if ( p != map2s.end() ){
+            hist = p->second;
+        } else {
+            hist = new ThreadSafeHistogramDetails::protected_object<SubtractedHistogram2Dp>(
+                    histograms.CreateSubtracted2D(name, title,
+                                                  xchannels, xleft, xright, xtitle,
+                                                  ychannels, yleft, yright, ytitle, ratio, path));
+            map2s[name] = hist;
         }
+        return {hist->mutex, hist->object, min_buffer, max_buffer, overload_policy, &hist->stats, &registry};
+    }
+
+    //! Find a prompt-minus-random matrix.
+    /*! \return The matrix, or nullptr if not found.
+     */
+    SubtractedHistogram2Dp FindSubtracted2D(const std::string &name)
+    {
+        auto p = map2s.find(name);
+        return ( p != map2s.end() ) ? p->second->object : nullptr;
+    }
+
+    //! Get a tally adapter for a 1D histogram, creating the histogram if needed.
+    /*! Tally adapters and buffered adapters (Create1D) may be used on the same histogram.
+     */
+    ThreadSafeTally1D CreateTally1D( const std::string& name,  /*!< The name of the new histogram. */
+                                     const std::string& title, /*!< The title of teh new histogram. */
+                                     Axis::index_t channels,   /*!< The number of regular bins. */
+                                     Axis::bin_t left,         /*!< The lower edge of the lowest bin.  */
+                                     Axis::bin_t right,        /*!< The upper edge of the highest bin. */
+                                     const std::string& xtitle, /*!< The title of the x axis. */
+                                     const std::string& path="" /*!< Path if in directories within root file */)
+    {
+        auto p = map1d.find(name);
+        if ( p != map1d.end() )
+            return {p->second->mutex, p->second->object, &registry};
+        p1d hist = new ThreadSafeHistogramDetails::protected_object<Histogram1Dp>(histograms.Create1D(name, title, channels, left, right, xtitle, path));
+        map1d[name] = hist;
+        return {hist->mutex, hist->object, &registry};
     }
 
     Histograms &GetHistograms(){ return histograms; }
 
+    //! Write a checkpoint of the set, including what is still buffered in the adapters.
+    /*!
+     * All live adapters are flushed first. Adapters that are not being filled, including those of idle
+     * threads, are flushed by the calling thread. Adapters in the middle of a fill flush on their next
+     * fill, or are flushed by the calling thread once the fill is done, so the checkpoint never touches
+     * a buffer that is being filled and never waits for a thread to fill again. The bins are then copied
+     * under the histogram mutexes, and encoded and written to the file after the mutexes are released.
+     * Prompt-minus-random matrices (CreateSubtracted2D) are included.
+     */
+    void WriteCheckpoint(Checkpoint &checkpoint,                    /*!< The checkpoint file to write to. */
+                         uint64_t offset,                           /*!< Input offset to resume from. */
+                         ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */)
+    {
+        registry.flush_all();
+        checkpoint.Write(histograms, offset, pool, [this](const std::function<void()> &copy){
+            const auto locks = LockAll();
+            copy();
+        });
+    }
+
+    //! Send the changes since the last call to the clients of a stream publisher.
+    /*!
+     * Like WriteCheckpoint, all live adapters are flushed first, including those of idle threads, so an
+     * update never waits for a thread to fill again. The mutexes are only held while the
+     * publisher copies the bins; the changes are found and sent to the clients after they are released.
+     */
+    void Publish(StreamPublisher &publisher,                /*!< The publisher of this set. */
+                 ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */)
+    {
+        registry.flush_all();
+        publisher.Publish(pool, [this](const std::function<void()> &copy){
+            const auto locks = LockAll();
+            copy();
+        });
+    }
+
+    //! Restore the set from a checkpoint file.
+    /*!
+     * Must be called before any adapters are created. Histograms in the file are created, or
+     * overwritten if they already exist.
+     * 
+     * \return The input offset to resume from, or 0 if there is no checkpoint file.
+     */
+    uint64_t RestoreCheckpoint(const std::string &path /*!< The checkpoint file. */)
+    {
+        const uint64_t offset = Checkpoint::Restore(path, histograms);
+        for ( auto h : histograms.GetAll1D() )
+            if ( map1d.find(h->GetName()) == map1d.end() )
+                map1d[h->GetName()] = new ThreadSafeHistogramDetails::protected_object<Histogram1Dp>(h);
+        for ( auto h : histograms.GetAll2D() )
+            if ( map2d.find(h->GetName()) == map2d.end() )
+                map2d[h->GetName()] = new ThreadSafeHistogramDetails::protected_object<Histogram2Dp>(h);
+        for ( auto h : histograms.GetAll3D() )
+            if ( map3d.find(h->GetName()) == map3d.end() )
+                map3d[h->GetName()] = new ThreadSafeHistogramDetails::protected_object<Histogram3Dp>(h);
+        for ( auto h : histograms.GetAllSubtracted2D() )
+            if ( map2s.find(h->GetName()) == map2s.end() )
+                map2s[h->GetName()] = new ThreadSafeHistogramDetails::protected_object<SubtractedHistogram2Dp>(h);
+        return offset;
+    }
+
+    //! Set the overload policy of adapters created after this call.
+    void SetOverloadPolicy(const ThreadSafeHistogramDetails::overload_policy_t &policy){ overload_policy = policy; }
+
+    //! Get the number of fills sampled and shed for a histogram.
+    /*!
+     * Only includes fills from adapters that have flushed since.
+     * \throws std::out_of_range if the histogram is not defined.
+     */
+    ThreadSafeHistogramDetails::overload_stats_t GetOverloadStats(const std::string &name)
+    {
+        ThreadSafeHistogramDetails::overload_stats_t *stats;
+        std::mutex *mutex;
+        if ( map1d.find(name) != map1d.end() ){
+            auto p = map1d[name];
+            stats = &p->stats;
+            mutex = &p->mutex;
+        } else if ( map2d.find(name) != map2d.end() ){
+            auto p = map2d[name];
+            stats = &p->stats;
+            mutex = &p->mutex;
+        } else if ( map2s.find(name) != map2s.end() ){
+            auto p = map2s[name];
+            stats = &p->stats;
+            mutex = &p->mutex;
+        } else {
+            auto p = Get(map3d, name);
+            stats = &p->stats;
+            mutex = &p->mutex;
+        }
+        std::lock_guard lock(*mutex);
+        return *stats;
+    }
+
 };
 
 
@@ -0,0 +1,110 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef HISTOGRAM_TRACE_H
+#define HISTOGRAM_TRACE_H
+
+#include <cstddef>
+#include <string>
+
+/*!
+ * Static tracepoints around the expensive phases of the library (flushing of
+ * thread safe buffers, lock waits, merging and writing).
+ *
+ * The tracepoints are only compiled in when HISTOGRAM_ENABLE_TRACE is defined
+ * (CMake option HISTOGRAM_ENABLE_TRACE). Otherwise HISTOGRAM_TRACE expands to
+ * nothing and the arguments are never evaluated.
+ *
+ * When enabled, each tracepoint is emitted as a USDT probe in the provider
+ * `histogram` if <sys/sdt.h> is available, so that they can be attached to with
+ * `perf probe sdt_histogram:flush_begin` or `bpftrace -e 'usdt:...:histogram:flush_begin'`.
+ * Each probe takes two arguments, the histogram name (char*) and an entry count.
+ * The name argument to HISTOGRAM_TRACE must be a std::string.
+ * In addition a callback can be installed with HistogramTrace::SetCallback for
+ * in-process tracing.
+ */
+
+namespace HistogramTrace {
+
+    //! The phases that are traced.
+    enum event_t {
+        flush_begin,    //!< A thread safe adapter starts flushing its buffer. Count is the buffer size.
+        flush_end,      //!< A thread safe adapter is done flushing its buffer.
+        lock_wait,      //!< A thread safe adapter is about to block on the histogram mutex. Count is the buffer size.
+        lock_acquire,   //!< A thread safe adapter has acquired the histogram mutex.
+        lock_release,   //!< A thread safe adapter has released the histogram mutex. Count is the entries flushed.
+        merge_begin,    //!< A histogram is about to be merged. Count is the entries to be added.
+        merge_end,      //!< A histogram has been merged. Count is the resulting entries.
+        write_begin,    //!< A histogram is about to be written. Count is the number of entries.
+        write_end       //!< A histogram has been written.
+    };
+
+    //! Signature of the trace callback.
+    typedef void (*callback_t)(event_t event,       /*!< The traced phase.          */
+                               const char *name,    /*!< Name of the histogram.     */
+                               size_t count         /*!< Entry count (see event_t). */);
+
+    //! Install a callback to be called at each tracepoint. Pass nullptr to remove it.
+    /*! Only has an effect when the library is compiled with HISTOGRAM_ENABLE_TRACE.
+     */
+    void SetCallback(callback_t callback);
+
+    //! Get the currently installed callback.
+    callback_t GetCallback();
+
+    //! Dispatch an event to the installed callback, if any.
+    void Emit(event_t event, const char *name, size_t count);
+
+    //! Human readable name of an event.
+    const char *GetEventName(event_t event);
+}
+
+#ifdef HISTOGRAM_ENABLE_TRACE
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HISTOGRAM_HAVE_USDT 1
+#endif // __has_include(<sys/sdt.h>)
+#endif // defined(__has_include)
+
+#ifdef HISTOGRAM_HAVE_USDT
+#define HISTOGRAM_TRACE_USDT(event, name, count) DTRACE_PROBE2(histogram, event, name, count)
+#else
+#define HISTOGRAM_TRACE_USDT(event, name, count) do {} while (0)
+#endif // HISTOGRAM_HAVE_USDT
+
+#define HISTOGRAM_TRACE(event, name, count)                                                    \
+    do {                                                                                       \
+        const std::string &histogram_trace_name_ = (name);                                     \
+        const size_t histogram_trace_count_ = static_cast<size_t>(count);                      \
+        HISTOGRAM_TRACE_USDT(event, histogram_trace_name_.c_str(), histogram_trace_count_);    \
+        HistogramTrace::Emit(HistogramTrace::event, histogram_trace_name_.c_str(),             \
+                             histogram_trace_count_);                                          \
+    } while (0)
+
+#else
+
+#define HISTOGRAM_TRACE(event, name, count) do {} while (0)
+
+#endif // HISTOGRAM_ENABLE_TRACE
+
+#endif // HISTOGRAM_TRACE_H
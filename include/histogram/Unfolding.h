@@ -0,0 +1,97 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef UNFOLDING_H
+#define UNFOLDING_H
+
+#include <histogram/Histograms.h>
+#include <histogram/ThreadPool.h>
+
+#include <string>
+#include <vector>
+
+/*!
+ * \class Unfolding
+ * \brief Iterative unfolding of all rows of a 2D histogram with a detector response matrix.
+ * \details Each row of the histogram (for instance the gamma spectrum for one excitation energy
+ * bin) is unfolded with the folding iteration method:
+ * u_0 = r, f_i = R u_i and u_{i+1} = u_i + (r - f_i), where r is the raw spectrum and R the
+ * response. The iteration of each row stops when its chi² between f_i and r no longer improves
+ * by the relative tolerance, and the iterate with the lowest chi² is kept.
+ *
+ * All rows still iterating are folded together as one matrix-matrix product, blocked for the
+ * cache and spread over a thread pool by blocks of rows.
+ */
+class Unfolding {
+public:
+
+    //! Parameters of the unfolding.
+    struct Options {
+        size_t max_iterations;      //!< Largest number of iterations of a row.
+        double tolerance;           //!< A row has converged when chi² improves by less than this fraction.
+        bool normalize_response;    //!< Normalise each row of the response to unit sum.
+        size_t block_size;          //!< Size of the blocks of the matrix product.
+
+        Options()
+            : max_iterations( 50 )
+            , tolerance( 1e-4 )
+            , normalize_response( true )
+            , block_size( 64 ){}
+    };
+
+    //! Result of the unfolding.
+    struct Result {
+        Histogram2Dp unfolded;              //!< The unfolded histogram.
+        std::vector<size_t> iterations;     //!< For each regular y bin, the iteration that was kept (0 for empty rows).
+        std::vector<double> chi2;           //!< For each regular y bin, chi² per bin of the kept iteration.
+    };
+
+    //! Unfold each row of a 2D histogram.
+    /*!
+     * The response histogram has the detected energy on the x axis and the incident energy on the y
+     * axis, with the same binning as the x axis of the raw histogram. The unfolded histogram is created
+     * in the set with the same axes as the raw histogram. Its contents are rounded, with negative
+     * values set to zero. Throws if the binning of the response does not match.
+     */
+    static Result Unfold(Histograms &set,                           /*!< The set to create the unfolded histogram in. */
+                         Histogram2Dp raw,                          /*!< The histogram to unfold. */
+                         Histogram2Dp response,                     /*!< The response matrix. */
+                         const std::string &name,                   /*!< Name of the unfolded histogram. */
+                         const Options &options = Options(),        /*!< Unfolding parameters. */
+                         ThreadPool &pool = ThreadPool::Default()   /*!< The pool to run on. */);
+
+    //! Fold spectra with a response, f = u R.
+    /*!
+     * u holds rows spectra of n bins, response is n x m and f gets rows spectra of m bins, all row
+     * major. The product is blocked in all three dimensions and the blocks of rows run in parallel.
+     */
+    static void Fold(const double *u,                           /*!< Spectra to fold, rows x n. */
+                     const double *response,                    /*!< The response, n x m. */
+                     double *f,                                 /*!< The folded spectra, rows x m. */
+                     size_t rows,                               /*!< Number of spectra. */
+                     size_t n,                                  /*!< Bins of the spectra to fold. */
+                     size_t m,                                  /*!< Bins of the folded spectra. */
+                     ThreadPool &pool = ThreadPool::Default(),  /*!< The pool to run on. */
+                     size_t block_size = 64                     /*!< Size of the blocks. */);
+
+};
+
+#endif // UNFOLDING_H
@@ -0,0 +1,165 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Alignment.h"
+
+#include "FFT.h"
+#include "Histogram1D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+//! Linear interpolation between bin centres, with position given in bins from the first centre. Zero outside.
+static double Interpolate(const std::vector<double> &y, double position)
+{
+    if ( position < 0 || position > double(y.size() - 1) )
+        return 0;
+    const size_t i = std::min(size_t(position), y.size() - 2);
+    const double f = position - double(i);
+    return ( 1 - f )*y[i] + f*y[i + 1];
+}
+
+//! Lag of the maximum of the cross-correlation of a and b, refined with a parabola.
+/*! \return the lag where a[i + lag] ~ b[i], and the correlation coefficient at that lag.
+ */
+static double BestLag(std::vector<double> a, std::vector<double> b, double max_lag, double &correlation)
+{
+    // Remove the means so that the zero padding does not favour small lags.
+    const double ma = std::accumulate(a.begin(), a.end(), 0.)/double(a.size());
+    const double mb = std::accumulate(b.begin(), b.end(), 0.)/double(b.size());
+    double na = 0, nb = 0;
+    for ( auto &v : a ){ v -= ma; na += v*v; }
+    for ( auto &v : b ){ v -= mb; nb += v*v; }
+
+    const std::vector<double> c = FFT::Correlate(a, b);
+    const long zero = long(b.size()) - 1;
+    size_t best = size_t(zero);
+    for ( size_t k = 0 ; k < c.size() ; ++k ){
+        if ( max_lag > 0 && std::abs(double(long(k) - zero)) > max_lag )
+            continue;
+        if ( c[k] > c[best] )
+            best = k;
+    }
+
+    double delta = 0;
+    if ( best > 0 && best + 1 < c.size() ){
+        const double curvature = c[best - 1] - 2*c[best] + c[best + 1];
+        if ( curvature < 0 )
+            delta = 0.5*( c[best - 1] - c[best + 1] )/curvature;
+    }
+    correlation = ( na > 0 && nb > 0 ) ? c[best]/std::sqrt(na*nb) : 0.;
+    return double(long(best) - zero) + delta;
+}
+
+// ########################################################################
+
+Alignment::Result Alignment::Align(Histogram1Dp hist, Histogram1Dp reference, const Options &options)
+{
+    const Axis &axis = hist->GetAxisX();
+    if ( axis.GetLeft() != reference->GetAxisX().GetLeft()
+         || axis.GetRight() != reference->GetAxisX().GetRight()
+         || axis.GetBinCount() != reference->GetAxisX().GetBinCount() )
+        throw std::runtime_error("Histograms '"+hist->GetName()+"' and '"+reference->GetName()+"' does not have the same dimentions.");
+
+    const size_t n = axis.GetBinCount();
+    if ( n < 2 )
+        throw std::runtime_error("Histogram '"+hist->GetName()+"' has too few bins to align.");
+    const std::vector<double> y(hist->GetData() + 1, hist->GetData() + n + 1);
+    std::vector<double> ref(reference->GetData() + 1, reference->GetData() + n + 1);
+
+    // Position of x in bins from the first bin centre.
+    auto position = [&axis](double x){ return ( x - axis.GetLeft() )/axis.GetBinWidth() - 0.5; };
+
+    Result result = {0, 1, 0};
+    if ( options.find_scale ){
+        double x_lo = options.min_x;
+        for ( size_t bin = 1 ; x_lo <= 0 && bin <= n ; ++bin )
+            x_lo = std::max(axis.GetBinCenter(bin), 0.);
+        const double x_hi = axis.GetBinCenter(n);
+        if ( x_lo <= 0 || x_lo >= x_hi )
+            throw std::runtime_error("Histogram '"+hist->GetName()+"' has no positive x range to find a scale in.");
+
+        // Counts per logarithmic bin, so that a scale of the spectrum is a shift on this axis.
+        const size_t m = ( options.log_bins > 0 ) ? options.log_bins : n;
+        if ( m < 2 )
+            throw std::runtime_error("Need at least 2 logarithmic bins to find a scale, got " + std::to_string(m) + ".");
+        const double du = std::log(x_hi/x_lo)/double(m - 1);
+        std::vector<double> log_y(m), log_ref(m);
+        for ( size_t j = 0 ; j < m ; ++j ){
+            const double x = x_lo*std::exp(double(j)*du);
+            log_y[j] = Interpolate(y, position(x))*x;
+            log_ref[j] = Interpolate(ref, position(x))*x;
+        }
+        double correlation;
+        result.scale = std::exp(du*BestLag(log_y, log_ref, std::log(options.max_scale)/du, correlation));
+
+        std::vector<double> scaled(n);
+        for ( size_t i = 0 ; i < n ; ++i )
+            scaled[i] = Interpolate(ref, position(axis.GetBinCenter(i + 1)/result.scale));
+        ref.swap(scaled);
+    }
+
+    result.shift = axis.GetBinWidth()*BestLag(y, ref, options.max_shift/axis.GetBinWidth(), result.correlation);
+    return result;
+}
+
+// ########################################################################
+
+std::vector<Alignment::Result> Alignment::Align(const Histograms::list1d_t &hists, const Histograms::list1d_t &references,
+                                                const Options &options, ThreadPool &pool)
+{
+    if ( hists.size() != references.size() )
+        throw std::runtime_error("Got " + std::to_string(hists.size()) + " histograms but " +
+                                 std::to_string(references.size()) + " references.");
+    // Flush the fill buffers before the parallel part, the same reference may be shared by several histograms.
+    for ( size_t i = 0 ; i < hists.size() ; ++i ){
+        hists[i]->GetData();
+        references[i]->GetData();
+    }
+    std::vector<Result> results(hists.size());
+    pool.ParallelFor(0, hists.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i )
+            results[i] = Align(hists[i], references[i], options);
+    });
+    return results;
+}
+
+// ########################################################################
+
+std::map<std::string, Alignment::Result> Alignment::Align(Histograms &hists, Histograms &references,
+                                                          const Options &options, ThreadPool &pool)
+{
+    Histograms::list1d_t list, reference_list;
+    for ( auto &hist : hists.GetAll1D() ){
+        if ( Histogram1Dp reference = references.Find1D( hist->GetName() ) ){
+            list.push_back(hist);
+            reference_list.push_back(reference);
+        }
+    }
+    const std::vector<Result> results = Align(list, reference_list, options, pool);
+    std::map<std::string, Result> result;
+    for ( size_t i = 0 ; i < list.size() ; ++i )
+        result[list[i]->GetName()] = results[i];
+    return result;
+}
@@ -0,0 +1,455 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Checkpoint.h"
+
+#include "Histogram1D.h"
+#include "Histogram2D.h"
+#include "Histogram3D.h"
+#include "SubtractedHistogram2D.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+    //! Magic at the start of a checkpoint file.
+    const char file_magic[8] = {'H', 'I', 'S', 'T', 'C', 'K', 'P', 'T'};
+
+    //! Version of the file format.
+    const uint32_t file_version = 1;
+
+    //! Magic at the start of a record.
+    const uint32_t record_magic = 0x44524352;
+
+    //! Flag in the dimension byte of a prompt-minus-random matrix, whose bins are stored as the bits of doubles.
+    const uint8_t subtracted_flag = 0x80;
+
+    static_assert(sizeof(size_t) == sizeof(SubtractedHistogram2D::data_t), "Bins are copied as 64 bit words.");
+
+    //! 64 bit FNV-1a hash of bytes.
+    uint64_t Checksum(const char *data, size_t n)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for ( size_t i = 0 ; i < n ; ++i )
+            hash = ( hash ^ uint8_t(data[i]) )*0x100000001b3ull;
+        return hash;
+    }
+
+    //! Hash of a block of bins.
+    uint64_t HashBins(const size_t *bins, size_t n)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull ^ n;
+        for ( size_t i = 0 ; i < n ; ++i )
+            hash = ( hash ^ uint64_t(bins[i]) )*0x100000001b3ull;
+        return hash;
+    }
+
+    //! Appends binary values to a string.
+    struct Encoder {
+        std::string &out;
+
+        template<typename V>
+        void Put(const V &value){ out.append(reinterpret_cast<const char *>(&value), sizeof(V)); }
+
+        void PutString(const std::string &value)
+        {
+            Put(uint32_t(value.size()));
+            out.append(value);
+        }
+
+        void PutBins(const size_t *bins, size_t n)
+        {
+            for ( size_t i = 0 ; i < n ; ++i )
+                Put(uint64_t(bins[i]));
+        }
+    };
+
+    //! Reads binary values from a range of bytes.
+    struct Decoder {
+        const char *p, *end;
+
+        template<typename V>
+        V Get()
+        {
+            if ( size_t(end - p) < sizeof(V) )
+                throw std::runtime_error("Checkpoint record ends unexpectedly.");
+            V value;
+            std::memcpy(&value, p, sizeof(V));
+            p += sizeof(V);
+            return value;
+        }
+
+        std::string GetString()
+        {
+            const auto n = Get<uint32_t>();
+            if ( size_t(end - p) < n )
+                throw std::runtime_error("Checkpoint record ends unexpectedly.");
+            std::string value(p, n);
+            p += n;
+            return value;
+        }
+    };
+
+    //! A histogram of the set, with a copy of its bins as one row-major array including the overflow bins.
+    struct Flat {
+        Histogram1Dp h1 = nullptr;
+        Histogram2Dp h2 = nullptr;
+        Histogram3Dp h3 = nullptr;
+        SubtractedHistogram2Dp h2s = nullptr;
+        std::vector<const Axis *> axes;
+
+        //! The bins, copied by Take().
+        std::vector<size_t> bins;
+
+        //! The entry count, copied by Take().
+        size_t entries = 0;
+
+        explicit Flat(Histogram1Dp h) : h1( h ), axes{&h->GetAxisX()} {}
+
+        explicit Flat(Histogram2Dp h) : h2( h ), axes{&h->GetAxisX(), &h->GetAxisY()} {}
+
+        explicit Flat(Histogram3Dp h) : h3( h ), axes{&h->GetAxisX(), &h->GetAxisY(), &h->GetAxisZ()} {}
+
+        explicit Flat(SubtractedHistogram2Dp h) : h2s( h ), axes{&h->GetAxisX(), &h->GetAxisY()} {}
+
+        [[nodiscard]] const Named &GetNamed() const
+        {
+            if ( h1 ) return *h1;
+            if ( h2 ) return *h2;
+            if ( h2s ) return *h2s;
+            return *h3;
+        }
+
+        //! Copy the bins and the entry count. The bins of a prompt-minus-random matrix are copied as bits.
+        void Take()
+        {
+            bins.clear();
+            if ( h2s ){
+                bins.resize(h2s->GetAxisX().GetBinCountAll()*h2s->GetAxisY().GetBinCountAll());
+                std::memcpy(bins.data(), h2s->GetData(), bins.size()*sizeof(size_t));
+                entries = size_t(h2s->GetEntries());
+            } else if ( h1 ){
+                const size_t *data = h1->GetData();
+                bins.assign(data, data + h1->GetAxisX().GetBinCountAll());
+                entries = size_t(h1->GetEntries());
+            } else if ( h2 ){
+                const size_t nx = h2->GetAxisX().GetBinCountAll();
+                bins.reserve(nx*h2->GetAxisY().GetBinCountAll());
+                for ( size_t y = 0 ; y < h2->GetAxisY().GetBinCountAll() ; ++y ){
+                    const size_t *row = h2->GetRow(y);
+                    bins.insert(bins.end(), row, row + nx);
+                }
+                entries = size_t(h2->GetEntries());
+            } else {
+                const size_t nx = h3->GetAxisX().GetBinCountAll();
+                bins.reserve(nx*h3->GetAxisY().GetBinCountAll()*h3->GetAxisZ().GetBinCountAll());
+                for ( size_t z = 0 ; z < h3->GetAxisZ().GetBinCountAll() ; ++z ){
+                    for ( size_t y = 0 ; y < h3->GetAxisY().GetBinCountAll() ; ++y ){
+                        const size_t *row = h3->GetRow(y, z);
+                        bins.insert(bins.end(), row, row + nx);
+                    }
+                }
+                entries = size_t(h3->GetEntries());
+            }
+        }
+    };
+
+    //! Check that a histogram restored into has the binning of the record.
+    void CheckAxis(const Axis &axis, uint64_t count, double left, double right, const std::string &name)
+    {
+        if ( axis.GetBinCount() != count || axis.GetLeft() != left || axis.GetRight() != right )
+            throw std::runtime_error("Histogram '" + name + "' does not have the binning of the checkpoint.");
+    }
+
+    //! Apply the payload of a record to a set.
+    void Apply(Decoder &in, Histograms &set)
+    {
+        const auto n = in.Get<uint32_t>();
+        for ( uint32_t i = 0 ; i < n ; ++i ){
+            const auto kind = in.Get<uint8_t>();
+            const bool subtracted = ( kind & subtracted_flag ) != 0;
+            const int dim = kind & ~subtracted_flag;
+            const std::string name = in.GetString(), title = in.GetString(), path = in.GetString();
+            uint64_t counts[3] = {0, 0, 0};
+            double lefts[3] = {0, 0, 0}, rights[3] = {0, 0, 0};
+            std::string titles[3];
+            if ( dim < 1 || dim > 3 || ( subtracted && dim != 2 ) )
+                throw std::runtime_error("Checkpoint holds a histogram with " + std::to_string(dim) + " dimensions.");
+            for ( int d = 0 ; d < dim ; ++d ){
+                counts[d] = in.Get<uint64_t>();
+                lefts[d] = in.Get<double>();
+                rights[d] = in.Get<double>();
+                titles[d] = in.GetString();
+            }
+
+            Histogram1Dp h1 = nullptr;
+            Histogram2Dp h2 = nullptr;
+            Histogram3Dp h3 = nullptr;
+            SubtractedHistogram2Dp h2s = nullptr;
+            if ( subtracted ){
+                const auto ratio = in.Get<double>();
+                if ( !( h2s = set.FindSubtracted2D(name) ) )
+                    h2s = set.CreateSubtracted2D(name, title, counts[0], lefts[0], rights[0], titles[0],
+                                                 counts[1], lefts[1], rights[1], titles[1], ratio, path);
+                CheckAxis(h2s->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                CheckAxis(h2s->GetAxisY(), counts[1], lefts[1], rights[1], name);
+                if ( h2s->GetRatio() != ratio )
+                    throw std::runtime_error("Histogram '" + name + "' does not have the ratio of the checkpoint.");
+            } else if ( dim == 1 ){
+                if ( !( h1 = set.Find1D(name) ) )
+                    h1 = set.Create1D(name, title, counts[0], lefts[0], rights[0], titles[0], path);
+                CheckAxis(h1->GetAxisX(), counts[0], lefts[0], rights[0], name);
+            } else if ( dim == 2 ){
+                if ( !( h2 = set.Find2D(name) ) )
+                    h2 = set.Create2D(name, title, counts[0], lefts[0], rights[0], titles[0],
+                                      counts[1], lefts[1], rights[1], titles[1], path);
+                CheckAxis(h2->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                CheckAxis(h2->GetAxisY(), counts[1], lefts[1], rights[1], name);
+            } else {
+                if ( !( h3 = set.Find3D(name) ) )
+                    h3 = set.Create3D(name, title, counts[0], lefts[0], rights[0], titles[0],
+                                      counts[1], lefts[1], rights[1], titles[1],
+                                      counts[2], lefts[2], rights[2], titles[2], path);
+                CheckAxis(h3->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                CheckAxis(h3->GetAxisY(), counts[1], lefts[1], rights[1], name);
+                CheckAxis(h3->GetAxisZ(), counts[2], lefts[2], rights[2], name);
+            }
+
+            // Entries are unsigned, so the difference wraps around to the right count.
+            const auto entries = in.Get<uint64_t>();
+            if ( h1 ) h1->AddEntries(entries - size_t(h1->GetEntries()));
+            if ( h2 ) h2->AddEntries(entries - size_t(h2->GetEntries()));
+            if ( h3 ) h3->AddEntries(entries - size_t(h3->GetEntries()));
+            if ( h2s ) h2s->AddEntries(entries - size_t(h2s->GetEntries()));
+
+            const size_t nx = counts[0] + 2, ny = counts[1] + 2;
+            const auto block_size = in.Get<uint64_t>();
+            const auto blocks = in.Get<uint64_t>();
+            for ( uint64_t b = 0 ; b < blocks ; ++b ){
+                const auto first = in.Get<uint64_t>()*block_size;
+                const auto size = in.Get<uint64_t>();
+                for ( uint64_t k = first ; k < first + size ; ++k ){
+                    const auto value = size_t(in.Get<uint64_t>());
+                    if ( h2s ){
+                        SubtractedHistogram2D::data_t content;
+                        std::memcpy(&content, &value, sizeof(content));
+                        h2s->SetBinContent(k % nx, k/nx, content);
+                    } else if ( h1 )
+                        h1->SetBinContent(k, value);
+                    else if ( h2 )
+                        h2->SetBinContent(k % nx, k/nx, value);
+                    else
+                        h3->SetBinContent(k % nx, ( k/nx ) % ny, k/( nx*ny ), value);
+                }
+            }
+        }
+    }
+}
+
+// ########################################################################
+
+Checkpoint::Checkpoint(const std::string &_path, const Options &_options)
+    : path( _path )
+    , options( _options )
+    , count( 0 )
+    , last_size( 0 )
+    , states()
+{
+    if ( options.block_size == 0 )
+        throw std::runtime_error("Checkpoint block size must be positive.");
+}
+
+// ########################################################################
+
+void Checkpoint::Write(Histograms &set, uint64_t offset, ThreadPool &pool, const guard_t &guard)
+{
+    const bool full = !options.incremental || count == 0
+            || ( options.full_interval > 0 && count % options.full_interval == 0 );
+
+    std::vector<Flat> flats;
+    for ( auto h : set.GetAll1D() )
+        flats.emplace_back(h);
+    for ( auto h : set.GetAll2D() )
+        flats.emplace_back(h);
+    for ( auto h : set.GetAll3D() )
+        flats.emplace_back(h);
+    for ( auto h : set.GetAllSubtracted2D() )
+        flats.emplace_back(h);
+
+    // Copying the bins is the only step that reads the contents of the histograms.
+    auto copy = [&](){
+        pool.ParallelFor(0, flats.size(), [&](size_t first, size_t last){
+            for ( size_t i = first ; i < last ; ++i )
+                flats[i].Take();
+        });
+    };
+    if ( guard )
+        guard(copy);
+    else
+        copy();
+
+    // The previous state of each histogram, looked up before the parallel part.
+    std::vector<const state_t *> previous(flats.size(), nullptr);
+    for ( size_t i = 0 ; i < flats.size() && !full ; ++i ){
+        auto it = states.find(flats[i].GetNamed().GetName());
+        if ( it != states.end() )
+            previous[i] = &it->second;
+    }
+
+    std::vector<state_t> current(flats.size());
+    std::vector<std::string> parts(flats.size());
+    pool.ParallelFor(0, flats.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i ){
+            const Flat &flat = flats[i];
+            const size_t size = flat.bins.size();
+            const size_t blocks = ( size + options.block_size - 1 )/options.block_size;
+            state_t &state = current[i];
+            state.entries = flat.entries;
+
+            std::string data;
+            Encoder block_out{data};
+            uint64_t changed = 0;
+            for ( size_t b = 0 ; b < blocks ; ++b ){
+                const size_t n = std::min(options.block_size, size - b*options.block_size);
+                const size_t *bins = flat.bins.data() + b*options.block_size;
+                state.blocks.push_back(HashBins(bins, n));
+                if ( previous[i] && b < previous[i]->blocks.size() && previous[i]->blocks[b] == state.blocks[b] )
+                    continue;
+                block_out.Put(uint64_t(b));
+                block_out.Put(uint64_t(n));
+                block_out.PutBins(bins, n);
+                ++changed;
+            }
+            if ( changed == 0 && previous[i] && previous[i]->entries == state.entries )
+                continue;
+
+            const Named &named = flat.GetNamed();
+            Encoder out{parts[i]};
+            out.Put(uint8_t(flat.axes.size() | ( flat.h2s ? subtracted_flag : 0 )));
+            out.PutString(named.GetName());
+            out.PutString(named.GetTitle());
+            out.PutString(named.GetPath());
+            for ( auto axis : flat.axes ){
+                out.Put(uint64_t(axis->GetBinCount()));
+                out.Put(double(axis->GetLeft()));
+                out.Put(double(axis->GetRight()));
+                out.PutString(axis->GetTitle());
+            }
+            if ( flat.h2s )
+                out.Put(double(flat.h2s->GetRatio()));
+            out.Put(uint64_t(state.entries));
+            out.Put(uint64_t(options.block_size));
+            out.Put(changed);
+            parts[i] += data;
+        }
+    });
+
+    std::string record;
+    Encoder out{record};
+    out.Put(record_magic);
+    out.Put(offset);
+    uint32_t histograms = 0;
+    size_t payload_size = sizeof(histograms);
+    for ( auto &part : parts ){
+        histograms += !part.empty();
+        payload_size += part.size();
+    }
+    out.Put(uint64_t(payload_size));
+    const size_t payload_start = record.size();
+    out.Put(histograms);
+    for ( auto &part : parts )
+        record += part;
+    out.Put(Checksum(record.data() + payload_start, record.size() - payload_start));
+
+    if ( full ){
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(file_magic, sizeof(file_magic));
+            file.write(reinterpret_cast<const char *>(&file_version), sizeof(file_version));
+            file.write(record.data(), std::streamsize(record.size()));
+            file.flush();
+            if ( !file )
+                throw std::runtime_error("Could not write checkpoint '" + temporary + "'.");
+        }
+        if ( std::rename(temporary.c_str(), path.c_str()) != 0 )
+            throw std::runtime_error("Could not move checkpoint '" + temporary + "' to '" + path + "'.");
+        states.clear();
+        last_size = sizeof(file_magic) + sizeof(file_version) + record.size();
+    } else {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file.write(record.data(), std::streamsize(record.size()));
+        file.flush();
+        if ( !file )
+            throw std::runtime_error("Could not append to checkpoint '" + path + "'.");
+        last_size = record.size();
+    }
+
+    for ( size_t i = 0 ; i < flats.size() ; ++i )
+        states[flats[i].GetNamed().GetName()] = std::move(current[i]);
+    ++count;
+}
+
+// ########################################################################
+
+uint64_t Checkpoint::Restore(const std::string &path, Histograms &set)
+{
+    std::ifstream file(path, std::ios::binary);
+    if ( !file.is_open() )
+        return 0;
+    const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    const size_t header = sizeof(file_magic) + sizeof(file_version);
+    uint32_t version = 0;
+    if ( contents.size() >= header )
+        std::memcpy(&version, contents.data() + sizeof(file_magic), sizeof(version));
+    if ( contents.size() < header || std::memcmp(contents.data(), file_magic, sizeof(file_magic)) != 0
+         || version != file_version )
+        throw std::runtime_error("'" + path + "' is not a checkpoint file.");
+
+    uint64_t offset = 0;
+    Decoder in{contents.data() + header, contents.data() + contents.size()};
+    const size_t record_header = sizeof(record_magic) + 2*sizeof(uint64_t);
+    while ( size_t(in.end - in.p) >= record_header ){
+        if ( in.Get<uint32_t>() != record_magic )
+            break;
+        const auto record_offset = in.Get<uint64_t>();
+        const auto size = in.Get<uint64_t>();
+        // Stop at a record cut short or corrupted by a crash while writing.
+        if ( size_t(in.end - in.p) < size + sizeof(uint64_t) )
+            break;
+        uint64_t checksum;
+        std::memcpy(&checksum, in.p + size, sizeof(checksum));
+        if ( Checksum(in.p, size) != checksum )
+            break;
+
+        Decoder payload{in.p, in.p + size};
+        Apply(payload, set);
+        offset = record_offset;
+        in.p += size + sizeof(checksum);
+    }
+    return offset;
+}
@@ -0,0 +1,260 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Coincidence.h"
+
+#include "Pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+    typedef Coincidence::hit_t hit_t;
+
+    //! Merges the sources in time order.
+    class Merger {
+    public:
+        explicit Merger(std::vector<Coincidence::source_t> _sources)
+            : sources( std::move(_sources) ), last( sources.size(), INT64_MIN )
+        {
+            for ( size_t i = 0 ; i < sources.size() ; ++i )
+                Advance(i);
+        }
+
+        //! Get the next hit in time order, false at the end of all sources.
+        bool Next(hit_t &hit)
+        {
+            if ( heap.empty() )
+                return false;
+            std::pop_heap(heap.begin(), heap.end(), Later);
+            hit = heap.back().first;
+            const size_t source = heap.back().second;
+            heap.pop_back();
+            Advance(source);
+            return true;
+        }
+
+    private:
+        typedef std::pair<hit_t, size_t> entry_t;
+
+        //! Heap order, earliest first, ties in source order.
+        static bool Later(const entry_t &a, const entry_t &b)
+        {
+            return ( a.first.timestamp != b.first.timestamp ) ? a.first.timestamp > b.first.timestamp : a.second > b.second;
+        }
+
+        //! Read the next hit of a source into the heap.
+        void Advance(size_t source)
+        {
+            hit_t hit{};
+            if ( !sources[source](hit) )
+                return;
+            if ( hit.timestamp < last[source] )
+                throw std::runtime_error("Hit stream " + std::to_string(source) + " is not in time order.");
+            last[source] = hit.timestamp;
+            heap.emplace_back(hit, source);
+            std::push_heap(heap.begin(), heap.end(), Later);
+        }
+
+        std::vector<Coincidence::source_t> sources;
+        std::vector<int64_t> last;
+        std::vector<entry_t> heap;
+    };
+
+    //! Ring buffer of merged hits, indexed by the running number of the hit.
+    class Ring {
+    public:
+        Ring() : data( 1024 ), head( 0 ), tail( 0 ){}
+
+        void push(const hit_t &hit)
+        {
+            if ( tail - head == data.size() ){
+                std::vector<hit_t> grown(2*data.size());
+                for ( size_t i = head ; i < tail ; ++i )
+                    grown[i & ( grown.size() - 1 )] = data[i & ( data.size() - 1 )];
+                data.swap(grown);
+            }
+            data[tail++ & ( data.size() - 1 )] = hit;
+        }
+
+        [[nodiscard]] const hit_t &operator[](size_t i) const { return data[i & ( data.size() - 1 )]; }
+
+        void pop_front(){ ++head; }
+
+        [[nodiscard]] size_t begin() const { return head; }
+        [[nodiscard]] size_t end() const { return tail; }
+        [[nodiscard]] bool empty() const { return head == tail; }
+        [[nodiscard]] const hit_t &back() const { return ( *this )[tail - 1]; }
+
+    private:
+        std::vector<hit_t> data;
+        size_t head, tail;
+    };
+
+    //! Triggers [first, last) of hits, with the hits around them.
+    struct batch_t {
+        std::vector<hit_t> hits;
+        size_t first = 0, last = 0;
+
+        [[nodiscard]] bool empty() const { return first == last; }
+    };
+}
+
+// ########################################################################
+
+Coincidence::Stats Coincidence::Run(std::vector<source_t> sources,
+                                    const std::function<std::unique_ptr<handler_base>()> &factory,
+                                    const Options &options)
+{
+    if ( options.prompt_high <= options.prompt_low )
+        throw std::runtime_error("Coincidence prompt window is empty.");
+    const bool randoms = options.random_high > options.random_low;
+    const int64_t look_back = randoms ? std::min(options.prompt_low, options.random_low) : options.prompt_low;
+    const int64_t look_ahead = randoms ? std::max(options.prompt_high, options.random_high) : options.prompt_high;
+    const size_t batch_size = std::max(options.batch_size, size_t(1));
+
+    std::vector<bool> is_trigger;
+    for ( auto detector : options.triggers ){
+        if ( detector >= is_trigger.size() )
+            is_trigger.resize(detector + 1, false);
+        is_trigger[detector] = true;
+    }
+
+    Merger merger(std::move(sources));
+    Ring ring;
+    size_t next = 0;
+    bool exhausted = false;
+    Stats stats;
+
+    auto read = [&](hit_t &hit){
+        if ( exhausted || !merger.Next(hit) )
+            return !( exhausted = true );
+        ++stats.hits;
+        ring.push(hit);
+        return true;
+    };
+
+    auto reader = [&](batch_t &batch){
+        hit_t hit{};
+        while ( ring.end() - next < batch_size && read(hit) ) {}
+        const size_t end = ring.end();
+        if ( end > next ){
+            // Read ahead until every hit in the windows of the last trigger is in the ring.
+            const int64_t horizon = ring[end - 1].timestamp + look_ahead;
+            while ( !exhausted && ring.back().timestamp < horizon )
+                read(hit);
+        }
+
+        batch.hits.clear();
+        for ( size_t i = ring.begin() ; i < ring.end() ; ++i )
+            batch.hits.push_back(ring[i]);
+        batch.first = next - ring.begin();
+        batch.last = end - ring.begin();
+        next = end;
+
+        // Keep the hits in the look-back of the next trigger.
+        if ( !ring.empty() ){
+            const int64_t oldest = ( ( next < ring.end() ) ? ring[next] : ring.back() ).timestamp + look_back;
+            while ( ring.begin() < next && ring[ring.begin()].timestamp < oldest )
+                ring.pop_front();
+        }
+        return !( exhausted && next == ring.end() );
+    };
+
+    std::atomic<size_t> triggers( 0 ), groups( 0 ), prompt( 0 ), random( 0 );
+    struct worker_t {
+        std::unique_ptr<handler_base> handler;
+        group_t group;
+        Stats stats;
+        std::atomic<size_t> *totals[4];
+
+        ~worker_t()
+        {
+            *totals[0] += stats.triggers;
+            *totals[1] += stats.groups;
+            *totals[2] += stats.prompt;
+            *totals[3] += stats.random;
+        }
+    };
+
+    // The handlers are created one at a time, so that the factory can create histograms.
+    std::mutex factory_mutex;
+    Pipeline<batch_t> pipeline(options.batches);
+    pipeline.SetReader(reader)
+            .AddStageFactory([&](){
+                auto worker = std::make_unique<worker_t>();
+                {
+                    std::lock_guard lock(factory_mutex);
+                    worker->handler = factory();
+                }
+                worker->totals[0] = &triggers;
+                worker->totals[1] = &groups;
+                worker->totals[2] = &prompt;
+                worker->totals[3] = &random;
+                return [worker = std::move(worker), &options, &is_trigger, look_back, look_ahead, randoms]
+                        (batch_t &batch) mutable {
+                    const std::vector<hit_t> &hits = batch.hits;
+                    group_t &group = worker->group;
+                    for ( size_t i = batch.first ; i < batch.last ; ++i ){
+                        const hit_t &trigger = hits[i];
+                        if ( !is_trigger.empty()
+                             && ( trigger.detector >= is_trigger.size() || !is_trigger[trigger.detector] ) )
+                            continue;
+                        ++worker->stats.triggers;
+                        group.trigger = trigger;
+                        group.prompt.clear();
+                        group.random.clear();
+
+                        auto classify = [&](const hit_t &hit){
+                            if ( !options.same_detector && hit.detector == trigger.detector )
+                                return;
+                            const int64_t dt = hit.timestamp - trigger.timestamp;
+                            if ( dt >= options.prompt_low && dt < options.prompt_high )
+                                group.prompt.push_back(hit);
+                            else if ( randoms && dt >= options.random_low && dt < options.random_high )
+                                group.random.push_back(hit);
+                        };
+                        for ( size_t j = i ; j-- > 0 && hits[j].timestamp >= trigger.timestamp + look_back ; )
+                            classify(hits[j]);
+                        for ( size_t j = i + 1 ; j < hits.size() && hits[j].timestamp < trigger.timestamp + look_ahead ; ++j )
+                            classify(hits[j]);
+
+                        if ( group.prompt.empty() && group.random.empty() )
+                            continue;
+                        ++worker->stats.groups;
+                        worker->stats.prompt += group.prompt.size();
+                        worker->stats.random += group.random.size();
+                        worker->handler->handle(group);
+                    }
+                };
+            }, std::max(options.threads, 1u));
+    pipeline.Run();
+
+    stats.triggers = triggers;
+    stats.groups = groups;
+    stats.prompt = prompt;
+    stats.random = random;
+    return stats;
+}
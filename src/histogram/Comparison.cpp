@@ -0,0 +1,146 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Comparison.h"
+
+#include "Histogram1D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+//! Sum of the regular bins and the bin with the most counts.
+static void Summarize(const Histogram1D::data_t *data, size_t bins, size_t &sum, size_t &peak)
+{
+    sum = 0;
+    peak = 1;
+    for ( size_t i = 1 ; i <= bins ; ++i ){
+        sum += data[i];
+    }
+    for ( size_t i = 1 ; i <= bins ; ++i ){
+        if ( data[i] > data[peak] )
+            peak = i;
+    }
+}
+
+//! Position of a peak refined with a parabola through the maximum bin and its neighbours.
+static double PeakPosition(const Histogram1D::data_t *data, size_t bins, size_t peak, const Axis &axis)
+{
+    double delta = 0;
+    if ( peak > 1 && peak < bins ){
+        const double left = double(data[peak - 1]), centre = double(data[peak]), right = double(data[peak + 1]);
+        const double curvature = left - 2*centre + right;
+        if ( curvature < 0 )
+            delta = 0.5*(left - right)/curvature;
+    }
+    return axis.GetBinCenter(peak) + delta*axis.GetBinWidth();
+}
+
+// ########################################################################
+
+Comparison::Metrics Comparison::Compare(Histogram1Dp live, Histogram1Dp reference, const Options &options)
+{
+    const Axis &axis = live->GetAxisX();
+    if ( axis.GetLeft() != reference->GetAxisX().GetLeft()
+         || axis.GetRight() != reference->GetAxisX().GetRight()
+         || axis.GetBinCount() != reference->GetAxisX().GetBinCount() )
+        throw std::runtime_error("Histograms '"+live->GetName()+"' and '"+reference->GetName()+"' does not have the same dimentions.");
+
+    const size_t bins = axis.GetBinCount();
+    const Histogram1D::data_t *l = live->GetData();
+    const Histogram1D::data_t *r = reference->GetData();
+
+    Metrics metrics = {live->GetName(), 0, 0, 0, 0, 0, 0, 0};
+    size_t live_peak, reference_peak;
+    Summarize(l, bins, metrics.live_counts, live_peak);
+    Summarize(r, bins, metrics.reference_counts, reference_peak);
+    if ( metrics.live_counts == 0 || metrics.reference_counts == 0 )
+        return metrics;
+
+    // chi² for the comparison of two unweighted spectra with different areas:
+    // sum of (N_r l_i - N_l r_i)² / (N_l N_r (l_i + r_i)) over the non-empty bins.
+    // The loop has no branches, so that it can be vectorised.
+    const double nl = double(metrics.live_counts), nr = double(metrics.reference_counts);
+    double chi2 = 0;
+    size_t filled = 0;
+    for ( size_t i = 1 ; i <= bins ; ++i ){
+        const double li = double(l[i]), ri = double(r[i]);
+        const double diff = nr*li - nl*ri;
+        const double sum = li + ri;
+        chi2 += ( sum > 0 ) ? diff*diff/sum : 0.;
+        filled += ( sum > 0 );
+    }
+    metrics.ndf = ( filled > 1 ) ? filled - 1 : 1;
+    metrics.chi2 = chi2/(nl*nr)/double(metrics.ndf);
+
+    // The cumulative sums are kept in integers to be exact, and compared cross-multiplied.
+    size_t cl = 0, cr = 0;
+    double ks = 0;
+    for ( size_t i = 1 ; i <= bins ; ++i ){
+        cl += l[i];
+        cr += r[i];
+        ks = std::max(ks, std::abs(double(cl)*nr - double(cr)*nl));
+    }
+    metrics.ks = ks/(nl*nr);
+
+    metrics.shift = PeakPosition(l, bins, live_peak, axis) - PeakPosition(r, bins, reference_peak, axis);
+
+    metrics.score = std::max(metrics.chi2/options.chi2_threshold, metrics.ks/options.ks_threshold);
+    if ( options.shift_threshold > 0 )
+        metrics.score = std::max(metrics.score, std::abs(metrics.shift)/options.shift_threshold);
+    return metrics;
+}
+
+// ########################################################################
+
+std::vector<Comparison::Metrics> Comparison::Compare(Histograms& live, Histograms& reference,
+                                                     const Options &options, ThreadPool &pool)
+{
+    // Pair up the histograms first, the parallel part only reads histogram contents.
+    std::vector<std::pair<Histogram1Dp, Histogram1Dp>> pairs;
+    for ( auto &hist : live.GetAll1D() ){
+        if ( Histogram1Dp ref = reference.Find1D( hist->GetName() ) )
+            pairs.emplace_back(hist, ref);
+    }
+
+    std::vector<Metrics> metrics(pairs.size());
+    std::vector<char> keep(pairs.size(), 0);
+    pool.ParallelFor(0, pairs.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i ){
+            metrics[i] = Compare(pairs[i].first, pairs[i].second, options);
+            keep[i] = metrics[i].live_counts >= options.min_counts
+                    && metrics[i].reference_counts >= options.min_counts
+                    && metrics[i].score > 1;
+        }
+    });
+
+    std::vector<Metrics> outliers;
+    for ( size_t i = 0 ; i < metrics.size() ; ++i ){
+        if ( keep[i] )
+            outliers.push_back(std::move(metrics[i]));
+    }
+    std::sort(outliers.begin(), outliers.end(), [](const Metrics &a, const Metrics &b){
+        return a.score > b.score;
+    });
+    if ( options.max_reported > 0 && outliers.size() > options.max_reported )
+        outliers.resize(options.max_reported);
+    return outliers;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "FFT.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+static constexpr double pi = 3.14159265358979323846;
+
+size_t FFT::GoodSize(size_t n)
+{
+    size_t size = 1;
+    while ( size < n )
+        size <<= 1;
+    return size;
+}
+
+// ########################################################################
+
+void FFT::Transform(std::vector<std::complex<double>> &data, bool inverse)
+{
+    const size_t n = data.size();
+    if ( n == 0 || ( n & (n - 1) ) != 0 )
+        throw std::runtime_error("FFT size must be a power of two, got " + std::to_string(n) + ".");
+
+    // Bit reversal permutation.
+    for ( size_t i = 1, j = 0 ; i < n ; ++i ){
+        size_t bit = n >> 1;
+        for ( ; j & bit ; bit >>= 1 )
+            j ^= bit;
+        j ^= bit;
+        if ( i < j )
+            std::swap(data[i], data[j]);
+    }
+
+    const double sign = inverse ? 1. : -1.;
+    std::vector<std::complex<double>> twiddle(n/2);
+    for ( size_t k = 0 ; k < n/2 ; ++k )
+        twiddle[k] = std::polar(1., sign*2*pi*double(k)/double(n));
+
+    for ( size_t len = 2 ; len <= n ; len <<= 1 ){
+        const size_t half = len/2, step = n/len;
+        for ( size_t i = 0 ; i < n ; i += len ){
+            for ( size_t k = 0 ; k < half ; ++k ){
+                const std::complex<double> u = data[i + k];
+                const std::complex<double> v = data[i + k + half]*twiddle[k*step];
+                data[i + k] = u + v;
+                data[i + k + half] = u - v;
+            }
+        }
+    }
+
+    if ( inverse ){
+        for ( auto &d : data )
+            d /= double(n);
+    }
+}
+
+// ########################################################################
+
+std::vector<double> FFT::Correlate(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if ( a.empty() || b.empty() )
+        return {};
+    const size_t n = GoodSize(a.size() + b.size() - 1);
+    std::vector<std::complex<double>> fa(n), fb(n);
+    std::copy(a.begin(), a.end(), fa.begin());
+    std::copy(b.begin(), b.end(), fb.begin());
+    Transform(fa);
+    Transform(fb);
+    for ( size_t i = 0 ; i < n ; ++i )
+        fa[i] *= std::conj(fb[i]);
+    Transform(fa, true);
+
+    // Positive lags are at the start of the circular result, negative lags at the end.
+    std::vector<double> c(a.size() + b.size() - 1);
+    for ( size_t k = 0 ; k < c.size() ; ++k ){
+        const long lag = long(k) - long(b.size() - 1);
+        c[k] = fa[( lag >= 0 ) ? size_t(lag) : size_t(long(n) + lag)].real();
+    }
+    return c;
+}
+
+// ########################################################################
+
+std::vector<double> FFT::Convolve(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if ( a.empty() || b.empty() )
+        return {};
+    const size_t n = GoodSize(a.size() + b.size() - 1);
+    std::vector<std::complex<double>> fa(n), fb(n);
+    std::copy(a.begin(), a.end(), fa.begin());
+    std::copy(b.begin(), b.end(), fb.begin());
+    Transform(fa);
+    Transform(fb);
+    for ( size_t i = 0 ; i < n ; ++i )
+        fa[i] *= fb[i];
+    Transform(fa, true);
+
+    std::vector<double> c(a.size() + b.size() - 1);
+    for ( size_t k = 0 ; k < c.size() ; ++k )
+        c[k] = fa[k].real();
+    return c;
+}
@@ -0,0 +1,206 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "FirstGeneration.h"
+
+#include "Histogram2D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+//! Read the regular bins of a matrix, row major.
+static std::vector<double> ReadMatrix(Histogram2Dp hist)
+{
+    const size_t n = hist->GetAxisX().GetBinCount(), rows = hist->GetAxisY().GetBinCount();
+    std::vector<double> values(rows*n);
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        const Histogram2D::data_t *row = hist->GetRow(i + 1);
+        std::copy(row + 1, row + n + 1, values.begin() + i*n);
+    }
+    return values;
+}
+
+//! Store values in a new histogram with the axes of another, rounded with negative values set to zero.
+static Histogram2Dp StoreMatrix(Histograms &set, Histogram2Dp like, const std::string &name,
+                                const std::string &title, const std::vector<double> &values)
+{
+    const Axis &xaxis = like->GetAxisX(), &yaxis = like->GetAxisY();
+    const size_t n = xaxis.GetBinCount(), rows = yaxis.GetBinCount();
+    Histogram2Dp hist = set.Create2D(name, title,
+                                     n, xaxis.GetLeft(), xaxis.GetRight(), xaxis.GetTitle(),
+                                     rows, yaxis.GetLeft(), yaxis.GetRight(), yaxis.GetTitle(),
+                                     like->GetPath());
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        for ( size_t j = 0 ; j < n ; ++j ){
+            const double value = std::max(std::round(values[i*n + j]), 0.);
+            if ( value > 0 )
+                hist->SetBinContent(j + 1, i + 1, Histogram2D::data_t(value));
+        }
+    }
+    return hist;
+}
+
+//! The first generation iteration on a dense matrix.
+static void Iterate(const std::vector<double> &u, const Axis &xaxis, const Axis &yaxis,
+                    const FirstGeneration::Options &options, ThreadPool &pool,
+                    std::vector<double> &fg, size_t &iterations, double &change)
+{
+    const size_t n = xaxis.GetBinCount(), rows = yaxis.GetBinCount();
+
+    // Number of cascades through each row, N_i = S_i/M_i = sum(Egamma u_i)/Ex_i.
+    std::vector<double> cascades(rows, 0.);
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        const double ex = yaxis.GetBinCenter(i + 1);
+        if ( ex <= 0 )
+            continue;
+        double energy = 0;
+        for ( size_t j = 0 ; j < n ; ++j )
+            energy += std::max(xaxis.GetBinCenter(j + 1), 0.)*u[i*n + j];
+        cascades[i] = energy/ex;
+    }
+
+    // Egamma bin of the transition from row i to each lower row j, or -1 if the transition is not possible.
+    std::vector<long> transition(rows*rows, -1);
+    std::vector<double> weights(rows*rows, 0.);
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        size_t count = 0;
+        for ( size_t j = 0 ; j < i ; ++j ){
+            if ( yaxis.GetBinCenter(j + 1) < -0.5*yaxis.GetBinWidth() )
+                continue;
+            const Axis::index_t bin = xaxis.FindBin(yaxis.GetBinCenter(i + 1) - yaxis.GetBinCenter(j + 1));
+            if ( bin >= 1 && bin <= n ){
+                transition[i*rows + j] = long(bin) - 1;
+                ++count;
+            }
+        }
+        for ( size_t j = 0 ; j < i && count > 0 ; ++j ){
+            if ( transition[i*rows + j] >= 0 )
+                weights[i*rows + j] = 1./double(count);
+        }
+    }
+
+    fg.assign(rows*n, 0.);
+    std::vector<double> row_change(rows, 0.);
+    change = 0;
+    iterations = 0;
+    while ( iterations < options.max_iterations ){
+        ++iterations;
+
+        pool.ParallelFor(0, rows, [&](size_t first, size_t last){
+            for ( size_t i = first ; i < last ; ++i ){
+                double *fi = fg.data() + i*n;
+                std::copy(u.begin() + i*n, u.begin() + (i + 1)*n, fi);
+                for ( size_t j = 0 ; j < i ; ++j ){
+                    const double w = weights[i*rows + j];
+                    if ( w <= 0 || cascades[j] <= 0 )
+                        continue;
+                    const double c = w*cascades[i]/cascades[j];
+                    const double *uj = u.data() + j*n;
+                    for ( size_t k = 0 ; k < n ; ++k )
+                        fi[k] -= c*uj[k];
+                }
+            }
+        });
+
+        pool.ParallelFor(0, rows, [&](size_t first, size_t last){
+            for ( size_t i = first ; i < last ; ++i ){
+                double sum = 0;
+                for ( size_t j = 0 ; j < i ; ++j ){
+                    const long bin = transition[i*rows + j];
+                    if ( bin >= 0 )
+                        sum += std::max(fg[i*n + size_t(bin)], 0.);
+                }
+                row_change[i] = 0;
+                if ( sum <= 0 )
+                    continue;
+                for ( size_t j = 0 ; j < i ; ++j ){
+                    const long bin = transition[i*rows + j];
+                    if ( bin < 0 )
+                        continue;
+                    const double w = std::max(fg[i*n + size_t(bin)], 0.)/sum;
+                    row_change[i] = std::max(row_change[i], std::abs(w - weights[i*rows + j]));
+                    weights[i*rows + j] = w;
+                }
+            }
+        });
+
+        change = *std::max_element(row_change.begin(), row_change.end());
+        if ( change < options.tolerance )
+            break;
+    }
+}
+
+// ########################################################################
+
+FirstGeneration::Result FirstGeneration::Extract(Histograms &set, Histogram2Dp unfolded, const std::string &name,
+                                                 const Options &options, ThreadPool &pool)
+{
+    Result result = {nullptr, 0, 0, {}};
+    const std::vector<double> u = ReadMatrix(unfolded);
+    Iterate(u, unfolded->GetAxisX(), unfolded->GetAxisY(), options, pool,
+            result.values, result.iterations, result.change);
+    result.fg = StoreMatrix(set, unfolded, name, "First generation " + unfolded->GetTitle(), result.values);
+    result.fg->AddEntries(unfolded->GetEntries());
+    return result;
+}
+
+// ########################################################################
+
+FirstGeneration::EnsembleResult FirstGeneration::Ensemble(Histograms &set, Histogram2Dp unfolded, const std::string &name,
+                                                          size_t members, uint64_t seed, const Options &options, ThreadPool &pool)
+{
+    const std::vector<double> u = ReadMatrix(unfolded);
+    std::vector<double> sum(u.size(), 0.), sum2(u.size(), 0.);
+    std::mutex mutex;
+
+    pool.ParallelFor(0, members, [&](size_t first, size_t last){
+        std::vector<double> fluctuated(u.size()), fg;
+        for ( size_t member = first ; member < last ; ++member ){
+            std::mt19937_64 generator(seed + member);
+            for ( size_t k = 0 ; k < u.size() ; ++k ){
+                fluctuated[k] = ( u[k] > 0 ) ? double(std::poisson_distribution<long>(u[k])(generator)) : 0.;
+            }
+            size_t iterations;
+            double change;
+            Iterate(fluctuated, unfolded->GetAxisX(), unfolded->GetAxisY(), options, pool, fg, iterations, change);
+
+            std::lock_guard lock(mutex);
+            for ( size_t k = 0 ; k < fg.size() ; ++k ){
+                sum[k] += fg[k];
+                sum2[k] += fg[k]*fg[k];
+            }
+        }
+    });
+
+    EnsembleResult result = {nullptr, nullptr, std::vector<double>(u.size(), 0.), std::vector<double>(u.size(), 0.)};
+    if ( members > 0 ){
+        for ( size_t k = 0 ; k < u.size() ; ++k ){
+            const double mean = sum[k]/double(members);
+            result.mean_values[k] = mean;
+            result.std_values[k] = std::sqrt(std::max(sum2[k]/double(members) - mean*mean, 0.));
+        }
+    }
+    result.mean = StoreMatrix(set, unfolded, name + "_mean", "Mean first generation " + unfolded->GetTitle(), result.mean_values);
+    result.std = StoreMatrix(set, unfolded, name + "_std", "Std. dev. first generation " + unfolded->GetTitle(), result.std_values);
+    return result;
+}
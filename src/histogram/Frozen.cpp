@@ -0,0 +1,428 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Frozen.h"
+
+#include "Histogram1D.h"
+#include "Histogram2D.h"
+#include "Histogram3D.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+//! Check that two axes have the same binning.
+static bool SameBinning(const Axis &a, const Axis &b)
+{
+    return a.GetLeft() == b.GetLeft() && a.GetRight() == b.GetRight() && a.GetBinCount() == b.GetBinCount();
+}
+
+// ########################################################################
+
+void FrozenBins::Append(const data_t *values, size_t n)
+{
+    while ( n > 0 ){
+        const size_t m = std::min(n, block_size - pending_size);
+        std::copy(values, values + m, pending.begin() + pending_size);
+        pending_size += m;
+        values += m;
+        n -= m;
+        if ( pending_size == block_size )
+            Encode();
+    }
+}
+
+// ########################################################################
+
+void FrozenBins::Seal()
+{
+    if ( pending_size > 0 ){
+        std::fill(pending.begin() + pending_size, pending.end(), 0);
+        const size_t n = pending_size;
+        Encode();
+        size -= block_size - n;
+    }
+    widths.shrink_to_fit();
+    offsets.shrink_to_fit();
+    bytes.shrink_to_fit();
+}
+
+// ########################################################################
+
+void FrozenBins::Encode()
+{
+    const data_t max = *std::max_element(pending.begin(), pending.end());
+    uint8_t width;
+    if ( max == 0 )
+        width = 0;
+    else if ( max <= UINT8_MAX )
+        width = 1;
+    else if ( max <= UINT16_MAX )
+        width = 2;
+    else if ( max <= UINT32_MAX )
+        width = 4;
+    else
+        width = 8;
+
+    widths.push_back(width);
+    offsets.push_back(bytes.size());
+    if ( width > 0 ){
+        const size_t offset = bytes.size();
+        bytes.resize(offset + block_size*width);
+        uint8_t *p = bytes.data() + offset;
+        for ( size_t i = 0 ; i < block_size ; ++i, p += width ){
+            switch ( width ){
+                case 1 : { auto v = uint8_t(pending[i]); std::memcpy(p, &v, 1); break; }
+                case 2 : { auto v = uint16_t(pending[i]); std::memcpy(p, &v, 2); break; }
+                case 4 : { auto v = uint32_t(pending[i]); std::memcpy(p, &v, 4); break; }
+                default : { auto v = uint64_t(pending[i]); std::memcpy(p, &v, 8); break; }
+            }
+        }
+    }
+    size += block_size;
+    pending_size = 0;
+}
+
+// ########################################################################
+
+FrozenBins::data_t FrozenBins::Read(const uint8_t *p, uint8_t width)
+{
+    switch ( width ){
+        case 1 : return *p;
+        case 2 : { uint16_t v; std::memcpy(&v, p, 2); return v; }
+        case 4 : { uint32_t v; std::memcpy(&v, p, 4); return v; }
+        default : { uint64_t v; std::memcpy(&v, p, 8); return data_t(v); }
+    }
+}
+
+// ########################################################################
+
+void FrozenBins::Decode(size_t first, size_t n, data_t *out) const
+{
+    const size_t last = first + n;
+    while ( first < last ){
+        const size_t block = first/block_size;
+        const size_t end = std::min(last, ( block + 1 )*block_size);
+        const uint8_t width = widths[block];
+        if ( width == 0 ){
+            std::fill(out, out + ( end - first ), 0);
+        } else {
+            const uint8_t *p = bytes.data() + offsets[block] + ( first % block_size )*width;
+            for ( size_t i = first ; i < end ; ++i, p += width )
+                out[i - first] = Read(p, width);
+        }
+        out += end - first;
+        first = end;
+    }
+}
+
+// ########################################################################
+
+FrozenHistogram1D::FrozenHistogram1D(Histogram1Dp hist)
+    : Named( hist->GetName(), hist->GetTitle(), hist->GetPath() )
+    , xaxis( hist->GetAxisX() )
+    , entries( size_t(hist->GetEntries()) )
+{
+    bins.Append(hist->GetData(), xaxis.GetBinCountAll());
+    bins.Seal();
+}
+
+// ########################################################################
+
+void FrozenHistogram1D::AddTo(Histogram1Dp hist, data_t scale) const
+{
+    if ( !SameBinning(xaxis, hist->GetAxisX()) )
+        throw std::runtime_error("Histograms '" + hist->GetName() + "' and '" + GetName() + "' does not have the same dimentions.");
+
+    std::array<data_t, FrozenBins::block_size> buffer;
+    for ( size_t first = 0 ; first < bins.GetSize() ; first += buffer.size() ){
+        const size_t n = std::min(buffer.size(), bins.GetSize() - first);
+        bins.Decode(first, n, buffer.data());
+        for ( size_t i = 0 ; i < n ; ++i ){
+            if ( buffer[i] != 0 )
+                hist->AddBinContent(first + i, scale*buffer[i]);
+        }
+    }
+    hist->AddEntries(scale*entries);
+}
+
+// ########################################################################
+
+FrozenHistogram2D::FrozenHistogram2D(Histogram2Dp hist)
+    : Named( hist->GetName(), hist->GetTitle(), hist->GetPath() )
+    , xaxis( hist->GetAxisX() )
+    , yaxis( hist->GetAxisY() )
+    , entries( size_t(hist->GetEntries()) )
+{
+    for ( size_t y = 0 ; y < yaxis.GetBinCountAll() ; ++y )
+        bins.Append(hist->GetRow(y), xaxis.GetBinCountAll());
+    bins.Seal();
+}
+
+// ########################################################################
+
+void FrozenHistogram2D::AddTo(Histogram2Dp hist, data_t scale) const
+{
+    if ( !SameBinning(xaxis, hist->GetAxisX()) || !SameBinning(yaxis, hist->GetAxisY()) )
+        throw std::runtime_error("Histograms '" + hist->GetName() + "' and '" + GetName() + "' does not have the same dimentions.");
+
+    const size_t columns = xaxis.GetBinCountAll();
+    std::vector<data_t> row(columns);
+    for ( size_t y = 0 ; y < yaxis.GetBinCountAll() ; ++y ){
+        bins.Decode(y*columns, columns, row.data());
+        const data_t *current = hist->GetRow(y);
+        for ( size_t x = 0 ; x < columns ; ++x ){
+            if ( row[x] != 0 )
+                hist->SetBinContent(x, y, current[x] + scale*row[x]);
+        }
+    }
+    hist->AddEntries(scale*entries);
+}
+
+// ########################################################################
+
+Histogram1Dp FrozenHistogram2D::ProjectX(Histograms &set, const std::string &name, Axis::index_t first, Axis::index_t last) const
+{
+    if ( last == 0 )
+        last = yaxis.GetBinCount();
+    Histogram1Dp projection = set.Create1D(name, GetTitle() + " projected on x",
+                                           xaxis.GetBinCount(), xaxis.GetLeft(), xaxis.GetRight(), xaxis.GetTitle(),
+                                           GetPath());
+    const size_t columns = xaxis.GetBinCountAll();
+    std::vector<data_t> row(columns);
+    size_t total = 0;
+    last = std::min(last, yaxis.GetBinCountAll() - 1);
+    for ( size_t y = first ; y <= last ; ++y ){
+        bins.Decode(y*columns, columns, row.data());
+        for ( size_t x = 0 ; x < columns ; ++x ){
+            projection->AddBinContent(x, row[x]);
+            total += row[x];
+        }
+    }
+    projection->AddEntries(total);
+    return projection;
+}
+
+// ########################################################################
+
+Histogram1Dp FrozenHistogram2D::ProjectY(Histograms &set, const std::string &name, Axis::index_t first, Axis::index_t last) const
+{
+    if ( last == 0 )
+        last = xaxis.GetBinCount();
+    last = std::min(last, xaxis.GetBinCountAll() - 1);
+    Histogram1Dp projection = set.Create1D(name, GetTitle() + " projected on y",
+                                           yaxis.GetBinCount(), yaxis.GetLeft(), yaxis.GetRight(), yaxis.GetTitle(),
+                                           GetPath());
+    const size_t columns = xaxis.GetBinCountAll();
+    std::vector<data_t> row(columns);
+    size_t total = 0;
+    for ( size_t y = 0 ; y < yaxis.GetBinCountAll() && first <= last ; ++y ){
+        bins.Decode(y*columns + first, last - first + 1, row.data());
+        data_t sum = 0;
+        for ( size_t x = 0 ; x <= last - first ; ++x )
+            sum += row[x];
+        projection->AddBinContent(y, sum);
+        total += sum;
+    }
+    projection->AddEntries(total);
+    return projection;
+}
+
+// ########################################################################
+
+FrozenHistogram3D::FrozenHistogram3D(Histogram3Dp hist)
+    : Named( hist->GetName(), hist->GetTitle(), hist->GetPath() )
+    , xaxis( hist->GetAxisX() )
+    , yaxis( hist->GetAxisY() )
+    , zaxis( hist->GetAxisZ() )
+    , entries( size_t(hist->GetEntries()) )
+{
+    for ( size_t z = 0 ; z < zaxis.GetBinCountAll() ; ++z ){
+        for ( size_t y = 0 ; y < yaxis.GetBinCountAll() ; ++y )
+            bins.Append(hist->GetRow(y, z), xaxis.GetBinCountAll());
+    }
+    bins.Seal();
+}
+
+// ########################################################################
+
+void FrozenHistogram3D::AddTo(Histogram3Dp hist, data_t scale) const
+{
+    if ( !SameBinning(xaxis, hist->GetAxisX()) || !SameBinning(yaxis, hist->GetAxisY())
+         || !SameBinning(zaxis, hist->GetAxisZ()) )
+        throw std::runtime_error("Histograms '" + hist->GetName() + "' and '" + GetName() + "' does not have the same dimentions.");
+
+    const size_t columns = xaxis.GetBinCountAll();
+    std::vector<data_t> row(columns);
+    for ( size_t z = 0 ; z < zaxis.GetBinCountAll() ; ++z ){
+        for ( size_t y = 0 ; y < yaxis.GetBinCountAll() ; ++y ){
+            bins.Decode(( z*yaxis.GetBinCountAll() + y )*columns, columns, row.data());
+            const data_t *current = hist->GetRow(y, z);
+            for ( size_t x = 0 ; x < columns ; ++x ){
+                if ( row[x] != 0 )
+                    hist->SetBinContent(x, y, z, current[x] + scale*row[x]);
+            }
+        }
+    }
+    hist->AddEntries(scale*entries);
+}
+
+// ########################################################################
+
+Histogram1Dp FrozenHistogram3D::Project(Histograms &set, const std::string &name, int axis) const
+{
+    const Axis *axes[3] = {&xaxis, &yaxis, &zaxis};
+    if ( axis < 0 || axis > 2 )
+        throw std::runtime_error("Cannot project '" + GetName() + "' onto axis " + std::to_string(axis) + ".");
+    const Axis &target = *axes[axis];
+    static const char *names[3] = {"x", "y", "z"};
+    Histogram1Dp projection = set.Create1D(name, GetTitle() + " projected on " + names[axis],
+                                           target.GetBinCount(), target.GetLeft(), target.GetRight(), target.GetTitle(),
+                                           GetPath());
+
+    const size_t columns = xaxis.GetBinCountAll();
+    std::vector<data_t> row(columns);
+    size_t total = 0;
+    const size_t nz = zaxis.GetBinCountAll(), ny = yaxis.GetBinCountAll();
+    for ( size_t z = 0 ; z < nz ; ++z ){
+        if ( axis != 2 && ( z == 0 || z == nz - 1 ) )
+            continue;
+        for ( size_t y = 0 ; y < ny ; ++y ){
+            if ( axis != 1 && ( y == 0 || y == ny - 1 ) )
+                continue;
+            bins.Decode(( z*ny + y )*columns, columns, row.data());
+            if ( axis == 0 ){
+                for ( size_t x = 0 ; x < columns ; ++x )
+                    projection->AddBinContent(x, row[x]);
+            }
+            data_t sum = 0;
+            for ( size_t x = 1 ; x + 1 < columns ; ++x )
+                sum += row[x];
+            if ( axis == 1 )
+                projection->AddBinContent(y, sum);
+            else if ( axis == 2 )
+                projection->AddBinContent(z, sum);
+            total += ( axis == 0 ) ? sum + row[0] + row[columns - 1] : sum;
+        }
+    }
+    projection->AddEntries(total);
+    return projection;
+}
+
+// ########################################################################
+
+FrozenHistograms::FrozenHistograms(Histograms &set, ThreadPool &pool)
+{
+    auto all1d = set.GetAll1D();
+    auto all2d = set.GetAll2D();
+    auto all3d = set.GetAll3D();
+    std::vector<std::unique_ptr<FrozenHistogram1D>> frozen1d(all1d.size());
+    std::vector<std::unique_ptr<FrozenHistogram2D>> frozen2d(all2d.size());
+    std::vector<std::unique_ptr<FrozenHistogram3D>> frozen3d(all3d.size());
+
+    const size_t n1 = all1d.size(), n2 = all2d.size();
+    pool.ParallelFor(0, n1 + n2 + all3d.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i ){
+            if ( i < n1 )
+                frozen1d[i] = std::make_unique<FrozenHistogram1D>(all1d[i]);
+            else if ( i < n1 + n2 )
+                frozen2d[i - n1] = std::make_unique<FrozenHistogram2D>(all2d[i - n1]);
+            else
+                frozen3d[i - n1 - n2] = std::make_unique<FrozenHistogram3D>(all3d[i - n1 - n2]);
+        }
+    });
+
+    for ( auto &frozen : frozen1d )
+        map1d[frozen->GetName()] = std::move(frozen);
+    for ( auto &frozen : frozen2d )
+        map2d[frozen->GetName()] = std::move(frozen);
+    for ( auto &frozen : frozen3d )
+        map3d[frozen->GetName()] = std::move(frozen);
+}
+
+// ########################################################################
+
+const FrozenHistogram1D *FrozenHistograms::Find1D(const std::string &name) const
+{
+    auto it = map1d.find(name);
+    return ( it == map1d.end() ) ? nullptr : it->second.get();
+}
+
+// ########################################################################
+
+const FrozenHistogram2D *FrozenHistograms::Find2D(const std::string &name) const
+{
+    auto it = map2d.find(name);
+    return ( it == map2d.end() ) ? nullptr : it->second.get();
+}
+
+// ########################################################################
+
+const FrozenHistogram3D *FrozenHistograms::Find3D(const std::string &name) const
+{
+    auto it = map3d.find(name);
+    return ( it == map3d.end() ) ? nullptr : it->second.get();
+}
+
+// ########################################################################
+
+void FrozenHistograms::AddTo(Histograms &set, ThreadPool &pool) const
+{
+    // Pair up the histograms first, the parallel part only touches histogram contents.
+    std::vector<std::pair<const FrozenHistogram1D *, Histogram1Dp>> pairs1d;
+    std::vector<std::pair<const FrozenHistogram2D *, Histogram2Dp>> pairs2d;
+    std::vector<std::pair<const FrozenHistogram3D *, Histogram3Dp>> pairs3d;
+    for ( auto &it : map1d )
+        if ( Histogram1Dp hist = set.Find1D(it.first) )
+            pairs1d.emplace_back(it.second.get(), hist);
+    for ( auto &it : map2d )
+        if ( Histogram2Dp hist = set.Find2D(it.first) )
+            pairs2d.emplace_back(it.second.get(), hist);
+    for ( auto &it : map3d )
+        if ( Histogram3Dp hist = set.Find3D(it.first) )
+            pairs3d.emplace_back(it.second.get(), hist);
+
+    const size_t n1 = pairs1d.size(), n2 = pairs2d.size();
+    pool.ParallelFor(0, n1 + n2 + pairs3d.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i ){
+            if ( i < n1 )
+                pairs1d[i].first->AddTo(pairs1d[i].second);
+            else if ( i < n1 + n2 )
+                pairs2d[i - n1].first->AddTo(pairs2d[i - n1].second);
+            else
+                pairs3d[i - n1 - n2].first->AddTo(pairs3d[i - n1 - n2].second);
+        }
+    });
+}
+
+// ########################################################################
+
+size_t FrozenHistograms::GetMemoryUsage() const
+{
+    size_t usage = sizeof(*this);
+    for ( auto &it : map1d )
+        usage += it.second->GetMemoryUsage();
+    for ( auto &it : map2d )
+        usage += it.second->GetMemoryUsage();
+    for ( auto &it : map3d )
+        usage += it.second->GetMemoryUsage();
+    return usage;
+}
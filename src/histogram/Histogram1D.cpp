@@ -28,26 +28,21 @@
 
 #include "Histogram1D.h"
 
+#include <algorithm>
 #include <iostream>
 
-
-#ifdef H1D_USE_BUFFER
-const unsigned int Histogram1D::buffer_max;
-#endif /* H1D_USE_BUFFER */
-
 // ########################################################################
 
 Histogram1D::Histogram1D( const std::string& name, const std::string& title,
                           Axis::index_t c, Axis::bin_t l, Axis::bin_t r, const std::string& xt,
-                          const std::string& path)
+                          const std::string& path, const FillPolicy& pol)
     : Named( name, title, path )
     , xaxis( name+"_xaxis", c, l, r, xt )
     , data( 0 )
+    , policy( pol.Resolve(xaxis.GetBinCountAll()) )
+    , buffered( false )
 {
-#ifdef H1D_USE_BUFFER
-  buffer.reserve(buffer_max);
-#endif /* H1D_USE_BUFFER */
-
+  buffer.reserve(policy.buffer_size);
   data = new data_t[xaxis.GetBinCountAll()];
   Reset();
 }
@@ -56,7 +51,7 @@ Histogram1D::Histogram1D( const std::string& name, const std::string& title,
 
 Histogram1D::~Histogram1D()
 {
-  delete data;
+  delete[] data;
 }
 
 // ########################################################################
@@ -70,10 +65,8 @@ void Histogram1D::Add(const Histogram1Dp other, data_t scale)
       || other->GetAxisX().GetBinCount() != xaxis.GetBinCount() )
     throw std::runtime_error("Histograms '"+GetName()+"' and '"+other->GetName()+"' does not have the same dimentions.");
 
-#ifdef H1D_USE_BUFFER
   other->FlushBuffer();
-    FlushBuffer();
-#endif /* H2D_USE_BUFFER */
+  FlushBuffer();
 
   for(Axis::index_t i=0; i < xaxis.GetBinCountAll(); ++i)
     data[i] += scale * other->data[i];
@@ -86,9 +79,7 @@ void Histogram1D::Add(const Histogram1Dp other, data_t scale)
 
 Histogram1D::data_t Histogram1D::GetBinContent(Axis::index_t bin)
 {
-#ifdef H1D_USE_BUFFER
   FlushBuffer();
-#endif /* H1D_USE_BUFFER */
   if( bin<xaxis.GetBinCountAll() ) {
     return data[bin];
   } else {
@@ -98,34 +89,61 @@ Histogram1D::data_t Histogram1D::GetBinContent(Axis::index_t bin)
 
 // ########################################################################
 
-void Histogram1D::FillDirect(Axis::bin_t x, data_t weight)
+void Histogram1D::SetBinContent(Axis::index_t bin, data_t c)
+{
+  FlushBuffer();
+  if( bin<xaxis.GetBinCountAll() )
+    data[bin] = c;
+}
+
+// ########################################################################
+
+const Histogram1D::data_t *Histogram1D::GetData()
 {
-  entries += 1;
-  data[xaxis.FindBin( x )] += weight;
+  FlushBuffer();
+  return data;
 }
 
 // ########################################################################
 
-#ifdef H1D_USE_BUFFER
 void Histogram1D::FlushBuffer()
 {
-    if( !buffer.empty() ) {
-        for(buffer_t::const_iterator it=buffer.begin(); it<buffer.end(); ++it)
-            FillDirect(it->x, it->w);
-        buffer.clear();
-    }
+  if( !buffered.load(std::memory_order_acquire) )
+    return;
+  std::lock_guard<std::mutex> lock(flush_mutex);
+  if( buffer.empty() )
+    return;
+  if( policy.flush == FillPolicy::sorted ) {
+    std::vector<FillPolicy::resolved_t> bins, scratch;
+    bins.reserve(buffer.size());
+    for(auto & it : buffer)
+      bins.emplace_back(xaxis.FindBin( it.x ), it.w);
+    FillPolicy::ApplySorted(data, xaxis.GetBinCountAll(), bins, scratch);
+    entries += bins.size();
+  } else {
+    for(auto & it : buffer)
+      FillDirect(it);
+  }
+  buffer.clear();
+  buffered.store(false, std::memory_order_release);
 }
 
-#endif /* H1D_USE_BUFFER */
+// ########################################################################
+
+void Histogram1D::SetFillPolicy(const FillPolicy& pol)
+{
+  FlushBuffer();
+  policy = pol.Resolve(xaxis.GetBinCountAll());
+  buffer.shrink_to_fit();
+  buffer.reserve(policy.buffer_size);
+}
 
 // ########################################################################
 
 void Histogram1D::Reset()
 {
-#ifdef H1D_USE_BUFFER
   buffer.clear();
-#endif /* H1D_USE_BUFFER */
-  for(Axis::index_t i=0; i < xaxis.GetBinCountAll(); ++i)
-    data[i] = 0;
+  buffered.store(false, std::memory_order_relaxed);
+  std::fill(data, data + xaxis.GetBinCountAll(), 0);
   entries = 0;
 }
@@ -26,39 +26,30 @@
 
 #include "Histogram2D.h"
 
+#include <algorithm>
 #include <iostream>
 
-#ifdef H2D_USE_BUFFER
-const unsigned int Histogram2D::buffer_max;
-#endif /* H2D_USE_BUFFER */
-
 // ########################################################################
 
 Histogram2D::Histogram2D( const std::string& name, const std::string& title,
                           Axis::index_t ch1, Axis::bin_t l1, Axis::bin_t r1, const std::string& xt,
                           Axis::index_t ch2, Axis::bin_t l2, Axis::bin_t r2, const std::string& yt,
-                          const std::string& path)
+                          const std::string& path, const FillPolicy& pol)
     : Named( name, title, path )
     , xaxis( name+"_xaxis", ch1, l1, r1, xt )
     , yaxis( name+"_yaxis", ch2, l2, r2, yt )
     , entries( 0 )
-#ifndef USE_ROWS
     , data( nullptr )
-#else
-, rows( nullptr )
-#endif
+    , rows( nullptr )
+    , policy( pol.Resolve(xaxis.GetBinCountAll()*yaxis.GetBinCountAll()) )
+    , buffered( false )
 {
-#ifdef H2D_USE_BUFFER
-  buffer.reserve(buffer_max);
-#endif /* H2D_USE_BUFFER */
+  buffer.reserve(policy.buffer_size);
 
-#ifndef USE_ROWS
   data = new data_t[xaxis.GetBinCountAll()*yaxis.GetBinCountAll()];
-#else
   rows = new data_t*[yaxis.GetBinCountAll()];
-    for(Axis::index_t y=0; y<yaxis.GetBinCountAll(); ++y)
-        rows[y] = new data_t[xaxis.GetBinCountAll()];
-#endif
+  for(Axis::index_t y=0; y<yaxis.GetBinCountAll(); ++y)
+    rows[y] = data + xaxis.GetBinCountAll()*y;
   Reset();
 }
 
@@ -66,13 +57,8 @@ Histogram2D::Histogram2D( const std::string& name, const std::string& title,
 
 Histogram2D::~Histogram2D()
 {
-#ifndef USE_ROWS
-  delete data;
-#else
-  for(Axis::index_t y=0; y < yaxis.GetBinCountAll(); ++y)
-        delete rows[y];
-    delete rows;
-#endif
+  delete[] rows;
+  delete[] data;
 }
 
 // ########################################################################
@@ -89,19 +75,12 @@ void Histogram2D::Add(const Histogram2Dp &other, data_t scale)
       || other->GetAxisY().GetBinCount() != yaxis.GetBinCount() )
     throw std::runtime_error("Histograms '"+GetName()+"' and '"+other->GetName()+"' does not have the same dimentions.");
 
-#ifdef H2D_USE_BUFFER
   other->FlushBuffer();
-    FlushBuffer();
-#endif /* H2D_USE_BUFFER */
+  FlushBuffer();
 
-#ifndef USE_ROWS
   for(Axis::index_t i=0; i<xaxis.GetBinCountAll()*yaxis.GetBinCountAll(); ++i)
     data[i] += scale * other->data[i];
-#else
-  for(Axis::index_t y=0; y<yaxis.GetBinCountAll(); ++y )
-        for(Axis::index_t x=0; x<xaxis.GetBinCountAll(); ++x )
-            rows[y][x] += scale*other->rows[y][x];
-#endif
+
   // Update total count
   entries += scale * other->entries;
 }
@@ -110,76 +89,84 @@ void Histogram2D::Add(const Histogram2Dp &other, data_t scale)
 
 Histogram2D::data_t Histogram2D::GetBinContent(Axis::index_t xbin, Axis::index_t ybin)
 {
-#ifdef H2D_USE_BUFFER
-  if( !buffer.empty() )
-        FlushBuffer();
-#endif /* H2D_USE_BUFFER */
-
-  if( xbin<xaxis.GetBinCountAll() && ybin<yaxis.GetBinCountAll() ) {
-#ifndef USE_ROWS
-    return data[xaxis.GetBinCountAll()*ybin + xbin];
-#else
+  FlushBuffer();
+
+  if( xbin<xaxis.GetBinCountAll() && ybin<yaxis.GetBinCountAll() )
     return rows[ybin][xbin];
-#endif
-  } else
+  else
     return 0;
 }
 
 // ########################################################################
 
+const Histogram2D::data_t *Histogram2D::GetRow(Axis::index_t ybin)
+{
+  return GetWritableRow(ybin);
+}
+
+// ########################################################################
+
+Histogram2D::data_t *Histogram2D::GetWritableRow(Axis::index_t ybin)
+{
+  FlushBuffer();
+
+  if( ybin<yaxis.GetBinCountAll() )
+    return rows[ybin];
+  else
+    return nullptr;
+}
+
+// ########################################################################
+
 void Histogram2D::SetBinContent(Axis::index_t xbin, Axis::index_t ybin, data_t c)
 {
-#ifdef H2D_USE_BUFFER
-  if( !buffer.empty() )
-        FlushBuffer();
-#endif /* H2D_USE_BUFFER */
-
-  if( xbin<xaxis.GetBinCountAll() && ybin<yaxis.GetBinCountAll() ) {
-#ifndef USE_ROWS
-    data[xaxis.GetBinCountAll()*ybin + xbin] = c;
-#else
+  FlushBuffer();
+
+  if( xbin<xaxis.GetBinCountAll() && ybin<yaxis.GetBinCountAll() )
     rows[ybin][xbin] = c;
-#endif
-  }
 }
 
 // ########################################################################
 
-void Histogram2D::FillDirect(Axis::bin_t x, Axis::bin_t y, data_t weight)
+void Histogram2D::FlushBuffer()
 {
-  const Axis::index_t xbin = xaxis.FindBin( x );
-  const Axis::index_t ybin = yaxis.FindBin( y );
-#ifndef USE_ROWS
-  data[xaxis.GetBinCountAll()*ybin + xbin] += weight;
-#else
-  rows[ybin][xbin] += weight;
-#endif
-  entries += 1;
+  if( !buffered.load(std::memory_order_acquire) )
+    return;
+  std::lock_guard<std::mutex> lock(flush_mutex);
+  if( buffer.empty() )
+    return;
+  if( policy.flush == FillPolicy::sorted ) {
+    std::vector<FillPolicy::resolved_t> bins, scratch;
+    bins.reserve(buffer.size());
+    for(auto & it : buffer)
+      bins.emplace_back(xaxis.GetBinCountAll()*yaxis.FindBin( it.y ) + xaxis.FindBin( it.x ), it.w);
+    FillPolicy::ApplySorted(data, xaxis.GetBinCountAll()*yaxis.GetBinCountAll(), bins, scratch);
+    entries += bins.size();
+  } else {
+    for(auto & it : buffer)
+      FillDirect(it);
+  }
+  buffer.clear();
+  buffered.store(false, std::memory_order_release);
 }
 
 // ########################################################################
 
-#ifdef H2D_USE_BUFFER
-void Histogram2D::FlushBuffer()
+void Histogram2D::SetFillPolicy(const FillPolicy& pol)
 {
-    if( !buffer.empty() ) {
-      for ( auto &v : buffer )
-        FillDirect(v.x, v.y, v.w);
-      buffer.clear();
-    }
+  FlushBuffer();
+  policy = pol.Resolve(xaxis.GetBinCountAll()*yaxis.GetBinCountAll());
+  buffer.shrink_to_fit();
+  buffer.reserve(policy.buffer_size);
 }
-#endif /* H2D_USE_BUFFER */
 
 // ########################################################################
 
 void Histogram2D::Reset()
 {
-#ifdef H2D_USE_BUFFER
   buffer.clear();
-#endif /* H2D_USE_BUFFER */
-  for(Axis::index_t y=0; y<yaxis.GetBinCountAll(); ++y )
-    for(Axis::index_t x=0; x<xaxis.GetBinCountAll(); ++x )
-      SetBinContent( x, y, 0 );
+  buffered.store(false, std::memory_order_relaxed);
+  std::fill(data, data + xaxis.GetBinCountAll()*yaxis.GetBinCountAll(), 0);
   entries = 0;
 }
 
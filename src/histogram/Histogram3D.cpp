@@ -25,44 +25,37 @@
 
 #include "Histogram3D.h"
 
+#include <algorithm>
 #include <iostream>
 
-#ifdef H3D_USE_BUFFER
-const unsigned int Histogram3D::buffer_max;
-#endif /* H2D_USE_BUFFER */
-
 // ########################################################################
 
 Histogram3D::Histogram3D( const std::string& name, const std::string& title,
                           Axis::index_t ch1, Axis::bin_t l1, Axis::bin_t r1, const std::string& xt,
                           Axis::index_t ch2, Axis::bin_t l2, Axis::bin_t r2, const std::string& yt,
                           Axis::index_t ch3, Axis::bin_t l3, Axis::bin_t r3, const std::string& zt,
-                          const std::string& path)
+                          const std::string& path, const FillPolicy& pol)
         : Named( name, title, path )
         , xaxis( name+"_xaxis", ch1, l1, r1, xt )
         , yaxis( name+"_yaxis", ch2, l2, r2, yt )
         , zaxis( name+"_zaxis", ch3, l3, r3, zt)
         , entries( 0 )
-#ifndef USE_ROWS
         , data( nullptr )
-#else
         , rows( nullptr )
-#endif
+        , policy( pol.Resolve(xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zaxis.GetBinCountAll()) )
+        , buffered( false )
 {
-#ifdef H3D_USE_BUFFER
-    buffer.reserve(buffer_max);
-#endif /* H2D_USE_BUFFER */
-
-#ifndef USE_ROWS
-    data = new data_t[xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zaxis.GetBinCountAll()];
-#else
-    rows = new data_t**[zaxis.GetBinCountAll()];
-    for(Axis::index_t z=0; z<zaxis.GetBinCountAll(); ++z) {
-        rows[z] = new data_t *[yaxis.GetBinCountAll()];
-        for (Axis::index_t y = 0; y < yaxis.GetBinCountAll(); ++y)
-            rows[z][y] = new data_t[xaxis.GetBinCountAll()];
+    buffer.reserve(policy.buffer_size);
+
+    const Axis::index_t nx = xaxis.GetBinCountAll(), ny = yaxis.GetBinCountAll(), nz = zaxis.GetBinCountAll();
+    data = new data_t[nx*ny*nz];
+    rows = new data_t**[nz];
+    data_t **table = new data_t*[ny*nz];
+    for(Axis::index_t z=0; z<nz; ++z) {
+        rows[z] = table + ny*z;
+        for (Axis::index_t y = 0; y < ny; ++y)
+            rows[z][y] = data + nx*( ny*z + y );
     }
-#endif
     Reset();
 }
 
@@ -70,16 +63,10 @@ Histogram3D::Histogram3D( const std::string& name, const std::string& title,
 
 Histogram3D::~Histogram3D()
 {
-#ifndef USE_ROWS
-    delete data;
-#else
-    for(Axis::index_t z=0; z<zaxis.GetBinCountAll(); ++z) {
-        for (Axis::index_t y = 0; y < yaxis.GetBinCountAll(); ++y)
-            delete rows[z][y];
-        delete rows[z];
-    }
-    delete rows;
-#endif
+    // All row pointers are in one table starting at rows[0].
+    delete[] rows[0];
+    delete[] rows;
+    delete[] data;
 }
 
 // ########################################################################
@@ -99,20 +86,12 @@ void Histogram3D::Add(const Histogram3Dp &other, data_t scale)
         || other->GetAxisZ().GetBinCount() != zaxis.GetBinCount() )
         throw std::runtime_error("Histograms '"+GetName()+"' and '"+other->GetName()+"' does not have the same dimentions.");
 
-#ifdef H3D_USE_BUFFER
     other->FlushBuffer();
     FlushBuffer();
-#endif /* H3D_USE_BUFFER */
 
-#ifndef USE_ROWS
     for(Axis::index_t i=0; i<xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zaxis.GetBinCountAll(); ++i)
         data[i] += scale * other->data[i];
-#else
-    for(Axis::index_t z=0; z<zaxis.GetBinCountAll(); ++z )
-        for(Axis::index_t y=0; y<yaxis.GetBinCountAll(); ++y )
-            for(Axis::index_t x=0; x<xaxis.GetBinCountAll(); ++x )
-            rows[z][y][x] += scale*other->rows[z][y][x];
-#endif
+
     // Update total count
     entries += scale * other->entries;
 }
@@ -121,85 +100,89 @@ void Histogram3D::Add(const Histogram3Dp &other, data_t scale)
 
 Histogram3D::data_t Histogram3D::GetBinContent(Axis::index_t xbin, Axis::index_t ybin, Axis::index_t zbin)
 {
-#ifdef H3D_USE_BUFFER
-    if( !buffer.empty() )
-        FlushBuffer();
-#endif /* H3D_USE_BUFFER */
+    FlushBuffer();
 
     if( xbin<xaxis.GetBinCountAll() &&
         ybin<yaxis.GetBinCountAll() &&
-        zbin<zaxis.GetBinCountAll() ) {
-#ifndef USE_ROWS
-        return data[xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zbin +
-                    xaxis.GetBinCountAll()*ybin + xbin];
-#else
+        zbin<zaxis.GetBinCountAll() )
         return rows[zbin][ybin][xbin];
-#endif // USE_ROWS
-    } else
+    else
         return 0;
 }
 
 // ########################################################################
 
+const Histogram3D::data_t *Histogram3D::GetRow(Axis::index_t ybin, Axis::index_t zbin)
+{
+    return GetWritableRow(ybin, zbin);
+}
+
+// ########################################################################
+
+Histogram3D::data_t *Histogram3D::GetWritableRow(Axis::index_t ybin, Axis::index_t zbin)
+{
+    FlushBuffer();
+
+    if( ybin<yaxis.GetBinCountAll() && zbin<zaxis.GetBinCountAll() )
+        return rows[zbin][ybin];
+    else
+        return nullptr;
+}
+
+// ########################################################################
+
 void Histogram3D::SetBinContent(Axis::index_t xbin, Axis::index_t ybin, Axis::index_t zbin, data_t c)
 {
-#ifdef H3D_USE_BUFFER
-    if( !buffer.empty() )
-        FlushBuffer();
-#endif /* H3D_USE_BUFFER */
+    FlushBuffer();
 
     if( xbin<xaxis.GetBinCountAll() &&
         ybin<yaxis.GetBinCountAll() &&
-        zbin<zaxis.GetBinCountAll() ) {
-#ifndef USE_ROWS
-        data[xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zbin +
-             xaxis.GetBinCountAll()*ybin + xbin] = c;
-#else
+        zbin<zaxis.GetBinCountAll() )
         rows[zbin][ybin][xbin] = c;
-#endif // USE_ROWS
-    }
 }
 
 // ########################################################################
 
-void Histogram3D::FillDirect(Axis::bin_t x, Axis::bin_t y, Axis::bin_t z, data_t weight)
+void Histogram3D::FlushBuffer()
 {
-    const Axis::index_t xbin = xaxis.FindBin( x );
-    const Axis::index_t ybin = yaxis.FindBin( y );
-    const Axis::index_t zbin = zaxis.FindBin( z );
-#ifndef USE_ROWS
-    data[xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zbin +
-         xaxis.GetBinCountAll()*ybin + xbin] += weight;
-#else
-    rows[zbin][ybin][xbin] += weight;
-    entries += 1;
-#endif // USE_ROWS
+    if( !buffered.load(std::memory_order_acquire) )
+        return;
+    std::lock_guard<std::mutex> lock(flush_mutex);
+    if( buffer.empty() )
+        return;
+    if( policy.flush == FillPolicy::sorted ) {
+        const Axis::index_t nx = xaxis.GetBinCountAll(), ny = yaxis.GetBinCountAll();
+        std::vector<FillPolicy::resolved_t> bins, scratch;
+        bins.reserve(buffer.size());
+        for(auto & it : buffer)
+            bins.emplace_back(nx*( ny*zaxis.FindBin( it.z ) + yaxis.FindBin( it.y ) ) + xaxis.FindBin( it.x ), it.w);
+        FillPolicy::ApplySorted(data, nx*ny*zaxis.GetBinCountAll(), bins, scratch);
+        entries += bins.size();
+    } else {
+        for(auto & it : buffer)
+            FillDirect(it);
+    }
+    buffer.clear();
+    buffered.store(false, std::memory_order_release);
 }
 
 // ########################################################################
 
-#ifdef H3D_USE_BUFFER
-void Histogram3D::FlushBuffer()
+void Histogram3D::SetFillPolicy(const FillPolicy& pol)
 {
-    if( !buffer.empty() ) {
-      for ( auto &v : buffer )
-        FillDirect(v.x, v.y, v.z, v.w);
-      buffer.clear();
-    }
+    FlushBuffer();
+    policy = pol.Resolve(xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zaxis.GetBinCountAll());
+    buffer.shrink_to_fit();
+    buffer.reserve(policy.buffer_size);
 }
-#endif /* H3D_USE_BUFFER */
 
 // ########################################################################
 
 void Histogram3D::Reset()
 {
-#ifdef H2D_USE_BUFFER
     buffer.clear();
-#endif /* H2D_USE_BUFFER */
-    for(Axis::index_t z=0; z<zaxis.GetBinCountAll(); ++z )
-        for(Axis::index_t y=0; y<yaxis.GetBinCountAll(); ++y )
-            for(Axis::index_t x=0; x<xaxis.GetBinCountAll(); ++x )
-                SetBinContent( x, y, z, 0 );
+    buffered.store(false, std::memory_order_relaxed);
+    std::fill(data, data + xaxis.GetBinCountAll()*yaxis.GetBinCountAll()*zaxis.GetBinCountAll(), 0);
     entries = 0;
 }
 
@@ -4,6 +4,9 @@
 #include "Histogram1D.h"
 #include "Histogram2D.h"
 #include "Histogram3D.h"
+#include "SubtractedHistogram2D.h"
+#include "ThreadPool.h"
+#include "Trace.h"
 
 #include <iostream>
 
@@ -37,6 +40,58 @@ Axis::Axis(const std::string& name, index_t c, bin_t l, bin_t r, const std::stri
 // ########################################################################
 // ########################################################################
 
+void FillPolicy::ApplySorted(size_t *data, size_t size, const std::vector<resolved_t> &fills,
+                             std::vector<resolved_t> &scratch)
+{
+  // Regions of at least 4096 bins (32 kB), at most 256 of them.
+  size_t shift = 12;
+  while( ( size >> shift ) >= 256 )
+    ++shift;
+  const size_t regions = ( size >> shift ) + 1;
+  if( regions == 1 ) {
+    for(auto & it : fills)
+      data[it.first] += it.second;
+    return;
+  }
+
+  std::vector<size_t> start(regions + 1, 0);
+  for(auto & it : fills)
+    ++start[( it.first >> shift ) + 1];
+  for(size_t i = 1; i <= regions; ++i)
+    start[i] += start[i - 1];
+  scratch.resize(fills.size());
+  for(auto & it : fills)
+    scratch[start[it.first >> shift]++] = it;
+  for(auto & it : scratch)
+    data[it.first] += it.second;
+}
+
+// ########################################################################
+// ########################################################################
+
+namespace {
+
+// Collect the histograms of a directory and its subdirectories.
+template<class List>
+void CollectSubtree(const Histograms::Directory& dir, List Histograms::Directory::*member, List& out)
+{
+  const List& own = dir.*member;
+  out.insert(out.end(), own.begin(), own.end());
+  for(auto & it : dir.children)
+    CollectSubtree(*it.second, member, out);
+}
+
+}
+
+// ########################################################################
+
+Histograms::Histograms()
+    : root( new Directory )
+{
+}
+
+// ########################################################################
+
 Histograms::~Histograms()
 {
   for(auto & it : map1d)
@@ -45,19 +100,93 @@ Histograms::~Histograms()
       delete it.second;
   for(auto & it : map3d)
       delete it.second;
+  for(auto & it : map2s)
+      delete it.second;
+}
+
+// ########################################################################
+
+std::string Histograms::NormalisePath(const std::string& path)
+{
+  std::string result;
+  size_t begin = 0;
+  while( begin < path.size() ) {
+    size_t end = path.find('/', begin);
+    if( end == std::string::npos )
+      end = path.size();
+    if( end > begin ) {
+      if( !result.empty() )
+        result += '/';
+      result.append(path, begin, end - begin);
+    }
+    begin = end + 1;
+  }
+  return result;
+}
+
+// ########################################################################
+
+const Histograms::Directory* Histograms::FindDirectory(const std::string& path) const
+{
+  const Directory* dir = root.get();
+  const std::string normalised = NormalisePath(path);
+  size_t begin = 0;
+  while( dir && begin < normalised.size() ) {
+    size_t end = normalised.find('/', begin);
+    if( end == std::string::npos )
+      end = normalised.size();
+    auto it = dir->children.find(normalised.substr(begin, end - begin));
+    dir = ( it != dir->children.end() ) ? it->second.get() : nullptr;
+    begin = end + 1;
+  }
+  return dir;
+}
+
+// ########################################################################
+
+const Histograms::Directory& Histograms::GetDirectory(const std::string& path) const
+{
+  const Directory* dir = FindDirectory(path);
+  if( dir == nullptr )
+    throw std::runtime_error("No directory '"+path+"' in histogram set");
+  return *dir;
+}
+
+// ########################################################################
+
+Histograms::Directory& Histograms::MakeDirectory(const std::string& path)
+{
+  Directory* dir = root.get();
+  const std::string normalised = NormalisePath(path);
+  size_t begin = 0;
+  while( begin < normalised.size() ) {
+    size_t end = normalised.find('/', begin);
+    if( end == std::string::npos )
+      end = normalised.size();
+    std::unique_ptr<Directory> &child = dir->children[normalised.substr(begin, end - begin)];
+    if( !child ) {
+      child.reset(new Directory);
+      child->name = normalised.substr(begin, end - begin);
+      child->path = normalised.substr(0, end);
+    }
+    dir = child.get();
+    begin = end + 1;
+  }
+  return *dir;
 }
 
 // ########################################################################
 
 Histogram1Dp Histograms::Create1D( const std::string& name, const std::string& title,
                                    Axis::index_t c, Axis::bin_t l, Axis::bin_t r, const std::string& xtitle,
-                                   const std::string& path)
+                                   const std::string& path, const FillPolicy& policy)
 {
   // Check if already exist, throw if so
   if ( Find1D(name) != nullptr )
     throw std::runtime_error("Histogram with name '"+name+"' already exists");
-  Histogram1Dp h(new Histogram1D(name, title, c, l, r, xtitle, path));
+  Histogram1Dp h(new Histogram1D(name, title, c, l, r, xtitle, path, policy));
   map1d[ name ] = h;
+  MakeDirectory( path ).hist1d.push_back( h );
   return h;
 }
 
@@ -66,12 +195,13 @@ Histogram1Dp Histograms::Create1D( const std::string& name, const std::string& t
 Histogram2Dp Histograms::Create2D( const std::string& name, const std::string& title,
                                    Axis::index_t ch1, Axis::bin_t l1, Axis::bin_t r1, const std::string& xtitle,
                                    Axis::index_t ch2, Axis::bin_t l2, Axis::bin_t r2, const std::string& ytitle,
-                                   const std::string& path)
+                                   const std::string& path, const FillPolicy& policy)
 {
-  Histogram2Dp h(new Histogram2D(name, title, ch1, l1, r1, xtitle, ch2, l2, r2, ytitle, path));
   if ( Find2D(name) != nullptr )
     throw std::runtime_error("Histogram with name '"+name+"' already exists");
+  Histogram2Dp h(new Histogram2D(name, title, ch1, l1, r1, xtitle, ch2, l2, r2, ytitle, path, policy));
   map2d[ name ] = h;
+  MakeDirectory( path ).hist2d.push_back( h );
   return h;
 }
 
@@ -81,25 +211,89 @@ Histogram3Dp Histograms::Create3D( const std::string& name, const std::string& t
                                    Axis::index_t ch1, Axis::bin_t l1, Axis::bin_t r1, const std::string& xtitle,
                                    Axis::index_t ch2, Axis::bin_t l2, Axis::bin_t r2, const std::string& ytitle,
                                    Axis::index_t ch3, Axis::bin_t l3, Axis::bin_t r3, const std::string& ztitle,
-                                   const std::string& path)
+                                   const std::string& path, const FillPolicy& policy)
 {
     if ( Find3D(name) != nullptr )
       throw std::runtime_error("Histogram with name '"+name+"' already exists");
-    Histogram3Dp h(new Histogram3D(name, title, ch1, l1, r1, xtitle, ch2, l2, r2, ytitle, ch3, l3, r3, ztitle, path));
+    Histogram3Dp h(new Histogram3D(name, title, ch1, l1, r1, xtitle, ch2, l2, r2, ytitle, ch3, l3, r3, ztitle, path, policy));
     map3d[ name ] = h;
+    MakeDirectory( path ).hist3d.push_back( h );
     return h;
 }
 
 // ########################################################################
 
+SubtractedHistogram2Dp Histograms::CreateSubtracted2D( const std::string& name, const std::string& title,
+                                                       Axis::index_t ch1, Axis::bin_t l1, Axis::bin_t r1, const std::string& xtitle,
+                                                       Axis::index_t ch2, Axis::bin_t l2, Axis::bin_t r2, const std::string& ytitle,
+                                                       double ratio, const std::string& path)
+{
+  if ( FindSubtracted2D(name) != nullptr )
+    throw std::runtime_error("Histogram with name '"+name+"' already exists");
+  SubtractedHistogram2Dp h(new SubtractedHistogram2D(name, title, ch1, l1, r1, xtitle, ch2, l2, r2, ytitle, ratio, path));
+  map2s[ name ] = h;
+  MakeDirectory( path ).hist2s.push_back( h );
+  return h;
+}
+
+// ########################################################################
+
+void Histograms::ResetLists(const list1d_t& list1d, const list2d_t& list2d, const list3d_t& list3d,
+                            const list2s_t& list2s, ThreadPool* pool)
+{
+  if( pool == nullptr ) {
+    for(auto & it : list1d)
+      it->Reset();
+    for(auto & it : list2d)
+      it->Reset();
+    for(auto & it : list3d)
+      it->Reset();
+    for(auto & it : list2s)
+      it->Reset();
+    return;
+  }
+
+  const size_t n1 = list1d.size(), n2 = list2d.size(), n3 = list3d.size();
+  pool->ParallelFor(0, n1 + n2 + n3 + list2s.size(), [&](size_t first, size_t last){
+    for(size_t i = first; i < last; ++i) {
+      if( i < n1 )
+        list1d[i]->Reset();
+      else if( i < n1 + n2 )
+        list2d[i - n1]->Reset();
+      else if( i < n1 + n2 + n3 )
+        list3d[i - n1 - n2]->Reset();
+      else
+        list2s[i - n1 - n2 - n3]->Reset();
+    }
+  });
+}
+
+// ########################################################################
+
 void Histograms::ResetAll()
 {
-  for(auto & it : map1d)
-    it.second->Reset();
-  for(auto & it : map2d)
-    it.second->Reset();
-  for(auto & it : map3d)
-    it.second->Reset();
+  ResetLists(GetAll1D(), GetAll2D(), GetAll3D(), GetAllSubtracted2D(), nullptr);
+}
+
+// ########################################################################
+
+void Histograms::ResetAll(ThreadPool& pool)
+{
+  ResetLists(GetAll1D(), GetAll2D(), GetAll3D(), GetAllSubtracted2D(), &pool);
+}
+
+// ########################################################################
+
+void Histograms::ResetAll(const std::string& path)
+{
+  ResetLists(GetAll1D(path), GetAll2D(path), GetAll3D(path), GetAllSubtracted2D(path), nullptr);
+}
+
+// ########################################################################
+
+void Histograms::ResetAll(const std::string& path, ThreadPool& pool)
+{
+  ResetLists(GetAll1D(path), GetAll2D(path), GetAll3D(path), GetAllSubtracted2D(path), &pool);
 }
 
 // ########################################################################
@@ -137,26 +331,96 @@ Histogram3Dp Histograms::Find3D( const std::string& name )
 
 // ########################################################################
 
-void Histograms::Merge(Histograms& other)
+SubtractedHistogram2Dp Histograms::FindSubtracted2D( const std::string& name )
 {
-  for(auto & it : map1d) {
-    Histogram1Dp me = it.second;
-    Histogram1Dp you = other.Find1D( me->GetName() );
-    if( you )
-      me->Add( you, 1 );
-  }
-  for(auto & it : map2d) {
-    Histogram2Dp me = it.second;
-    Histogram2Dp you = other.Find2D( me->GetName() );
-    if( you )
-      me->Add( you, 1 );
-  }
-    for(auto & it : map3d) {
-        Histogram3Dp me = it.second;
-        Histogram3Dp you = other.Find3D( me->GetName() );
-        if( you )
-            me->Add( you, 1 );
+  auto it = map2s.find( name );
+  if( it != map2s.end() )
+    return it->second;
+  else
+    return nullptr;
+}
+
+// ########################################################################
+
+void Histograms::MergeLists(const list1d_t& list1d, const list2d_t& list2d, const list3d_t& list3d,
+                            const list2s_t& list2s, Histograms& other, ThreadPool* pool)
+{
+  // Pair up the histograms first, the parallel part only touches histogram contents.
+  std::vector<std::pair<Histogram1Dp, Histogram1Dp>> pairs1d;
+  std::vector<std::pair<Histogram2Dp, Histogram2Dp>> pairs2d;
+  std::vector<std::pair<Histogram3Dp, Histogram3Dp>> pairs3d;
+  std::vector<std::pair<SubtractedHistogram2Dp, SubtractedHistogram2Dp>> pairs2s;
+  for(auto & it : list1d)
+    if( Histogram1Dp you = other.Find1D( it->GetName() ) )
+      pairs1d.emplace_back(it, you);
+  for(auto & it : list2d)
+    if( Histogram2Dp you = other.Find2D( it->GetName() ) )
+      pairs2d.emplace_back(it, you);
+  for(auto & it : list3d)
+    if( Histogram3Dp you = other.Find3D( it->GetName() ) )
+      pairs3d.emplace_back(it, you);
+  for(auto & it : list2s)
+    if( SubtractedHistogram2Dp you = other.FindSubtracted2D( it->GetName() ) )
+      pairs2s.emplace_back(it, you);
+
+  const size_t n1 = pairs1d.size(), n2 = pairs2d.size(), n3 = pairs3d.size();
+  auto merge = [&](size_t first, size_t last){
+    for(size_t i = first; i < last; ++i) {
+      if( i < n1 ) {
+        auto &p = pairs1d[i];
+        HISTOGRAM_TRACE(merge_begin, p.first->GetName(), p.second->GetEntries());
+        p.first->Add( p.second, 1 );
+        HISTOGRAM_TRACE(merge_end, p.first->GetName(), p.first->GetEntries());
+      } else if( i < n1 + n2 ) {
+        auto &p = pairs2d[i - n1];
+        HISTOGRAM_TRACE(merge_begin, p.first->GetName(), p.second->GetEntries());
+        p.first->Add( p.second, 1 );
+        HISTOGRAM_TRACE(merge_end, p.first->GetName(), p.first->GetEntries());
+      } else if( i < n1 + n2 + n3 ) {
+        auto &p = pairs3d[i - n1 - n2];
+        HISTOGRAM_TRACE(merge_begin, p.first->GetName(), p.second->GetEntries());
+        p.first->Add( p.second, 1 );
+        HISTOGRAM_TRACE(merge_end, p.first->GetName(), p.first->GetEntries());
+      } else {
+        auto &p = pairs2s[i - n1 - n2 - n3];
+        HISTOGRAM_TRACE(merge_begin, p.first->GetName(), p.second->GetEntries());
+        p.first->Add( p.second, 1 );
+        HISTOGRAM_TRACE(merge_end, p.first->GetName(), p.first->GetEntries());
+      }
     }
+  };
+  if( pool )
+    pool->ParallelFor(0, n1 + n2 + n3 + pairs2s.size(), merge);
+  else
+    merge(0, n1 + n2 + n3 + pairs2s.size());
+}
+
+// ########################################################################
+
+void Histograms::Merge(Histograms& other)
+{
+  MergeLists(GetAll1D(), GetAll2D(), GetAll3D(), GetAllSubtracted2D(), other, nullptr);
+}
+
+// ########################################################################
+
+void Histograms::Merge(Histograms& other, ThreadPool& pool)
+{
+  MergeLists(GetAll1D(), GetAll2D(), GetAll3D(), GetAllSubtracted2D(), other, &pool);
+}
+
+// ########################################################################
+
+void Histograms::Merge(Histograms& other, const std::string& path)
+{
+  MergeLists(GetAll1D(path), GetAll2D(path), GetAll3D(path), GetAllSubtracted2D(path), other, nullptr);
+}
+
+// ########################################################################
+
+void Histograms::Merge(Histograms& other, const std::string& path, ThreadPool& pool)
+{
+  MergeLists(GetAll1D(path), GetAll2D(path), GetAll3D(path), GetAllSubtracted2D(path), other, &pool);
 }
 
 // ########################################################################
@@ -189,4 +453,50 @@ Histograms::list3d_t Histograms::GetAll3D()
     return list3d;
 }
 
-// ########################################################################
\ No newline at end of file
+// ########################################################################
+
+Histograms::list2s_t Histograms::GetAllSubtracted2D()
+{
+  list2s_t list2s;
+  for(auto & it : map2s)
+    list2s.push_back( it.second );
+  return list2s;
+}
+
+// ########################################################################
+
+Histograms::list1d_t Histograms::GetAll1D(const std::string& path)
+{
+  list1d_t list1d;
+  CollectSubtree(GetDirectory(path), &Directory::hist1d, list1d);
+  return list1d;
+}
+
+// ########################################################################
+
+Histograms::list2d_t Histograms::GetAll2D(const std::string& path)
+{
+  list2d_t list2d;
+  CollectSubtree(GetDirectory(path), &Directory::hist2d, list2d);
+  return list2d;
+}
+
+// ########################################################################
+
+Histograms::list3d_t Histograms::GetAll3D(const std::string& path)
+{
+  list3d_t list3d;
+  CollectSubtree(GetDirectory(path), &Directory::hist3d, list3d);
+  return list3d;
+}
+
+// ########################################################################
+
+Histograms::list2s_t Histograms::GetAllSubtracted2D(const std::string& path)
+{
+  list2s_t list2s;
+  CollectSubtree(GetDirectory(path), &Directory::hist2s, list2s);
+  return list2s;
+}
+
+// ########################################################################
@@ -14,6 +14,8 @@
 
 #include "Histogram1D.h"
 #include "Histogram2D.h"
+#include "SubtractedHistogram2D.h"
+#include "Trace.h"
 
 #include <fstream>
 #include <iostream>
@@ -102,12 +104,14 @@ static void spectrum_write_header(std::ostream& fp, const std::string& comment,
 
 int MamaWriter::Write(std::ostream& fp, Histogram1Dp h)
 {
+  HISTOGRAM_TRACE(write_begin, h->GetName(), h->GetEntries());
   const Axis& xax = h->GetAxisX();
   float cal[3] = { (float)xax.GetLeft(), (float)xax.GetBinWidth(), 0 };
   spectrum_write_header(fp, h->GetTitle(), xax.GetBinCount(), -1, cal);
   for(Axis::index_t i = 0; i < xax.GetBinCount(); i++)
     fp << h->GetBinContent(i+1) << ' ';
   fp << "\n!IDEND=\n\n" << std::flush;
+  HISTOGRAM_TRACE(write_end, h->GetName(), h->GetEntries());
 
   return ( !fp ) ? -1 : 0;
 }
@@ -116,6 +120,7 @@ int MamaWriter::Write(std::ostream& fp, Histogram1Dp h)
 
 int MamaWriter::Write(std::ostream& fp, Histogram2Dp h)
 {
+  HISTOGRAM_TRACE(write_begin, h->GetName(), h->GetEntries());
   const Axis& xax = h->GetAxisX();
   const Axis& yax = h->GetAxisY();
   float cal[6] = {
@@ -129,12 +134,36 @@ int MamaWriter::Write(std::ostream& fp, Histogram2Dp h)
     fp << '\n';
   }
   fp << "!IDEND=\n\n" << std::flush;
+  HISTOGRAM_TRACE(write_end, h->GetName(), h->GetEntries());
 
   return 0;
 }
 
 // ########################################################################
 
+int MamaWriter::Write(std::ostream& fp, SubtractedHistogram2Dp h)
+{
+  HISTOGRAM_TRACE(write_begin, h->GetName(), h->GetEntries());
+  const Axis& xax = h->GetAxisX();
+  const Axis& yax = h->GetAxisY();
+  float cal[6] = {
+      (float)xax.GetLeft(), (float)xax.GetBinWidth(), 0,
+      (float)yax.GetLeft(), (float)yax.GetBinWidth(), 0
+  };
+  spectrum_write_header(fp, h->GetTitle(), xax.GetBinCount(), yax.GetBinCount(), cal);
+  for(Axis::index_t j=0; j < yax.GetBinCount(); ++j) {
+    for(Axis::index_t i=0; i < xax.GetBinCount(); ++i)
+      fp << h->GetBinContent(i+1, j+1) << ' ';
+    fp << '\n';
+  }
+  fp << "!IDEND=\n\n" << std::flush;
+  HISTOGRAM_TRACE(write_end, h->GetName(), h->GetEntries());
+
+  return ( !fp ) ? -1 : 0;
+}
+
+// ########################################################################
+
 int MamaWriter::Write(std::ostream&, Histogram3Dp)
 {
     throw std::runtime_error("MaMa format does not support 3D histograms");
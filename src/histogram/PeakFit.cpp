@@ -0,0 +1,258 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "PeakFit.h"
+
+#include "Histogram1D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+static constexpr double pi = 3.14159265358979323846;
+
+//! Solve a x = b by Gaussian elimination with partial pivoting. a is n x n, row major.
+/*! \return false if the matrix is singular.
+ */
+static bool Solve(std::vector<double> a, std::vector<double> b, std::vector<double> &x)
+{
+    const size_t n = b.size();
+    for ( size_t col = 0 ; col < n ; ++col ){
+        size_t pivot = col;
+        for ( size_t row = col + 1 ; row < n ; ++row ){
+            if ( std::abs(a[row*n + col]) > std::abs(a[pivot*n + col]) )
+                pivot = row;
+        }
+        if ( a[pivot*n + col] == 0 || !std::isfinite(a[pivot*n + col]) )
+            return false;
+        if ( pivot != col ){
+            for ( size_t k = 0 ; k < n ; ++k )
+                std::swap(a[col*n + k], a[pivot*n + k]);
+            std::swap(b[col], b[pivot]);
+        }
+        for ( size_t row = col + 1 ; row < n ; ++row ){
+            const double factor = a[row*n + col]/a[col*n + col];
+            for ( size_t k = col ; k < n ; ++k )
+                a[row*n + k] -= factor*a[col*n + k];
+            b[row] -= factor*b[col];
+        }
+    }
+    x.assign(n, 0.);
+    for ( size_t row = n ; row-- > 0 ; ){
+        double sum = b[row];
+        for ( size_t k = row + 1 ; k < n ; ++k )
+            sum -= a[row*n + k]*x[k];
+        x[row] = sum/a[row*n + row];
+    }
+    return true;
+}
+
+namespace {
+
+    //! The data of a region and the model evaluated on it.
+    struct Model {
+        std::vector<double> x, y, weight;   //!< Bin centres, contents and 1/variance.
+        double x0;                          //!< Middle of the region.
+        double width;                       //!< Bin width.
+        size_t parameters;                  //!< Number of parameters.
+
+        std::vector<double> f;              //!< Model at each bin.
+        std::vector<double> jacobian;       //!< Derivative of the model, one array of bins per parameter.
+
+        //! Evaluate model and Jacobian at p. \return chi².
+        double Evaluate(const std::vector<double> &p)
+        {
+            const size_t m = x.size();
+            f.resize(m);
+            jacobian.resize(parameters*m);
+            double *j0 = jacobian.data(), *j1 = j0 + m;
+            for ( size_t i = 0 ; i < m ; ++i ){
+                j0[i] = 1;
+                j1[i] = x[i] - x0;
+                f[i] = p[0] + p[1]*j1[i];
+            }
+            for ( size_t k = 2 ; k < parameters ; k += 3 ){
+                const double area = p[k], centroid = p[k + 1], sigma = p[k + 2];
+                const double norm = width/( sigma*std::sqrt(2*pi) );
+                const double inv_var = 1/( sigma*sigma );
+                double *ja = jacobian.data() + k*m, *jc = ja + m, *js = jc + m;
+                for ( size_t i = 0 ; i < m ; ++i ){
+                    const double d = x[i] - centroid;
+                    const double g = norm*std::exp(-0.5*d*d*inv_var);
+                    f[i] += area*g;
+                    ja[i] = g;
+                    jc[i] = area*g*d*inv_var;
+                    js[i] = area*g*( d*d*inv_var - 1 )/sigma;
+                }
+            }
+            double chi2 = 0;
+            for ( size_t i = 0 ; i < m ; ++i ){
+                const double r = y[i] - f[i];
+                chi2 += weight[i]*r*r;
+            }
+            return chi2;
+        }
+
+        //! Curvature matrix J^T W J and gradient J^T W (y - f) at the last evaluation.
+        void Normal(std::vector<double> &h, std::vector<double> &g) const
+        {
+            const size_t m = x.size();
+            h.assign(parameters*parameters, 0.);
+            g.assign(parameters, 0.);
+            for ( size_t a = 0 ; a < parameters ; ++a ){
+                const double *ja = jacobian.data() + a*m;
+                double sum = 0;
+                for ( size_t i = 0 ; i < m ; ++i )
+                    sum += weight[i]*ja[i]*( y[i] - f[i] );
+                g[a] = sum;
+                for ( size_t b = 0 ; b <= a ; ++b ){
+                    const double *jb = jacobian.data() + b*m;
+                    double hab = 0;
+                    for ( size_t i = 0 ; i < m ; ++i )
+                        hab += weight[i]*ja[i]*jb[i];
+                    h[a*parameters + b] = h[b*parameters + a] = hab;
+                }
+            }
+        }
+    };
+}
+
+// ########################################################################
+
+PeakFit::Result PeakFit::Fit(const Region &region, const Options &options)
+{
+    const Axis &axis = region.hist->GetAxisX();
+    const size_t first = std::max(axis.FindBin(region.low), Axis::index_t(1));
+    const size_t last = std::min(axis.FindBin(region.high), axis.GetBinCount());
+    const size_t peaks = region.centroids.size();
+
+    Model model;
+    model.parameters = 2 + 3*peaks;
+    model.width = axis.GetBinWidth();
+    model.x0 = 0.5*( region.low + region.high );
+    const Histogram1D::data_t *data = region.hist->GetData();
+    for ( size_t bin = first ; bin <= last ; ++bin ){
+        model.x.push_back(axis.GetBinCenter(bin));
+        model.y.push_back(double(data[bin]));
+        model.weight.push_back(1/std::max(double(data[bin]), 1.));
+    }
+    const size_t m = model.x.size();
+    if ( last < first || m <= model.parameters )
+        throw std::runtime_error("Region of '" + region.hist->GetName() + "' has " + std::to_string(m) +
+                                 " bins, too few to fit " + std::to_string(model.parameters) + " parameters.");
+
+    // Starting values: straight line between the ends of the region, and peaks of the height above it.
+    std::vector<double> p(model.parameters);
+    const double yl = 0.5*( model.y[0] + model.y[1] ), xl = 0.5*( model.x[0] + model.x[1] );
+    const double yr = 0.5*( model.y[m - 2] + model.y[m - 1] ), xr = 0.5*( model.x[m - 2] + model.x[m - 1] );
+    p[1] = ( yr - yl )/( xr - xl );
+    p[0] = yl + p[1]*( model.x0 - xl );
+    const double sigma = ( options.sigma > 0 ) ? options.sigma : 2*model.width;
+    for ( size_t k = 0 ; k < peaks ; ++k ){
+        const double centroid = region.centroids[k];
+        const size_t i = std::min(size_t(std::max(( centroid - model.x[0] )/model.width + 0.5, 0.)), m - 1);
+        const double height = std::max(model.y[i] - p[0] - p[1]*( centroid - model.x0 ), 1.);
+        p[2 + 3*k] = height*sigma*std::sqrt(2*pi)/model.width;
+        p[3 + 3*k] = centroid;
+        p[4 + 3*k] = sigma;
+    }
+
+    Result result;
+    result.ndf = m - model.parameters;
+    result.iterations = 0;
+    result.converged = false;
+
+    double chi2 = model.Evaluate(p);
+    double lambda = 1e-3;
+    std::vector<double> h, g, damped, step, trial(p.size());
+    while ( !result.converged && result.iterations < options.max_iterations ){
+        ++result.iterations;
+        model.Normal(h, g);
+        while ( true ){
+            damped = h;
+            for ( size_t a = 0 ; a < model.parameters ; ++a )
+                damped[a*model.parameters + a] *= 1 + lambda;
+            bool solved = Solve(damped, g, step);
+            double trial_chi2 = 0;
+            if ( solved ){
+                for ( size_t a = 0 ; a < p.size() ; ++a )
+                    trial[a] = p[a] + step[a];
+                for ( size_t k = 0 ; k < peaks ; ++k )
+                    trial[4 + 3*k] = std::abs(trial[4 + 3*k]);
+                trial_chi2 = model.Evaluate(trial);
+                solved = std::isfinite(trial_chi2);
+            }
+            if ( solved && trial_chi2 <= chi2 ){
+                const double improvement = chi2 - trial_chi2;
+                p.swap(trial);
+                chi2 = trial_chi2;
+                lambda = std::max(lambda/10, 1e-12);
+                result.converged = improvement <= options.tolerance*chi2;
+                break;
+            }
+            lambda *= 10;
+            if ( lambda > 1e12 ){
+                // No step improves chi², we are at the minimum.
+                model.Evaluate(p);
+                result.converged = true;
+                break;
+            }
+        }
+    }
+
+    // Errors from the inverse of the curvature matrix at the minimum.
+    model.Normal(h, g);
+    std::vector<double> errors(model.parameters, 0.), unit(model.parameters), column;
+    for ( size_t a = 0 ; a < model.parameters ; ++a ){
+        std::fill(unit.begin(), unit.end(), 0.);
+        unit[a] = 1;
+        if ( Solve(h, unit, column) )
+            errors[a] = std::sqrt(std::max(column[a], 0.));
+    }
+
+    result.chi2 = chi2;
+    result.offset = p[0];
+    result.offset_error = errors[0];
+    result.slope = p[1];
+    result.slope_error = errors[1];
+    for ( size_t k = 0 ; k < peaks ; ++k ){
+        const size_t a = 2 + 3*k;
+        result.peaks.push_back({p[a], errors[a], p[a + 1], errors[a + 1], p[a + 2], errors[a + 2]});
+    }
+    return result;
+}
+
+// ########################################################################
+
+std::vector<PeakFit::Result> PeakFit::Fit(const std::vector<Region> &regions, const Options &options, ThreadPool &pool)
+{
+    // Apply the fill buffers first, so the tasks only read the bins of histograms shared by regions.
+    for ( auto &region : regions )
+        region.hist->GetData();
+
+    std::vector<Result> results(regions.size());
+    pool.ParallelFor(0, regions.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i )
+            results[i] = Fit(regions[i], options);
+    });
+    return results;
+}
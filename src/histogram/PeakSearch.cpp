@@ -0,0 +1,173 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "PeakSearch.h"
+
+#include "Histogram1D.h"
+
+#include <algorithm>
+#include <cmath>
+
+//! Mean of the bins [first, last) clipped to the spectrum, and the position of that mean.
+static void EdgeMean(const std::vector<double> &y, long first, long last, double &mean, double &position)
+{
+    first = std::max(first, 0L);
+    last = std::min(last, long(y.size()));
+    if ( first >= last ){
+        // Nothing outside the window, use the bin at the window edge.
+        first = std::min(std::max(first, 0L), long(y.size()) - 1);
+        last = first + 1;
+    }
+    mean = 0;
+    for ( long i = first ; i < last ; ++i )
+        mean += y[i];
+    mean /= double(last - first);
+    position = 0.5*double(first + last - 1);
+}
+
+// ########################################################################
+
+void PeakSearch::Filter(const std::vector<double> &spectrum, double sigma,
+                        std::vector<double> &response, std::vector<double> &variance)
+{
+    const size_t n = spectrum.size();
+    const size_t half = size_t(std::ceil(3*sigma));
+
+    // Negative second derivative of a Gaussian, shifted to zero sum so that
+    // constant (and linear) background gives no response.
+    std::vector<double> kernel(2*half + 1);
+    double sum = 0;
+    for ( size_t k = 0 ; k < kernel.size() ; ++k ){
+        const double u = ( double(k) - double(half) )/sigma;
+        kernel[k] = ( 1 - u*u )*std::exp(-0.5*u*u);
+        sum += kernel[k];
+    }
+    for ( auto &c : kernel )
+        c -= sum/double(kernel.size());
+
+    std::vector<double> padded(n + 2*half);
+    for ( size_t i = 0 ; i < padded.size() ; ++i ){
+        const size_t j = std::min(std::max(i, half) - half, n - 1);
+        padded[i] = spectrum[j];
+    }
+
+    response.assign(n, 0.);
+    variance.assign(n, 0.);
+    double *r = response.data();
+    double *v = variance.data();
+    for ( size_t k = 0 ; k < kernel.size() ; ++k ){
+        const double c = kernel[k], c2 = c*c;
+        const double *y = padded.data() + k;
+        for ( size_t i = 0 ; i < n ; ++i ){
+            r[i] += c*y[i];
+            v[i] += c2*y[i];
+        }
+    }
+}
+
+// ########################################################################
+
+std::vector<PeakSearch::Peak> PeakSearch::Search(Histogram1Dp hist, const Options &options)
+{
+    const Axis &axis = hist->GetAxisX();
+    const size_t n = axis.GetBinCount();
+    const Histogram1D::data_t *data = hist->GetData();
+
+    std::vector<Peak> peaks;
+    if ( n < 3 )
+        return peaks;
+
+    std::vector<double> y(data + 1, data + n + 1);
+    std::vector<double> s, v;
+    Filter(y, options.sigma, s, v);
+
+    for ( size_t i = 1 ; i + 1 < n ; ++i ){
+        if ( s[i] <= 0 || s[i] < s[i - 1] || s[i] <= s[i + 1] )
+            continue;
+        const double significance = s[i]/std::sqrt(std::max(v[i], 1.));
+        if ( significance < options.threshold )
+            continue;
+
+        // The response of a Gaussian peak crosses zero at about one total sigma on each side.
+        size_t left = i, right = i;
+        while ( left > 0 && s[left - 1] > 0 )
+            --left;
+        while ( right + 1 < n && s[right + 1] > 0 )
+            ++right;
+        const double total = 0.5*double(right - left + 1);
+        const double sigma = std::sqrt(std::max(total*total - options.sigma*options.sigma, 0.25));
+
+        // Window of three sigma on each side, with linear background from the bins just outside.
+        const long width = long(std::ceil(3*sigma));
+        const long lo = std::max(long(i) - width, 0L);
+        const long hi = std::min(long(i) + width, long(n) - 1);
+        double bl, xl, br, xr;
+        EdgeMean(y, lo - 2, lo, bl, xl);
+        EdgeMean(y, hi + 1, hi + 3, br, xr);
+        const double slope = ( xr > xl ) ? ( br - bl )/( xr - xl ) : 0.;
+
+        Peak peak = {0, sigma*axis.GetBinWidth(), 0, 0, significance};
+        double moment = 0;
+        for ( long j = lo ; j <= hi ; ++j ){
+            const double b = bl + slope*( double(j) - xl );
+            peak.area += y[j] - b;
+            peak.background += b;
+            moment += ( y[j] - b )*double(j);
+        }
+        if ( peak.area <= 0 )
+            continue;
+        peak.centroid = axis.GetLeft() + ( moment/peak.area + 0.5 )*axis.GetBinWidth();
+        peaks.push_back(peak);
+    }
+
+    if ( options.max_peaks > 0 && peaks.size() > options.max_peaks ){
+        std::sort(peaks.begin(), peaks.end(), [](const Peak &a, const Peak &b){ return a.area > b.area; });
+        peaks.resize(options.max_peaks);
+        std::sort(peaks.begin(), peaks.end(), [](const Peak &a, const Peak &b){ return a.centroid < b.centroid; });
+    }
+    return peaks;
+}
+
+// ########################################################################
+
+std::vector<std::vector<PeakSearch::Peak>> PeakSearch::Search(const Histograms::list1d_t &hists,
+                                                              const Options &options, ThreadPool &pool)
+{
+    std::vector<std::vector<Peak>> peaks(hists.size());
+    pool.ParallelFor(0, hists.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i )
+            peaks[i] = Search(hists[i], options);
+    });
+    return peaks;
+}
+
+// ########################################################################
+
+std::map<std::string, std::vector<PeakSearch::Peak>> PeakSearch::Search(Histograms &hists,
+                                                                        const Options &options, ThreadPool &pool)
+{
+    const Histograms::list1d_t list = hists.GetAll1D();
+    std::vector<std::vector<Peak>> peaks = Search(list, options, pool);
+    std::map<std::string, std::vector<Peak>> result;
+    for ( size_t i = 0 ; i < list.size() ; ++i )
+        result[list[i]->GetName()] = std::move(peaks[i]);
+    return result;
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Permutation.h"
+
+#include "Histogram2D.h"
+#include "Histogram3D.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+// ########################################################################
+
+Histogram2Dp Permutation::Transpose(Histograms &set, Histogram2Dp hist, const std::string &name, ThreadPool &pool)
+{
+    const Axis &xaxis = hist->GetAxisX(), &yaxis = hist->GetAxisY();
+    const size_t columns = xaxis.GetBinCountAll(), rows = yaxis.GetBinCountAll();
+
+    // Collect the row pointers first, the tiles only read through them.
+    std::vector<const Histogram2D::data_t *> source(rows);
+    for ( size_t y = 0 ; y < rows ; ++y )
+        source[y] = hist->GetRow(y);
+
+    Histogram2Dp result = set.Create2D(name, hist->GetTitle(),
+                                       yaxis.GetBinCount(), yaxis.GetLeft(), yaxis.GetRight(), yaxis.GetTitle(),
+                                       xaxis.GetBinCount(), xaxis.GetLeft(), xaxis.GetRight(), xaxis.GetTitle(),
+                                       hist->GetPath());
+    std::vector<Histogram2D::data_t *> target(columns);
+    for ( size_t x = 0 ; x < columns ; ++x )
+        target[x] = result->GetWritableRow(x);
+
+    // Each task writes whole blocks of rows of the result, i.e. blocks of columns of the source.
+    const size_t blocks = ( columns + block2d - 1 )/block2d;
+    pool.ParallelFor(0, blocks, [&](size_t first, size_t last){
+        for ( size_t xb = first*block2d ; xb < std::min(last*block2d, columns) ; xb += block2d ){
+            const size_t xe = std::min(xb + block2d, columns);
+            for ( size_t yb = 0 ; yb < rows ; yb += block2d ){
+                const size_t ye = std::min(yb + block2d, rows);
+                for ( size_t x = xb ; x < xe ; ++x ){
+                    Histogram2D::data_t *row = target[x];
+                    for ( size_t y = yb ; y < ye ; ++y )
+                        row[y] = source[y][x];
+                }
+            }
+        }
+    });
+    result->AddEntries(size_t(hist->GetEntries()));
+    return result;
+}
+
+// ########################################################################
+
+Histogram3Dp Permutation::Permute(Histograms &set, Histogram3Dp hist, const std::string &name,
+                                  const std::array<int, 3> &order, ThreadPool &pool)
+{
+    std::array<int, 3> sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+    if ( sorted != std::array<int, 3>{0, 1, 2} )
+        throw std::runtime_error("Axis order for '" + hist->GetName() + "' is not a permutation of {0, 1, 2}.");
+
+    const Axis *axes[3] = {&hist->GetAxisX(), &hist->GetAxisY(), &hist->GetAxisZ()};
+    const size_t rows = axes[1]->GetBinCountAll(), slices = axes[2]->GetBinCountAll();
+
+    std::vector<const Histogram3D::data_t *> source(rows*slices);
+    for ( size_t z = 0 ; z < slices ; ++z ){
+        for ( size_t y = 0 ; y < rows ; ++y )
+            source[z*rows + y] = hist->GetRow(y, z);
+    }
+
+    const Axis &a0 = *axes[order[0]], &a1 = *axes[order[1]], &a2 = *axes[order[2]];
+    Histogram3Dp result = set.Create3D(name, hist->GetTitle(),
+                                       a0.GetBinCount(), a0.GetLeft(), a0.GetRight(), a0.GetTitle(),
+                                       a1.GetBinCount(), a1.GetLeft(), a1.GetRight(), a1.GetTitle(),
+                                       a2.GetBinCount(), a2.GetLeft(), a2.GetRight(), a2.GetTitle(),
+                                       hist->GetPath());
+
+    // Each task writes whole (k, j) tiles of the result, so a short z axis still gives enough tasks.
+    const size_t n[3] = {a0.GetBinCountAll(), a1.GetBinCountAll(), a2.GetBinCountAll()};
+    std::vector<Histogram3D::data_t *> target(n[1]*n[2]);
+    for ( size_t k = 0 ; k < n[2] ; ++k ){
+        for ( size_t j = 0 ; j < n[1] ; ++j )
+            target[k*n[1] + j] = result->GetWritableRow(j, k);
+    }
+    const size_t jblocks = ( n[1] + block3d - 1 )/block3d, kblocks = ( n[2] + block3d - 1 )/block3d;
+    pool.ParallelFor(0, jblocks*kblocks, [&](size_t first, size_t last){
+        size_t s[3];
+        for ( size_t tile = first ; tile < last ; ++tile ){
+            const size_t kb = ( tile/jblocks )*block3d, ke = std::min(kb + block3d, n[2]);
+            const size_t jb = ( tile % jblocks )*block3d, je = std::min(jb + block3d, n[1]);
+            for ( size_t ib = 0 ; ib < n[0] ; ib += block3d ){
+                const size_t ie = std::min(ib + block3d, n[0]);
+                for ( size_t k = kb ; k < ke ; ++k ){
+                    s[order[2]] = k;
+                    for ( size_t j = jb ; j < je ; ++j ){
+                        s[order[1]] = j;
+                        Histogram3D::data_t *row = target[k*n[1] + j];
+                        for ( size_t i = ib ; i < ie ; ++i ){
+                            s[order[0]] = i;
+                            row[i] = source[s[2]*rows + s[1]][s[0]];
+                        }
+                    }
+                }
+            }
+        }
+    });
+    result->AddEntries(size_t(hist->GetEntries()));
+    return result;
+}
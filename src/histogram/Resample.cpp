@@ -0,0 +1,258 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Resample.h"
+
+#include "Histogram2D.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+//! Check that two axes have the same binning.
+static bool SameBinning(const Axis &a, const Axis &b)
+{
+    return a.GetLeft() == b.GetLeft() && a.GetRight() == b.GetRight() && a.GetBinCount() == b.GetBinCount();
+}
+
+namespace {
+
+    typedef std::pair<double, double> point_t;
+
+    //! A convex or simple polygon with few vertices.
+    struct Polygon {
+        std::array<point_t, 16> points;
+        size_t size = 0;
+
+        void Add(const point_t &point){ points[size++] = point; }
+
+        //! Area by the shoelace formula.
+        [[nodiscard]] double Area() const
+        {
+            double area = 0;
+            for ( size_t i = 0 ; i < size ; ++i ){
+                const point_t &a = points[i], &b = points[( i + 1 ) % size];
+                area += a.first*b.second - b.first*a.second;
+            }
+            return 0.5*std::abs(area);
+        }
+    };
+
+    //! Clip a polygon against the half plane where coordinate `dim` is above (or below) a limit.
+    void ClipEdge(const Polygon &in, Polygon &out, int dim, double limit, bool keep_above)
+    {
+        out.size = 0;
+        auto coordinate = [dim](const point_t &p){ return ( dim == 0 ) ? p.first : p.second; };
+        auto inside = [&](const point_t &p){ return keep_above ? coordinate(p) >= limit : coordinate(p) <= limit; };
+        for ( size_t i = 0 ; i < in.size ; ++i ){
+            const point_t &a = in.points[i], &b = in.points[( i + 1 ) % in.size];
+            const bool a_in = inside(a), b_in = inside(b);
+            if ( a_in )
+                out.Add(a);
+            if ( a_in != b_in ){
+                const double t = ( limit - coordinate(a) )/( coordinate(b) - coordinate(a) );
+                out.Add({a.first + t*( b.first - a.first ), a.second + t*( b.second - a.second )});
+            }
+        }
+    }
+
+    //! Area of the overlap of a polygon with a rectangle.
+    double Overlap(const Polygon &polygon, double x0, double x1, double y0, double y1)
+    {
+        Polygon a, b;
+        ClipEdge(polygon, a, 0, x0, true);
+        ClipEdge(a, b, 0, x1, false);
+        ClipEdge(b, a, 1, y0, true);
+        ClipEdge(a, b, 1, y1, false);
+        return ( b.size >= 3 ) ? b.Area() : 0.;
+    }
+
+    //! Overlap of a source bin with a target bin.
+    struct Entry {
+        size_t target;
+        double fraction;
+    };
+}
+
+// ########################################################################
+
+Resample::Affine Resample::Affine::Rotation(double angle, double x0, double y0)
+{
+    const double c = std::cos(angle), s = std::sin(angle);
+    return {c, -s, s, c, x0 - c*x0 + s*y0, y0 - s*x0 - c*y0};
+}
+
+// ########################################################################
+
+Resample::Stencil::Stencil(const Axis &_source_x, const Axis &_source_y, const Axis &_target_x, const Axis &_target_y,
+                           const map_t &map, size_t subdivisions, ThreadPool &pool)
+    : source_columns( _source_x.GetBinCount() )
+    , source_rows( _source_y.GetBinCount() )
+    , source_x( _source_x )
+    , source_y( _source_y )
+    , target_x( _target_x )
+    , target_y( _target_y )
+{
+    subdivisions = std::max(subdivisions, size_t(1));
+    const size_t tcols = target_x.GetBinCount(), trows = target_y.GetBinCount();
+    const double sub_w = source_x.GetBinWidth()/double(subdivisions);
+    const double sub_h = source_y.GetBinWidth()/double(subdivisions);
+    const double sub_weight = 1./double(subdivisions*subdivisions);
+
+    // Overlaps of each source row, computed in parallel.
+    std::vector<std::vector<std::pair<size_t, Entry>>> row_entries(source_rows);
+    pool.ParallelFor(0, source_rows, [&](size_t first, size_t last){
+        for ( size_t j = first ; j < last ; ++j ){
+            auto &entries = row_entries[j];
+            for ( size_t i = 0 ; i < source_columns ; ++i ){
+                const size_t bin = j*source_columns + i;
+                for ( size_t a = 0 ; a < subdivisions ; ++a ){
+                    for ( size_t b = 0 ; b < subdivisions ; ++b ){
+                        const double x0 = source_x.GetLeft() + double(i)*source_x.GetBinWidth() + double(a)*sub_w;
+                        const double y0 = source_y.GetLeft() + double(j)*source_y.GetBinWidth() + double(b)*sub_h;
+                        Polygon quad;
+                        quad.Add(map(x0, y0));
+                        quad.Add(map(x0 + sub_w, y0));
+                        quad.Add(map(x0 + sub_w, y0 + sub_h));
+                        quad.Add(map(x0, y0 + sub_h));
+
+                        double min_x = quad.points[0].first, max_x = min_x;
+                        double min_y = quad.points[0].second, max_y = min_y;
+                        for ( size_t k = 1 ; k < 4 ; ++k ){
+                            min_x = std::min(min_x, quad.points[k].first);
+                            max_x = std::max(max_x, quad.points[k].first);
+                            min_y = std::min(min_y, quad.points[k].second);
+                            max_y = std::max(max_y, quad.points[k].second);
+                        }
+
+                        const double area = quad.Area();
+                        if ( !( area > 0 ) ){
+                            // Degenerate image, all counts go to the bin of the image of the centre.
+                            const auto centre = map(x0 + 0.5*sub_w, y0 + 0.5*sub_h);
+                            const size_t p = target_x.FindBin(centre.first), q = target_y.FindBin(centre.second);
+                            if ( p >= 1 && p <= tcols && q >= 1 && q <= trows )
+                                entries.push_back({bin, {( q - 1 )*tcols + p - 1, sub_weight}});
+                            continue;
+                        }
+                        if ( max_x <= target_x.GetLeft() || min_x >= target_x.GetRight()
+                             || max_y <= target_y.GetLeft() || min_y >= target_y.GetRight() )
+                            continue;
+
+                        const size_t p0 = std::max(target_x.FindBin(min_x), Axis::index_t(1));
+                        const size_t p1 = std::min(target_x.FindBin(max_x), tcols);
+                        const size_t q0 = std::max(target_y.FindBin(min_y), Axis::index_t(1));
+                        const size_t q1 = std::min(target_y.FindBin(max_y), trows);
+                        for ( size_t q = q0 ; q <= q1 ; ++q ){
+                            const double ty0 = target_y.GetLeft() + double(q - 1)*target_y.GetBinWidth();
+                            for ( size_t p = p0 ; p <= p1 ; ++p ){
+                                const double tx0 = target_x.GetLeft() + double(p - 1)*target_x.GetBinWidth();
+                                const double overlap = Overlap(quad, tx0, tx0 + target_x.GetBinWidth(),
+                                                               ty0, ty0 + target_y.GetBinWidth());
+                                if ( overlap > 0 )
+                                    entries.push_back({bin, {( q - 1 )*tcols + p - 1, sub_weight*overlap/area}});
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Sort the overlaps by target bin.
+    start.assign(tcols*trows + 1, 0);
+    for ( auto &entries : row_entries ){
+        for ( auto &entry : entries )
+            ++start[entry.second.target + 1];
+    }
+    for ( size_t t = 0 ; t < tcols*trows ; ++t )
+        start[t + 1] += start[t];
+    source.resize(start.back());
+    fraction.resize(start.back());
+    std::vector<size_t> next(start.begin(), start.end() - 1);
+    for ( auto &entries : row_entries ){
+        for ( auto &entry : entries ){
+            const size_t k = next[entry.second.target]++;
+            source[k] = entry.first;
+            fraction[k] = entry.second.fraction;
+        }
+    }
+}
+
+// ########################################################################
+
+void Resample::Stencil::Apply(const std::vector<double> &matrix, std::vector<double> &target, ThreadPool &pool) const
+{
+    if ( matrix.size() != source_columns*source_rows )
+        throw std::runtime_error("Matrix of " + std::to_string(matrix.size()) + " bins does not match stencil with " +
+                                 std::to_string(source_columns*source_rows) + " source bins.");
+    const size_t tcols = target_x.GetBinCount(), trows = target_y.GetBinCount();
+    target.assign(tcols*trows, 0.);
+    pool.ParallelFor(0, trows, [&](size_t first, size_t last){
+        for ( size_t t = first*tcols ; t < last*tcols ; ++t ){
+            double sum = 0;
+            for ( size_t k = start[t] ; k < start[t + 1] ; ++k )
+                sum += fraction[k]*matrix[source[k]];
+            target[t] = sum;
+        }
+    });
+}
+
+// ########################################################################
+
+Histogram2Dp Resample::Transform(Histograms &set, Histogram2Dp hist, const std::string &name,
+                                 const Axis &target_x, const Axis &target_y, const map_t &map,
+                                 size_t subdivisions, ThreadPool &pool)
+{
+    const Stencil stencil(hist->GetAxisX(), hist->GetAxisY(), target_x, target_y, map, subdivisions, pool);
+    return Transform(set, hist, name, stencil, pool);
+}
+
+// ########################################################################
+
+Histogram2Dp Resample::Transform(Histograms &set, Histogram2Dp hist, const std::string &name,
+                                 const Stencil &stencil, ThreadPool &pool)
+{
+    if ( !SameBinning(hist->GetAxisX(), stencil.GetSourceX()) || !SameBinning(hist->GetAxisY(), stencil.GetSourceY()) )
+        throw std::runtime_error("Histogram '" + hist->GetName() + "' does not have the binning of the stencil.");
+    const size_t columns = hist->GetAxisX().GetBinCount(), rows = hist->GetAxisY().GetBinCount();
+    std::vector<double> matrix(columns*rows), target;
+    for ( size_t y = 0 ; y < rows ; ++y ){
+        const Histogram2D::data_t *row = hist->GetRow(y + 1);
+        std::copy(row + 1, row + columns + 1, matrix.begin() + y*columns);
+    }
+    stencil.Apply(matrix, target, pool);
+
+    const Axis &tx = stencil.GetTargetX(), &ty = stencil.GetTargetY();
+    Histogram2Dp result = set.Create2D(name, "Transformed " + hist->GetTitle(),
+                                       tx.GetBinCount(), tx.GetLeft(), tx.GetRight(), tx.GetTitle(),
+                                       ty.GetBinCount(), ty.GetLeft(), ty.GetRight(), ty.GetTitle(),
+                                       hist->GetPath());
+    for ( size_t y = 0 ; y < ty.GetBinCount() ; ++y ){
+        for ( size_t x = 0 ; x < tx.GetBinCount() ; ++x ){
+            const double value = std::round(target[y*tx.GetBinCount() + x]);
+            if ( value > 0 )
+                result->SetBinContent(x + 1, y + 1, Histogram2D::data_t(value));
+        }
+    }
+    return result;
+}
@@ -0,0 +1,172 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Resolution.h"
+
+#include "FFT.h"
+#include "Histogram1D.h"
+#include "Histogram2D.h"
+
+#include <algorithm>
+#include <cmath>
+
+//! Cumulative normal distribution.
+static double Phi(double u)
+{
+    return 0.5*std::erfc(-u/std::sqrt(2.));
+}
+
+//! Fold with a constant width as an FFT convolution.
+static void FoldConstant(std::vector<double> &spectrum, double sigma)
+{
+    const size_t n = spectrum.size();
+    const size_t half = size_t(std::ceil(4*sigma));
+
+    // Fraction of a bin's counts that ends up d bins away.
+    std::vector<double> kernel(2*half + 1);
+    for ( size_t k = 0 ; k < kernel.size() ; ++k ){
+        const double d = double(k) - double(half);
+        kernel[k] = Phi(( d + 0.5 )/sigma) - Phi(( d - 0.5 )/sigma);
+    }
+
+    const std::vector<double> folded = FFT::Convolve(spectrum, kernel);
+    for ( size_t i = 0 ; i < n ; ++i )
+        spectrum[i] = std::max(folded[i + half], 0.);
+}
+
+//! Fold with a width that depends on the bin, as a banded sum.
+static void FoldBanded(std::vector<double> &spectrum, const Axis &axis, const Resolution::sigma_t &sigma_of_x)
+{
+    const long n = long(spectrum.size());
+    std::vector<double> folded(spectrum.size(), 0.), edges;
+    for ( long i = 0 ; i < n ; ++i ){
+        const double counts = spectrum[i];
+        if ( counts == 0 )
+            continue;
+        const double sigma = sigma_of_x(axis.GetBinCenter(Axis::index_t(i + 1)))/axis.GetBinWidth();
+        if ( !( sigma > 0 ) ){
+            folded[i] += counts;
+            continue;
+        }
+        const long half = long(std::ceil(4*sigma));
+        const long first = std::max(i - half, 0L), last = std::min(i + half, n - 1);
+
+        // Cumulative distribution at the bin edges, in bins from the centre of bin i.
+        edges.resize(size_t(last - first + 2));
+        for ( long j = first ; j <= last + 1 ; ++j )
+            edges[size_t(j - first)] = Phi(( double(j - i) - 0.5 )/sigma);
+        for ( long j = first ; j <= last ; ++j )
+            folded[j] += counts*( edges[size_t(j - first + 1)] - edges[size_t(j - first)] );
+    }
+    spectrum.swap(folded);
+}
+
+// ########################################################################
+
+void Resolution::Fold(std::vector<double> &spectrum, const Axis &axis, const Kernel &kernel)
+{
+    if ( kernel.sigma_of_x )
+        FoldBanded(spectrum, axis, kernel.sigma_of_x);
+    else if ( kernel.sigma > 0 )
+        FoldConstant(spectrum, kernel.sigma/axis.GetBinWidth());
+}
+
+// ########################################################################
+
+//! Fold the regular bins of a spectrum into another.
+static void Fold(Histogram1Dp hist, Histogram1Dp folded, const Resolution::Kernel &kernel)
+{
+    const Axis &axis = hist->GetAxisX();
+    const size_t n = axis.GetBinCount();
+    const Histogram1D::data_t *data = hist->GetData();
+    std::vector<double> spectrum(data + 1, data + n + 1);
+    Resolution::Fold(spectrum, axis, kernel);
+    for ( size_t i = 0 ; i < n ; ++i )
+        folded->SetBinContent(i + 1, Histogram1D::data_t(std::max(std::round(spectrum[i]), 0.)));
+}
+
+//! Create a histogram with the axis of another.
+static Histogram1Dp CreateLike(Histograms &set, Histogram1Dp hist, const std::string &name)
+{
+    const Axis &axis = hist->GetAxisX();
+    return set.Create1D(name, "Folded " + hist->GetTitle(),
+                        axis.GetBinCount(), axis.GetLeft(), axis.GetRight(), axis.GetTitle(), hist->GetPath());
+}
+
+// ########################################################################
+
+Histogram1Dp Resolution::Fold(Histograms &set, Histogram1Dp hist, const std::string &name, const Kernel &kernel)
+{
+    Histogram1Dp folded = CreateLike(set, hist, name);
+    ::Fold(hist, folded, kernel);
+    return folded;
+}
+
+// ########################################################################
+
+Histogram2Dp Resolution::Fold(Histograms &set, Histogram2Dp hist, const std::string &name,
+                              const Kernel &kernel, ThreadPool &pool)
+{
+    const Axis &xaxis = hist->GetAxisX(), &yaxis = hist->GetAxisY();
+    const size_t columns = xaxis.GetBinCount(), rows = yaxis.GetBinCount();
+    Histogram2Dp folded = set.Create2D(name, "Folded " + hist->GetTitle(),
+                                       columns, xaxis.GetLeft(), xaxis.GetRight(), xaxis.GetTitle(),
+                                       rows, yaxis.GetLeft(), yaxis.GetRight(), yaxis.GetTitle(),
+                                       hist->GetPath());
+
+    // Collect the row pointers first, since GetRow() flushes the fill buffer.
+    std::vector<const Histogram2D::data_t *> source(rows);
+    for ( size_t y = 0 ; y < rows ; ++y )
+        source[y] = hist->GetRow(y + 1);
+
+    // Rows are independent, each task reads its rows and writes the same rows of the result.
+    pool.ParallelFor(0, rows, [&](size_t first, size_t last){
+        std::vector<double> spectrum;
+        for ( size_t y = first ; y < last ; ++y ){
+            const Histogram2D::data_t *row = source[y];
+            spectrum.assign(row + 1, row + columns + 1);
+            Fold(spectrum, xaxis, kernel);
+            for ( size_t x = 0 ; x < columns ; ++x )
+                folded->SetBinContent(x + 1, y + 1, Histogram2D::data_t(std::max(std::round(spectrum[x]), 0.)));
+        }
+    });
+    return folded;
+}
+
+// ########################################################################
+
+Histograms::list1d_t Resolution::Fold(Histograms &set, const Histograms::list1d_t &hists, const std::string &suffix,
+                                      const Kernel &kernel, ThreadPool &pool)
+{
+    // The set is not thread safe, so the histograms are created before the parallel part. The fill
+    // buffers are flushed here too, a histogram may be in the list more than once.
+    Histograms::list1d_t folded;
+    for ( auto &hist : hists ){
+        folded.push_back(CreateLike(set, hist, hist->GetName() + suffix));
+        hist->GetData();
+    }
+
+    pool.ParallelFor(0, hists.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i )
+            ::Fold(hists[i], folded[i], kernel);
+    });
+    return folded;
+}
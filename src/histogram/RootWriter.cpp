@@ -7,6 +7,7 @@
 
 #include "RootWriter.h"
 
+#include <TDirectory.h>
 #include <TFile.h>
 #include <TH1.h>
 #include <TH2.h>
@@ -15,26 +16,48 @@
 #include "Histogram1D.h"
 #include "Histogram2D.h"
 #include "Histogram3D.h"
+#include "SubtractedHistogram2D.h"
+#include "Trace.h"
+
+#include <stdexcept>
 
 // ########################################################################
 
-void RootWriter::Navigate(Named *named, TFile *file)
+size_t RootWriter::WriteDirectory(const Histograms::Directory& dir, TDirectory *target)
 {
-    // Ensure we are at the top.
-    file->cd();
-    auto path = named->GetPath();
-    if ( path.empty() )
-        return;
-    auto title = path;
-    if ( path.find_last_of( '/') < path.npos ){
-        title = path.substr(path.find_last_of('/')+1);
+    // ROOT attaches new histograms to the current directory.
+    target->cd();
+    for(auto & it : dir.hist1d) {
+        HISTOGRAM_TRACE(write_begin, it->GetName(), it->GetEntries());
+        CreateTH1(it);
+        HISTOGRAM_TRACE(write_end, it->GetName(), it->GetEntries());
+    }
+    for(auto & it : dir.hist2d) {
+        HISTOGRAM_TRACE(write_begin, it->GetName(), it->GetEntries());
+        CreateTH2(it);
+        HISTOGRAM_TRACE(write_end, it->GetName(), it->GetEntries());
+    }
+    for(auto & it : dir.hist3d) {
+        HISTOGRAM_TRACE(write_begin, it->GetName(), it->GetEntries());
+        CreateTH3(it);
+        HISTOGRAM_TRACE(write_end, it->GetName(), it->GetEntries());
     }
-    if ( file->mkdir(path.c_str(), title.c_str(), true) == nullptr ){
-        throw std::runtime_error("Error, could not create directory '"+path+"'.");
+    for(auto & it : dir.hist2s) {
+        HISTOGRAM_TRACE(write_begin, it->GetName(), it->GetEntries());
+        CreateTH2(it);
+        HISTOGRAM_TRACE(write_end, it->GetName(), it->GetEntries());
     }
 
-    // Navigate to the folder and return
-    file->cd(path.c_str());
+    size_t count = dir.hist1d.size() + dir.hist2d.size() + dir.hist3d.size() + dir.hist2s.size();
+    for(auto & it : dir.children) {
+        const Histograms::Directory& child = *it.second;
+        TDirectory *sub = target->mkdir(child.name.c_str(), child.name.c_str(), true);
+        if ( sub == nullptr ){
+            throw std::runtime_error("Error, could not create directory '"+child.path+"'.");
+        }
+        count += WriteDirectory(child, sub);
+    }
+    return count;
 }
 
 // ########################################################################
@@ -42,28 +65,41 @@ void RootWriter::Navigate(Named *named, TFile *file)
 void RootWriter::Write(Histograms& histograms, const char *filename,
                        const char *title, const char *options)
 {
-  TFile outfile(filename, options, title);
-
-  Histograms::list1d_t list1d = histograms.GetAll1D();
-  for(auto & it : list1d) {
-      Navigate(it, &outfile);
-      CreateTH1(it);
-  }
-
-  Histograms::list2d_t list2d = histograms.GetAll2D();
-  for(auto & it : list2d) {
-      Navigate(it, &outfile);
-      CreateTH2(it);
-  }
-
-    Histograms::list3d_t list3d = histograms.GetAll3D();
-    for(auto & it : list3d) {
-        Navigate(it, &outfile);
-        CreateTH3(it);
+    WriteSubtree(histograms, "", filename, title, options);
+}
+
+// ########################################################################
+
+void RootWriter::WriteSubtree(Histograms& histograms, const std::string& path, const char *filename,
+                              const char *title, const char *options)
+{
+    const Histograms::Directory* dir = histograms.FindDirectory(path);
+    if ( dir == nullptr ){
+        throw std::runtime_error("No directory '"+path+"' in histogram set");
+    }
+
+    TFile outfile(filename, options, title);
+
+    // Create the parents of the subtree so that the histograms keep their full path.
+    TDirectory *target = &outfile;
+    size_t begin = 0;
+    while ( begin < dir->path.size() ){
+        size_t end = dir->path.find('/', begin);
+        if ( end == std::string::npos )
+            end = dir->path.size();
+        const std::string name = dir->path.substr(begin, end - begin);
+        target = target->mkdir(name.c_str(), name.c_str(), true);
+        if ( target == nullptr ){
+            throw std::runtime_error("Error, could not create directory '"+dir->path.substr(0, end)+"'.");
+        }
+        begin = end + 1;
     }
+    [[maybe_unused]] const size_t count = WriteDirectory(*dir, target);
 
-  outfile.Write();
-  outfile.Close();
+    HISTOGRAM_TRACE(write_begin, std::string(filename), count);
+    outfile.Write();
+    outfile.Close();
+    HISTOGRAM_TRACE(write_end, std::string(filename), count);
 }
 
 // ########################################################################
@@ -135,6 +171,42 @@ TH2* RootWriter::CreateTH2(Histogram2Dp h)
 
 // ########################################################################
 
+TH2* RootWriter::CreateTH2(SubtractedHistogram2Dp h)
+{
+  const Axis& xax = h->GetAxisX();
+  const Axis& yax = h->GetAxisY();
+  const int xchannels = xax.GetBinCount();
+  const int ychannels = yax.GetBinCount();
+  TH2* mat = new TH2D( h->GetName().c_str(), h->GetTitle().c_str(),
+                       xchannels, xax.GetLeft(), xax.GetRight(),
+                       ychannels, yax.GetLeft(), yax.GetRight() );
+  mat->SetOption( "colz" );
+  mat->SetContour( 64 );
+
+  TAxis* rxax = mat->GetXaxis();
+  rxax->SetTitle(xax.GetTitle().c_str());
+  rxax->SetTitleSize(0.03);
+  rxax->SetLabelSize(0.03);
+
+  TAxis* ryax = mat->GetYaxis();
+  ryax->SetTitle(yax.GetTitle().c_str());
+  ryax->SetTitleSize(0.03);
+  ryax->SetLabelSize(0.03);
+  ryax->SetTitleOffset(1.3);
+
+  TAxis* zax = mat->GetZaxis();
+  zax->SetLabelSize(0.025);
+
+  for(int iy=0; iy<ychannels+2; ++iy)
+    for(int ix=0; ix<xchannels+2; ++ix)
+      mat->SetBinContent(ix, iy, h->GetBinContent(ix, iy));
+  mat->SetEntries( h->GetEntries() );
+
+  return mat;
+}
+
+// ########################################################################
+
 TH3* RootWriter::CreateTH3(Histogram3Dp h)
 {
     const Axis& xax = h->GetAxisX();
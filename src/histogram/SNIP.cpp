@@ -0,0 +1,200 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SNIP.h"
+
+#include "Histogram1D.h"
+#include "Histogram2D.h"
+
+#include <algorithm>
+#include <cmath>
+
+//! The log-log-square root transform.
+static double Forward(double y)
+{
+    return std::log(std::log(std::sqrt(std::max(y, 0.) + 1) + 1) + 1);
+}
+
+//! Inverse of the log-log-square root transform.
+static double Inverse(double v)
+{
+    const double s = std::exp(std::exp(v) - 1) - 1;
+    return s*s - 1;
+}
+
+//! The clipping windows in the order they are applied.
+static std::vector<size_t> Windows(const SNIP::Options &options)
+{
+    std::vector<size_t> windows;
+    for ( size_t p = 1 ; p <= options.iterations ; ++p )
+        windows.push_back(p);
+    if ( options.decreasing_window )
+        std::reverse(windows.begin(), windows.end());
+    return windows;
+}
+
+// ########################################################################
+
+void SNIP::Background(std::vector<double> &spectrum, const Options &options)
+{
+    const size_t n = spectrum.size();
+    if ( options.lls )
+        std::transform(spectrum.begin(), spectrum.end(), spectrum.begin(), Forward);
+
+    std::vector<double> clipped(spectrum);
+    for ( size_t p : Windows(options) ){
+        if ( 2*p >= n )
+            continue;
+        const double *v = spectrum.data();
+        double *w = clipped.data();
+        for ( size_t i = p ; i < n - p ; ++i )
+            w[i] = std::min(v[i], 0.5*( v[i - p] + v[i + p] ));
+        std::copy(clipped.begin() + p, clipped.end() - p, spectrum.begin() + p);
+    }
+
+    if ( options.lls )
+        std::transform(spectrum.begin(), spectrum.end(), spectrum.begin(), Inverse);
+}
+
+// ########################################################################
+
+void SNIP::Background(std::vector<double> &matrix, size_t columns, size_t rows, bool rows_only,
+                      const Options &options, ThreadPool &pool)
+{
+    if ( rows_only ){
+        pool.ParallelFor(0, rows, [&](size_t first, size_t last){
+            std::vector<double> row;
+            for ( size_t y = first ; y < last ; ++y ){
+                row.assign(matrix.begin() + y*columns, matrix.begin() + (y + 1)*columns);
+                Background(row, options);
+                std::copy(row.begin(), row.end(), matrix.begin() + y*columns);
+            }
+        });
+        return;
+    }
+
+    if ( options.lls )
+        std::transform(matrix.begin(), matrix.end(), matrix.begin(), Forward);
+
+    std::vector<double> clipped(matrix.size());
+    for ( size_t p : Windows(options) ){
+        const bool clip_x = 2*p < columns;
+        pool.ParallelFor(0, rows, [&](size_t first, size_t last){
+            for ( size_t y = first ; y < last ; ++y ){
+                const double *v = matrix.data() + y*columns;
+                double *w = clipped.data() + y*columns;
+                std::copy(v, v + columns, w);
+                const bool clip_y = y >= p && y + p < rows;
+                const double *up = clip_y ? v - p*columns : nullptr;
+                const double *down = clip_y ? v + p*columns : nullptr;
+                if ( clip_y ){
+                    for ( size_t x = 0 ; x < columns ; ++x )
+                        w[x] = std::min(w[x], 0.5*( up[x] + down[x] ));
+                }
+                if ( clip_x ){
+                    for ( size_t x = p ; x < columns - p ; ++x )
+                        w[x] = std::min(w[x], 0.5*( v[x - p] + v[x + p] ));
+                }
+                if ( clip_x && clip_y ){
+                    for ( size_t x = p ; x < columns - p ; ++x )
+                        w[x] = std::min(w[x], 0.25*( up[x - p] + up[x + p] + down[x - p] + down[x + p] ));
+                }
+            }
+        });
+        matrix.swap(clipped);
+    }
+
+    if ( options.lls )
+        std::transform(matrix.begin(), matrix.end(), matrix.begin(), Inverse);
+}
+
+// ########################################################################
+
+//! Run SNIP on the regular bins of a spectrum and store the result in another.
+static void Background(Histogram1Dp hist, Histogram1Dp background, const SNIP::Options &options)
+{
+    const size_t n = hist->GetAxisX().GetBinCount();
+    const Histogram1D::data_t *data = hist->GetData();
+    std::vector<double> spectrum(data + 1, data + n + 1);
+    SNIP::Background(spectrum, options);
+    for ( size_t i = 0 ; i < n ; ++i )
+        background->SetBinContent(i + 1, Histogram1D::data_t(std::max(std::round(spectrum[i]), 0.)));
+}
+
+//! Create a histogram with the axis of another.
+static Histogram1Dp CreateLike(Histograms &set, Histogram1Dp hist, const std::string &name)
+{
+    const Axis &axis = hist->GetAxisX();
+    return set.Create1D(name, "Background " + hist->GetTitle(),
+                        axis.GetBinCount(), axis.GetLeft(), axis.GetRight(), axis.GetTitle(), hist->GetPath());
+}
+
+// ########################################################################
+
+Histogram1Dp SNIP::Background(Histograms &set, Histogram1Dp hist, const std::string &name, const Options &options)
+{
+    Histogram1Dp background = CreateLike(set, hist, name);
+    ::Background(hist, background, options);
+    return background;
+}
+
+// ########################################################################
+
+Histogram2Dp SNIP::Background(Histograms &set, Histogram2Dp hist, const std::string &name, bool rows_only,
+                              const Options &options, ThreadPool &pool)
+{
+    const Axis &xaxis = hist->GetAxisX(), &yaxis = hist->GetAxisY();
+    const size_t columns = xaxis.GetBinCount(), rows = yaxis.GetBinCount();
+    std::vector<double> matrix(columns*rows);
+    for ( size_t y = 0 ; y < rows ; ++y ){
+        const Histogram2D::data_t *row = hist->GetRow(y + 1);
+        std::copy(row + 1, row + columns + 1, matrix.begin() + y*columns);
+    }
+
+    Background(matrix, columns, rows, rows_only, options, pool);
+
+    Histogram2Dp background = set.Create2D(name, "Background " + hist->GetTitle(),
+                                           columns, xaxis.GetLeft(), xaxis.GetRight(), xaxis.GetTitle(),
+                                           rows, yaxis.GetLeft(), yaxis.GetRight(), yaxis.GetTitle(),
+                                           hist->GetPath());
+    for ( size_t y = 0 ; y < rows ; ++y ){
+        for ( size_t x = 0 ; x < columns ; ++x )
+            background->SetBinContent(x + 1, y + 1, Histogram2D::data_t(std::max(std::round(matrix[y*columns + x]), 0.)));
+    }
+    return background;
+}
+
+// ########################################################################
+
+Histograms::list1d_t SNIP::Background(Histograms &set, const Histograms::list1d_t &hists, const std::string &suffix,
+                                      const Options &options, ThreadPool &pool)
+{
+    // The set is not thread safe, so the histograms are created before the parallel part.
+    Histograms::list1d_t backgrounds;
+    for ( auto &hist : hists )
+        backgrounds.push_back(CreateLike(set, hist, hist->GetName() + suffix));
+
+    pool.ParallelFor(0, hists.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i )
+            ::Background(hists[i], backgrounds[i], options);
+    });
+    return backgrounds;
+}
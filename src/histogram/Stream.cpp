@@ -0,0 +1,755 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Stream.h"
+
+#include "Histogram1D.h"
+#include "Histogram2D.h"
+#include "Histogram3D.h"
+#include "SubtractedHistogram2D.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+    //! Magic at the start of each message.
+    const uint32_t message_magic = 0x52545348;
+
+    //! Message types.
+    enum message_t : uint8_t {
+        message_subscribe = 1,
+        message_update = 2
+    };
+
+    //! Size of the message header: magic, type and payload size.
+    const size_t header_size = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+    //! Entry flag for keyframes.
+    const uint8_t flag_keyframe = 1;
+
+    //! Flag in the dimensions of a prompt-minus-random matrix, whose bins are sent as the bits of doubles.
+    const uint8_t subtracted_flag = 0x80;
+
+    static_assert(sizeof(size_t) == sizeof(SubtractedHistogram2D::data_t), "Bins are copied as 64 bit words.");
+
+#ifdef MSG_NOSIGNAL
+    //! Flags for send, so that a closed peer does not raise SIGPIPE.
+    const int send_flags = MSG_NOSIGNAL;
+#else
+    const int send_flags = 0;
+#endif // MSG_NOSIGNAL
+
+    //! Appends binary values to a string.
+    struct Encoder {
+        std::string &out;
+
+        template<typename V>
+        void Put(const V &value){ out.append(reinterpret_cast<const char *>(&value), sizeof(V)); }
+
+        void PutString(const std::string &value)
+        {
+            Put(uint32_t(value.size()));
+            out.append(value);
+        }
+
+        void PutVarint(uint64_t value)
+        {
+            while ( value >= 0x80 ){
+                out.push_back(char(uint8_t(value) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(char(value));
+        }
+
+        void PutZigzag(int64_t value){ PutVarint(( uint64_t(value) << 1 ) ^ uint64_t(value >> 63)); }
+    };
+
+    //! Reads binary values from a range of bytes.
+    struct Decoder {
+        const char *p, *end;
+
+        template<typename V>
+        V Get()
+        {
+            if ( size_t(end - p) < sizeof(V) )
+                throw std::runtime_error("Stream message ends unexpectedly.");
+            V value;
+            std::memcpy(&value, p, sizeof(V));
+            p += sizeof(V);
+            return value;
+        }
+
+        std::string GetString()
+        {
+            const auto n = Get<uint32_t>();
+            if ( size_t(end - p) < n )
+                throw std::runtime_error("Stream message ends unexpectedly.");
+            std::string value(p, n);
+            p += n;
+            return value;
+        }
+
+        uint64_t GetVarint()
+        {
+            uint64_t value = 0;
+            for ( int shift = 0 ; shift < 64 ; shift += 7 ){
+                const auto byte = Get<uint8_t>();
+                value |= uint64_t(byte & 0x7f) << shift;
+                if ( ( byte & 0x80 ) == 0 )
+                    return value;
+            }
+            throw std::runtime_error("Stream message holds a malformed varint.");
+        }
+
+        int64_t GetZigzag()
+        {
+            const uint64_t value = GetVarint();
+            return int64_t(value >> 1) ^ -int64_t(value & 1);
+        }
+    };
+
+    //! Append a message with header to a string.
+    void PutMessage(std::string &out, message_t type, const std::string &payload)
+    {
+        Encoder enc{out};
+        enc.Put(message_magic);
+        enc.Put(uint8_t(type));
+        enc.Put(uint32_t(payload.size()));
+        out += payload;
+    }
+
+    //! Address of a socket path.
+    sockaddr_un MakeAddress(const std::string &path)
+    {
+        sockaddr_un address{};
+        if ( path.empty() || path.size() >= sizeof(address.sun_path) )
+            throw std::runtime_error("Invalid socket path '" + path + "'.");
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    //! Create a socket that does not raise SIGPIPE where this is a socket option.
+    int MakeSocket()
+    {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+#ifdef SO_NOSIGPIPE
+        if ( fd >= 0 ){
+            const int on = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+        }
+#endif // SO_NOSIGPIPE
+        return fd;
+    }
+
+    //! Make a socket non-blocking.
+    void SetNonBlocking(int fd)
+    {
+        const int flags = ::fcntl(fd, F_GETFL, 0);
+        ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    //! A histogram of any dimension in the published set.
+    struct Source {
+        int dim;
+        Histogram1Dp h1 = nullptr;
+        Histogram2Dp h2 = nullptr;
+        Histogram3Dp h3 = nullptr;
+        SubtractedHistogram2Dp h2s = nullptr;
+
+        explicit Source(Histogram1Dp h) : dim( 1 ), h1( h ){}
+        explicit Source(Histogram2Dp h) : dim( 2 ), h2( h ){}
+        explicit Source(Histogram3Dp h) : dim( 3 ), h3( h ){}
+        explicit Source(SubtractedHistogram2Dp h) : dim( 2 | subtracted_flag ), h2s( h ){}
+
+        [[nodiscard]] const Named &GetNamed() const
+        {
+            if ( h1 ) return *h1;
+            if ( h2 ) return *h2;
+            if ( h2s ) return *h2s;
+            return *h3;
+        }
+
+        [[nodiscard]] uint64_t GetEntries() const
+        {
+            if ( h1 ) return size_t(h1->GetEntries());
+            if ( h2 ) return size_t(h2->GetEntries());
+            if ( h2s ) return size_t(h2s->GetEntries());
+            return size_t(h3->GetEntries());
+        }
+
+        [[nodiscard]] std::vector<const Axis *> GetAxes() const
+        {
+            if ( h1 ) return {&h1->GetAxisX()};
+            if ( h2 ) return {&h2->GetAxisX(), &h2->GetAxisY()};
+            if ( h2s ) return {&h2s->GetAxisX(), &h2s->GetAxisY()};
+            return {&h3->GetAxisX(), &h3->GetAxisY(), &h3->GetAxisZ()};
+        }
+
+        //! Copy all bins, row-major including the overflow bins. The bins of a prompt-minus-random matrix are copied as bits.
+        void Copy(std::vector<size_t> &bins) const
+        {
+            bins.clear();
+            if ( h2s ){
+                bins.resize(h2s->GetAxisX().GetBinCountAll()*h2s->GetAxisY().GetBinCountAll());
+                std::memcpy(bins.data(), h2s->GetData(), bins.size()*sizeof(size_t));
+            } else if ( h1 ){
+                const size_t *data = h1->GetData();
+                bins.assign(data, data + h1->GetAxisX().GetBinCountAll());
+            } else if ( h2 ){
+                const size_t nx = h2->GetAxisX().GetBinCountAll();
+                bins.reserve(nx*h2->GetAxisY().GetBinCountAll());
+                for ( size_t y = 0 ; y < h2->GetAxisY().GetBinCountAll() ; ++y ){
+                    const size_t *row = h2->GetRow(y);
+                    bins.insert(bins.end(), row, row + nx);
+                }
+            } else {
+                const size_t nx = h3->GetAxisX().GetBinCountAll();
+                bins.reserve(nx*h3->GetAxisY().GetBinCountAll()*h3->GetAxisZ().GetBinCountAll());
+                for ( size_t z = 0 ; z < h3->GetAxisZ().GetBinCountAll() ; ++z ){
+                    for ( size_t y = 0 ; y < h3->GetAxisY().GetBinCountAll() ; ++y ){
+                        const size_t *row = h3->GetRow(y, z);
+                        bins.insert(bins.end(), row, row + nx);
+                    }
+                }
+            }
+        }
+    };
+
+    //! Encode an update entry of a histogram.
+    /*! The changed bins are those that differ from previous, or all non-zero bins if previous is null.
+     *  \return false if nothing changed, in which case nothing is written.
+     */
+    bool EncodeEntry(std::string &out, const Source &source, const std::vector<size_t> &bins, uint64_t entries,
+                     const std::vector<size_t> *previous, uint64_t previous_entries)
+    {
+        std::string changes;
+        Encoder body{changes};
+        uint64_t count = 0;
+        size_t last = 0;
+        for ( size_t i = 0 ; i < bins.size() ; ++i ){
+            const size_t before = previous ? (*previous)[i] : 0;
+            if ( bins[i] == before )
+                continue;
+            body.PutVarint(i - last);
+            body.PutZigzag(int64_t(bins[i] - before));
+            last = i;
+            ++count;
+        }
+        if ( previous && count == 0 && entries == previous_entries )
+            return false;
+
+        const Named &named = source.GetNamed();
+        Encoder enc{out};
+        enc.Put(uint8_t(previous ? 0 : flag_keyframe));
+        enc.Put(uint8_t(source.dim));
+        enc.PutString(named.GetName());
+        if ( !previous ){
+            enc.PutString(named.GetTitle());
+            enc.PutString(named.GetPath());
+            for ( auto axis : source.GetAxes() ){
+                enc.Put(uint64_t(axis->GetBinCount()));
+                enc.Put(double(axis->GetLeft()));
+                enc.Put(double(axis->GetRight()));
+                enc.PutString(axis->GetTitle());
+            }
+            if ( source.h2s )
+                enc.Put(double(source.h2s->GetRatio()));
+        }
+        enc.Put(entries);
+        enc.PutVarint(count);
+        out += changes;
+        return true;
+    }
+
+    //! Check that a reconstructed histogram has the binning of a keyframe.
+    void CheckAxis(const Axis &axis, uint64_t count, double left, double right, const std::string &name)
+    {
+        if ( axis.GetBinCount() != count || axis.GetLeft() != left || axis.GetRight() != right )
+            throw std::runtime_error("Histogram '" + name + "' changed binning in the stream.");
+    }
+}
+
+// ########################################################################
+
+StreamPublisher::StreamPublisher(Histograms &_set, const std::string &_path, const Options &_options)
+    : set( _set )
+    , path( _path )
+    , options( _options )
+    , listener( -1 )
+    , sequence( 0 )
+    , last_size( 0 )
+{
+    const sockaddr_un address = MakeAddress(path);
+    if ( ( listener = MakeSocket() ) < 0 )
+        throw std::runtime_error("Could not create socket: " + std::string(std::strerror(errno)));
+    ::unlink(path.c_str());
+    if ( ::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0
+         || ::listen(listener, options.backlog) != 0 ){
+        const std::string error = std::strerror(errno);
+        ::close(listener);
+        throw std::runtime_error("Could not listen on '" + path + "': " + error);
+    }
+    SetNonBlocking(listener);
+}
+
+// ########################################################################
+
+StreamPublisher::~StreamPublisher()
+{
+    for ( auto &client : clients )
+        ::close(client->fd);
+    ::close(listener);
+    ::unlink(path.c_str());
+}
+
+// ########################################################################
+
+void StreamPublisher::Accept()
+{
+    int fd;
+    while ( ( fd = ::accept(listener, nullptr, nullptr) ) >= 0 ){
+#ifdef SO_NOSIGPIPE
+        const int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif // SO_NOSIGPIPE
+        SetNonBlocking(fd);
+        clients.emplace_back(new client_t);
+        clients.back()->fd = fd;
+    }
+}
+
+// ########################################################################
+
+bool StreamPublisher::Receive(client_t &client)
+{
+    char buffer[4096];
+    while ( true ){
+        const ssize_t n = ::recv(client.fd, buffer, sizeof(buffer), 0);
+        if ( n > 0 )
+            client.in.append(buffer, size_t(n));
+        else if ( n == 0 )
+            return false;
+        else if ( errno == EINTR )
+            continue;
+        else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+            break;
+        else
+            return false;
+    }
+
+    size_t consumed = 0;
+    while ( client.in.size() - consumed >= header_size ){
+        Decoder header{client.in.data() + consumed, client.in.data() + client.in.size()};
+        if ( header.Get<uint32_t>() != message_magic )
+            return false;
+        const auto type = header.Get<uint8_t>();
+        const auto size = header.Get<uint32_t>();
+        if ( size_t(header.end - header.p) < size )
+            break;
+        if ( type == message_subscribe ){
+            try {
+                Decoder in{header.p, header.p + size};
+                const auto count = in.Get<uint32_t>();
+                client.names.clear();
+                for ( uint32_t i = 0 ; i < count ; ++i )
+                    client.names.insert(in.GetString());
+                client.all = count == 0;
+            } catch ( std::runtime_error & ){
+                return false;
+            }
+            // The new subscription starts with keyframes.
+            client.synced.clear();
+        }
+        consumed += header_size + size;
+    }
+    client.in.erase(0, consumed);
+    return true;
+}
+
+// ########################################################################
+
+bool StreamPublisher::Send(client_t &client)
+{
+    size_t sent = 0;
+    while ( sent < client.out.size() ){
+        const ssize_t n = ::send(client.fd, client.out.data() + sent, client.out.size() - sent, send_flags);
+        if ( n > 0 )
+            sent += size_t(n);
+        else if ( n < 0 && errno == EINTR )
+            continue;
+        else if ( n < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            break;
+        else
+            return false;
+    }
+    client.out.erase(0, sent);
+    return true;
+}
+
+// ########################################################################
+
+void StreamPublisher::Publish(ThreadPool &pool, const guard_t &guard)
+{
+    Accept();
+    for ( auto &client : clients ){
+        if ( !Receive(*client) ){
+            ::close(client->fd);
+            client->fd = -1;
+        }
+    }
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                 [](const std::unique_ptr<client_t> &client){ return client->fd < 0; }),
+                  clients.end());
+
+    // Clients that have not read the previous updates are skipped and get keyframes later.
+    std::vector<client_t *> active;
+    for ( auto &client : clients ){
+        if ( client->out.size() > options.max_pending )
+            client->synced.clear();
+        else
+            active.push_back(client.get());
+    }
+
+    // The subscribed histograms, with what kind of entries they need.
+    std::vector<Source> all;
+    for ( auto h : set.GetAll1D() )
+        all.emplace_back(h);
+    for ( auto h : set.GetAll2D() )
+        all.emplace_back(h);
+    for ( auto h : set.GetAll3D() )
+        all.emplace_back(h);
+    for ( auto h : set.GetAllSubtracted2D() )
+        all.emplace_back(h);
+
+    std::vector<Source> sources;
+    std::vector<key_t> keys;
+    std::vector<char> need_delta, need_keyframe;
+    std::vector<snapshot_t *> states;
+    std::map<key_t, snapshot_t> kept;
+    for ( auto &source : all ){
+        const key_t key(source.dim, source.GetNamed().GetName());
+        bool delta = false, keyframe = false;
+        for ( auto client : active ){
+            if ( !client->all && client->names.count(key.second) == 0 )
+                continue;
+            if ( client->synced.count(key) )
+                delta = true;
+            else
+                keyframe = true;
+        }
+        if ( !delta && !keyframe )
+            continue;
+        sources.push_back(source);
+        keys.push_back(key);
+        need_delta.push_back(delta);
+        need_keyframe.push_back(keyframe);
+        auto it = snapshots.find(key);
+        kept[key] = ( it != snapshots.end() ) ? std::move(it->second) : snapshot_t();
+    }
+    // Histograms nobody has a copy of any more are dropped from the snapshots.
+    snapshots = std::move(kept);
+    for ( auto &key : keys )
+        states.push_back(&snapshots[key]);
+
+    // Copying the bins is the only step that reads the contents of the histograms.
+    std::vector<std::vector<size_t>> bins(sources.size());
+    std::vector<uint64_t> entries(sources.size());
+    auto copy = [&](){
+        pool.ParallelFor(0, sources.size(), [&](size_t first, size_t last){
+            for ( size_t i = first ; i < last ; ++i ){
+                sources[i].Copy(bins[i]);
+                entries[i] = sources[i].GetEntries();
+            }
+        });
+    };
+    if ( guard )
+        guard(copy);
+    else
+        copy();
+
+    std::vector<std::string> deltas(sources.size()), keyframes(sources.size());
+    pool.ParallelFor(0, sources.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i ){
+            snapshot_t &state = *states[i];
+            if ( need_keyframe[i] )
+                EncodeEntry(keyframes[i], sources[i], bins[i], entries[i], nullptr, 0);
+            if ( need_delta[i] )
+                EncodeEntry(deltas[i], sources[i], bins[i], entries[i], &state.bins, state.entries);
+            state.bins.swap(bins[i]);
+            state.entries = entries[i];
+        }
+    });
+
+    ++sequence;
+    last_size = 0;
+    for ( auto client : active ){
+        std::string payload;
+        Encoder enc{payload};
+        enc.Put(sequence);
+        enc.Put(uint32_t(0));
+        uint32_t count = 0;
+        for ( size_t i = 0 ; i < sources.size() ; ++i ){
+            if ( !client->all && client->names.count(keys[i].second) == 0 )
+                continue;
+            if ( client->synced.count(keys[i]) ){
+                if ( deltas[i].empty() )
+                    continue;
+                payload += deltas[i];
+            } else {
+                payload += keyframes[i];
+                client->synced.insert(keys[i]);
+            }
+            ++count;
+        }
+        std::memcpy(&payload[sizeof(sequence)], &count, sizeof(count));
+        const size_t before = client->out.size();
+        PutMessage(client->out, message_update, payload);
+        last_size += client->out.size() - before;
+    }
+
+    for ( auto &client : clients ){
+        if ( !Send(*client) ){
+            ::close(client->fd);
+            client->fd = -1;
+        }
+    }
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                 [](const std::unique_ptr<client_t> &client){ return client->fd < 0; }),
+                  clients.end());
+}
+
+// ########################################################################
+// ########################################################################
+
+StreamClient::StreamClient(const std::string &path)
+    : fd( -1 )
+    , sequence( 0 )
+{
+    const sockaddr_un address = MakeAddress(path);
+    if ( ( fd = MakeSocket() ) < 0 )
+        throw std::runtime_error("Could not create socket: " + std::string(std::strerror(errno)));
+    if ( ::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 ){
+        const std::string error = std::strerror(errno);
+        ::close(fd);
+        throw std::runtime_error("Could not connect to '" + path + "': " + error);
+    }
+}
+
+// ########################################################################
+
+StreamClient::~StreamClient()
+{
+    if ( fd >= 0 )
+        ::close(fd);
+}
+
+// ########################################################################
+
+void StreamClient::Subscribe(const std::vector<std::string> &names)
+{
+    if ( fd < 0 )
+        throw std::runtime_error("Stream is not connected.");
+    std::string payload, message;
+    Encoder enc{payload};
+    enc.Put(uint32_t(names.size()));
+    for ( auto &name : names )
+        enc.PutString(name);
+    PutMessage(message, message_subscribe, payload);
+
+    size_t sent = 0;
+    while ( sent < message.size() ){
+        const ssize_t n = ::send(fd, message.data() + sent, message.size() - sent, send_flags);
+        if ( n > 0 )
+            sent += size_t(n);
+        else if ( n < 0 && errno == EINTR )
+            continue;
+        else
+            throw std::runtime_error("Could not send subscription: " + std::string(std::strerror(errno)));
+    }
+}
+
+// ########################################################################
+
+size_t StreamClient::Poll(int timeout)
+{
+    size_t applied = 0;
+    while ( fd >= 0 ){
+        pollfd request{fd, POLLIN, 0};
+        const int ready = ::poll(&request, 1, timeout);
+        if ( ready < 0 && errno != EINTR )
+            throw std::runtime_error("Could not poll stream: " + std::string(std::strerror(errno)));
+
+        char buffer[65536];
+        while ( ready > 0 ){
+            const ssize_t n = ::recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if ( n > 0 ){
+                in.append(buffer, size_t(n));
+            } else if ( n < 0 && errno == EINTR ){
+                continue;
+            } else {
+                if ( n == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK ) ){
+                    ::close(fd);
+                    fd = -1;
+                }
+                break;
+            }
+        }
+
+        size_t consumed = 0;
+        while ( in.size() - consumed >= header_size ){
+            Decoder header{in.data() + consumed, in.data() + in.size()};
+            if ( header.Get<uint32_t>() != message_magic )
+                throw std::runtime_error("Stream is corrupt.");
+            const auto type = header.Get<uint8_t>();
+            const auto size = header.Get<uint32_t>();
+            if ( size_t(header.end - header.p) < size )
+                break;
+            if ( type == message_update ){
+                Apply(header.p, size);
+                ++applied;
+            }
+            consumed += header_size + size;
+        }
+        in.erase(0, consumed);
+
+        // Keep waiting only if asked to wait for an update.
+        if ( applied > 0 || timeout >= 0 )
+            break;
+    }
+    return applied;
+}
+
+// ########################################################################
+
+void StreamClient::Apply(const char *payload, size_t size)
+{
+    Decoder in{payload, payload + size};
+    const auto number = in.Get<uint64_t>();
+    const auto count = in.Get<uint32_t>();
+    const bool missed = number != sequence + 1;
+    for ( uint32_t i = 0 ; i < count ; ++i ){
+        const auto flags = in.Get<uint8_t>();
+        const auto kind = in.Get<uint8_t>();
+        const std::string name = in.GetString();
+        const bool keyframe = ( flags & flag_keyframe ) != 0;
+        const bool subtracted = ( kind & subtracted_flag ) != 0;
+        const int dim = kind & ~subtracted_flag;
+        if ( dim < 1 || dim > 3 || ( subtracted && dim != 2 ) )
+            throw std::runtime_error("Stream holds a histogram with " + std::to_string(dim) + " dimensions.");
+        if ( missed && !keyframe )
+            throw std::runtime_error("Missed stream updates before sequence " + std::to_string(number)
+                                     + " for histogram '" + name + "'.");
+
+        Histogram1Dp h1 = ( dim == 1 ) ? set.Find1D(name) : nullptr;
+        Histogram2Dp h2 = ( dim == 2 && !subtracted ) ? set.Find2D(name) : nullptr;
+        Histogram3Dp h3 = ( dim == 3 ) ? set.Find3D(name) : nullptr;
+        SubtractedHistogram2Dp h2s = subtracted ? set.FindSubtracted2D(name) : nullptr;
+        uint64_t counts[3] = {0, 0, 0};
+        if ( keyframe ){
+            const std::string title = in.GetString(), path = in.GetString();
+            double lefts[3] = {0, 0, 0}, rights[3] = {0, 0, 0};
+            std::string titles[3];
+            for ( int d = 0 ; d < dim ; ++d ){
+                counts[d] = in.Get<uint64_t>();
+                lefts[d] = in.Get<double>();
+                rights[d] = in.Get<double>();
+                titles[d] = in.GetString();
+            }
+            if ( subtracted ){
+                const auto ratio = in.Get<double>();
+                if ( !h2s )
+                    h2s = set.CreateSubtracted2D(name, title, counts[0], lefts[0], rights[0], titles[0],
+                                                 counts[1], lefts[1], rights[1], titles[1], ratio, path);
+                CheckAxis(h2s->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                CheckAxis(h2s->GetAxisY(), counts[1], lefts[1], rights[1], name);
+                h2s->Reset();
+            } else if ( dim == 1 ){
+                if ( !h1 )
+                    h1 = set.Create1D(name, title, counts[0], lefts[0], rights[0], titles[0], path);
+                CheckAxis(h1->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                h1->Reset();
+            } else if ( dim == 2 ){
+                if ( !h2 )
+                    h2 = set.Create2D(name, title, counts[0], lefts[0], rights[0], titles[0],
+                                      counts[1], lefts[1], rights[1], titles[1], path);
+                CheckAxis(h2->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                CheckAxis(h2->GetAxisY(), counts[1], lefts[1], rights[1], name);
+                h2->Reset();
+            } else {
+                if ( !h3 )
+                    h3 = set.Create3D(name, title, counts[0], lefts[0], rights[0], titles[0],
+                                      counts[1], lefts[1], rights[1], titles[1],
+                                      counts[2], lefts[2], rights[2], titles[2], path);
+                CheckAxis(h3->GetAxisX(), counts[0], lefts[0], rights[0], name);
+                CheckAxis(h3->GetAxisY(), counts[1], lefts[1], rights[1], name);
+                CheckAxis(h3->GetAxisZ(), counts[2], lefts[2], rights[2], name);
+                h3->Reset();
+            }
+        } else if ( !h1 && !h2 && !h3 && !h2s ){
+            throw std::runtime_error("Stream update for unknown histogram '" + name + "'.");
+        }
+
+        // Entries are unsigned, so the difference wraps around to the right count.
+        const auto entries = in.Get<uint64_t>();
+        if ( h1 ) h1->AddEntries(entries - size_t(h1->GetEntries()));
+        if ( h2 ) h2->AddEntries(entries - size_t(h2->GetEntries()));
+        if ( h3 ) h3->AddEntries(entries - size_t(h3->GetEntries()));
+        if ( h2s ) h2s->AddEntries(entries - size_t(h2s->GetEntries()));
+
+        const size_t nx = h1 ? h1->GetAxisX().GetBinCountAll() : h2 ? h2->GetAxisX().GetBinCountAll()
+                        : h2s ? h2s->GetAxisX().GetBinCountAll() : h3->GetAxisX().GetBinCountAll();
+        const size_t ny = h2 ? h2->GetAxisY().GetBinCountAll() : h3 ? h3->GetAxisY().GetBinCountAll() : 1;
+        const auto changed = in.GetVarint();
+        size_t k = 0;
+        for ( uint64_t c = 0 ; c < changed ; ++c ){
+            k += in.GetVarint();
+            const auto delta = size_t(in.GetZigzag());
+            if ( h2s ){
+                // The change is to the bits of the double, wrapping around like the unsigned bins.
+                SubtractedHistogram2D::data_t content = h2s->GetBinContent(k % nx, k/nx);
+                size_t bits;
+                std::memcpy(&bits, &content, sizeof(bits));
+                bits += delta;
+                std::memcpy(&content, &bits, sizeof(content));
+                h2s->SetBinContent(k % nx, k/nx, content);
+            } else if ( h1 )
+                h1->SetBinContent(k, h1->GetBinContent(k) + delta);
+            else if ( h2 )
+                h2->SetBinContent(k % nx, k/nx, h2->GetBinContent(k % nx, k/nx) + delta);
+            else
+                h3->SetBinContent(k % nx, ( k/nx ) % ny, k/( nx*ny ),
+                                  h3->GetBinContent(k % nx, ( k/nx ) % ny, k/( nx*ny )) + delta);
+        }
+    }
+    sequence = number;
+}
+
+// ########################################################################
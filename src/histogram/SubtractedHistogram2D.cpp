@@ -0,0 +1,69 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "SubtractedHistogram2D.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// ########################################################################
+
+SubtractedHistogram2D::SubtractedHistogram2D( const std::string& name, const std::string& title,
+                                              Axis::index_t xc, Axis::bin_t xl, Axis::bin_t xr, const std::string& xt,
+                                              Axis::index_t yc, Axis::bin_t yl, Axis::bin_t yr, const std::string& yt,
+                                              double _ratio, const std::string& path)
+    : Named( name, title, path )
+    , xaxis( name+"_xaxis", xc, xl, xr, xt )
+    , yaxis( name+"_yaxis", yc, yl, yr, yt )
+    , ratio( _ratio )
+    , entries( 0 )
+    , data()
+{
+    if ( xaxis.GetBinCountAll()*yaxis.GetBinCountAll() > ( size_t(1) << 31 ) )
+        throw std::runtime_error("Histogram '" + name + "' has too many bins for a subtracted histogram.");
+    data.assign(xaxis.GetBinCountAll()*yaxis.GetBinCountAll(), 0.);
+}
+
+// ########################################################################
+
+void SubtractedHistogram2D::Add(const SubtractedHistogram2Dp &other, data_t scale)
+{
+    if ( !other
+         || other->GetAxisX().GetLeft() != xaxis.GetLeft()
+         || other->GetAxisX().GetRight() != xaxis.GetRight()
+         || other->GetAxisX().GetBinCount() != xaxis.GetBinCount()
+         || other->GetAxisY().GetLeft() != yaxis.GetLeft()
+         || other->GetAxisY().GetRight() != yaxis.GetRight()
+         || other->GetAxisY().GetBinCount() != yaxis.GetBinCount() )
+        throw std::runtime_error("Histograms '" + GetName() + "' and '" + ( other ? other->GetName() : "" ) +
+                                 "' do not have the same dimensions.");
+    for ( size_t i = 0 ; i < data.size() ; ++i )
+        data[i] += scale*other->data[i];
+    entries += size_t(scale*double(other->entries));
+}
+
+// ########################################################################
+
+void SubtractedHistogram2D::Reset()
+{
+    std::fill(data.begin(), data.end(), 0.);
+    entries = 0;
+}
@@ -0,0 +1,243 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif // __linux__
+
+//! The pool and worker index of the current thread, if it is a worker.
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+//! Pool installed with SetDefault.
+static std::atomic<ThreadPool *> default_pool( nullptr );
+
+// ########################################################################
+
+ThreadPool::ThreadPool(unsigned threads, const std::vector<int> &cpus)
+    : pending( 0 )
+    , next_worker( 0 )
+    , stop( false )
+{
+    if ( threads == 0 )
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for ( unsigned i = 0 ; i < threads ; ++i )
+        workers.emplace_back(new worker_t);
+
+    for ( size_t i = 0 ; i < workers.size() ; ++i ){
+        workers[i]->thread = std::thread(&ThreadPool::run, this, i);
+#ifdef __linux__
+        if ( !cpus.empty() ){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i % cpus.size()], &set);
+            pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(set), &set);
+        }
+#endif // __linux__
+    }
+}
+
+// ########################################################################
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(sleep_mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for ( auto &worker : workers )
+        worker->thread.join();
+}
+
+// ########################################################################
+
+void ThreadPool::Submit(task_t task)
+{
+    const size_t index = ( current_pool == this ) ? current_index
+            : next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    // Counted before it is queued, so that pending never drops below the queued tasks.
+    pending.fetch_add(1);
+    {
+        std::lock_guard lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taking the lock makes sure a worker about to sleep sees the new task.
+        std::lock_guard lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+// ########################################################################
+
+bool ThreadPool::pop(size_t index, task_t &task)
+{
+    worker_t &worker = *workers[index];
+    std::lock_guard lock(worker.mutex);
+    if ( worker.tasks.empty() )
+        return false;
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+// ########################################################################
+
+bool ThreadPool::steal(size_t index, task_t &task)
+{
+    for ( size_t i = 1 ; i < workers.size() ; ++i ){
+        worker_t &victim = *workers[(index + i) % workers.size()];
+        std::unique_lock lock(victim.mutex, std::try_to_lock);
+        if ( !lock.owns_lock() || victim.tasks.empty() )
+            continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+// ########################################################################
+
+void ThreadPool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+    for (;;) {
+        task_t task;
+        if ( pop(index, task) || steal(index, task) ){
+            pending.fetch_sub(1);
+            task();
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex);
+        if ( pending.load() > 0 ){
+            // A steal may have failed on try_lock, look again.
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        if ( stop )
+            return;
+        wake.wait(lock, [this](){ return stop || pending.load() > 0; });
+    }
+}
+
+// ########################################################################
+
+void ThreadPool::ParallelFor(size_t begin, size_t end, const range_body_t &body, size_t grain)
+{
+    if ( end <= begin )
+        return;
+    const size_t n = end - begin;
+    grain = std::max<size_t>(grain, 1);
+
+    // A few chunks per worker evens out imbalance between chunks.
+    const size_t max_chunks = 4 * (workers.size() + 1);
+    const size_t chunks = std::min((n + grain - 1) / grain, max_chunks);
+    if ( chunks == 1 ){
+        body(begin, end);
+        return;
+    }
+
+    struct state_t {
+        range_body_t body;
+        size_t begin, n, chunks;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+
+        void work()
+        {
+            for ( size_t c = next.fetch_add(1) ; c < chunks ; c = next.fetch_add(1) ){
+                if ( !failed.load(std::memory_order_relaxed) ){
+                    try {
+                        body(begin + n*c/chunks, begin + n*(c + 1)/chunks);
+                    } catch ( ... ){
+                        std::lock_guard lock(mutex);
+                        if ( !error )
+                            error = std::current_exception();
+                        failed.store(true);
+                    }
+                }
+                if ( done.fetch_add(1) + 1 == chunks ){
+                    std::lock_guard lock(mutex);
+                    finished.notify_all();
+                }
+            }
+        }
+    };
+
+    auto state = std::make_shared<state_t>();
+    state->body = body;
+    state->begin = begin;
+    state->n = n;
+    state->chunks = chunks;
+
+    // Helpers that start after all chunks are taken return immediately.
+    const size_t helpers = std::min(chunks - 1, workers.size());
+    for ( size_t i = 0 ; i < helpers ; ++i )
+        Submit([state](){ state->work(); });
+
+    state->work();
+
+    std::unique_lock lock(state->mutex);
+    state->finished.wait(lock, [&state](){ return state->done.load() == state->chunks; });
+    if ( state->error )
+        std::rethrow_exception(state->error);
+}
+
+// ########################################################################
+
+ThreadPool &ThreadPool::Default()
+{
+    ThreadPool *pool = default_pool.load(std::memory_order_acquire);
+    if ( pool )
+        return *pool;
+
+    static ThreadPool builtin([](){
+        const char *env = std::getenv("HISTOGRAM_THREADS");
+        return env ? unsigned(std::strtoul(env, nullptr, 10)) : 0u;
+    }());
+    return builtin;
+}
+
+// ########################################################################
+
+void ThreadPool::SetDefault(ThreadPool *pool)
+{
+    default_pool.store(pool, std::memory_order_release);
+}
+
+// ########################################################################
@@ -0,0 +1,69 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Trace.h"
+
+#include <atomic>
+
+static std::atomic<HistogramTrace::callback_t> trace_callback( nullptr );
+
+// ########################################################################
+
+void HistogramTrace::SetCallback(callback_t callback)
+{
+    trace_callback.store(callback, std::memory_order_release);
+}
+
+// ########################################################################
+
+HistogramTrace::callback_t HistogramTrace::GetCallback()
+{
+    return trace_callback.load(std::memory_order_acquire);
+}
+
+// ########################################################################
+
+void HistogramTrace::Emit(event_t event, const char *name, size_t count)
+{
+    callback_t callback = trace_callback.load(std::memory_order_acquire);
+    if ( callback )
+        callback(event, name, count);
+}
+
+// ########################################################################
+
+const char *HistogramTrace::GetEventName(event_t event)
+{
+    switch ( event ){
+        case flush_begin : return "flush_begin";
+        case flush_end : return "flush_end";
+        case lock_wait : return "lock_wait";
+        case lock_acquire : return "lock_acquire";
+        case lock_release : return "lock_release";
+        case merge_begin : return "merge_begin";
+        case merge_end : return "merge_end";
+        case write_begin : return "write_begin";
+        case write_end : return "write_end";
+    }
+    return "unknown";
+}
+
+// ########################################################################
@@ -0,0 +1,165 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "Unfolding.h"
+
+#include "Histogram2D.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+void Unfolding::Fold(const double *u, const double *response, double *f,
+                     size_t rows, size_t n, size_t m, ThreadPool &pool, size_t block_size)
+{
+    block_size = std::max(block_size, size_t(1));
+    const size_t row_blocks = ( rows + block_size - 1 )/block_size;
+    pool.ParallelFor(0, row_blocks, [&](size_t first, size_t last){
+        for ( size_t rb = first ; rb < last ; ++rb ){
+            const size_t r0 = rb*block_size, r1 = std::min(r0 + block_size, rows);
+            std::fill(f + r0*m, f + r1*m, 0.);
+            for ( size_t k0 = 0 ; k0 < n ; k0 += block_size ){
+                const size_t k1 = std::min(k0 + block_size, n);
+                for ( size_t j0 = 0 ; j0 < m ; j0 += block_size ){
+                    const size_t j1 = std::min(j0 + block_size, m);
+                    // The response block is reused for every row of the row block.
+                    for ( size_t i = r0 ; i < r1 ; ++i ){
+                        double *fi = f + i*m;
+                        for ( size_t k = k0 ; k < k1 ; ++k ){
+                            const double uik = u[i*n + k];
+                            if ( uik == 0 )
+                                continue;
+                            const double *rk = response + k*m;
+                            for ( size_t j = j0 ; j < j1 ; ++j )
+                                fi[j] += uik*rk[j];
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// ########################################################################
+
+Unfolding::Result Unfolding::Unfold(Histograms &set, Histogram2Dp raw, Histogram2Dp response,
+                                    const std::string &name, const Options &options, ThreadPool &pool)
+{
+    const Axis &xaxis = raw->GetAxisX(), &yaxis = raw->GetAxisY();
+    const size_t n = xaxis.GetBinCount(), rows = yaxis.GetBinCount();
+    if ( response->GetAxisX().GetLeft() != xaxis.GetLeft()
+         || response->GetAxisX().GetRight() != xaxis.GetRight()
+         || response->GetAxisX().GetBinCount() != n
+         || response->GetAxisY().GetBinCount() != n )
+        throw std::runtime_error("Response '"+response->GetName()+"' does not match the x axis of '"+raw->GetName()+"'.");
+
+    // Response and raw spectra as dense matrices of the regular bins.
+    std::vector<double> R(n*n), r(rows*n);
+    for ( size_t t = 0 ; t < n ; ++t ){
+        const Histogram2D::data_t *row = response->GetRow(t + 1);
+        double sum = 0;
+        for ( size_t j = 0 ; j < n ; ++j ){
+            R[t*n + j] = double(row[j + 1]);
+            sum += R[t*n + j];
+        }
+        if ( options.normalize_response && sum > 0 ){
+            for ( size_t j = 0 ; j < n ; ++j )
+                R[t*n + j] /= sum;
+        }
+    }
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        const Histogram2D::data_t *row = raw->GetRow(i + 1);
+        std::copy(row + 1, row + n + 1, r.begin() + i*n);
+    }
+
+    Result result = {nullptr, std::vector<size_t>(rows, 0), std::vector<double>(rows, 0.)};
+    std::vector<double> u(r), best(rows*n, 0.);
+    std::vector<double> best_chi2(rows, std::numeric_limits<double>::max());
+
+    std::vector<size_t> active;
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        if ( std::any_of(r.begin() + i*n, r.begin() + (i + 1)*n, [](double v){ return v > 0; }) )
+            active.push_back(i);
+    }
+
+    std::vector<double> packed, folded;
+    std::vector<char> converged;
+    for ( size_t iteration = 1 ; iteration <= options.max_iterations && !active.empty() ; ++iteration ){
+        const size_t count = active.size();
+        packed.resize(count*n);
+        folded.resize(count*n);
+        converged.assign(count, 0);
+        for ( size_t a = 0 ; a < count ; ++a )
+            std::copy(u.begin() + active[a]*n, u.begin() + (active[a] + 1)*n, packed.begin() + a*n);
+
+        Fold(packed.data(), R.data(), folded.data(), count, n, n, pool, options.block_size);
+
+        pool.ParallelFor(0, count, [&](size_t first, size_t last){
+            for ( size_t a = first ; a < last ; ++a ){
+                const size_t i = active[a];
+                const double *ri = r.data() + i*n, *fi = folded.data() + a*n;
+                double *ui = u.data() + i*n;
+                double chi2 = 0;
+                for ( size_t j = 0 ; j < n ; ++j ){
+                    const double diff = fi[j] - ri[j];
+                    chi2 += diff*diff/std::max(ri[j], 1.);
+                }
+                chi2 /= double(n);
+
+                const double previous = best_chi2[i];
+                if ( chi2 < previous ){
+                    best_chi2[i] = chi2;
+                    std::copy(ui, ui + n, best.begin() + i*n);
+                    result.iterations[i] = iteration;
+                    result.chi2[i] = chi2;
+                }
+                if ( chi2 >= previous*( 1 - options.tolerance ) ){
+                    converged[a] = 1;
+                    continue;
+                }
+                for ( size_t j = 0 ; j < n ; ++j )
+                    ui[j] += ri[j] - fi[j];
+            }
+        });
+
+        size_t kept = 0;
+        for ( size_t a = 0 ; a < count ; ++a ){
+            if ( !converged[a] )
+                active[kept++] = active[a];
+        }
+        active.resize(kept);
+    }
+
+    result.unfolded = set.Create2D(name, "Unfolded " + raw->GetTitle(),
+                                   n, xaxis.GetLeft(), xaxis.GetRight(), xaxis.GetTitle(),
+                                   rows, yaxis.GetLeft(), yaxis.GetRight(), yaxis.GetTitle(),
+                                   raw->GetPath());
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        for ( size_t j = 0 ; j < n ; ++j ){
+            const double value = std::max(std::round(best[i*n + j]), 0.);
+            if ( value > 0 )
+                result.unfolded->SetBinContent(j + 1, i + 1, Histogram2D::data_t(value));
+        }
+    }
+    result.unfolded->AddEntries(raw->GetEntries());
+    return result;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ListModeFile.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ########################################################################
+
+ListModeFile::ListModeFile(const std::string &filename)
+    : data( nullptr )
+    , size( 0 )
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if ( fd < 0 )
+        throw std::runtime_error("Could not open '"+filename+"': "+std::strerror(errno));
+
+    struct stat st{};
+    if ( fstat(fd, &st) < 0 ){
+        close(fd);
+        throw std::runtime_error("Could not stat '"+filename+"': "+std::strerror(errno));
+    }
+    size = st.st_size;
+    if ( size == 0 ){
+        close(fd);
+        return;
+    }
+
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( addr == MAP_FAILED )
+        throw std::runtime_error("Could not map '"+filename+"': "+std::strerror(errno));
+
+    // We read each chunk front to back.
+    madvise(addr, size, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(addr);
+}
+
+// ########################################################################
+
+ListModeFile::~ListModeFile()
+{
+    if ( data )
+        munmap(const_cast<char *>(data), size);
+}
+
+// ########################################################################
@@ -0,0 +1,59 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef LISTMODEFILE_H
+#define LISTMODEFILE_H
+
+#include <string>
+#include <cstddef>
+
+/*!
+ * Read only memory map of a binary list-mode file.
+ * The file is mapped once and the pages are faulted in on demand by the
+ * threads reading from it, so there is no copying through a read buffer.
+ */
+class ListModeFile
+{
+public:
+    //! Map the file. Throws if the file can't be opened or mapped.
+    explicit ListModeFile(const std::string &filename);
+
+    //! Unmap the file.
+    ~ListModeFile();
+
+    ListModeFile(const ListModeFile &) = delete;
+    ListModeFile &operator=(const ListModeFile &) = delete;
+
+    //! Get a pointer to the first byte of the file.
+    [[nodiscard]] const char *GetData() const { return data; }
+
+    //! Get the size of the file in bytes.
+    [[nodiscard]] size_t GetSize() const { return size; }
+
+private:
+    //! Start of the mapped region.
+    const char *data;
+
+    //! Size of the mapped region.
+    size_t size;
+};
+
+#endif // LISTMODEFILE_H
@@ -0,0 +1,128 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "ReplaySpec.h"
+
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+// ########################################################################
+
+static ReplaySpec::type_t ParseType(const std::string &name)
+{
+    static const std::map<std::string, ReplaySpec::type_t> types = {
+            {"u8", ReplaySpec::u8}, {"u16", ReplaySpec::u16}, {"u32", ReplaySpec::u32}, {"u64", ReplaySpec::u64},
+            {"i8", ReplaySpec::i8}, {"i16", ReplaySpec::i16}, {"i32", ReplaySpec::i32}, {"i64", ReplaySpec::i64},
+            {"f32", ReplaySpec::f32}, {"f64", ReplaySpec::f64}
+    };
+    auto it = types.find(name);
+    if ( it == types.end() )
+        throw std::runtime_error("unknown column type '"+name+"'");
+    return it->second;
+}
+
+// ########################################################################
+
+size_t ReplaySpec::GetTypeSize(type_t type)
+{
+    switch ( type ){
+        case u8 : case i8 : return 1;
+        case u16 : case i16 : return 2;
+        case u32 : case i32 : case f32 : return 4;
+        case u64 : case i64 : case f64 : return 8;
+    }
+    return 0;
+}
+
+// ########################################################################
+
+ReplaySpec ReplaySpec::Parse(std::istream &in)
+{
+    ReplaySpec spec;
+    std::map<std::string, size_t> column_index;
+    std::string line;
+    int lineno = 0;
+
+    auto find_column = [&column_index](const std::string &name){
+        auto it = column_index.find(name);
+        if ( it == column_index.end() )
+            throw std::runtime_error("unknown column '"+name+"'");
+        return it->second;
+    };
+
+    while ( std::getline(in, line) ){
+        ++lineno;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string keyword;
+        if ( !(words >> keyword) )
+            continue;
+
+        try {
+            if ( keyword == "record" ){
+                if ( !(words >> spec.record_size) || spec.record_size == 0 )
+                    throw std::runtime_error("expected record size");
+            } else if ( keyword == "column" ){
+                Column column{"", u8, 0, 1.0, 0.0};
+                std::string type;
+                if ( !(words >> column.name >> type >> column.offset) )
+                    throw std::runtime_error("expected 'column <name> <type> <offset>'");
+                column.type = ParseType(type);
+                if ( words >> column.gain )
+                    words >> column.shift;
+                if ( column_index.count(column.name) > 0 )
+                    throw std::runtime_error("column '"+column.name+"' already defined");
+                column_index[column.name] = spec.columns.size();
+                spec.columns.push_back(column);
+            } else if ( keyword == "1d" || keyword == "2d" || keyword == "3d" ){
+                Hist hist;
+                const int dims = keyword[0] - '0';
+                if ( !(words >> hist.name) )
+                    throw std::runtime_error("expected histogram name");
+                for ( int i = 0 ; i < dims ; ++i ){
+                    AxisSpec axis{0, 0, 0, 0};
+                    std::string column;
+                    if ( !(words >> axis.channels >> axis.left >> axis.right >> column) )
+                        throw std::runtime_error("expected '<channels> <left> <right> <column>' for each axis");
+                    axis.column = find_column(column);
+                    hist.axes.push_back(axis);
+                }
+                words >> hist.path;
+                spec.histograms.push_back(hist);
+            } else {
+                throw std::runtime_error("unknown keyword '"+keyword+"'");
+            }
+        } catch ( std::exception &e ){
+            throw std::runtime_error("spec line "+std::to_string(lineno)+": "+e.what());
+        }
+    }
+
+    if ( spec.record_size == 0 )
+        throw std::runtime_error("spec: missing 'record' statement");
+    for ( auto &column : spec.columns ){
+        if ( column.offset + GetTypeSize(column.type) > spec.record_size )
+            throw std::runtime_error("spec: column '"+column.name+"' extends beyond the record");
+    }
+    return spec;
+}
+
+// ########################################################################
@@ -0,0 +1,92 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef REPLAYSPEC_H
+#define REPLAYSPEC_H
+
+#include <histogram/Histograms.h>
+
+#include <string>
+#include <vector>
+#include <istream>
+
+/*!
+ * Description of a list-mode file and of the histograms to fill from it.
+ *
+ * The spec is a plain text file with one statement per line. Empty lines and
+ * everything after a '#' are ignored.
+ *
+ *     record <bytes>
+ *     column <name> <u8|u16|u32|u64|i8|i16|i32|i64|f32|f64> <byte offset> [gain] [shift]
+ *     1d <name> <channels> <left> <right> <x column> [path]
+ *     2d <name> <channels> <left> <right> <x column> <channels> <left> <right> <y column> [path]
+ *     3d <name> <channels> <left> <right> <x column> <channels> <left> <right> <y column>
+ *               <channels> <left> <right> <z column> [path]
+ *
+ * Each column is decoded as `value*gain + shift` (default gain 1, shift 0).
+ * Multibyte values are read in host byte order.
+ */
+struct ReplaySpec
+{
+    //! Raw type of a column in the record.
+    enum type_t { u8, u16, u32, u64, i8, i16, i32, i64, f32, f64 };
+
+    //! A column of the event record.
+    struct Column {
+        std::string name;
+        type_t type;
+        size_t offset;
+        double gain;
+        double shift;
+    };
+
+    //! Binning of one histogram axis together with the column it is filled from.
+    struct AxisSpec {
+        Axis::index_t channels;
+        Axis::bin_t left;
+        Axis::bin_t right;
+        size_t column;
+    };
+
+    //! A histogram to fill.
+    struct Hist {
+        std::string name;
+        std::string path;
+        std::vector<AxisSpec> axes;
+    };
+
+    //! Size of each event record in bytes.
+    size_t record_size = 0;
+
+    //! The columns of the record.
+    std::vector<Column> columns;
+
+    //! The histograms to fill.
+    std::vector<Hist> histograms;
+
+    //! Parse a spec. Throws std::runtime_error with the offending line on errors.
+    static ReplaySpec Parse(std::istream &in);
+
+    //! Size in bytes of a raw column type.
+    static size_t GetTypeSize(type_t type);
+};
+
+#endif // REPLAYSPEC_H
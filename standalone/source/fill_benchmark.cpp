@@ -0,0 +1,196 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/*!
+ * Measure the fill rate of Histogram1D/2D/3D for each fill policy.
+ *
+ * Every combination of histogram shape, access pattern and FillPolicy is filled
+ * with the same pre-generated values and the rate in million fills per second is
+ * printed as a table. The access patterns are uniform (random bins all over the
+ * histogram) and peaked (most fills in a few narrow peaks, like a gamma-ray
+ * spectrum). The results were used to choose the default FillPolicy.
+ */
+
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+//! Values to fill, one vector per axis.
+typedef std::vector<std::vector<double>> values_t;
+
+//! A policy to benchmark and its label.
+struct policy_entry_t {
+    std::string label;
+    FillPolicy policy;
+};
+
+//! A histogram shape to benchmark.
+struct shape_t {
+    std::string label;
+    size_t dimensions;
+    Axis::index_t channels;
+};
+
+// ########################################################################
+
+static values_t Generate(const shape_t &shape, bool peaked, size_t count, std::mt19937_64 &gen)
+{
+    const double range = double(shape.channels);
+    std::uniform_real_distribution<double> uniform(-0.01*range, 1.01*range);
+    std::uniform_int_distribution<int> pick(0, 9);
+    std::normal_distribution<double> peak(0, 0.005*range);
+
+    values_t values(shape.dimensions, std::vector<double>(count));
+    for ( size_t d = 0 ; d < shape.dimensions ; ++d ){
+        for ( auto &v : values[d] ){
+            // 80% of the fills in ten narrow peaks, the rest as background.
+            if ( peaked && pick(gen) < 8 )
+                v = ( 0.05 + 0.09*pick(gen) )*range + peak(gen);
+            else
+                v = uniform(gen);
+        }
+    }
+    return values;
+}
+
+// ########################################################################
+
+static double Run(const shape_t &shape, const FillPolicy &policy, const values_t &values, size_t repeat)
+{
+    const Axis::index_t n = shape.channels;
+    const size_t count = values[0].size();
+    Histograms histograms;
+    Histogram1Dp hist = nullptr;
+    Histogram2Dp mat = nullptr;
+    Histogram3Dp cube = nullptr;
+    if ( shape.dimensions == 1 )
+        hist = histograms.Create1D("h", "h", n, 0, n, "x", "", policy);
+    else if ( shape.dimensions == 2 )
+        mat = histograms.Create2D("h", "h", n, 0, n, "x", n, 0, n, "y", "", policy);
+    else
+        cube = histograms.Create3D("h", "h", n, 0, n, "x", n, 0, n, "y", n, 0, n, "z", "", policy);
+
+    const auto start = std::chrono::steady_clock::now();
+    for ( size_t r = 0 ; r < repeat ; ++r ){
+        if ( hist ){
+            for ( size_t i = 0 ; i < count ; ++i )
+                hist->Fill(values[0][i]);
+            hist->GetData();
+        } else if ( mat ){
+            for ( size_t i = 0 ; i < count ; ++i )
+                mat->Fill(values[0][i], values[1][i]);
+            mat->GetRow(0);
+        } else {
+            for ( size_t i = 0 ; i < count ; ++i )
+                cube->Fill(values[0][i], values[1][i], values[2][i]);
+            cube->GetRow(0, 0);
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return double(count*repeat)/elapsed.count()*1e-6;
+}
+
+// ########################################################################
+
+static void Usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  -f, --fills <n>       Fills per repetition (default: 4000000)\n"
+              << "  -r, --repeat <n>      Repetitions per measurement (default: 3)\n"
+              << "  -h, --help            Show this help\n";
+}
+
+// ########################################################################
+
+int main(int argc, char *argv[])
+{
+    size_t fills = 4000000;
+    size_t repeat = 3;
+
+    static const struct option long_options[] = {
+            {"fills", required_argument, nullptr, 'f'},
+            {"repeat", required_argument, nullptr, 'r'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0}
+    };
+
+    try {
+        int opt;
+        while ( (opt = getopt_long(argc, argv, "f:r:h", long_options, nullptr)) != -1 ){
+            switch ( opt ){
+                case 'f' : fills = std::stoul(optarg); break;
+                case 'r' : repeat = std::stoul(optarg); break;
+                case 'h' : Usage(argv[0]); return 0;
+                default : Usage(argv[0]); return 1;
+            }
+        }
+        if ( fills == 0 || repeat == 0 || optind != argc ){
+            Usage(argv[0]);
+            return 1;
+        }
+
+        const std::vector<shape_t> shapes = {
+                {"1D 16k", 1, 16384},
+                {"2D 512x512", 2, 512},
+                {"2D 4096x4096", 2, 4096},
+                {"3D 64^3", 3, 64},
+                {"3D 256^3", 3, 256}
+        };
+        const std::vector<policy_entry_t> policies = {
+                {"contiguous", FillPolicy(FillPolicy::contiguous)},
+                {"rows", FillPolicy(FillPolicy::rows)},
+                {"buffered", FillPolicy(FillPolicy::contiguous, 4096)},
+                {"sorted 4k", FillPolicy(FillPolicy::contiguous, 4096, FillPolicy::sorted)},
+                {"sorted 64k", FillPolicy(FillPolicy::contiguous, 65536, FillPolicy::sorted)}
+        };
+
+        std::mt19937_64 gen(42);
+        std::cout << std::left << std::setw(16) << "shape" << std::setw(10) << "pattern";
+        for ( auto &policy : policies )
+            std::cout << std::right << std::setw(12) << policy.label;
+        std::cout << "   [Mfills/s]" << std::endl;
+        for ( auto &shape : shapes ){
+            for ( bool peaked : {false, true} ){
+                const values_t values = Generate(shape, peaked, fills, gen);
+                std::cout << std::left << std::setw(16) << shape.label
+                          << std::setw(10) << ( peaked ? "peaked" : "uniform" ) << std::right;
+                for ( auto &policy : policies )
+                    std::cout << std::setw(12) << std::fixed << std::setprecision(1)
+                              << Run(shape, policy.policy, values, repeat) << std::flush;
+                std::cout << std::endl;
+            }
+        }
+    } catch ( std::exception &e ){
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
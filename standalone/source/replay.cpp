@@ -0,0 +1,363 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/*!
+ * Replay a binary list-mode file into histograms as fast as possible.
+ *
+ * The file is memory mapped and split into chunks of events. Worker threads grab
+ * chunks from a shared counter, decode the columns of the chunk into arrays and
+ * fill the histograms described by the spec file, either through the
+ * ThreadSafeHistograms adapters (shared mode) or into a private Histograms set per
+ * thread that is merged at the end (replica mode). The achieved event rate is
+ * reported when done, so the tool doubles as an end-to-end throughput benchmark.
+ */
+
+#include "ListModeFile.h"
+#include "ReplaySpec.h"
+
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+#include <histogram/ThreadSafeHistograms.h>
+#include <histogram/MamaWriter.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+//! Decoded columns of one chunk of events.
+typedef std::vector<std::vector<double>> columns_t;
+
+// ########################################################################
+
+template<typename T>
+static void DecodeColumn(const char *records, size_t record_size, size_t events,
+                         const ReplaySpec::Column &column, double *out)
+{
+    const char *p = records + column.offset;
+    for ( size_t i = 0 ; i < events ; ++i, p += record_size ){
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        out[i] = double(value)*column.gain + column.shift;
+    }
+}
+
+// ########################################################################
+
+static void Decode(const ReplaySpec &spec, const char *records, size_t events, columns_t &columns)
+{
+    for ( size_t c = 0 ; c < spec.columns.size() ; ++c ){
+        const ReplaySpec::Column &column = spec.columns[c];
+        double *out = columns[c].data();
+        switch ( column.type ){
+            case ReplaySpec::u8 : DecodeColumn<uint8_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::u16 : DecodeColumn<uint16_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::u32 : DecodeColumn<uint32_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::u64 : DecodeColumn<uint64_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::i8 : DecodeColumn<int8_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::i16 : DecodeColumn<int16_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::i32 : DecodeColumn<int32_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::i64 : DecodeColumn<int64_t>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::f32 : DecodeColumn<float>(records, spec.record_size, events, column, out); break;
+            case ReplaySpec::f64 : DecodeColumn<double>(records, spec.record_size, events, column, out); break;
+        }
+    }
+}
+
+// ########################################################################
+
+//! Fills the histograms of a chunk through the thread safe adapters.
+class SharedFiller
+{
+private:
+    const ReplaySpec &spec;
+    std::vector<ThreadSafeHistogram1D> h1;
+    std::vector<ThreadSafeHistogram2D> h2;
+    std::vector<ThreadSafeHistogram3D> h3;
+    std::vector<const ReplaySpec::Hist *> s1, s2, s3;
+
+public:
+    SharedFiller(const ReplaySpec &_spec, ThreadSafeHistograms &histograms)
+        : spec( _spec )
+    {
+        h1.reserve(spec.histograms.size());
+        h2.reserve(spec.histograms.size());
+        h3.reserve(spec.histograms.size());
+        for ( auto &h : spec.histograms ){
+            const auto &a = h.axes;
+            const auto &c = spec.columns;
+            if ( a.size() == 1 ){
+                h1.emplace_back(histograms.Create1D(h.name, h.name, a[0].channels, a[0].left, a[0].right,
+                                                    c[a[0].column].name, h.path));
+                s1.push_back(&h);
+            } else if ( a.size() == 2 ){
+                h2.emplace_back(histograms.Create2D(h.name, h.name,
+                                                    a[0].channels, a[0].left, a[0].right, c[a[0].column].name,
+                                                    a[1].channels, a[1].left, a[1].right, c[a[1].column].name,
+                                                    h.path));
+                s2.push_back(&h);
+            } else {
+                h3.emplace_back(histograms.Create3D(h.name, h.name,
+                                                    a[0].channels, a[0].left, a[0].right, c[a[0].column].name,
+                                                    a[1].channels, a[1].left, a[1].right, c[a[1].column].name,
+                                                    a[2].channels, a[2].left, a[2].right, c[a[2].column].name,
+                                                    h.path));
+                s3.push_back(&h);
+            }
+        }
+    }
+
+    void Fill(const columns_t &columns, size_t events)
+    {
+        for ( size_t n = 0 ; n < h1.size() ; ++n ){
+            const double *x = columns[s1[n]->axes[0].column].data();
+            for ( size_t i = 0 ; i < events ; ++i )
+                h1[n].Fill(x[i]);
+        }
+        for ( size_t n = 0 ; n < h2.size() ; ++n ){
+            const double *x = columns[s2[n]->axes[0].column].data();
+            const double *y = columns[s2[n]->axes[1].column].data();
+            for ( size_t i = 0 ; i < events ; ++i )
+                h2[n].Fill(x[i], y[i]);
+        }
+        for ( size_t n = 0 ; n < h3.size() ; ++n ){
+            const double *x = columns[s3[n]->axes[0].column].data();
+            const double *y = columns[s3[n]->axes[1].column].data();
+            const double *z = columns[s3[n]->axes[2].column].data();
+            for ( size_t i = 0 ; i < events ; ++i )
+                h3[n].Fill(x[i], y[i], z[i]);
+        }
+    }
+};
+
+// ########################################################################
+
+//! Fills the histograms of a chunk into a private set of histograms.
+class ReplicaFiller
+{
+private:
+    Histograms histograms;
+    std::vector<std::pair<Histogram1Dp, const ReplaySpec::Hist *>> h1;
+    std::vector<std::pair<Histogram2Dp, const ReplaySpec::Hist *>> h2;
+    std::vector<std::pair<Histogram3Dp, const ReplaySpec::Hist *>> h3;
+
+public:
+    explicit ReplicaFiller(const ReplaySpec &spec)
+    {
+        for ( auto &h : spec.histograms ){
+            const auto &a = h.axes;
+            const auto &c = spec.columns;
+            if ( a.size() == 1 ){
+                h1.emplace_back(histograms.Create1D(h.name, h.name, a[0].channels, a[0].left, a[0].right,
+                                                    c[a[0].column].name, h.path), &h);
+            } else if ( a.size() == 2 ){
+                h2.emplace_back(histograms.Create2D(h.name, h.name,
+                                                    a[0].channels, a[0].left, a[0].right, c[a[0].column].name,
+                                                    a[1].channels, a[1].left, a[1].right, c[a[1].column].name,
+                                                    h.path), &h);
+            } else {
+                h3.emplace_back(histograms.Create3D(h.name, h.name,
+                                                    a[0].channels, a[0].left, a[0].right, c[a[0].column].name,
+                                                    a[1].channels, a[1].left, a[1].right, c[a[1].column].name,
+                                                    a[2].channels, a[2].left, a[2].right, c[a[2].column].name,
+                                                    h.path), &h);
+            }
+        }
+    }
+
+    void Fill(const columns_t &columns, size_t events)
+    {
+        for ( auto &h : h1 ){
+            const double *x = columns[h.second->axes[0].column].data();
+            for ( size_t i = 0 ; i < events ; ++i )
+                h.first->Fill(x[i]);
+        }
+        for ( auto &h : h2 ){
+            const double *x = columns[h.second->axes[0].column].data();
+            const double *y = columns[h.second->axes[1].column].data();
+            for ( size_t i = 0 ; i < events ; ++i )
+                h.first->Fill(x[i], y[i]);
+        }
+        for ( auto &h : h3 ){
+            const double *x = columns[h.second->axes[0].column].data();
+            const double *y = columns[h.second->axes[1].column].data();
+            const double *z = columns[h.second->axes[2].column].data();
+            for ( size_t i = 0 ; i < events ; ++i )
+                h.first->Fill(x[i], y[i], z[i]);
+        }
+    }
+
+    Histograms &GetHistograms(){ return histograms; }
+};
+
+// ########################################################################
+
+//! Process chunks from the shared counter until the file is exhausted.
+template<typename Filler>
+static void Worker(const ReplaySpec &spec, const ListModeFile &file, size_t events, size_t chunk,
+                   std::atomic<size_t> &next_chunk, Filler &filler)
+{
+    columns_t columns(spec.columns.size(), std::vector<double>(chunk));
+    const size_t chunks = (events + chunk - 1) / chunk;
+    for ( size_t c = next_chunk.fetch_add(1) ; c < chunks ; c = next_chunk.fetch_add(1) ){
+        const size_t first = c * chunk;
+        const size_t n = std::min(chunk, events - first);
+        Decode(spec, file.GetData() + first*spec.record_size, n, columns);
+        filler.Fill(columns, n);
+    }
+}
+
+// ########################################################################
+
+static void Usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " -s <spec> [options] <list-mode file>\n"
+              << "  -s, --spec <file>     Spec describing the records and the histograms to fill\n"
+              << "  -n, --threads <n>     Number of worker threads (default: hardware concurrency)\n"
+              << "  -c, --chunk <events>  Events per work chunk (default: 65536)\n"
+              << "  -m, --mode <mode>     'shared' (ThreadSafeHistograms, default) or 'replica'\n"
+              << "  -r, --repeat <n>      Replay the file n times (default: 1)\n"
+              << "  -o, --output <dir>    Write the 1D and 2D histograms as MAMA files to dir\n"
+              << "  -h, --help            Show this help\n";
+}
+
+// ########################################################################
+
+static void WriteMama(Histograms &histograms, const std::string &directory)
+{
+    for ( auto &h : histograms.GetAll1D() ){
+        std::ofstream out(directory + "/" + h->GetName() + ".m");
+        if ( MamaWriter::Write(out, h) < 0 )
+            throw std::runtime_error("Error writing '"+h->GetName()+"'");
+    }
+    for ( auto &h : histograms.GetAll2D() ){
+        std::ofstream out(directory + "/" + h->GetName() + ".m");
+        if ( MamaWriter::Write(out, h) < 0 )
+            throw std::runtime_error("Error writing '"+h->GetName()+"'");
+    }
+}
+
+// ########################################################################
+
+int main(int argc, char *argv[])
+{
+    std::string spec_file, output, mode = "shared";
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunk = 65536;
+    size_t repeat = 1;
+
+    static const struct option long_options[] = {
+            {"spec", required_argument, nullptr, 's'},
+            {"threads", required_argument, nullptr, 'n'},
+            {"chunk", required_argument, nullptr, 'c'},
+            {"mode", required_argument, nullptr, 'm'},
+            {"repeat", required_argument, nullptr, 'r'},
+            {"output", required_argument, nullptr, 'o'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0}
+    };
+
+    try {
+        int opt;
+        while ( (opt = getopt_long(argc, argv, "s:n:c:m:r:o:h", long_options, nullptr)) != -1 ){
+            switch ( opt ){
+                case 's' : spec_file = optarg; break;
+                case 'n' : threads = std::stoul(optarg); break;
+                case 'c' : chunk = std::stoul(optarg); break;
+                case 'm' : mode = optarg; break;
+                case 'r' : repeat = std::stoul(optarg); break;
+                case 'o' : output = optarg; break;
+                case 'h' : Usage(argv[0]); return 0;
+                default : Usage(argv[0]); return 1;
+            }
+        }
+        if ( spec_file.empty() || optind != argc - 1 || threads == 0 || chunk == 0 ||
+             (mode != "shared" && mode != "replica") ){
+            Usage(argv[0]);
+            return 1;
+        }
+
+        std::ifstream spec_stream(spec_file);
+        if ( !spec_stream )
+            throw std::runtime_error("Could not open spec '"+spec_file+"'");
+        const ReplaySpec spec = ReplaySpec::Parse(spec_stream);
+
+        const ListModeFile file(argv[optind]);
+        const size_t events = file.GetSize() / spec.record_size;
+        if ( file.GetSize() % spec.record_size != 0 )
+            std::cerr << "Warning: ignoring " << file.GetSize() % spec.record_size
+                      << " trailing bytes not making up a full record" << std::endl;
+
+        ThreadSafeHistograms shared;
+        std::vector<std::unique_ptr<ReplicaFiller>> replicas;
+
+        // Histograms are defined up front so the workers only look them up.
+        if ( mode == "shared" )
+            SharedFiller(spec, shared);
+        else
+            for ( unsigned i = 0 ; i < threads ; ++i )
+                replicas.push_back(std::make_unique<ReplicaFiller>(spec));
+
+        const auto start = std::chrono::steady_clock::now();
+        for ( size_t r = 0 ; r < repeat ; ++r ){
+            std::atomic<size_t> next_chunk( 0 );
+            std::vector<std::thread> workers;
+            for ( unsigned i = 0 ; i < threads ; ++i ){
+                workers.emplace_back([&, i](){
+                    if ( mode == "shared" ){
+                        SharedFiller filler(spec, shared);
+                        Worker(spec, file, events, chunk, next_chunk, filler);
+                    } else {
+                        Worker(spec, file, events, chunk, next_chunk, *replicas[i]);
+                    }
+                });
+            }
+            for ( auto &worker : workers )
+                worker.join();
+        }
+
+        Histograms &result = ( mode == "shared" ) ? shared.GetHistograms() : replicas[0]->GetHistograms();
+        for ( size_t i = 1 ; i < replicas.size() ; ++i )
+            result.Merge(replicas[i]->GetHistograms());
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        const size_t total = events * repeat;
+        std::cout << "Replayed " << total << " events (" << spec.histograms.size() << " histograms, "
+                  << threads << " threads, " << mode << " mode) in " << elapsed.count() << " s: "
+                  << double(total) / elapsed.count() << " events/s, "
+                  << double(total * spec.record_size) / elapsed.count() / 1e6 << " MB/s" << std::endl;
+
+        if ( !output.empty() )
+            WriteMama(result, output);
+    } catch ( std::exception &e ){
+        std::cerr << argv[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Alignment.h>
+#include <histogram/FFT.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+#include <stdexcept>
+
+TEST_SUITE_BEGIN( "Alignment" );
+
+TEST_CASE( "FFT" ){
+
+    CHECK(FFT::GoodSize(1) == 1);
+    CHECK(FFT::GoodSize(5) == 8);
+    CHECK(FFT::GoodSize(64) == 64);
+
+    SUBCASE("Round trip"){
+        std::vector<std::complex<double>> data(16);
+        for ( size_t i = 0 ; i < data.size() ; ++i )
+            data[i] = {double(i % 5), double(i % 3)};
+        auto copy = data;
+        FFT::Transform(data);
+        CHECK(data[0].real() == doctest::Approx(30));
+        FFT::Transform(data, true);
+        for ( size_t i = 0 ; i < data.size() ; ++i ){
+            CHECK(data[i].real() == doctest::Approx(copy[i].real()));
+            CHECK(data[i].imag() == doctest::Approx(copy[i].imag()));
+        }
+        std::vector<std::complex<double>> bad(12);
+        CHECK_THROWS(FFT::Transform(bad));
+    }
+
+    SUBCASE("Correlation matches direct sum"){
+        const std::vector<double> a = {1, 3, -2, 4, 0.5};
+        const std::vector<double> b = {2, -1, 1};
+        auto c = FFT::Correlate(a, b);
+        REQUIRE(c.size() == a.size() + b.size() - 1);
+        for ( long lag = -2 ; lag < 5 ; ++lag ){
+            double sum = 0;
+            for ( long i = 0 ; i < 3 ; ++i ){
+                if ( i + lag >= 0 && i + lag < 5 )
+                    sum += a[i + lag]*b[i];
+            }
+            CHECK(c[lag + 2] == doctest::Approx(sum));
+        }
+    }
+}
+
+//! Fill Gaussian peaks at the given positions, scaled and shifted.
+static void FillPeaks(Histogram1Dp hist, double scale, double shift)
+{
+    const Axis &axis = hist->GetAxisX();
+    for ( double centroid : {100., 310., 620.} ){
+        const double mean = scale*centroid + shift, sigma = 4*scale;
+        for ( size_t bin = 1 ; bin <= axis.GetBinCount() ; ++bin ){
+            const double u = ( axis.GetBinCenter(bin) - mean )/sigma;
+            hist->Fill(axis.GetBinCenter(bin), size_t(std::lround(1000*std::exp(-0.5*u*u))));
+        }
+    }
+}
+
+TEST_CASE( "Align spectra" ){
+
+    Histograms hists, references;
+    for ( auto *set : {&hists, &references} ){
+        set->Create1D("shifted", "shifted", 1024, 0, 1024, "x");
+        set->Create1D("scaled", "scaled", 1024, 0, 1024, "x");
+    }
+    FillPeaks(references.Find1D("shifted"), 1, 0);
+    FillPeaks(references.Find1D("scaled"), 1, 0);
+    FillPeaks(hists.Find1D("shifted"), 1, 7.3);
+    FillPeaks(hists.Find1D("scaled"), 1.05, 2);
+
+    SUBCASE("Shift"){
+        auto result = Alignment::Align(hists.Find1D("shifted"), references.Find1D("shifted"));
+        CHECK(result.shift == doctest::Approx(7.3).epsilon(0.03));
+        CHECK(result.scale == 1);
+        CHECK(result.correlation > 0.95);
+
+        Histogram1D other("other", "other", 512, 0, 1024, "x");
+        CHECK_THROWS(Alignment::Align(hists.Find1D("shifted"), &other));
+    }
+
+    SUBCASE("Scale and shift"){
+        Alignment::Options options;
+        options.find_scale = true;
+        options.min_x = 50;
+        auto result = Alignment::Align(hists.Find1D("scaled"), references.Find1D("scaled"), options);
+        CHECK(result.scale == doctest::Approx(1.05).epsilon(0.003));
+        CHECK(std::abs(result.shift - 2) < 1.5);
+        CHECK(result.correlation > 0.9);
+
+        options.log_bins = 1;
+        CHECK_THROWS(Alignment::Align(hists.Find1D("scaled"), references.Find1D("scaled"), options));
+    }
+
+    SUBCASE("Sets"){
+        ThreadPool pool(2);
+        Alignment::Options options;
+        options.max_shift = 20;
+        auto results = Alignment::Align(hists, references, options, pool);
+        REQUIRE(results.size() == 2);
+        CHECK(results["shifted"].shift == doctest::Approx(7.3).epsilon(0.03));
+
+        CHECK_THROWS(Alignment::Align(hists.GetAll1D(), Histograms::list1d_t(), options, pool));
+    }
+
+    SUBCASE("Shared buffered reference"){
+        FillPolicy policy;
+        policy.buffer_size = 4096;
+        Histograms buffered;
+        Histogram1Dp reference = buffered.Create1D("reference", "reference", 1024, 0, 1024, "x", "", policy);
+        FillPeaks(reference, 1, 0);
+        Histograms::list1d_t list(4, hists.Find1D("shifted")), reference_list(4, reference);
+        ThreadPool pool(4);
+        Alignment::Options options;
+        options.max_shift = 20;
+        for ( auto &result : Alignment::Align(list, reference_list, options, pool) )
+            CHECK(result.shift == doctest::Approx(7.3).epsilon(0.03));
+    }
+}
+
+TEST_SUITE_END();
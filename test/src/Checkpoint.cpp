@@ -0,0 +1,323 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Checkpoint.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+#include <histogram/SubtractedHistogram2D.h>
+#include <histogram/ThreadPool.h>
+#include <histogram/ThreadSafeHistograms.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+TEST_SUITE_BEGIN( "Checkpoint" );
+
+//! Path of a scratch checkpoint file, removed when it goes out of scope.
+struct ScratchFile {
+    std::string path;
+    explicit ScratchFile(const std::string &name)
+        : path( ( std::filesystem::temp_directory_path() / name ).string() ){ std::filesystem::remove(path); }
+    ~ScratchFile(){ std::filesystem::remove(path); }
+};
+
+static void FillSet(Histograms &set)
+{
+    Histogram1Dp spectrum = set.Create1D("spectrum", "spectrum", 1000, 0, 1000, "x", "dir");
+    Histogram2Dp matrix = set.Create2D("matrix", "matrix", 300, 0, 300, "x", 200, 0, 200, "y");
+    Histogram3Dp cube = set.Create3D("cube", "cube", 10, 0, 10, "x", 12, 0, 12, "y", 8, 0, 8, "z");
+    for ( int i = 0 ; i < 10000 ; ++i ){
+        spectrum->Fill(( i*7 ) % 1100);
+        matrix->Fill(( i*13 ) % 320, ( i*3 ) % 210);
+        cube->Fill(i % 11, ( i*7 ) % 13, ( i*3 ) % 9);
+    }
+}
+
+static void CheckSame(Histograms &a, Histograms &b)
+{
+    Histogram1Dp a1 = a.Find1D("spectrum"), b1 = b.Find1D("spectrum");
+    Histogram2Dp a2 = a.Find2D("matrix"), b2 = b.Find2D("matrix");
+    Histogram3Dp a3 = a.Find3D("cube"), b3 = b.Find3D("cube");
+    REQUIRE(b1);
+    REQUIRE(b2);
+    REQUIRE(b3);
+    CHECK(b1->GetPath() == "dir");
+    CHECK(b2->GetAxisY().GetBinCount() == 200);
+    CHECK(a1->GetEntries() == b1->GetEntries());
+    CHECK(a2->GetEntries() == b2->GetEntries());
+    CHECK(a3->GetEntries() == b3->GetEntries());
+    size_t mismatches = 0;
+    for ( size_t x = 0 ; x < 1002 ; ++x )
+        mismatches += ( a1->GetBinContent(x) != b1->GetBinContent(x) );
+    for ( size_t y = 0 ; y < 202 ; ++y )
+        for ( size_t x = 0 ; x < 302 ; ++x )
+            mismatches += ( a2->GetBinContent(x, y) != b2->GetBinContent(x, y) );
+    for ( size_t z = 0 ; z < 10 ; ++z )
+        for ( size_t y = 0 ; y < 14 ; ++y )
+            for ( size_t x = 0 ; x < 12 ; ++x )
+                mismatches += ( a3->GetBinContent(x, y, z) != b3->GetBinContent(x, y, z) );
+    CHECK(mismatches == 0);
+}
+
+TEST_CASE( "Checkpoint and restore" ){
+
+    ScratchFile file("histogram_checkpoint_test.bin");
+    Histograms set;
+    FillSet(set);
+    ThreadPool pool(2);
+
+    SUBCASE("Round trip"){
+        Checkpoint checkpoint(file.path);
+        checkpoint.Write(set, 1234, pool);
+        Histograms restored;
+        CHECK(Checkpoint::Restore(file.path, restored) == 1234);
+        CheckSame(set, restored);
+    }
+
+    SUBCASE("Incremental"){
+        Checkpoint checkpoint(file.path);
+        checkpoint.Write(set, 1, pool);
+        const size_t full = checkpoint.GetLastSize();
+        set.Find2D("matrix")->Fill(150, 150, 5);
+        checkpoint.Write(set, 2, pool);
+        CHECK(checkpoint.GetLastSize()*10 < full);
+        checkpoint.Write(set, 3, pool);
+        CHECK(checkpoint.GetCount() == 3);
+
+        Histograms restored;
+        CHECK(Checkpoint::Restore(file.path, restored) == 3);
+        CheckSame(set, restored);
+    }
+
+    SUBCASE("Torn record"){
+        Checkpoint checkpoint(file.path);
+        checkpoint.Write(set, 10, pool);
+        Histograms before;
+        Checkpoint::Restore(file.path, before);
+
+        set.Find1D("spectrum")->Fill(10, 100);
+        checkpoint.Write(set, 20, pool);
+        std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 3);
+
+        Histograms restored;
+        CHECK(Checkpoint::Restore(file.path, restored) == 10);
+        CheckSame(before, restored);
+    }
+
+    SUBCASE("Full interval"){
+        Checkpoint::Options options;
+        options.full_interval = 2;
+        Checkpoint checkpoint(file.path, options);
+        checkpoint.Write(set, 1, pool);
+        set.Find1D("spectrum")->Fill(10);
+        checkpoint.Write(set, 2, pool);
+        set.Find1D("spectrum")->Fill(10);
+        checkpoint.Write(set, 3, pool);
+        CHECK(std::filesystem::file_size(file.path) == checkpoint.GetLastSize());
+
+        Histograms restored;
+        CHECK(Checkpoint::Restore(file.path, restored) == 3);
+        CheckSame(set, restored);
+    }
+
+    SUBCASE("Missing and invalid files"){
+        Histograms restored;
+        CHECK(Checkpoint::Restore(file.path, restored) == 0);
+        {
+            std::ofstream out(file.path);
+            out << "not a checkpoint";
+        }
+        CHECK_THROWS(Checkpoint::Restore(file.path, restored));
+    }
+
+    SUBCASE("Binning mismatch"){
+        Checkpoint checkpoint(file.path);
+        checkpoint.Write(set, 1, pool);
+        Histograms other;
+        other.Create1D("spectrum", "spectrum", 10, 0, 10, "x");
+        CHECK_THROWS(Checkpoint::Restore(file.path, other));
+    }
+}
+
+TEST_CASE( "Checkpoint thread safe histograms" ){
+
+    ScratchFile file("histogram_checkpoint_ts_test.bin");
+    {
+        ThreadSafeHistograms histograms;
+        auto adapter = histograms.Create1D("spectrum", "spectrum", 100, 0, 100, "x");
+        auto tally = histograms.CreateTally1D("tally", "tally", 10, 0, 10, "x");
+        auto moved = histograms.Create2D("matrix", "matrix", 10, 0, 10, "x", 10, 0, 10, "y");
+        auto matrix = std::move(moved);
+        for ( int i = 0 ; i < 100 ; ++i ){
+            adapter.Fill(i);
+            tally.Fill(i % 10);
+            matrix.Fill(i % 10, 3);
+        }
+        // Nothing has been flushed yet, the checkpoint has to flush the adapters.
+        CHECK(histograms.GetHistograms().Find1D("spectrum")->GetEntries() == 0);
+
+        Checkpoint checkpoint(file.path);
+        histograms.WriteCheckpoint(checkpoint, 100);
+        CHECK(histograms.GetHistograms().Find1D("spectrum")->GetEntries() == 100);
+        CHECK(histograms.GetHistograms().Find2D("matrix")->GetBinContent(4, 4) == 10);
+    }
+
+    ThreadSafeHistograms restarted;
+    CHECK(restarted.RestoreCheckpoint(file.path) == 100);
+    Histograms &set = restarted.GetHistograms();
+    CHECK(set.Find1D("spectrum")->GetEntries() == 100);
+    CHECK(set.Find1D("tally")->GetBinContent(3) == 10);
+    CHECK(set.Find2D("matrix")->GetBinContent(4, 4) == 10);
+    {
+        auto adapter = restarted.Create1D("spectrum", "spectrum", 100, 0, 100, "x");
+        adapter.Fill(50.5);
+    }
+    CHECK(set.Find1D("spectrum")->GetBinContent(51) == 2);
+    CHECK(set.Find1D("spectrum")->GetEntries() == 101);
+}
+
+TEST_CASE( "Checkpoint prompt-minus-random matrices" ){
+
+    ScratchFile file("histogram_checkpoint_subtracted_test.bin");
+    {
+        Histograms set;
+        auto sub = set.CreateSubtracted2D("sub", "sub", 10, 0, 10, "x", 10, 0, 10, "y", 0.25, "coinc");
+        sub->Fill(2.5, 3.5, SubtractedHistogram2D::prompt, 3);
+        sub->Fill(2.5, 3.5, SubtractedHistogram2D::random);
+        Checkpoint checkpoint(file.path);
+        checkpoint.Write(set, 7);
+        sub->Fill(7.5, 7.5, SubtractedHistogram2D::random, 2);
+        checkpoint.Write(set, 8);
+    }
+
+    Histograms restored;
+    CHECK(Checkpoint::Restore(file.path, restored) == 8);
+    SubtractedHistogram2Dp sub = restored.FindSubtracted2D("sub");
+    REQUIRE(sub);
+    CHECK(sub->GetPath() == "coinc");
+    CHECK(sub->GetRatio() == 0.25);
+    CHECK(sub->GetEntries() == 3);
+    CHECK(sub->GetBinContent(3, 4) == doctest::Approx(2.75));
+    CHECK(sub->GetBinContent(8, 8) == doctest::Approx(-0.5));
+
+    Histograms other;
+    other.CreateSubtracted2D("sub", "sub", 10, 0, 10, "x", 10, 0, 10, "y", 0.5);
+    CHECK_THROWS(Checkpoint::Restore(file.path, other));
+}
+
+TEST_CASE( "Checkpoint while other threads fill" ){
+
+    ScratchFile file("histogram_checkpoint_threads_test.bin");
+    const int threads = 4, fills = 100;
+    ThreadSafeHistograms histograms;
+    histograms.Create1D("spectrum", "spectrum", 100, 0, 100, "x");
+    std::atomic<int> ready( 0 );
+    std::atomic<bool> done( false );
+    std::vector<std::thread> workers;
+    for ( int t = 0 ; t < threads ; ++t ){
+        workers.emplace_back([&](){
+            static std::mutex create;
+            std::unique_lock lock(create);
+            auto adapter = histograms.Create1D("spectrum", "spectrum", 100, 0, 100, "x");
+            lock.unlock();
+            // Fewer fills than the buffer holds, so only the checkpoint request flushes them.
+            for ( int i = 0 ; i < fills ; ++i )
+                adapter.Fill(i);
+            ++ready;
+            while ( !done )
+                adapter.Fill(-1);
+        });
+    }
+    while ( ready < threads )
+        std::this_thread::yield();
+
+    Checkpoint checkpoint(file.path);
+    histograms.WriteCheckpoint(checkpoint, 1);
+    done = true;
+    for ( auto &worker : workers )
+        worker.join();
+
+    Histograms restored;
+    CHECK(Checkpoint::Restore(file.path, restored) == 1);
+    Histogram1Dp spectrum = restored.Find1D("spectrum");
+    REQUIRE(spectrum);
+    for ( int i = 0 ; i < fills ; ++i )
+        CHECK(spectrum->GetBinContent(i + 1) == threads);
+    CHECK(histograms.GetHistograms().Find1D("spectrum")->GetBinContent(50) == threads);
+}
+
+TEST_CASE( "Checkpoint while a filling thread is idle" ){
+
+    ScratchFile file("histogram_checkpoint_idle_test.bin");
+    ThreadSafeHistograms histograms;
+    histograms.Create1D("spectrum", "spectrum", 100, 0, 100, "x");
+    std::atomic<bool> ready( false ), done( false );
+    std::thread worker([&](){
+        auto adapter = histograms.Create1D("spectrum", "spectrum", 100, 0, 100, "x");
+        // Fewer fills than the buffer holds, then the thread waits without filling.
+        for ( int i = 0 ; i < 10 ; ++i )
+            adapter.Fill(i);
+        ready = true;
+        while ( !done )
+            std::this_thread::yield();
+    });
+    while ( !ready )
+        std::this_thread::yield();
+
+    Checkpoint checkpoint(file.path);
+    histograms.WriteCheckpoint(checkpoint, 1);
+    done = true;
+    worker.join();
+
+    Histograms restored;
+    CHECK(Checkpoint::Restore(file.path, restored) == 1);
+    Histogram1Dp spectrum = restored.Find1D("spectrum");
+    REQUIRE(spectrum);
+    CHECK(spectrum->GetEntries() == 10);
+    for ( int i = 0 ; i < 10 ; ++i )
+        CHECK(spectrum->GetBinContent(i + 1) == 1);
+}
+
+TEST_CASE( "Checkpoint copies the bins under the guard and writes after" ){
+
+    ScratchFile file("histogram_checkpoint_guard_test.bin");
+    Histograms set;
+    FillSet(set);
+    Checkpoint checkpoint(file.path);
+    int guarded = 0;
+    checkpoint.Write(set, 3, ThreadPool::Default(), [&](const std::function<void()> &copy){
+        ++guarded;
+        copy();
+        CHECK_FALSE(std::filesystem::exists(file.path));
+    });
+    CHECK(guarded == 1);
+
+    Histograms restored;
+    CHECK(Checkpoint::Restore(file.path, restored) == 3);
+    CheckSame(set, restored);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,140 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Coincidence.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/ThreadSafeHistograms.h>
+
+#include <mutex>
+#include <random>
+
+TEST_SUITE_BEGIN( "Coincidence" );
+
+//! Three detectors: 0 triggers every 1000 ticks, 1 follows it after 10 ticks, 2 is random background.
+static std::vector<std::vector<Coincidence::hit_t>> MakeStreams(size_t events)
+{
+    std::vector<std::vector<Coincidence::hit_t>> streams(3);
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<int64_t> jitter(-5, 5);
+    for ( size_t k = 0 ; k < events ; ++k ){
+        const int64_t t = int64_t(k)*1000;
+        streams[0].push_back({t, 0, double(k % 100)});
+        streams[1].push_back({t + 10 + jitter(rng), 1, double(( k*7 ) % 100)});
+    }
+    std::uniform_int_distribution<int64_t> gap(1, 600);
+    for ( int64_t t = 0 ; t < int64_t(events)*1000 ; t += gap(rng) )
+        streams[2].push_back({t, 2, double(t % 50)});
+    return streams;
+}
+
+//! Reference result by brute force.
+static void BruteForce(const std::vector<std::vector<Coincidence::hit_t>> &streams, const Coincidence::Options &options,
+                       size_t &prompt, size_t &random, double &prompt_sum)
+{
+    prompt = random = 0;
+    prompt_sum = 0;
+    for ( auto &trigger : streams[0] ){
+        for ( size_t s = 1 ; s < streams.size() ; ++s ){
+            for ( auto &hit : streams[s] ){
+                const int64_t dt = hit.timestamp - trigger.timestamp;
+                if ( dt >= options.prompt_low && dt < options.prompt_high ){
+                    ++prompt;
+                    prompt_sum += trigger.energy*hit.energy;
+                } else if ( dt >= options.random_low && dt < options.random_high )
+                    ++random;
+            }
+        }
+    }
+}
+
+TEST_CASE( "Build coincidences" ){
+
+    auto streams = MakeStreams(2000);
+    Coincidence::Options options;
+    options.triggers = {0};
+    options.batch_size = 37;
+    options.batches = 4;
+    options.threads = 3;
+
+    size_t prompt, random;
+    double prompt_sum;
+    BruteForce(streams, options, prompt, random, prompt_sum);
+    REQUIRE(prompt > 2000);
+    REQUIRE(random > 0);
+
+    std::mutex mutex;
+    double sum = 0;
+    size_t random_seen = 0;
+    auto stats = Coincidence::Build(streams, [&](){
+        return [&, local = 0., local_random = size_t(0)](const Coincidence::group_t &group) mutable {
+            for ( auto &hit : group.prompt )
+                local += group.trigger.energy*hit.energy;
+            local_random += group.random.size();
+            std::lock_guard lock(mutex);
+            sum += local;
+            random_seen += local_random;
+            local = 0;
+            local_random = 0;
+        };
+    }, options);
+
+    CHECK(stats.hits == streams[0].size() + streams[1].size() + streams[2].size());
+    CHECK(stats.triggers == 2000);
+    CHECK(stats.prompt == prompt);
+    CHECK(stats.random == random);
+    CHECK(random_seen == random);
+    CHECK(sum == doctest::Approx(prompt_sum));
+    CHECK(options.GetRandomScale() == doctest::Approx(0.5));
+}
+
+TEST_CASE( "Fill matrices from coincidences" ){
+
+    auto streams = MakeStreams(500);
+    ThreadSafeHistograms histograms;
+    Coincidence::Options options;
+    options.triggers = {0};
+    options.batch_size = 64;
+
+    auto stats = Coincidence::Build(streams, [&](){
+        return [prompt = histograms.Create2D("prompt", "prompt", 100, 0, 100, "E0", 100, 0, 100, "E"),
+                random = histograms.Create2D("random", "random", 100, 0, 100, "E0", 100, 0, 100, "E")]
+                (const Coincidence::group_t &group) mutable {
+            for ( auto &hit : group.prompt )
+                prompt.Fill(group.trigger.energy, hit.energy);
+            for ( auto &hit : group.random )
+                random.Fill(group.trigger.energy, hit.energy);
+        };
+    }, options);
+
+    Histograms &set = histograms.GetHistograms();
+    CHECK(size_t(set.Find2D("prompt")->GetEntries()) == stats.prompt);
+    CHECK(size_t(set.Find2D("random")->GetEntries()) == stats.random);
+    // Detector 1 always follows the trigger in the prompt window.
+    CHECK(set.Find2D("prompt")->GetBinContent(4, 22) >= 5);
+}
+
+TEST_CASE( "Streams out of order" ){
+    std::vector<std::vector<Coincidence::hit_t>> streams = {{{0, 0, 1}, {100, 0, 1}, {50, 0, 1}}, {{10, 1, 1}}};
+    CHECK_THROWS(Coincidence::Build(streams, [](){ return [](const Coincidence::group_t &){}; }));
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,96 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Comparison.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+#include <stdexcept>
+
+TEST_SUITE_BEGIN( "Comparison" );
+
+//! Fill a triangular peak with the given centre and height.
+static void FillPeak(Histogram1Dp hist, double centre, size_t height)
+{
+    for ( int i = -10 ; i <= 10 ; ++i ){
+        hist->Fill(centre + i, height*(11 - std::abs(i)));
+    }
+}
+
+TEST_CASE( "Compare spectra with reference" ){
+
+    Histograms reference, live;
+    ThreadPool pool(2);
+
+    for ( auto *set : {&reference, &live} ){
+        set->Create1D("same", "same", 200, 0, 200, "x");
+        set->Create1D("shifted", "shifted", 200, 0, 200, "x");
+        set->Create1D("broad", "broad", 200, 0, 200, "x");
+        set->Create1D("empty", "empty", 200, 0, 200, "x");
+    }
+    reference.Create1D("no_live", "no_live", 200, 0, 200, "x");
+    live.Create1D("no_reference", "no_reference", 200, 0, 200, "x");
+
+    FillPeak(reference.Find1D("same"), 100.5, 10);
+    FillPeak(reference.Find1D("shifted"), 100.5, 10);
+    FillPeak(reference.Find1D("broad"), 100.5, 10);
+    FillPeak(live.Find1D("same"), 100.5, 20);
+    FillPeak(live.Find1D("shifted"), 105.5, 10);
+    FillPeak(live.Find1D("broad"), 100.5, 10);
+    for ( int i = 0 ; i < 200 ; ++i )
+        live.Find1D("broad")->Fill(i + 0.5, 5);
+
+    SUBCASE("Single spectrum"){
+        auto same = Comparison::Compare(live.Find1D("same"), reference.Find1D("same"));
+        CHECK(same.live_counts == 2*same.reference_counts);
+        CHECK(same.chi2 == doctest::Approx(0));
+        CHECK(same.ks == doctest::Approx(0));
+        CHECK(same.shift == doctest::Approx(0));
+        CHECK(same.ndf == 20);
+        CHECK(same.score < 1);
+
+        auto shifted = Comparison::Compare(live.Find1D("shifted"), reference.Find1D("shifted"));
+        CHECK(shifted.shift == doctest::Approx(5));
+        CHECK(shifted.ks > 0.1);
+        CHECK(shifted.score > 1);
+
+        Histogram1D other("other", "other", 100, 0, 200, "x");
+        CHECK_THROWS(Comparison::Compare(live.Find1D("same"), &other));
+    }
+
+    SUBCASE("Ranked outliers"){
+        Comparison::Options options;
+        options.shift_threshold = 2;
+        auto outliers = Comparison::Compare(live, reference, options, pool);
+        REQUIRE(outliers.size() == 2);
+        CHECK(outliers[0].score >= outliers[1].score);
+        CHECK(((outliers[0].name == "shifted" && outliers[1].name == "broad") ||
+               (outliers[0].name == "broad" && outliers[1].name == "shifted")));
+
+        options.max_reported = 1;
+        CHECK(Comparison::Compare(live, reference, options, pool).size() == 1);
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,87 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/FirstGeneration.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+#include <vector>
+
+TEST_SUITE_BEGIN( "FirstGeneration" );
+
+TEST_CASE( "Extract first generation matrix" ){
+
+    // Levels at 0, 100, ..., 1100 with 1e5 cascades starting in each level, decaying
+    // to each lower level j with probability proportional to j + 1.
+    const size_t rows = 12;
+    const double cascades = 1e5;
+    std::vector<double> fg(rows*rows, 0.), u(rows*rows, 0.);
+    for ( size_t i = 1 ; i < rows ; ++i ){
+        const double norm = double(i*(i + 1))/2;
+        for ( size_t j = 0 ; j < i ; ++j ){
+            const double w = double(j + 1)/norm;
+            fg[i*rows + (i - j)] = cascades*w;
+            for ( size_t k = 0 ; k < rows ; ++k )
+                u[i*rows + k] += w*u[j*rows + k];
+        }
+        for ( size_t k = 0 ; k < rows ; ++k )
+            u[i*rows + k] += fg[i*rows + k];
+    }
+
+    Histograms set;
+    Histogram2Dp unfolded = set.Create2D("unfolded", "unfolded", rows, -50, 1150, "E_{#gamma}", rows, -50, 1150, "E_{x}");
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        for ( size_t k = 0 ; k < rows ; ++k )
+            unfolded->SetBinContent(k + 1, i + 1, Histogram2D::data_t(std::round(u[i*rows + k])));
+    }
+
+    ThreadPool pool(2);
+
+    SUBCASE("Extract"){
+        auto result = FirstGeneration::Extract(set, unfolded, "fg", FirstGeneration::Options(), pool);
+        REQUIRE(result.fg != nullptr);
+        CHECK(set.Find2D("fg") == result.fg);
+        CHECK(result.iterations > 1);
+        CHECK(result.change < 1e-4);
+        for ( size_t i = 1 ; i < rows ; ++i ){
+            for ( size_t k = 0 ; k < rows ; ++k ){
+                CHECK(std::abs(result.values[i*rows + k] - fg[i*rows + k]) < 0.01*fg[i*rows + k] + 50);
+            }
+        }
+        CHECK(double(result.fg->GetBinContent(3, 6)) == doctest::Approx(fg[5*rows + 2]).epsilon(0.01));
+    }
+
+    SUBCASE("Ensemble"){
+        auto result = FirstGeneration::Ensemble(set, unfolded, "fg_ensemble", 4, 7, FirstGeneration::Options(), pool);
+        REQUIRE(result.mean != nullptr);
+        REQUIRE(result.std != nullptr);
+        CHECK(set.Find2D("fg_ensemble_mean") == result.mean);
+        CHECK(set.Find2D("fg_ensemble_std") == result.std);
+        CHECK(result.mean_values[5*rows + 2] == doctest::Approx(fg[5*rows + 2]).epsilon(0.05));
+        CHECK(result.std_values[5*rows + 2] > 0);
+        CHECK(result.std_values[5*rows + 2] < 0.1*fg[5*rows + 2]);
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,171 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Frozen.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+#include <histogram/ThreadPool.h>
+
+#include <vector>
+
+TEST_SUITE_BEGIN( "Frozen" );
+
+TEST_CASE( "Frozen bins" ){
+    std::vector<size_t> values(1000, 0);
+    values[3] = 7;
+    values[70] = 300;
+    values[140] = 70000;
+    values[500] = 5000000000ull;
+    values[999] = 1;
+
+    FrozenBins bins;
+    bins.Append(values.data(), 100);
+    bins.Append(values.data() + 100, 900);
+    bins.Seal();
+    REQUIRE(bins.GetSize() == 1000);
+    for ( size_t i = 0 ; i < values.size() ; ++i )
+        CHECK(bins.Get(i) == values[i]);
+
+    std::vector<size_t> decoded(600);
+    bins.Decode(50, 600, decoded.data());
+    for ( size_t i = 0 ; i < decoded.size() ; ++i )
+        CHECK(decoded[i] == values[50 + i]);
+}
+
+TEST_CASE( "Freeze histograms" ){
+
+    Histograms set;
+    Histogram1Dp spectrum = set.Create1D("spectrum", "spectrum", 1000, 0, 1000, "x");
+    Histogram2Dp matrix = set.Create2D("matrix", "matrix", 500, 0, 500, "x", 400, 0, 400, "y");
+    Histogram3Dp cube = set.Create3D("cube", "cube", 20, 0, 20, "x", 30, 0, 30, "y", 10, 0, 10, "z");
+    for ( int i = 0 ; i < 20000 ; ++i ){
+        spectrum->Fill(( i*7 ) % 1100);
+        matrix->Fill(( i*13 ) % 250, ( i*3 ) % 450);
+        cube->Fill(i % 22, ( i*7 ) % 31, ( i*3 ) % 11);
+    }
+    matrix->Fill(10, 10, 100000);
+
+    ThreadPool pool(2);
+    FrozenHistograms frozen(set, pool);
+    REQUIRE(frozen.Find1D("spectrum"));
+    REQUIRE(frozen.Find2D("matrix"));
+    REQUIRE(frozen.Find3D("cube"));
+    CHECK(frozen.Find1D("matrix") == nullptr);
+
+    SUBCASE("Contents"){
+        const FrozenHistogram1D *f1 = frozen.Find1D("spectrum");
+        CHECK(f1->GetEntries() == size_t(spectrum->GetEntries()));
+        for ( size_t bin = 0 ; bin < 1002 ; ++bin )
+            CHECK(f1->GetBinContent(bin) == spectrum->GetBinContent(bin));
+        CHECK(f1->GetBinContent(5000) == 0);
+
+        const FrozenHistogram2D *f2 = frozen.Find2D("matrix");
+        size_t mismatches = 0;
+        for ( size_t y = 0 ; y < 402 ; ++y ){
+            for ( size_t x = 0 ; x < 502 ; ++x )
+                mismatches += ( f2->GetBinContent(x, y) != matrix->GetBinContent(x, y) );
+        }
+        CHECK(mismatches == 0);
+
+        const FrozenHistogram3D *f3 = frozen.Find3D("cube");
+        mismatches = 0;
+        for ( size_t z = 0 ; z < 12 ; ++z ){
+            for ( size_t y = 0 ; y < 32 ; ++y ){
+                for ( size_t x = 0 ; x < 22 ; ++x )
+                    mismatches += ( f3->GetBinContent(x, y, z) != cube->GetBinContent(x, y, z) );
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    SUBCASE("Memory"){
+        const size_t full = 8*( 1002 + 502*402 + 22*32*12 );
+        CHECK(frozen.GetMemoryUsage()*10 < full);
+    }
+
+    SUBCASE("Projections"){
+        const FrozenHistogram2D *f2 = frozen.Find2D("matrix");
+        Histograms out;
+        Histogram1Dp px = f2->ProjectX(out, "px");
+        Histogram1Dp py = f2->ProjectY(out, "py", 1, 100);
+        for ( size_t x = 0 ; x < 502 ; ++x ){
+            size_t sum = 0;
+            for ( size_t y = 1 ; y <= 400 ; ++y )
+                sum += matrix->GetBinContent(x, y);
+            CHECK(px->GetBinContent(x) == sum);
+        }
+        for ( size_t y = 0 ; y < 402 ; ++y ){
+            size_t sum = 0;
+            for ( size_t x = 1 ; x <= 100 ; ++x )
+                sum += matrix->GetBinContent(x, y);
+            CHECK(py->GetBinContent(y) == sum);
+        }
+
+        const FrozenHistogram3D *f3 = frozen.Find3D("cube");
+        for ( int axis = 0 ; axis < 3 ; ++axis ){
+            Histogram1Dp p = f3->Project(out, "p" + std::to_string(axis), axis);
+            const size_t n[3] = {22, 32, 12};
+            for ( size_t k = 0 ; k < n[axis] ; ++k ){
+                size_t sum = 0;
+                for ( size_t z = 0 ; z < 12 ; ++z ){
+                    for ( size_t y = 0 ; y < 32 ; ++y ){
+                        for ( size_t x = 0 ; x < 22 ; ++x ){
+                            const size_t c[3] = {x, y, z};
+                            bool inside = c[axis] == k;
+                            for ( int other = 0 ; other < 3 ; ++other ){
+                                if ( other != axis && ( c[other] == 0 || c[other] == n[other] - 1 ) )
+                                    inside = false;
+                            }
+                            if ( inside )
+                                sum += cube->GetBinContent(x, y, z);
+                        }
+                    }
+                }
+                CHECK(p->GetBinContent(k) == sum);
+            }
+        }
+        CHECK_THROWS(f3->Project(out, "bad", 3));
+    }
+
+    SUBCASE("Add to mutable set"){
+        Histograms sum;
+        Histogram1Dp s1 = sum.Create1D("spectrum", "spectrum", 1000, 0, 1000, "x");
+        Histogram2Dp s2 = sum.Create2D("matrix", "matrix", 500, 0, 500, "x", 400, 0, 400, "y");
+        Histogram3Dp s3 = sum.Create3D("cube", "cube", 20, 0, 20, "x", 30, 0, 30, "y", 10, 0, 10, "z");
+        s1->Fill(5);
+        frozen.AddTo(sum, pool);
+        frozen.AddTo(sum, pool);
+        CHECK(s1->GetBinContent(6) == 2*spectrum->GetBinContent(6) + 1);
+        CHECK(s1->GetEntries() == 2*spectrum->GetEntries() + 1);
+        CHECK(s2->GetBinContent(11, 11) == 2*matrix->GetBinContent(11, 11));
+        CHECK(s2->GetEntries() == 2*matrix->GetEntries());
+        CHECK(s3->GetBinContent(3, 4, 5) == 2*cube->GetBinContent(3, 4, 5));
+
+        Histograms wrong;
+        Histogram1Dp w1 = wrong.Create1D("spectrum", "spectrum", 10, 0, 10, "x");
+        CHECK_THROWS(frozen.Find1D("spectrum")->AddTo(w1));
+    }
+}
+
+TEST_SUITE_END();
@@ -30,6 +30,7 @@
 #include <histogram/Histogram2D.h>
 #include <histogram/Histogram3D.h>
 #include <histogram/MamaWriter.h>
+#include <histogram/ThreadPool.h>
 
 #include <iostream>
 #include <sstream>
@@ -509,4 +510,189 @@ TEST_CASE("Histograms"){
 
 }
 
+TEST_CASE("Histograms directory index"){
+    Histograms histograms;
+    auto top = histograms.Create1D("top", "top", 10, 0, 10, "x");
+    auto e1 = histograms.Create1D("e1", "e1", 10, 0, 10, "x", "energy");
+    auto e2 = histograms.Create2D("e2", "e2", 10, 0, 10, "x", 10, 0, 10, "y", "/energy/");
+    auto t1 = histograms.Create1D("t1", "t1", 10, 0, 10, "x", "energy//time");
+    auto c1 = histograms.Create3D("c1", "c1", 4, 0, 4, "x", 4, 0, 4, "y", 4, 0, 4, "z", "cubes/a/b");
+
+    CHECK(Histograms::NormalisePath("//a///b/") == "a/b");
+    CHECK(Histograms::NormalisePath("") == "");
+
+    const Histograms::Directory& root = histograms.GetRoot();
+    CHECK(root.path.empty());
+    REQUIRE(root.hist1d.size() == 1);
+    CHECK(root.hist1d[0] == top);
+    CHECK(root.children.size() == 2);
+
+    const Histograms::Directory* energy = histograms.FindDirectory("energy");
+    REQUIRE(energy != nullptr);
+    CHECK(energy->name == "energy");
+    CHECK(energy->hist1d.size() == 1);
+    CHECK(energy->hist2d.size() == 1);
+    REQUIRE(histograms.FindDirectory("/energy/time") != nullptr);
+    CHECK(histograms.FindDirectory("energy/time")->path == "energy/time");
+    CHECK(histograms.FindDirectory("cubes/a")->hist3d.empty());
+    CHECK(histograms.FindDirectory("cubes/a/b")->hist3d.size() == 1);
+    CHECK(histograms.FindDirectory("missing") == nullptr);
+
+    auto list1d = histograms.GetAll1D("energy");
+    REQUIRE(list1d.size() == 2);
+    CHECK(list1d[0] == e1);
+    CHECK(list1d[1] == t1);
+    CHECK(histograms.GetAll1D("").size() == 3);
+    CHECK(histograms.GetAll2D("energy/time").empty());
+    CHECK(histograms.GetAll3D("cubes").size() == 1);
+    CHECK_THROWS(histograms.GetAll1D("missing"));
+
+    top->Fill(1);
+    e1->Fill(1);
+    e2->Fill(1, 1);
+    t1->Fill(1);
+    c1->Fill(1, 1, 1);
+
+    SUBCASE("ResetAll subtree"){
+        histograms.ResetAll("energy");
+        CHECK(top->GetEntries() == 1);
+        CHECK(e1->GetEntries() == 0);
+        CHECK(e2->GetEntries() == 0);
+        CHECK(t1->GetEntries() == 0);
+        CHECK(c1->GetEntries() == 1);
+        ThreadPool pool(2);
+        histograms.ResetAll("cubes", pool);
+        CHECK(c1->GetEntries() == 0);
+        CHECK(top->GetEntries() == 1);
+        CHECK_THROWS(histograms.ResetAll("missing"));
+    }
+
+    SUBCASE("Merge subtree"){
+        Histograms other;
+        other.Create1D("top", "top", 10, 0, 10, "x")->Fill(2);
+        other.Create1D("t1", "t1", 10, 0, 10, "x", "elsewhere")->Fill(2);
+        other.Create2D("e2", "e2", 10, 0, 10, "x", 10, 0, 10, "y")->Fill(2, 2);
+        histograms.Merge(other, "energy/time");
+        CHECK(t1->GetEntries() == 2);
+        CHECK(e2->GetEntries() == 1);
+        CHECK(top->GetEntries() == 1);
+        ThreadPool pool(2);
+        histograms.Merge(other, "energy", pool);
+        CHECK(t1->GetEntries() == 3);
+        CHECK(e2->GetEntries() == 2);
+        CHECK(top->GetEntries() == 1);
+        histograms.Merge(other);
+        CHECK(top->GetEntries() == 2);
+    }
+}
+
+TEST_CASE("Fill policies"){
+    const std::vector<FillPolicy> policies = {
+        FillPolicy(),
+        FillPolicy(FillPolicy::rows),
+        FillPolicy(FillPolicy::contiguous, 64),
+        FillPolicy(FillPolicy::rows, 100, FillPolicy::sorted),
+        FillPolicy(FillPolicy::contiguous, 1, FillPolicy::sorted),
+        FillPolicy(FillPolicy::contiguous, FillPolicy::automatic)
+    };
+
+    Histograms reference;
+    Histogram1Dp ref1d = reference.Create1D("h", "h", 50, -5, 45, "x");
+    Histogram2Dp ref2d = reference.Create2D("m", "m", 30, 0, 30, "x", 20, -10, 10, "y");
+    Histogram3Dp ref3d = reference.Create3D("c", "c", 8, 0, 8, "x", 6, 0, 6, "y", 5, 0, 5, "z");
+    for ( int i = 0 ; i < 1000 ; ++i ){
+        ref1d->Fill(( i*37 ) % 60 - 8.5, 1 + i % 3);
+        ref2d->Fill(( i*13 ) % 35 - 2.5, ( i*7 ) % 25 - 12.5, 1 + i % 2);
+        ref3d->Fill(( i*5 ) % 10 - 1.5, ( i*3 ) % 8 - 0.5, i % 7 - 0.5);
+    }
+    CHECK(ref3d->GetEntries() == 1000);
+
+    for ( auto &policy : policies ){
+        Histograms histograms;
+        Histogram1Dp hist = histograms.Create1D("h", "h", 50, -5, 45, "x", "", policy);
+        Histogram2Dp mat = histograms.Create2D("m", "m", 30, 0, 30, "x", 20, -10, 10, "y", "", policy);
+        Histogram3Dp cube = histograms.Create3D("c", "c", 8, 0, 8, "x", 6, 0, 6, "y", 5, 0, 5, "z", "", policy);
+        CHECK(mat->GetFillPolicy().buffer_size == policy.Resolve(32*22).buffer_size);
+        for ( int i = 0 ; i < 1000 ; ++i ){
+            hist->Fill(( i*37 ) % 60 - 8.5, 1 + i % 3);
+            mat->Fill(( i*13 ) % 35 - 2.5, ( i*7 ) % 25 - 12.5, 1 + i % 2);
+            cube->Fill(( i*5 ) % 10 - 1.5, ( i*3 ) % 8 - 0.5, i % 7 - 0.5);
+        }
+        // Buffered fills are counted before they are applied.
+        CHECK(hist->GetEntries() == 1000);
+        CHECK(mat->GetEntries() == 1000);
+        CHECK(cube->GetEntries() == 1000);
+
+        for ( Axis::index_t x = 0 ; x < 52 ; ++x )
+            CHECK(hist->GetBinContent(x) == ref1d->GetBinContent(x));
+        for ( Axis::index_t y = 0 ; y < 22 ; ++y )
+            for ( Axis::index_t x = 0 ; x < 32 ; ++x )
+                CHECK(mat->GetBinContent(x, y) == ref2d->GetBinContent(x, y));
+        for ( Axis::index_t z = 0 ; z < 7 ; ++z )
+            for ( Axis::index_t y = 0 ; y < 8 ; ++y )
+                for ( Axis::index_t x = 0 ; x < 10 ; ++x )
+                    CHECK(cube->GetBinContent(x, y, z) == ref3d->GetBinContent(x, y, z));
+
+        // Merging applies the buffers of both histograms.
+        mat->Fill(3.5, 3.5);
+        Histograms merged;
+        Histogram2Dp sum = merged.Create2D("m", "m", 30, 0, 30, "x", 20, -10, 10, "y", "", FillPolicy(FillPolicy::rows, 8));
+        sum->Fill(3.5, 3.5);
+        merged.Merge(histograms);
+        CHECK(sum->GetBinContent(4, 14) == ref2d->GetBinContent(4, 14) + 2);
+        CHECK(sum->GetEntries() == 1002);
+
+        // Changing the policy keeps the contents.
+        cube->Fill(0.5, 0.5, 0.5);
+        cube->SetFillPolicy(FillPolicy(FillPolicy::rows, 3, FillPolicy::sorted));
+        CHECK(cube->GetBinContent(1, 1, 1) == ref3d->GetBinContent(1, 1, 1) + 1);
+        cube->Reset();
+        CHECK(cube->GetEntries() == 0);
+        CHECK(cube->GetBinContent(1, 1, 1) == 0);
+    }
+
+    FillPolicy automatic(FillPolicy::rows, FillPolicy::automatic);
+    CHECK(automatic.Resolve(1000).buffer_size == 0);
+    CHECK(automatic.Resolve(FillPolicy::large_bins + 1).buffer_size > 0);
+    CHECK(automatic.Resolve(FillPolicy::large_bins + 1).flush == FillPolicy::sorted);
+    CHECK(automatic.Resolve(FillPolicy::large_bins + 1).layout == FillPolicy::rows);
+
+    // Large histograms group buffered fills by region of the bin array.
+    Histograms large;
+    Histogram2Dp big = large.Create2D("big", "big", 2100, 0, 2100, "x", 2100, 0, 2100, "y", "", automatic);
+    REQUIRE(big->GetFillPolicy().buffer_size > 0);
+    for ( size_t i = 0 ; i < 100000 ; ++i )
+        big->Fill(( i*7919 ) % 2100 + 0.5, ( i*104729 ) % 2100 + 0.5);
+    big->Fill(5.5, 7.5, 3);
+    CHECK(big->GetEntries() == 100001);
+    size_t sum = 0;
+    for ( Axis::index_t y = 0 ; y < 2102 ; ++y ){
+        const Histogram2D::data_t *row = big->GetRow(y);
+        for ( Axis::index_t x = 0 ; x < 2102 ; ++x )
+            sum += row[x];
+    }
+    CHECK(sum == 100003);
+    CHECK(big->GetBinContent(6, 8) >= 3);
+}
+
+TEST_CASE("Concurrent reads of a buffered histogram"){
+    Histogram1D hist("shared", "shared", 100, 0, 100, "x", "", FillPolicy(FillPolicy::contiguous, 1 << 20));
+    for ( size_t i = 0 ; i < 100000 ; ++i )
+        hist.Fill(i % 100 + 0.5);
+
+    // The first reader applies the buffer, the others must not apply it again.
+    ThreadPool pool(8);
+    std::vector<size_t> sums(64, 0);
+    pool.ParallelFor(0, sums.size(), [&](size_t first, size_t last){
+        for ( size_t i = first ; i < last ; ++i ){
+            const Histogram1D::data_t *data = hist.GetData();
+            for ( size_t bin = 0 ; bin < 102 ; ++bin )
+                sums[i] += data[bin];
+        }
+    });
+    for ( auto sum : sums )
+        CHECK(sum == 100000);
+    CHECK(hist.GetEntries() == 100000);
+}
+
 TEST_SUITE_END();
\ No newline at end of file
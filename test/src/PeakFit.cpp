@@ -0,0 +1,99 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/PeakFit.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+#include <stdexcept>
+
+TEST_SUITE_BEGIN( "PeakFit" );
+
+static constexpr double pi = 3.14159265358979323846;
+
+//! Fill the expected counts of two Gaussian peaks on a linear background.
+static void FillDoublet(Histogram1Dp hist)
+{
+    const Axis &axis = hist->GetAxisX();
+    for ( size_t bin = 1 ; bin <= axis.GetBinCount() ; ++bin ){
+        const double x = axis.GetBinCenter(bin);
+        double counts = 50 - 0.05*x;
+        for ( auto peak : {std::make_pair(480.3, 20000.), std::make_pair(502.1, 8000.)} ){
+            const double u = ( x - peak.first )/5;
+            counts += peak.second*axis.GetBinWidth()*std::exp(-0.5*u*u)/( 5*std::sqrt(2*pi) );
+        }
+        hist->Fill(x, size_t(std::lround(counts)));
+    }
+}
+
+TEST_CASE( "Fit peaks" ){
+
+    Histograms hists;
+    Histogram1Dp spectrum = hists.Create1D("doublet", "doublet", 500, 0, 1000, "x");
+    FillDoublet(spectrum);
+
+    SUBCASE("Single region"){
+        auto result = PeakFit::Fit({spectrum, 440, 550, {478, 505}});
+        CHECK(result.converged);
+        REQUIRE(result.peaks.size() == 2);
+        CHECK(result.peaks[0].centroid == doctest::Approx(480.3).epsilon(0.001));
+        CHECK(result.peaks[0].area == doctest::Approx(20000).epsilon(0.01));
+        CHECK(result.peaks[0].sigma == doctest::Approx(5).epsilon(0.02));
+        CHECK(result.peaks[1].centroid == doctest::Approx(502.1).epsilon(0.001));
+        CHECK(result.peaks[1].area == doctest::Approx(8000).epsilon(0.02));
+        CHECK(result.peaks[0].area_error > 0);
+        CHECK(result.peaks[0].centroid_error > 0);
+        CHECK(result.slope == doctest::Approx(-0.05).epsilon(0.2));
+        CHECK(result.ndf == 56 - 8);
+        CHECK(result.chi2 < double(result.ndf));
+    }
+
+    SUBCASE("Batch"){
+        ThreadPool pool(2);
+        std::vector<PeakFit::Region> regions(50, {spectrum, 440, 550, {478, 505}});
+        auto results = PeakFit::Fit(regions, PeakFit::Options(), pool);
+        REQUIRE(results.size() == 50);
+        for ( auto &result : results )
+            CHECK(result.peaks[0].centroid == doctest::Approx(480.3).epsilon(0.001));
+    }
+
+    SUBCASE("Batch on a buffered spectrum"){
+        Histogram1Dp buffered = hists.Create1D("buffered", "buffered", 500, 0, 1000, "x", "",
+                                               FillPolicy(FillPolicy::contiguous, 1 << 20));
+        FillDoublet(buffered);
+        ThreadPool pool(8);
+        std::vector<PeakFit::Region> regions(32, {buffered, 440, 550, {478, 505}});
+        auto results = PeakFit::Fit(regions, PeakFit::Options(), pool);
+        REQUIRE(results.size() == 32);
+        for ( auto &result : results )
+            CHECK(result.peaks[0].area == doctest::Approx(20000).epsilon(0.01));
+        CHECK(spectrum->GetEntries() == buffered->GetEntries());
+    }
+
+    SUBCASE("Too small region"){
+        CHECK_THROWS(PeakFit::Fit({spectrum, 470, 480, {475, 476, 477}}));
+    }
+}
+
+TEST_SUITE_END();
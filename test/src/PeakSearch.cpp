@@ -0,0 +1,89 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/PeakSearch.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+
+TEST_SUITE_BEGIN( "PeakSearch" );
+
+static constexpr double pi = 3.14159265358979323846;
+
+//! Fill the expected counts of a Gaussian peak.
+static void FillGauss(Histogram1Dp hist, double centroid, double sigma, double area)
+{
+    const Axis &axis = hist->GetAxisX();
+    for ( size_t bin = 1 ; bin <= axis.GetBinCount() ; ++bin ){
+        const double u = ( axis.GetBinCenter(bin) - centroid )/sigma;
+        const double counts = area*axis.GetBinWidth()*std::exp(-0.5*u*u)/( sigma*std::sqrt(2*pi) );
+        hist->Fill(axis.GetBinCenter(bin), size_t(std::lround(counts)));
+    }
+}
+
+//! Fill a linear background.
+static void FillBackground(Histogram1Dp hist, double offset, double slope)
+{
+    const Axis &axis = hist->GetAxisX();
+    for ( size_t bin = 1 ; bin <= axis.GetBinCount() ; ++bin ){
+        hist->Fill(axis.GetBinCenter(bin), size_t(std::lround(offset + slope*axis.GetBinCenter(bin))));
+    }
+}
+
+TEST_CASE( "Search peaks" ){
+
+    Histograms hists;
+    Histogram1Dp spectrum = hists.Create1D("spectrum", "spectrum", 200, 0, 400, "x");
+    FillBackground(spectrum, 20, 0.05);
+    FillGauss(spectrum, 120.6, 6, 5000);
+    FillGauss(spectrum, 280, 6, 2000);
+
+    SUBCASE("Single spectrum"){
+        auto peaks = PeakSearch::Search(spectrum);
+        REQUIRE(peaks.size() == 2);
+        CHECK(peaks[0].centroid == doctest::Approx(120.6).epsilon(0.003));
+        CHECK(peaks[0].area == doctest::Approx(5000).epsilon(0.03));
+        CHECK(peaks[0].sigma == doctest::Approx(6).epsilon(0.3));
+        CHECK(peaks[1].centroid == doctest::Approx(280).epsilon(0.003));
+        CHECK(peaks[1].area == doctest::Approx(2000).epsilon(0.03));
+
+        PeakSearch::Options options;
+        options.max_peaks = 1;
+        peaks = PeakSearch::Search(spectrum, options);
+        REQUIRE(peaks.size() == 1);
+        CHECK(peaks[0].centroid == doctest::Approx(120.6).epsilon(0.003));
+    }
+
+    SUBCASE("Set of spectra"){
+        Histogram1Dp flat = hists.Create1D("flat", "flat", 200, 0, 400, "x");
+        FillBackground(flat, 50, 0);
+        ThreadPool pool(2);
+        auto peaks = PeakSearch::Search(hists, PeakSearch::Options(), pool);
+        CHECK(peaks.size() == 2);
+        CHECK(peaks["spectrum"].size() == 2);
+        CHECK(peaks["flat"].empty());
+    }
+}
+
+TEST_SUITE_END();
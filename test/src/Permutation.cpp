@@ -0,0 +1,97 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Permutation.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+#include <histogram/ThreadPool.h>
+
+#include <string>
+
+TEST_SUITE_BEGIN( "Permutation" );
+
+TEST_CASE( "Transpose matrix" ){
+
+    Histograms set;
+    Histogram2Dp matrix = set.Create2D("matrix", "matrix", 150, 0, 150, "x", 70, -10, 60, "y");
+    for ( size_t y = 0 ; y < 72 ; ++y ){
+        for ( size_t x = 0 ; x < 152 ; ++x )
+            matrix->SetBinContent(x, y, 1000*x + y);
+    }
+    matrix->Fill(10, 10);
+
+    ThreadPool pool(3);
+    Histogram2Dp transposed = Permutation::Transpose(set, matrix, "transposed", pool);
+    REQUIRE(set.Find2D("transposed") == transposed);
+    CHECK(transposed->GetAxisX().GetBinCount() == 70);
+    CHECK(transposed->GetAxisX().GetLeft() == -10);
+    CHECK(transposed->GetAxisX().GetTitle() == "y");
+    CHECK(transposed->GetAxisY().GetBinCount() == 150);
+    CHECK(transposed->GetEntries() == matrix->GetEntries());
+    for ( size_t y = 0 ; y < 72 ; ++y ){
+        for ( size_t x = 0 ; x < 152 ; ++x )
+            CHECK(transposed->GetBinContent(y, x) == matrix->GetBinContent(x, y));
+    }
+}
+
+TEST_CASE( "Permute cube" ){
+
+    Histograms set;
+    Histogram3Dp cube = set.Create3D("cube", "cube", 20, 0, 20, "x", 35, 0, 35, "y", 9, 0, 9, "z");
+    for ( size_t z = 0 ; z < 11 ; ++z ){
+        for ( size_t y = 0 ; y < 37 ; ++y ){
+            for ( size_t x = 0 ; x < 22 ; ++x )
+                cube->SetBinContent(x, y, z, 10000*x + 100*y + z);
+        }
+    }
+    ThreadPool pool(2);
+
+    const std::array<int, 3> orders[] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+    for ( const auto &order : orders ){
+        const std::string name = "cube_" + std::to_string(order[0]) + std::to_string(order[1]) + std::to_string(order[2]);
+        Histogram3Dp result = Permutation::Permute(set, cube, name, order, pool);
+        const Axis *axes[3] = {&cube->GetAxisX(), &cube->GetAxisY(), &cube->GetAxisZ()};
+        CHECK(result->GetAxisX().GetBinCount() == axes[order[0]]->GetBinCount());
+        CHECK(result->GetAxisY().GetBinCount() == axes[order[1]]->GetBinCount());
+        CHECK(result->GetAxisZ().GetBinCount() == axes[order[2]]->GetBinCount());
+
+        size_t mismatches = 0;
+        size_t s[3];
+        for ( size_t k = 0 ; k < result->GetAxisZ().GetBinCountAll() ; ++k ){
+            s[order[2]] = k;
+            for ( size_t j = 0 ; j < result->GetAxisY().GetBinCountAll() ; ++j ){
+                s[order[1]] = j;
+                for ( size_t i = 0 ; i < result->GetAxisX().GetBinCountAll() ; ++i ){
+                    s[order[0]] = i;
+                    if ( result->GetBinContent(i, j, k) != cube->GetBinContent(s[0], s[1], s[2]) )
+                        ++mismatches;
+                }
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    CHECK_THROWS(Permutation::Permute(set, cube, "bad", {0, 0, 2}, pool));
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,130 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Pipeline.h>
+#include <histogram/ThreadSafeHistograms.h>
+
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+TEST_SUITE_BEGIN( "Pipeline" );
+
+TEST_CASE( "Bounded queue" ){
+
+    BoundedQueue<int> queue(3);
+    CHECK(queue.capacity() == 4);
+
+    for ( int i = 0 ; i < 4 ; ++i )
+        CHECK(queue.try_push(i));
+    CHECK_FALSE(queue.try_push(4));
+
+    int value = -1;
+    CHECK(queue.try_pop(value));
+    CHECK(value == 0);
+    CHECK(queue.try_push(4));
+
+    queue.close();
+    std::vector<int> rest;
+    while ( queue.pop(value) )
+        rest.push_back(value);
+    CHECK(rest == std::vector<int>({1, 2, 3, 4}));
+}
+
+TEST_CASE( "Blocked queue waiters are woken" ){
+
+    BoundedQueue<int> queue(2);
+    std::vector<int> popped;
+    std::thread consumer([&](){
+        int value;
+        while ( queue.pop(value) )
+            popped.push_back(value);
+    });
+
+    // The consumer is blocked by now, and woken by each push and by close.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for ( int i = 0 ; i < 100 ; ++i ){
+        queue.push(i);
+        if ( i % 25 == 0 )
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.close();
+    consumer.join();
+
+    REQUIRE(popped.size() == 100);
+    for ( int i = 0 ; i < 100 ; ++i )
+        CHECK(popped[i] == i);
+}
+
+TEST_CASE( "Reader, transform and fill stages" ){
+
+    ThreadSafeHistograms histograms;
+    histograms.Create1D("pipeline", "pipeline", 100, 0, 200, "x");
+
+    const int n_batches = 50, batch_size = 100;
+    int produced = 0;
+
+    Pipeline<std::vector<double>> pipeline(4);
+    pipeline.SetReader([&](std::vector<double> &batch){
+                batch.resize(batch_size);
+                std::iota(batch.begin(), batch.end(), 0.);
+                return ++produced < n_batches;
+            })
+            .AddStage([](std::vector<double> &batch){
+                for ( auto &x : batch )
+                    x *= 2;
+            }, 3)
+            .AddStageFactory([&histograms](){
+                return [adapter = histograms.Create1D("pipeline", "pipeline", 100, 0, 200, "x")]
+                        (std::vector<double> &batch) mutable {
+                    for ( auto &x : batch )
+                        adapter.Fill(x);
+                };
+            }, 2);
+    pipeline.Run();
+
+    Histogram1Dp hist = histograms.GetHistograms().Find1D("pipeline");
+    REQUIRE(hist != nullptr);
+    CHECK(hist->GetEntries() == n_batches*batch_size);
+    for ( Axis::index_t bin = 1 ; bin <= hist->GetAxisX().GetBinCount() ; ++bin )
+        CHECK(hist->GetBinContent(bin) == n_batches);
+}
+
+TEST_CASE( "Exceptions are propagated" ){
+
+    int produced = 0;
+    Pipeline<std::vector<int>> pipeline(2);
+    pipeline.SetReader([&](std::vector<int> &batch){
+                batch.assign(10, produced);
+                return ++produced < 100;
+            })
+            .AddStage([](std::vector<int> &batch){
+                if ( batch[0] == 10 )
+                    throw std::runtime_error("bad batch");
+            }, 2);
+    CHECK_THROWS(pipeline.Run());
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,117 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Resample.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+
+TEST_SUITE_BEGIN( "Resample" );
+
+//! Sum of the regular bins of a matrix.
+static double Total(Histogram2Dp hist)
+{
+    double sum = 0;
+    for ( size_t y = 1 ; y <= hist->GetAxisY().GetBinCount() ; ++y ){
+        for ( size_t x = 1 ; x <= hist->GetAxisX().GetBinCount() ; ++x )
+            sum += double(hist->GetBinContent(x, y));
+    }
+    return sum;
+}
+
+TEST_CASE( "Transform matrix" ){
+
+    Histograms set;
+    Histogram2Dp matrix = set.Create2D("matrix", "matrix", 20, 0, 20, "x", 10, 0, 10, "y");
+    for ( size_t y = 1 ; y <= 10 ; ++y ){
+        for ( size_t x = 1 ; x <= 20 ; ++x )
+            matrix->SetBinContent(x, y, 1000*x + y);
+    }
+    ThreadPool pool(2);
+
+    SUBCASE("Identity"){
+        Histogram2Dp result = Resample::Transform(set, matrix, "identity", matrix->GetAxisX(), matrix->GetAxisY(),
+                                                  Resample::Affine{1, 0, 0, 1, 0, 0}, 1, pool);
+        REQUIRE(set.Find2D("identity") == result);
+        for ( size_t y = 1 ; y <= 10 ; ++y ){
+            for ( size_t x = 1 ; x <= 20 ; ++x )
+                CHECK(result->GetBinContent(x, y) == matrix->GetBinContent(x, y));
+        }
+    }
+
+    SUBCASE("Half bin shift"){
+        Histograms other;
+        Histogram2Dp single = other.Create2D("single", "single", 10, 0, 10, "x", 10, 0, 10, "y");
+        single->SetBinContent(5, 5, 1000);
+        Histogram2Dp result = Resample::Transform(other, single, "shifted", single->GetAxisX(), single->GetAxisY(),
+                                                  Resample::Affine{1, 0, 0, 1, 0.5, 0}, 1, pool);
+        CHECK(result->GetBinContent(5, 5) == 500);
+        CHECK(result->GetBinContent(6, 5) == 500);
+        CHECK(Total(result) == doctest::Approx(1000));
+    }
+
+    SUBCASE("Sum energy"){
+        // (E1, E2) -> (E1 + E2, E1), a shear that maps every bin to a parallelogram.
+        const Axis sum_axis("sum", 30, 0, 30, "E1 + E2");
+        const Axis e1_axis("sum", 20, 0, 20, "E1");
+        Histogram2Dp result = Resample::Transform(set, matrix, "sum", sum_axis, e1_axis,
+                                                  [](double e1, double e2){ return std::make_pair(e1 + e2, e1); },
+                                                  1, pool);
+        CHECK(Total(result) == doctest::Approx(Total(matrix)).epsilon(1e-3));
+        CHECK(result->GetAxisX().GetBinCount() == 30);
+    }
+
+    SUBCASE("Rotation"){
+        const Axis wide_x("rot", 40, -10, 30, "x");
+        const Axis wide_y("rot", 40, -15, 25, "y");
+        Histogram2Dp result = Resample::Transform(set, matrix, "rotated", wide_x, wide_y,
+                                                  Resample::Affine::Rotation(0.3, 10, 5), 2, pool);
+        CHECK(Total(result) == doctest::Approx(Total(matrix)).epsilon(1e-3));
+    }
+
+    SUBCASE("Stencil reuse"){
+        const Resample::Stencil stencil(matrix->GetAxisX(), matrix->GetAxisY(), matrix->GetAxisX(), matrix->GetAxisY(),
+                                        Resample::Affine::Rotation(0.1, 10, 5), 1, pool);
+        CHECK(stencil.GetSize() > 200);
+        Histogram2Dp a = Resample::Transform(set, matrix, "a", stencil, pool);
+        Histogram2Dp b = Resample::Transform(set, matrix, "b", stencil, pool);
+        for ( size_t y = 1 ; y <= 10 ; ++y ){
+            for ( size_t x = 1 ; x <= 20 ; ++x )
+                CHECK(a->GetBinContent(x, y) == b->GetBinContent(x, y));
+        }
+
+        std::vector<double> target;
+        CHECK_THROWS(stencil.Apply(std::vector<double>(10), target, pool));
+        Histogram2Dp small = set.Create2D("small", "small", 5, 0, 5, "x", 5, 0, 5, "y");
+        CHECK_THROWS(Resample::Transform(set, small, "c", stencil, pool));
+
+        // Same shape, other edges.
+        const Axis &ax = matrix->GetAxisX(), &ay = matrix->GetAxisY();
+        Histogram2Dp moved = set.Create2D("moved", "moved", ax.GetBinCount(), ax.GetLeft() + 1, ax.GetRight() + 1, "x",
+                                          ay.GetBinCount(), ay.GetLeft(), ay.GetRight(), "y");
+        CHECK_THROWS(Resample::Transform(set, moved, "d", stencil, pool));
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,137 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Resolution.h>
+#include <histogram/FFT.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+
+TEST_SUITE_BEGIN( "Resolution" );
+
+//! Mean and variance of the regular bins of a spectrum.
+static void Moments(Histogram1Dp hist, double &sum, double &mean, double &variance)
+{
+    const Axis &axis = hist->GetAxisX();
+    sum = mean = variance = 0;
+    for ( size_t bin = 1 ; bin <= axis.GetBinCount() ; ++bin ){
+        const double c = double(hist->GetBinContent(bin));
+        sum += c;
+        mean += c*axis.GetBinCenter(bin);
+        variance += c*axis.GetBinCenter(bin)*axis.GetBinCenter(bin);
+    }
+    mean /= sum;
+    variance = variance/sum - mean*mean;
+}
+
+TEST_CASE( "FFT convolution" ){
+    auto c = FFT::Convolve({1, 2, 3}, {0, 1, 0.5});
+    REQUIRE(c.size() == 5);
+    CHECK(c[0] == doctest::Approx(0).epsilon(1e-9));
+    CHECK(c[1] == doctest::Approx(1));
+    CHECK(c[2] == doctest::Approx(2.5));
+    CHECK(c[3] == doctest::Approx(4));
+    CHECK(c[4] == doctest::Approx(1.5));
+}
+
+TEST_CASE( "Fold spectra" ){
+
+    Histograms set;
+    Histogram1Dp line = set.Create1D("line", "line", 400, 0, 800, "x");
+    line->Fill(201, 100000);
+    line->Fill(601, 100000);
+
+    SUBCASE("Constant width"){
+        Histogram1Dp folded = Resolution::Fold(set, line, "folded", 6.);
+        REQUIRE(set.Find1D("folded") == folded);
+        double sum, mean, variance;
+        Moments(folded, sum, mean, variance);
+        CHECK(sum == doctest::Approx(200000).epsilon(0.001));
+        CHECK(mean == doctest::Approx(401).epsilon(0.001));
+        CHECK(folded->GetBinContent(101) > folded->GetBinContent(104));
+        CHECK(folded->GetBinContent(101) == folded->GetBinContent(301));
+    }
+
+    SUBCASE("Energy dependent width"){
+        Histogram1Dp folded = Resolution::Fold(set, line, "folded", [](double x){ return 0.01*x + 2; });
+        double sum, mean, variance;
+        Moments(folded, sum, mean, variance);
+        CHECK(sum == doctest::Approx(200000).epsilon(0.001));
+        // The high energy line is wider, so its peak bin holds fewer counts.
+        CHECK(double(folded->GetBinContent(101)) > 1.5*double(folded->GetBinContent(301)));
+    }
+
+    SUBCASE("Banded and FFT agree for constant width"){
+        Histogram1Dp fft = Resolution::Fold(set, line, "fft", 6.);
+        Histogram1Dp banded = Resolution::Fold(set, line, "banded", [](double){ return 6.; });
+        for ( size_t bin = 1 ; bin <= 400 ; ++bin ){
+            const double a = double(fft->GetBinContent(bin)), b = double(banded->GetBinContent(bin));
+            CHECK(std::abs(a - b) <= 1);
+        }
+    }
+
+    SUBCASE("List"){
+        ThreadPool pool(2);
+        auto folded = Resolution::Fold(set, {line}, "_folded", 4., pool);
+        REQUIRE(folded.size() == 1);
+        CHECK(folded[0] == set.Find1D("line_folded"));
+        double sum, mean, variance;
+        Moments(folded[0], sum, mean, variance);
+        CHECK(sum == doctest::Approx(200000).epsilon(0.001));
+    }
+}
+
+TEST_CASE( "Fold matrix" ){
+
+    Histograms set;
+    Histogram2Dp matrix = set.Create2D("matrix", "matrix", 100, 0, 100, "x", 20, 0, 20, "y");
+    for ( size_t y = 1 ; y <= 20 ; ++y )
+        matrix->SetBinContent(51, y, 10000*y);
+
+    ThreadPool pool(2);
+    Histogram2Dp folded = Resolution::Fold(set, matrix, "matrix_folded", 3., pool);
+    REQUIRE(set.Find2D("matrix_folded") == folded);
+    for ( size_t y = 1 ; y <= 20 ; ++y ){
+        double sum = 0;
+        for ( size_t x = 1 ; x <= 100 ; ++x )
+            sum += double(folded->GetBinContent(x, y));
+        CHECK(sum == doctest::Approx(10000.*double(y)).epsilon(0.001));
+        CHECK(folded->GetBinContent(50, y) == folded->GetBinContent(52, y));
+    }
+
+    // Fills still in the buffer of the source are applied before the rows are folded in parallel.
+    FillPolicy policy;
+    policy.buffer_size = 4096;
+    Histogram2Dp buffered = set.Create2D("buffered", "buffered", 100, 0, 100, "x", 20, 0, 20, "y", "", policy);
+    for ( size_t y = 1 ; y <= 20 ; ++y )
+        buffered->Fill(50.5, double(y) - 0.5, 10000*y);
+    Histogram2Dp folded_buffered = Resolution::Fold(set, buffered, "buffered_folded", 3., pool);
+    for ( size_t y = 1 ; y <= 20 ; ++y ){
+        for ( size_t x = 1 ; x <= 100 ; ++x )
+            CHECK(folded_buffered->GetBinContent(x, y) == folded->GetBinContent(x, y));
+    }
+}
+
+TEST_SUITE_END();
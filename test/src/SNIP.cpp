@@ -0,0 +1,106 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/SNIP.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+
+TEST_SUITE_BEGIN( "SNIP" );
+
+//! Linear background with a Gaussian peak.
+static double Spectrum(double x)
+{
+    const double u = ( x - 100 )/3;
+    return 100 + 0.5*x + 2000*std::exp(-0.5*u*u);
+}
+
+TEST_CASE( "SNIP background of spectra" ){
+
+    Histograms set;
+    Histogram1Dp hist = set.Create1D("spectrum", "spectrum", 200, 0, 200, "x");
+    for ( size_t bin = 1 ; bin <= 200 ; ++bin )
+        hist->Fill(hist->GetAxisX().GetBinCenter(bin), size_t(std::lround(Spectrum(hist->GetAxisX().GetBinCenter(bin)))));
+
+    SNIP::Options options;
+    options.iterations = 12;
+
+    SUBCASE("Single spectrum"){
+        Histogram1Dp background = SNIP::Background(set, hist, "spectrum_bg", options);
+        REQUIRE(set.Find1D("spectrum_bg") == background);
+        CHECK(double(background->GetBinContent(101)) == doctest::Approx(150).epsilon(0.1));
+        CHECK(double(background->GetBinContent(41)) == doctest::Approx(120).epsilon(0.03));
+        CHECK(double(background->GetBinContent(161)) == doctest::Approx(180).epsilon(0.03));
+    }
+
+    SUBCASE("Without transform, increasing window"){
+        options.lls = false;
+        options.decreasing_window = false;
+        Histogram1Dp background = SNIP::Background(set, hist, "spectrum_bg", options);
+        CHECK(double(background->GetBinContent(101)) == doctest::Approx(150).epsilon(0.1));
+    }
+
+    SUBCASE("List of spectra"){
+        Histogram1Dp other = set.Create1D("other", "other", 200, 0, 200, "x");
+        ThreadPool pool(2);
+        auto backgrounds = SNIP::Background(set, {hist, other}, "_bg", options, pool);
+        REQUIRE(backgrounds.size() == 2);
+        CHECK(backgrounds[0] == set.Find1D("spectrum_bg"));
+        CHECK(backgrounds[1] == set.Find1D("other_bg"));
+        CHECK(double(backgrounds[0]->GetBinContent(101)) == doctest::Approx(150).epsilon(0.1));
+        CHECK(backgrounds[1]->GetBinContent(101) == 0);
+    }
+}
+
+TEST_CASE( "SNIP background of matrices" ){
+
+    Histograms set;
+    Histogram2Dp hist = set.Create2D("matrix", "matrix", 60, 0, 60, "x", 50, 0, 50, "y");
+    for ( size_t y = 1 ; y <= 50 ; ++y ){
+        for ( size_t x = 1 ; x <= 60 ; ++x ){
+            const double u = ( double(x) - 30 )/2, v = ( double(y) - 25 )/2;
+            hist->SetBinContent(x, y, size_t(std::lround(50 + 1000*std::exp(-0.5*(u*u + v*v)))));
+        }
+    }
+
+    ThreadPool pool(2);
+    SNIP::Options options;
+    options.iterations = 8;
+
+    SUBCASE("2D clipping"){
+        Histogram2Dp background = SNIP::Background(set, hist, "matrix_bg", false, options, pool);
+        REQUIRE(set.Find2D("matrix_bg") == background);
+        CHECK(double(background->GetBinContent(30, 25)) == doctest::Approx(50).epsilon(0.15));
+        CHECK(double(background->GetBinContent(5, 5)) == doctest::Approx(50).epsilon(0.02));
+    }
+
+    SUBCASE("Rows"){
+        Histogram2Dp background = SNIP::Background(set, hist, "matrix_bg", true, options, pool);
+        CHECK(double(background->GetBinContent(30, 25)) == doctest::Approx(50).epsilon(0.15));
+        CHECK(double(background->GetBinContent(5, 25)) == doctest::Approx(50).epsilon(0.02));
+    }
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,129 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/StaticHistogram.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+
+#include <cstdint>
+#include <random>
+
+TEST_SUITE_BEGIN( "StaticHistogram" );
+
+TEST_CASE( "Static axis is a constant expression" ){
+    typedef StaticAxis<64, 0, 64> axis_t;
+    static_assert(axis_t::FindBin(-0.5) == 0);
+    static_assert(axis_t::FindBin(0) == 1);
+    static_assert(axis_t::FindBin(63.9) == 64);
+    static_assert(axis_t::FindBin(64) == 65);
+    static_assert(axis_t::binwidth == 1.0);
+
+    Axis axis("axis", 256, -100, 412, "x");
+    typedef StaticAxis<256, -100, 412> taxis_t;
+    CHECK(taxis_t::Matches(axis));
+    CHECK_FALSE(axis_t::Matches(axis));
+    for ( double x = -120 ; x < 430 ; x += 0.37 )
+        CHECK(taxis_t::FindBin(x) == axis.FindBin(x));
+}
+
+TEST_CASE( "Static 1D histogram matches Histogram1D" ){
+    StaticHistogram1D<256, -100, 412, uint32_t> hist("time", "Time", "t", "timing");
+    Histogram1D reference("time", "Time", 256, -100, 412, "t");
+
+    std::mt19937 gen(42);
+    std::normal_distribution<double> dist(150, 120);
+    for ( int i = 0 ; i < 20000 ; ++i ){
+        const double x = dist(gen);
+        hist.Fill(x);
+        reference.Fill(x);
+    }
+    CHECK(hist.GetEntries() == size_t(reference.GetEntries()));
+    for ( Axis::index_t bin = 0 ; bin < 258 ; ++bin )
+        CHECK(hist.GetBinContent(bin) == reference.GetBinContent(bin));
+    CHECK(hist.GetBinContent(1000) == 0);
+    CHECK(hist.GetAxisX().GetBinWidth() == 2);
+    CHECK(hist.GetAxisX().GetTitle() == "t");
+
+    SUBCASE("Add"){
+        StaticHistogram1D<256, -100, 412, uint32_t> other("other", "other", "t");
+        other.Fill(10, 3);
+        hist.Add(other, 2);
+        CHECK(hist.GetBinContent(56) == reference.GetBinContent(56) + 6);
+        CHECK(hist.GetEntries() == size_t(reference.GetEntries()) + 2);
+    }
+
+    SUBCASE("AddTo histogram set"){
+        Histograms histograms;
+        Histogram1Dp added = hist.AddTo(histograms);
+        REQUIRE(added == histograms.Find1D("time"));
+        CHECK(added->GetPath() == "timing");
+        CHECK(histograms.GetAll1D("timing").size() == 1);
+        CHECK(hist.AddTo(histograms) == added);
+        for ( Axis::index_t bin = 0 ; bin < 258 ; ++bin )
+            CHECK(added->GetBinContent(bin) == 2*reference.GetBinContent(bin));
+        CHECK(added->GetEntries() == 2*reference.GetEntries());
+
+        Histogram1D wrong("wrong", "wrong", 128, -100, 412, "t");
+        CHECK_THROWS(hist.AddTo(&wrong));
+    }
+
+    SUBCASE("Reset"){
+        hist.Reset();
+        CHECK(hist.GetEntries() == 0);
+        for ( Axis::index_t bin = 0 ; bin < 258 ; ++bin )
+            CHECK(hist.GetBinContent(bin) == 0);
+    }
+}
+
+TEST_CASE( "Static 2D histogram matches Histogram2D" ){
+    StaticHistogram2D<16, 0, 64, 8, -4, 4, double> hist("mat", "mat", "x", "y");
+    Histogram2D reference("mat", "mat", 16, 0, 64, "x", 8, -4, 4, "y");
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> xdist(-5, 70), ydist(-5, 5);
+    for ( int i = 0 ; i < 5000 ; ++i ){
+        const double x = xdist(gen), y = ydist(gen);
+        hist.Fill(x, y);
+        reference.Fill(x, y);
+    }
+    CHECK(hist.GetEntries() == size_t(reference.GetEntries()));
+    for ( Axis::index_t y = 0 ; y < 10 ; ++y ){
+        for ( Axis::index_t x = 0 ; x < 18 ; ++x ){
+            CHECK(hist.GetBinContent(x, y) == doctest::Approx(reference.GetBinContent(x, y)));
+            CHECK(hist.GetRow(y)[x] == hist.GetBinContent(x, y));
+        }
+    }
+
+    Histograms histograms;
+    Histogram2Dp added = hist.AddTo(histograms, 3);
+    for ( Axis::index_t y = 0 ; y < 10 ; ++y ){
+        for ( Axis::index_t x = 0 ; x < 18 ; ++x )
+            CHECK(added->GetBinContent(x, y) == 3*reference.GetBinContent(x, y));
+    }
+    CHECK(added->GetEntries() == 3*reference.GetEntries());
+    CHECK(added->GetAxisY().GetLeft() == -4);
+
+    Histogram2D wrong("wrong", "wrong", 16, 0, 64, "x", 8, -4, 5, "y");
+    CHECK_THROWS(hist.AddTo(&wrong));
+}
+
+TEST_SUITE_END();
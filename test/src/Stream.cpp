@@ -0,0 +1,301 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Stream.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+#include <histogram/SubtractedHistogram2D.h>
+#include <histogram/ThreadSafeHistograms.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+    std::string SocketPath(const std::string &name)
+    {
+        return "/tmp/histogram-stream-" + name + "-" + std::to_string(::getpid()) + ".sock";
+    }
+}
+
+TEST_SUITE_BEGIN( "Stream" );
+
+TEST_CASE( "Keyframes reconstruct the histograms" ){
+    Histograms histograms;
+    auto h1 = histograms.Create1D("e", "energy", 100, 0, 100, "E", "det/a");
+    auto h2 = histograms.Create2D("m", "matrix", 10, 0, 10, "x", 20, 0, 20, "y");
+    auto h3 = histograms.Create3D("c", "cube", 4, 0, 4, "x", 5, 0, 5, "y", 6, 0, 6, "z");
+    h1->Fill(10.5, 3);
+    h1->Fill(-5);
+    h2->Fill(2.5, 17.5, 4);
+    h2->Fill(12, 30);
+    h3->Fill(1.5, 2.5, 3.5, 2);
+
+    StreamPublisher publisher(histograms, SocketPath("keyframe"));
+    StreamClient client(SocketPath("keyframe"));
+    client.Subscribe();
+    publisher.Publish();
+    CHECK(publisher.GetClientCount() == 1);
+    CHECK(client.Poll(-1) == 1);
+
+    auto &copy = client.GetHistograms();
+    REQUIRE(copy.Find1D("e") != nullptr);
+    REQUIRE(copy.Find2D("m") != nullptr);
+    REQUIRE(copy.Find3D("c") != nullptr);
+    CHECK(copy.Find1D("e")->GetTitle() == "energy");
+    CHECK(copy.Find1D("e")->GetPath() == "det/a");
+    CHECK(copy.Find1D("e")->GetAxisX().GetBinCount() == 100);
+    CHECK(copy.Find1D("e")->GetBinContent(11) == 3);
+    CHECK(copy.Find1D("e")->GetBinContent(0) == 1);
+    CHECK(copy.Find1D("e")->GetEntries() == h1->GetEntries());
+    CHECK(copy.Find2D("m")->GetBinContent(3, 18) == 4);
+    CHECK(copy.Find2D("m")->GetBinContent(11, 21) == 1);
+    CHECK(copy.Find2D("m")->GetEntries() == h2->GetEntries());
+    CHECK(copy.Find3D("c")->GetBinContent(2, 3, 4) == 2);
+    CHECK(copy.Find3D("c")->GetEntries() == h3->GetEntries());
+    CHECK(client.GetSequence() == publisher.GetSequence());
+}
+
+TEST_CASE( "Updates only hold the changed bins" ){
+    Histograms histograms;
+    auto h = histograms.Create2D("m", "matrix", 1000, 0, 1000, "x", 1000, 0, 1000, "y");
+    for ( size_t i = 0 ; i < 1000 ; ++i )
+        h->Fill(i, ( i*7 ) % 1000);
+
+    StreamPublisher publisher(histograms, SocketPath("delta"));
+    StreamClient client(SocketPath("delta"));
+    client.Subscribe();
+    publisher.Publish();
+    client.Poll(-1);
+    const size_t keyframe = publisher.GetLastSize();
+
+    // Nothing changed, so the update is only the header.
+    publisher.Publish();
+    CHECK(client.Poll(-1) == 1);
+    const size_t empty = publisher.GetLastSize();
+    CHECK(empty < 32);
+
+    h->Fill(5, 5);
+    h->Fill(5, 5);
+    h->Fill(900, 100);
+    publisher.Publish();
+    CHECK(client.Poll(-1) == 1);
+    const size_t small = publisher.GetLastSize();
+    CHECK(small > empty);
+    CHECK(small < 64);
+    CHECK(small < keyframe);
+
+    auto copy = client.GetHistograms().Find2D("m");
+    REQUIRE(copy != nullptr);
+    CHECK(copy->GetBinContent(6, 6) == 2);
+    CHECK(copy->GetBinContent(901, 101) == 1);
+    CHECK(copy->GetBinContent(2, 8) == 1);
+    CHECK(copy->GetEntries() == h->GetEntries());
+
+    // A reset gives negative changes.
+    h->Reset();
+    h->Fill(1, 1);
+    publisher.Publish();
+    CHECK(client.Poll(-1) == 1);
+    CHECK(copy->GetBinContent(6, 6) == 0);
+    CHECK(copy->GetBinContent(2, 8) == 0);
+    CHECK(copy->GetBinContent(2, 2) == 1);
+    CHECK(copy->GetEntries() == 1);
+    CHECK(client.GetSequence() == publisher.GetSequence());
+}
+
+TEST_CASE( "Subscriptions select histograms" ){
+    Histograms histograms;
+    auto a = histograms.Create1D("a", "a", 10, 0, 10, "x");
+    auto b = histograms.Create1D("b", "b", 10, 0, 10, "x");
+    a->Fill(1);
+    b->Fill(2);
+
+    StreamPublisher publisher(histograms, SocketPath("subscribe"));
+    StreamClient only_a(SocketPath("subscribe")), everything(SocketPath("subscribe"));
+    only_a.Subscribe({"a", "missing"});
+    everything.Subscribe();
+    publisher.Publish();
+    CHECK(publisher.GetClientCount() == 2);
+    only_a.Poll(-1);
+    everything.Poll(-1);
+    CHECK(only_a.GetHistograms().Find1D("a") != nullptr);
+    CHECK(only_a.GetHistograms().Find1D("b") == nullptr);
+    CHECK(everything.GetHistograms().Find1D("b") != nullptr);
+
+    // A histogram that is created later is streamed once it exists.
+    auto missing = histograms.Create1D("missing", "missing", 10, 0, 10, "x");
+    missing->Fill(3);
+    b->Fill(2);
+    publisher.Publish();
+    only_a.Poll(-1);
+    everything.Poll(-1);
+    REQUIRE(only_a.GetHistograms().Find1D("missing") != nullptr);
+    CHECK(only_a.GetHistograms().Find1D("missing")->GetBinContent(4) == 1);
+    CHECK(everything.GetHistograms().Find1D("b")->GetBinContent(3) == 2);
+
+    // Changing the subscription sends keyframes for the new set.
+    only_a.Subscribe({"b"});
+    publisher.Publish();
+    only_a.Poll(-1);
+    REQUIRE(only_a.GetHistograms().Find1D("b") != nullptr);
+    CHECK(only_a.GetHistograms().Find1D("b")->GetBinContent(3) == 2);
+}
+
+TEST_CASE( "Sequence numbers and disconnects" ){
+    Histograms histograms;
+    auto h = histograms.Create1D("h", "h", 10, 0, 10, "x");
+
+    StreamPublisher publisher(histograms, SocketPath("sequence"));
+    CHECK_THROWS(StreamPublisher(histograms, std::string(200, 'x')));
+    CHECK_THROWS(StreamClient(SocketPath("nobody")));
+    {
+        StreamClient client(SocketPath("sequence"));
+        client.Subscribe();
+        for ( size_t i = 0 ; i < 5 ; ++i ){
+            h->Fill(i);
+            publisher.Publish();
+        }
+        CHECK(client.Poll(-1) == 5);
+        CHECK(client.GetSequence() == 5);
+        CHECK(client.GetHistograms().Find1D("h")->GetEntries() == 5);
+        CHECK(client.IsConnected());
+    }
+    publisher.Publish();
+    publisher.Publish();
+    CHECK(publisher.GetClientCount() == 0);
+
+    // A client that joins later starts from a keyframe with a gap in the sequence.
+    StreamClient late(SocketPath("sequence"));
+    late.Subscribe({"h"});
+    publisher.Publish();
+    CHECK(late.Poll(-1) == 1);
+    CHECK(late.GetSequence() == publisher.GetSequence());
+    CHECK(late.GetHistograms().Find1D("h")->GetBinContent(3) == 1);
+}
+
+TEST_CASE( "Publish from a thread safe set" ){
+    ThreadSafeHistograms histograms;
+    auto adapter = histograms.Create1D("t", "t", 10, 0, 10, "x");
+    StreamPublisher publisher(histograms.GetHistograms(), SocketPath("threadsafe"));
+    StreamClient client(SocketPath("threadsafe"));
+    client.Subscribe();
+    adapter.Fill(4.5);
+    adapter.Fill(4.5);
+    histograms.Publish(publisher);
+    client.Poll(-1);
+    REQUIRE(client.GetHistograms().Find1D("t") != nullptr);
+    CHECK(client.GetHistograms().Find1D("t")->GetBinContent(5) == 2);
+}
+
+TEST_CASE( "Publish while a filling thread is idle" ){
+    ThreadSafeHistograms histograms;
+    histograms.Create1D("idle", "idle", 10, 0, 10, "x");
+    StreamPublisher publisher(histograms.GetHistograms(), SocketPath("idle"));
+    StreamClient client(SocketPath("idle"));
+    client.Subscribe();
+    histograms.Publish(publisher);
+    client.Poll(-1);
+    REQUIRE(client.GetHistograms().Find1D("idle") != nullptr);
+
+    // The thread fills fewer entries than its buffer holds each round, then waits without filling.
+    std::atomic<int> round( 0 ), filled( 0 );
+    std::thread worker([&](){
+        auto adapter = histograms.Create1D("idle", "idle", 10, 0, 10, "x");
+        for ( int r = 1 ; r <= 2 ; ++r ){
+            while ( round < r )
+                std::this_thread::yield();
+            for ( int i = 0 ; i < 10 ; ++i )
+                adapter.Fill(6.5);
+            filled = r;
+        }
+        while ( round < 3 )
+            std::this_thread::yield();
+    });
+    for ( int r = 1 ; r <= 2 ; ++r ){
+        round = r;
+        while ( filled < r )
+            std::this_thread::yield();
+        histograms.Publish(publisher);
+        client.Poll(-1);
+        CHECK(client.GetHistograms().Find1D("idle")->GetBinContent(7) == size_t(10*r));
+    }
+    round = 3;
+    worker.join();
+}
+
+TEST_CASE( "Stream prompt-minus-random matrices" ){
+    Histograms histograms;
+    auto sub = histograms.CreateSubtracted2D("s", "subtracted", 10, 0, 10, "x", 10, 0, 10, "y", 0.25, "coinc");
+    sub->Fill(2.5, 3.5, SubtractedHistogram2D::prompt, 2);
+    sub->Fill(5.5, 5.5, SubtractedHistogram2D::random);
+
+    StreamPublisher publisher(histograms, SocketPath("subtracted"));
+    StreamClient client(SocketPath("subtracted"));
+    client.Subscribe({"s"});
+    publisher.Publish();
+    client.Poll(-1);
+    SubtractedHistogram2Dp copy = client.GetHistograms().FindSubtracted2D("s");
+    REQUIRE(copy != nullptr);
+    CHECK(copy->GetRatio() == 0.25);
+    CHECK(copy->GetPath() == "coinc");
+    CHECK(copy->GetBinContent(3, 4) == 2);
+    CHECK(copy->GetBinContent(6, 6) == -0.25);
+
+    sub->Fill(5.5, 5.5, SubtractedHistogram2D::random, 3);
+    sub->Fill(7.5, 0.5, SubtractedHistogram2D::prompt);
+    publisher.Publish();
+    client.Poll(-1);
+    CHECK(copy->GetEntries() == 4);
+    CHECK(copy->GetBinContent(6, 6) == -1);
+    CHECK(copy->GetBinContent(8, 1) == 1);
+    CHECK(copy->GetBinContent(3, 4) == 2);
+}
+
+TEST_CASE( "Bins are copied under the guard" ){
+    Histograms histograms;
+    auto h = histograms.Create1D("g", "g", 10, 0, 10, "x");
+    StreamPublisher publisher(histograms, SocketPath("guard"));
+    StreamClient client(SocketPath("guard"));
+    client.Subscribe();
+    h->Fill(2.5);
+
+    int guarded = 0;
+    publisher.Publish(ThreadPool::Default(), [&](const std::function<void()> &copy){
+        ++guarded;
+        copy();
+        // Fills after the copy are not in this update.
+        h->Fill(2.5);
+    });
+    CHECK(guarded == 1);
+    client.Poll(-1);
+    CHECK(client.GetHistograms().Find1D("g")->GetBinContent(3) == 1);
+
+    publisher.Publish();
+    client.Poll(-1);
+    CHECK(client.GetHistograms().Find1D("g")->GetBinContent(3) == 2);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,161 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/SubtractedHistogram2D.h>
+#include <histogram/Coincidence.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histograms.h>
+#include <histogram/MamaWriter.h>
+#include <histogram/ThreadSafeHistograms.h>
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+TEST_SUITE_BEGIN( "SubtractedHistogram2D" );
+
+TEST_CASE( "Fill with window tags" ){
+    SubtractedHistogram2D hist("sub", "sub", 10, 0, 10, "x", 10, 0, 10, "y", 0.5);
+    hist.Fill(2.5, 3.5, SubtractedHistogram2D::prompt);
+    hist.Fill(2.5, 3.5, SubtractedHistogram2D::prompt);
+    for ( int i = 0 ; i < 4 ; ++i )
+        hist.Fill(2.5, 3.5, SubtractedHistogram2D::random);
+    hist.Fill(7.5, 1.5, SubtractedHistogram2D::random, 3);
+    hist.Fill(-1, 20, SubtractedHistogram2D::prompt);
+
+    CHECK(hist.GetEntries() == 8);
+    CHECK(hist.GetBinContent(3, 4) == doctest::Approx(0));
+    CHECK(hist.GetBinContent(8, 2) == doctest::Approx(-1.5));
+    CHECK(hist.GetBinContent(0, 11) == doctest::Approx(1));
+    CHECK(hist.GetRatio() == 0.5);
+
+    hist.Reset();
+    CHECK(hist.GetEntries() == 0);
+    CHECK(hist.GetBinContent(8, 2) == 0);
+
+    CHECK_THROWS(SubtractedHistogram2D("big", "big", 100000, 0, 1, "x", 100000, 0, 1, "y", 1));
+}
+
+TEST_CASE( "Subtracted matrices in the histogram set" ){
+    Histograms histograms, other;
+    SubtractedHistogram2Dp sub = histograms.CreateSubtracted2D("sub", "sub", 4, 0, 4, "x", 4, 0, 4, "y", 0.5, "coinc");
+    SubtractedHistogram2Dp osub = other.CreateSubtracted2D("sub", "sub", 4, 0, 4, "x", 4, 0, 4, "y", 0.5, "coinc");
+    CHECK(sub->GetAxisX().GetName() == "sub_xaxis");
+    CHECK(sub->GetAxisY().GetName() == "sub_yaxis");
+    CHECK(histograms.FindSubtracted2D("sub") == sub);
+    CHECK(histograms.GetAllSubtracted2D().size() == 1);
+    CHECK(histograms.GetAllSubtracted2D("coinc").size() == 1);
+    CHECK_THROWS(histograms.CreateSubtracted2D("sub", "sub", 4, 0, 4, "x", 4, 0, 4, "y", 0.5));
+
+    sub->Fill(1.5, 2.5, SubtractedHistogram2D::prompt, 3);
+    osub->Fill(1.5, 2.5, SubtractedHistogram2D::random, 2);
+    histograms.Merge(other);
+    CHECK(sub->GetBinContent(2, 3) == doctest::Approx(2));
+    CHECK(sub->GetEntries() == 2);
+
+    std::ostringstream out;
+    CHECK(MamaWriter::Write(out, sub) == 0);
+    CHECK(out.str().find("!KIND=Matrix") != std::string::npos);
+    CHECK(out.str().find("!IDEND=") != std::string::npos);
+
+    histograms.ResetAll();
+    CHECK(sub->GetEntries() == 0);
+    CHECK(sub->GetBinContent(2, 3) == 0);
+}
+
+TEST_CASE( "Thread safe subtracted fills" ){
+    ThreadSafeHistograms histograms(64, 256);
+    const int threads = 4, fills = 20000;
+    std::vector<std::thread> workers;
+    for ( int t = 0 ; t < threads ; ++t ){
+        workers.emplace_back([&histograms, t](){
+            static std::mutex create;
+            std::unique_lock lock(create);
+            auto adapter = histograms.CreateSubtracted2D("sub", "sub", 20, 0, 20, "x", 20, 0, 20, "y", 0.25);
+            lock.unlock();
+            for ( int i = 0 ; i < fills ; ++i ){
+                adapter.Fill(i % 20, t, SubtractedHistogram2D::prompt);
+                adapter.Fill(i % 20, t, SubtractedHistogram2D::random);
+                adapter.Fill(i % 20, t, SubtractedHistogram2D::random);
+            }
+        });
+    }
+    for ( auto &worker : workers )
+        worker.join();
+
+    SubtractedHistogram2Dp sub = histograms.FindSubtracted2D("sub");
+    REQUIRE(sub);
+    CHECK(histograms.FindSubtracted2D("other") == nullptr);
+    CHECK(sub->GetEntries() == threads*fills*3);
+    for ( int t = 0 ; t < threads ; ++t ){
+        for ( int x = 1 ; x <= 20 ; ++x )
+            CHECK(sub->GetBinContent(x, t + 1) == doctest::Approx(0.5*fills/20));
+    }
+
+    // No overload policy was set, so nothing was sampled.
+    const auto stats = histograms.GetOverloadStats("sub");
+    CHECK(stats.sampled == 0);
+    CHECK(stats.shed == 0);
+    CHECK_THROWS(histograms.GetOverloadStats("other"));
+}
+
+TEST_CASE( "Subtract coincidences while filling" ){
+    std::vector<std::vector<Coincidence::hit_t>> streams(2);
+    for ( int64_t k = 0 ; k < 3000 ; ++k ){
+        streams[0].push_back({k*1000, 0, double(k % 10)});
+        streams[1].push_back({k*1000 + 5, 1, 3.});
+        streams[1].push_back({k*1000 + 250 + ( k % 7 )*20, 1, double(k % 4)});
+    }
+    Coincidence::Options options;
+    options.triggers = {0};
+    options.batch_size = 100;
+
+    ThreadSafeHistograms histograms;
+    Coincidence::Build(streams, [&](){
+        return [sub = histograms.CreateSubtracted2D("sub", "sub", 10, 0, 10, "E0", 10, 0, 10, "E", options.GetRandomScale()),
+                prompt = histograms.Create2D("prompt", "prompt", 10, 0, 10, "E0", 10, 0, 10, "E"),
+                random = histograms.Create2D("random", "random", 10, 0, 10, "E0", 10, 0, 10, "E")]
+                (const Coincidence::group_t &group) mutable {
+            for ( auto &hit : group.prompt ){
+                sub.Fill(group.trigger.energy, hit.energy, SubtractedHistogram2D::prompt);
+                prompt.Fill(group.trigger.energy, hit.energy);
+            }
+            for ( auto &hit : group.random ){
+                sub.Fill(group.trigger.energy, hit.energy, SubtractedHistogram2D::random);
+                random.Fill(group.trigger.energy, hit.energy);
+            }
+        };
+    }, options);
+
+    SubtractedHistogram2Dp sub = histograms.FindSubtracted2D("sub");
+    Histogram2Dp prompt = histograms.GetHistograms().Find2D("prompt");
+    Histogram2Dp random = histograms.GetHistograms().Find2D("random");
+    CHECK(sub->GetEntries() == prompt->GetEntries() + random->GetEntries());
+    for ( size_t y = 0 ; y < 12 ; ++y ){
+        for ( size_t x = 0 ; x < 12 ; ++x ){
+            const double expected = double(prompt->GetBinContent(x, y)) - 0.5*double(random->GetBinContent(x, y));
+            CHECK(sub->GetBinContent(x, y) == doctest::Approx(expected));
+        }
+    }
+}
+
+TEST_SUITE_END();
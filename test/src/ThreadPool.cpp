@@ -0,0 +1,114 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/ThreadPool.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram1D.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/Histogram3D.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST_SUITE_BEGIN( "ThreadPool" );
+
+TEST_CASE( "Submit and parallel for" ){
+
+    ThreadPool pool(3);
+    CHECK(pool.GetThreadCount() == 3);
+
+    SUBCASE("Parallel for covers the range once"){
+        std::vector<std::atomic<int>> visits(1000);
+        pool.ParallelFor(0, visits.size(), [&visits](size_t first, size_t last){
+            for ( size_t i = first ; i < last ; ++i )
+                ++visits[i];
+        });
+        for ( auto &v : visits )
+            CHECK(v.load() == 1);
+    }
+
+    SUBCASE("Nested parallel for"){
+        std::atomic<size_t> sum( 0 );
+        pool.ParallelFor(0, 8, [&](size_t first, size_t last){
+            for ( size_t i = first ; i < last ; ++i ){
+                pool.ParallelFor(0, 100, [&sum](size_t f, size_t l){ sum += l - f; });
+            }
+        });
+        CHECK(sum.load() == 800);
+    }
+
+    SUBCASE("Exceptions are rethrown"){
+        CHECK_THROWS(pool.ParallelFor(0, 100, [](size_t first, size_t){
+            if ( first > 50 )
+                throw std::runtime_error("fail");
+        }));
+    }
+
+    SUBCASE("Submitted tasks run before the pool stops"){
+        std::atomic<int> count( 0 );
+        {
+            ThreadPool local(2);
+            for ( int i = 0 ; i < 100 ; ++i )
+                local.Submit([&count](){ ++count; });
+        }
+        CHECK(count.load() == 100);
+    }
+}
+
+TEST_CASE( "Default pool" ){
+    ThreadPool pool(1);
+    CHECK(&ThreadPool::Default() != &pool);
+    ThreadPool::SetDefault(&pool);
+    CHECK(&ThreadPool::Default() == &pool);
+    ThreadPool::SetDefault(nullptr);
+    CHECK(&ThreadPool::Default() != &pool);
+}
+
+TEST_CASE( "Parallel merge and reset" ){
+
+    ThreadPool pool(2);
+    Histograms histograms, other;
+    for ( int i = 0 ; i < 10 ; ++i ){
+        const std::string name = "hist" + std::to_string(i);
+        histograms.Create1D(name, name, 100, 0, 100, "x")->Fill(i);
+        other.Create1D(name, name, 100, 0, 100, "x")->Fill(i);
+    }
+    histograms.Create2D("mat", "mat", 10, 0, 10, "x", 10, 0, 10, "y")->Fill(1, 1);
+    other.Create2D("mat", "mat", 10, 0, 10, "x", 10, 0, 10, "y")->Fill(1, 1);
+    histograms.Create3D("cube", "cube", 10, 0, 10, "x", 10, 0, 10, "y", 10, 0, 10, "z")->Fill(1, 1, 1);
+
+    histograms.Merge(other, pool);
+    for ( auto &h : histograms.GetAll1D() )
+        CHECK(h->GetEntries() == 2);
+    CHECK(histograms.Find2D("mat")->GetBinContent(2, 2) == 2);
+    CHECK(histograms.Find3D("cube")->GetEntries() == 1);
+
+    histograms.ResetAll(pool);
+    for ( auto &h : histograms.GetAll1D() )
+        CHECK(h->GetEntries() == 0);
+    CHECK(histograms.Find2D("mat")->GetEntries() == 0);
+    CHECK(histograms.Find3D("cube")->GetEntries() == 0);
+}
+
+TEST_SUITE_END();
@@ -27,6 +27,7 @@
 #include <histogram/version.h>
 #include <histogram/ThreadSafeHistograms.h>
 #include <histogram/MamaWriter.h>
+#include <histogram/Trace.h>
 
 #include <thread>
 
@@ -171,4 +172,238 @@ TEST_CASE( "Thread safe 3D histogram" ){
     }
 }
 
+TEST_CASE( "Thread safe histograms in directories" ){
+    histograms.Create1D("dir1d", "dir1d", 10, 0, 10, "x", "det/e");
+    histograms.Create2D("dir2d", "dir2d", 10, 0, 10, "x", 10, 0, 10, "y", "det/ede");
+    histograms.Create3D("dir3d", "dir3d", 4, 0, 4, "x", 4, 0, 4, "y", 4, 0, 4, "z", "det");
+
+    CHECK(histograms.GetHistograms().Find1D("dir1d")->GetPath() == "det/e");
+    CHECK(histograms.GetHistograms().Find2D("dir2d")->GetPath() == "det/ede");
+    CHECK(histograms.GetHistograms().Find3D("dir3d")->GetPath() == "det");
+
+    histograms.CreateTally1D("dirtally", "dirtally", 10, 0, 10, "x", "det/e");
+    CHECK(histograms.GetHistograms().Find1D("dirtally")->GetPath() == "det/e");
+    CHECK(histograms.GetHistograms().GetAll1D("det/e").size() == 2);
+    CHECK(histograms.GetHistograms().GetAll2D("det/ede").size() == 1);
+}
+
+static std::vector<HistogramTrace::event_t> traced_events;
+static std::vector<size_t> traced_counts;
+
+TEST_CASE( "Trace flush of thread safe histogram" ){
+
+    ThreadSafeHistogram1D ts_hist = histograms.Create1D("trace", "trace title", 1024, 0, 1024, "x");
+
+    traced_events.clear();
+    traced_counts.clear();
+    HistogramTrace::SetCallback([](HistogramTrace::event_t event, const char *, size_t count){
+        traced_events.push_back(event);
+        traced_counts.push_back(count);
+    });
+    ts_hist.Fill(83);
+    ts_hist.Fill(84);
+    ts_hist.force_flush();
+    HistogramTrace::SetCallback(nullptr);
+
+#ifdef HISTOGRAM_ENABLE_TRACE
+    REQUIRE(traced_events.size() == 5);
+    CHECK(traced_events[0] == HistogramTrace::lock_wait);
+    CHECK(traced_events[1] == HistogramTrace::lock_acquire);
+    CHECK(traced_events[2] == HistogramTrace::flush_begin);
+    CHECK(traced_events[3] == HistogramTrace::flush_end);
+    CHECK(traced_events[4] == HistogramTrace::lock_release);
+    CHECK(traced_counts[2] == 2);
+    CHECK(traced_counts[4] == 2);
+#else
+    CHECK(traced_events.empty());
+#endif // HISTOGRAM_ENABLE_TRACE
+}
+
+TEST_CASE( "Sample fills when overloaded" ){
+
+    Histogram1D hist("overload", "overload title", 16, 0, 16, "x");
+    std::mutex mutex;
+    ThreadSafeHistogram1D::overload_policy_t policy;
+    policy.high_watermark = 20;
+    policy.prescale = 4;
+    ThreadSafeHistogramDetails::overload_stats_t shared_stats;
+    ThreadSafeHistogram1D ts_hist(mutex, &hist, 10, 100000, policy, &shared_stats);
+
+    // Keep the mutex busy while another thread fills the histogram.
+    mutex.lock();
+    std::thread thread([&ts_hist](){
+        for ( int i = 0 ; i < 1000 ; ++i ){
+            ts_hist.Fill(3);
+        }
+    });
+    thread.join();
+    CHECK(ts_hist.IsOverloaded());
+    mutex.unlock();
+    ts_hist.force_flush();
+    CHECK_FALSE(ts_hist.IsOverloaded());
+
+    const auto &stats = ts_hist.GetOverloadStats();
+    CHECK(stats.sampled > 0);
+    CHECK(stats.shed > stats.sampled);
+    CHECK(shared_stats.sampled == stats.sampled);
+    CHECK(shared_stats.shed == stats.shed);
+    CHECK(stats.prescale == policy.prescale);
+    CHECK(shared_stats.prescale == policy.prescale);
+
+    // Unsampled fills have weight 1, sampled fills count as prescale entries with the prescale as weight.
+    const size_t unsampled = 1000 - stats.sampled - stats.shed;
+    CHECK(unsampled == 20);
+    CHECK(size_t(hist.GetEntries()) == unsampled + policy.prescale * stats.sampled);
+    CHECK(hist.GetBinContent(hist.GetAxisX().FindBin(3)) == unsampled + policy.prescale * stats.sampled);
+}
+
+TEST_CASE( "Sampling does not block at the max buffer size" ){
+
+    Histogram1D hist("overload_max", "overload max title", 16, 0, 16, "x");
+    std::mutex mutex;
+    ThreadSafeHistogram1D::overload_policy_t policy;
+    policy.high_watermark = 20;
+    policy.prescale = 2;
+    ThreadSafeHistogramDetails::overload_stats_t shared_stats;
+    ThreadSafeHistogram1D ts_hist(mutex, &hist, 10, 64, policy, &shared_stats);
+
+    // The filling thread would never finish if it waited for the mutex.
+    mutex.lock();
+    std::thread thread([&ts_hist](){
+        for ( int i = 0 ; i < 100000 ; ++i ){
+            ts_hist.Fill(3);
+        }
+    });
+    thread.join();
+    CHECK(ts_hist.IsOverloaded());
+    CHECK(ts_hist.GetPrescale() > policy.prescale);
+    mutex.unlock();
+    ts_hist.force_flush();
+    CHECK(ts_hist.GetPrescale() == 1);
+
+    const auto &stats = ts_hist.GetOverloadStats();
+    CHECK(stats.prescale > policy.prescale);
+    CHECK(shared_stats.prescale == stats.prescale);
+    CHECK(stats.sampled + stats.shed + 20 == 100000);
+
+    // Each kept fill counts as many entries as its weight.
+    CHECK(size_t(hist.GetEntries()) == hist.GetBinContent(hist.GetAxisX().FindBin(3)));
+}
+
+TEST_CASE( "Thread safe tally 1D histogram" ){
+
+    {
+        ThreadSafeTally1D tally = histograms.CreateTally1D("tally", "tally title", 1024, 0, 1024, "x");
+
+        std::thread thread([](){
+            ThreadSafeTally1D thread_tally = histograms.CreateTally1D("tally", "tally title", 1024, 0, 1024, "x");
+            for ( int i = 0 ; i < 100000 ; ++i ){
+                thread_tally.Fill(83);
+            }
+        });
+
+        // Saturate a counter and fill with a weight larger than the counter range.
+        for ( int i = 0 ; i < 70000 ; ++i ){
+            tally.Fill(12);
+        }
+        tally.Fill(500, 100000);
+        tally.Fill(-3);
+        thread.join();
+    }
+
+    auto hist = histograms.GetHistograms().Find1D("tally");
+    REQUIRE(hist != nullptr);
+    CHECK(hist->GetEntries() == 170002);
+    CHECK(hist->GetBinContent(hist->GetAxisX().FindBin(83)) == 100000);
+    CHECK(hist->GetBinContent(hist->GetAxisX().FindBin(12)) == 70000);
+    CHECK(hist->GetBinContent(hist->GetAxisX().FindBin(500)) == 100000);
+    CHECK(hist->GetBinContent(0) == 1);
+}
+
+TEST_CASE( "Combine repeated fills in cache" ){
+
+    Histogram2D hist("combine", "combine title", 16, 0, 16, "x", 16, 0, 16, "y");
+    std::mutex mutex;
+    ThreadSafeHistogram2D ts_hist(mutex, &hist, 4, 8);
+    CHECK(ts_hist.GetCacheSize() == 0);
+    ts_hist.SetCacheSize(5, 50);
+    CHECK(ts_hist.GetCacheSize() == 8);
+
+    // Combined fills are bounded by the max held fills, so a peaked spectrum reaches the histogram.
+    for ( int i = 0 ; i < 100 ; ++i ){
+        ts_hist.Fill(3, 4);
+    }
+    CHECK(hist.GetEntries() == 100);
+    CHECK(hist.GetBinContent(hist.GetAxisX().FindBin(3), hist.GetAxisY().FindBin(4)) == 100);
+
+    // Bins mapping to the same slot evict each other.
+    for ( int i = 0 ; i < 102 ; ++i ){
+        ts_hist.Fill(i % 16, 7, 2);
+    }
+    CHECK(hist.GetEntries() == 200);
+    ts_hist.force_flush();
+
+    CHECK(hist.GetEntries() == 202);
+    size_t sum = 0;
+    for ( int i = 0 ; i < 16 ; ++i ){
+        sum += hist.GetBinContent(hist.GetAxisX().FindBin(i), hist.GetAxisY().FindBin(7));
+    }
+    CHECK(sum == 204);
+    CHECK(hist.GetBinContent(hist.GetAxisX().FindBin(0), hist.GetAxisY().FindBin(7)) == 14);
+
+    // Combined fills do not count as distinct entries, so they do not reach the min buffer size.
+    for ( int i = 0 ; i < 49 ; ++i )
+        ts_hist.Fill(3, 4);
+    CHECK(hist.GetEntries() == 202);
+    ts_hist.Fill(3, 4);
+    CHECK(hist.GetEntries() == 252);
+}
+
+//! Count the flushes of an adapter filling a single bin, by watching the histogram after each fill.
+static size_t CountHotBinFlushes(const size_t &cache_size)
+{
+    Histogram1D hist("hot", "hot title", 16, 0, 16, "x");
+    std::mutex mutex;
+    size_t flushes = 0;
+    {
+        ThreadSafeHistogram1D ts_hist(mutex, &hist, 16, 64);
+        ts_hist.SetCacheSize(cache_size, 4096);
+        Histogram1D::data_t last = 0;
+        for ( int i = 0 ; i < 10000 ; ++i ){
+            ts_hist.Fill(5);
+            if ( hist.GetBinContent(hist.GetAxisX().FindBin(5)) != last ){
+                last = hist.GetBinContent(hist.GetAxisX().FindBin(5));
+                ++flushes;
+            }
+        }
+    }
+    CHECK(hist.GetEntries() == 10000);
+    CHECK(hist.GetBinContent(hist.GetAxisX().FindBin(5)) == 10000);
+    return flushes;
+}
+
+TEST_CASE( "Fewer flushes for a hot bin with the cache" ){
+    CHECK(CountHotBinFlushes(0) == 625);
+    CHECK(CountHotBinFlushes(8) == 2);
+}
+
+TEST_CASE( "Combine large weights in cache" ){
+
+    SubtractedHistogram2D hist("combine_sub", "combine_sub", 4, 0, 4, "x", 4, 0, 4, "y", 1.);
+    std::mutex mutex;
+    ThreadSafeSubtracted2D ts_hist(mutex, &hist, 100, 200);
+    ts_hist.SetCacheSize(4);
+
+    // Combining these in one slot would overflow the 32 bit weight.
+    ts_hist.Fill(1, 1, SubtractedHistogram2D::prompt, 3000000000);
+    ts_hist.Fill(1, 1, SubtractedHistogram2D::prompt, 3000000000);
+    // Too large for a buffered fill.
+    ts_hist.Fill(2, 2, SubtractedHistogram2D::prompt, 10000000000);
+    ts_hist.force_flush();
+
+    CHECK(hist.GetEntries() == 3);
+    CHECK(hist.GetBinContent(2, 2) == doctest::Approx(6e9));
+    CHECK(hist.GetBinContent(3, 3) == doctest::Approx(1e10));
+}
+
 TEST_SUITE_END();
\ No newline at end of file
@@ -0,0 +1,102 @@
+// Copyright (c) 2022. Vetle Wegner Ingeberg/University of Oslo.
+// All rights reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <doctest/doctest.h>
+#include <histogram/Unfolding.h>
+#include <histogram/Histograms.h>
+#include <histogram/Histogram2D.h>
+#include <histogram/ThreadPool.h>
+
+#include <cmath>
+#include <stdexcept>
+
+TEST_SUITE_BEGIN( "Unfolding" );
+
+TEST_CASE( "Blocked fold matches direct product" ){
+
+    ThreadPool pool(2);
+    const size_t rows = 13, n = 21, m = 17;
+    std::vector<double> u(rows*n), response(n*m), f(rows*m);
+    for ( size_t i = 0 ; i < u.size() ; ++i )
+        u[i] = double(( i*7 ) % 11);
+    for ( size_t i = 0 ; i < response.size() ; ++i )
+        response[i] = double(( i*3 ) % 5)/4.;
+
+    Unfolding::Fold(u.data(), response.data(), f.data(), rows, n, m, pool, 4);
+    for ( size_t i = 0 ; i < rows ; ++i ){
+        for ( size_t j = 0 ; j < m ; ++j ){
+            double sum = 0;
+            for ( size_t k = 0 ; k < n ; ++k )
+                sum += u[i*n + k]*response[k*m + j];
+            CHECK(f[i*m + j] == doctest::Approx(sum));
+        }
+    }
+}
+
+TEST_CASE( "Unfold rows of a matrix" ){
+
+    ThreadPool pool(2);
+    Histograms set;
+    const size_t n = 40, rows = 10;
+
+    // Detector keeps 60% in the full energy bin and spreads the rest evenly below it.
+    Histogram2Dp response = set.Create2D("response", "response", n, 0, 4000, "E_{#gamma} detected", n, 0, 4000, "E_{#gamma} incident");
+    for ( size_t t = 1 ; t <= n ; ++t ){
+        response->SetBinContent(t, t, 6000);
+        for ( size_t j = 1 ; j < t ; ++j )
+            response->SetBinContent(j, t, 4000/(t - 1));
+    }
+
+    // Each row has a single line at a row dependent energy.
+    Histogram2Dp raw = set.Create2D("raw", "raw", n, 0, 4000, "E_{#gamma}", rows, 0, 10, "E_{x}");
+    for ( size_t i = 1 ; i <= rows ; ++i ){
+        const size_t t = 10 + 2*i;
+        const double total = 10000;
+        raw->SetBinContent(t, i, Histogram2D::data_t(0.6*total));
+        for ( size_t j = 1 ; j < t ; ++j )
+            raw->SetBinContent(j, i, Histogram2D::data_t(std::round(0.4*total/double(t - 1))));
+    }
+    raw->AddEntries(12345);
+
+    Unfolding::Options options;
+    options.block_size = 8;
+    auto result = Unfolding::Unfold(set, raw, response, "unfolded", options, pool);
+    REQUIRE(result.unfolded != nullptr);
+    CHECK(set.Find2D("unfolded") == result.unfolded);
+    CHECK(result.unfolded->GetEntries() == 12345);
+    CHECK(result.unfolded->GetAxisY().GetBinCount() == rows);
+    REQUIRE(result.iterations.size() == rows);
+
+    for ( size_t i = 1 ; i <= rows ; ++i ){
+        const size_t t = 10 + 2*i;
+        CHECK(result.iterations[i - 1] > 1);
+        CHECK(double(result.unfolded->GetBinContent(t, i)) == doctest::Approx(10000).epsilon(0.02));
+        size_t rest = 0;
+        for ( size_t j = 1 ; j <= n ; ++j )
+            rest += ( j != t ) ? result.unfolded->GetBinContent(j, i) : 0;
+        CHECK(rest < 300);
+    }
+
+    Histogram2Dp bad = set.Create2D("bad", "bad", n/2, 0, 4000, "x", n, 0, 4000, "y");
+    CHECK_THROWS(Unfolding::Unfold(set, raw, bad, "unfolded_bad", options, pool));
+}
+
+TEST_SUITE_END();